@@ -23,6 +23,13 @@
 #ifndef __BDB_SQLITE_H_
 #define __BDB_SQLITE_H_ 1
 
+/*
+ * Number of insert statements to batch-up in batch insert
+ * mode. We use multi-row inserts only in the batch mode
+ * on the private database connection.
+ */
+#define SQLITE_CHANGES_PER_BATCH_INSERT 100
+
 class B_DB_SQLITE: public B_DB_PRIV {
 private:
    /*
@@ -554,6 +554,20 @@ typedef struct sql_field {
 } SQL_FIELD;
 #endif
 
+/*
+ * Size of the PathId cache, a number of sets with a few entries each
+ * that are kept in least recently used order.
+ */
+#define PATH_CACHE_SETS 256
+#define PATH_CACHE_WAYS 4
+
+struct PATH_CACHE_ENTRY {
+   uint64_t hash;                         /* Hash of the path */
+   uint32_t PathId;                       /* PathId, 0 for an unused entry */
+   int len;                               /* Length of the path */
+   POOLMEM *path;                         /* Path */
+};
+
 /*
  * Dynamic loaded query from a query table.
  */
@@ -585,22 +599,20 @@ protected:
    char *m_db_password;                   /**< Database password */
    char *m_last_query_text;               /**< Last query text obtained from query table */
    int m_db_port;                         /**< Port for host name address */
-   int cached_path_len;                   /**< Length of cached path */
    int changes;                           /**< Changes during transaction */
    int fnl;                               /**< File name length */
    int pnl;                               /**< Path name length */
    bool m_disabled_batch_insert;          /**< Explicitly disabled batch insert mode ? */
    bool m_is_private;                     /**< Private connection ? */
-   uint32_t cached_path_id;               /**< Cached path id */
    uint32_t m_last_hash_key;              /**< Last hash key lookup on query table */
    POOLMEM *fname;                        /**< Filename only */
    POOLMEM *path;                         /**< Path only */
-   POOLMEM *cached_path;                  /**< Cached path name */
    POOLMEM *esc_name;                     /**< Escaped file name */
    POOLMEM *esc_path;                     /**< Escaped path name */
    POOLMEM *esc_obj;                      /**< Escaped restore object */
    POOLMEM *cmd;                          /**< SQL command string */
    POOLMEM *errmsg;                       /**< Nicely edited error message */
+   PATH_CACHE_ENTRY *m_path_cache;        /**< Recently used PathIds */
    const char **queries;                  /**< table of query texts */
    static const char *query_names[];      /**< table of query names */
 
@@ -623,8 +635,8 @@ public:
    /*
     * Methods
     */
-   B_DB() {};
-   virtual ~B_DB() {};
+   B_DB() : m_path_cache(NULL) {};
+   virtual ~B_DB() { free_path_cache(); };
    const char *get_db_name(void) { return m_db_name; };
    const char *get_db_user(void) { return m_db_user; };
    bool is_connected(void) { return m_connected; };
@@ -654,6 +666,9 @@ public:
    int list_result(JCR *jcr, OUTPUT_FORMATTER *send, e_list_type type);
    bool open_batch_connection(JCR *jcr);
    void db_debug_print(FILE *fp);
+   uint32_t lookup_path_cache(const char *new_path, int len);
+   void add_path_cache(const char *new_path, int len, uint32_t PathId);
+   void free_path_cache();
 
    /* sql_create.c */
    bool create_path_record(JCR *jcr, ATTR_DBR *ar);
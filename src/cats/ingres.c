@@ -192,8 +192,6 @@ B_DB_INGRES::B_DB_INGRES(JCR *jcr,
    errmsg = get_pool_memory(PM_EMSG); /* get error message buffer */
    *errmsg = 0;
    cmd = get_pool_memory(PM_EMSG); /* get command buffer */
-   cached_path = get_pool_memory(PM_FNAME);
-   cached_path_id = 0;
    m_ref_count = 1;
    fname = get_pool_memory(PM_FNAME);
    path = get_pool_memory(PM_FNAME);
@@ -303,7 +301,6 @@ void B_DB_INGRES::close_database(JCR *jcr)
       }
       free_pool_memory(errmsg);
       free_pool_memory(cmd);
-      free_pool_memory(cached_path);
       free_pool_memory(fname);
       free_pool_memory(path);
       free_pool_memory(esc_name);
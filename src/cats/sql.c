@@ -427,6 +427,98 @@ void B_DB::split_path_and_file(JCR *jcr, const char *filename)
    Dmsg2(500, "split path=%s file=%s\n", path, fname);
 }
 
+static inline uint64_t path_cache_hash(const char *new_path, int len)
+{
+   uint64_t hash = 14695981039346656037ULL;
+
+   for (int i = 0; i < len; i++) {
+      hash ^= (uint8_t)new_path[i];
+      hash *= 1099511628211ULL;
+   }
+
+   return hash;
+}
+
+/**
+ * Look up the PathId of a path in the cache of recently used paths.
+ * Returns: 0 if the path is not cached
+ *          PathId otherwise
+ */
+uint32_t B_DB::lookup_path_cache(const char *new_path, int len)
+{
+   uint64_t hash;
+   PATH_CACHE_ENTRY *set, entry;
+
+   if (!m_path_cache) {
+      return 0;
+   }
+
+   hash = path_cache_hash(new_path, len);
+   set = m_path_cache + (hash % PATH_CACHE_SETS) * PATH_CACHE_WAYS;
+   for (int i = 0; i < PATH_CACHE_WAYS && set[i].PathId; i++) {
+      if (set[i].hash == hash && set[i].len == len && memcmp(set[i].path, new_path, len) == 0) {
+         /*
+          * Move the entry to the front of its set.
+          */
+         if (i > 0) {
+            entry = set[i];
+            memmove(set + 1, set, i * sizeof(PATH_CACHE_ENTRY));
+            set[0] = entry;
+         }
+         return set[0].PathId;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Add a path to the cache of recently used paths, replacing
+ * the least recently used path of its set.
+ */
+void B_DB::add_path_cache(const char *new_path, int len, uint32_t PathId)
+{
+   uint64_t hash;
+   POOLMEM *buf;
+   PATH_CACHE_ENTRY *set;
+
+   if (!m_path_cache) {
+      m_path_cache = (PATH_CACHE_ENTRY *)malloc(PATH_CACHE_SETS * PATH_CACHE_WAYS * sizeof(PATH_CACHE_ENTRY));
+      memset(m_path_cache, 0, PATH_CACHE_SETS * PATH_CACHE_WAYS * sizeof(PATH_CACHE_ENTRY));
+   }
+
+   hash = path_cache_hash(new_path, len);
+   set = m_path_cache + (hash % PATH_CACHE_SETS) * PATH_CACHE_WAYS;
+   buf = set[PATH_CACHE_WAYS - 1].path;
+   if (!buf) {
+      buf = get_pool_memory(PM_FNAME);
+   }
+   buf = check_pool_memory_size(buf, len + 1);
+   memcpy(buf, new_path, len);
+   buf[len] = 0;
+
+   memmove(set + 1, set, (PATH_CACHE_WAYS - 1) * sizeof(PATH_CACHE_ENTRY));
+   set[0].hash = hash;
+   set[0].PathId = PathId;
+   set[0].len = len;
+   set[0].path = buf;
+}
+
+void B_DB::free_path_cache()
+{
+   if (!m_path_cache) {
+      return;
+   }
+
+   for (int i = 0; i < PATH_CACHE_SETS * PATH_CACHE_WAYS; i++) {
+      if (m_path_cache[i].path) {
+         free_pool_memory(m_path_cache[i].path);
+      }
+   }
+   free(m_path_cache);
+   m_path_cache = NULL;
+}
+
 /**
  * Set maximum field length to something reasonable
  */
@@ -599,16 +599,14 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
    int num_rows;
 
    errmsg[0] = 0;
-   esc_name = check_pool_memory_size(esc_name, 2 * pnl + 2);
-   escape_string(jcr, esc_name, path, pnl);
-
-   if (cached_path_id != 0 &&
-       cached_path_len == pnl &&
-       bstrcmp(cached_path, path)) {
-      ar->PathId = cached_path_id;
+   ar->PathId = lookup_path_cache(path, pnl);
+   if (ar->PathId != 0) {
       return true;
    }
 
+   esc_name = check_pool_memory_size(esc_name, 2 * pnl + 2);
+   escape_string(jcr, esc_name, path, pnl);
+
    Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
 
    if (QUERY_DB(jcr, cmd)) {
@@ -635,11 +633,7 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
          /*
           * Cache path
           */
-         if (ar->PathId != cached_path_id) {
-            cached_path_id = ar->PathId;
-            cached_path_len = pnl;
-            pm_strcpy(cached_path, path);
-         }
+         add_path_cache(path, pnl, ar->PathId);
          ASSERT(ar->PathId);
          retval = true;
          goto bail_out;
@@ -660,11 +654,7 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
    /*
     * Cache path
     */
-   if (ar->PathId != cached_path_id) {
-      cached_path_id = ar->PathId;
-      cached_path_len = pnl;
-      pm_strcpy(cached_path, path);
-   }
+   add_path_cache(path, pnl, ar->PathId);
    retval = true;
 
 bail_out:
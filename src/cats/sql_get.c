@@ -178,13 +178,14 @@ int B_DB::get_path_record(JCR *jcr)
    DBId_t PathId = 0;
    int num_rows;
 
+   PathId = lookup_path_cache(path, pnl);
+   if (PathId != 0) {
+      return PathId;
+   }
+
    esc_name = check_pool_memory_size(esc_name, 2 * pnl + 2);
    escape_string(jcr, esc_name, path, pnl);
 
-   if (cached_path_id != 0 && cached_path_len == pnl && bstrcmp(cached_path, path)) {
-      return cached_path_id;
-   }
-
    Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
    if (QUERY_DB(jcr, cmd)) {
       char ed1[30];
@@ -206,11 +207,7 @@ int B_DB::get_path_record(JCR *jcr)
                /*
                 * Cache path
                 */
-               if (PathId != cached_path_id) {
-                  cached_path_id = PathId;
-                  cached_path_len = pnl;
-                  pm_strcpy(cached_path, path);
-               }
+               add_path_cache(path, pnl, PathId);
             }
          }
       } else {
@@ -104,8 +104,6 @@ B_DB_SQLITE::B_DB_SQLITE(JCR *jcr,
    errmsg = get_pool_memory(PM_EMSG); /* get error message buffer */
    *errmsg = 0;
    cmd = get_pool_memory(PM_EMSG);    /* get command buffer */
-   cached_path = get_pool_memory(PM_FNAME);
-   cached_path_id = 0;
    m_ref_count = 1;
    fname = get_pool_memory(PM_FNAME);
    path = get_pool_memory(PM_FNAME);
@@ -247,7 +245,6 @@ void B_DB_SQLITE::close_database(JCR *jcr)
       }
       free_pool_memory(errmsg);
       free_pool_memory(cmd);
-      free_pool_memory(cached_path);
       free_pool_memory(fname);
       free_pool_memory(path);
       free_pool_memory(esc_name);
@@ -620,6 +617,11 @@ bool B_DB_SQLITE::sql_batch_start(JCR *jcr)
          );
    db_unlock(this);
 
+   /*
+    * Keep track of the number of changes in batch mode.
+    */
+   changes = 0;
+
    return retval;
 }
 
@@ -632,6 +634,14 @@ bool B_DB_SQLITE::sql_batch_end(JCR *jcr, const char *error)
 {
    m_status = 0;
 
+   /*
+    * Flush any pending inserts.
+    */
+   if (changes) {
+      changes = 0;
+      return sql_query_without_handler(cmd);
+   }
+
    return true;
 }
 
@@ -656,14 +666,40 @@ bool B_DB_SQLITE::sql_batch_insert(JCR *jcr, ATTR_DBR *ar)
       digest = ar->Digest;
    }
 
-   Mmsg(cmd, "INSERT INTO batch VALUES "
-        "(%u,%s,'%s','%s','%s','%s',%u,'%s','%s')",
-        ar->FileIndex, edit_int64(ar->JobId,ed1), esc_path,
-        esc_name, ar->attr, digest, ar->DeltaSeq,
-        edit_uint64(ar->Fhinfo,ed2),
-        edit_uint64(ar->Fhnode,ed3));
+   /*
+    * Try to batch up multiple inserts using multi-row inserts.
+    */
+   if (changes == 0) {
+      Mmsg(cmd, "INSERT INTO batch VALUES "
+           "(%u,%s,'%s','%s','%s','%s',%u,'%s','%s')",
+           ar->FileIndex, edit_int64(ar->JobId,ed1), esc_path,
+           esc_name, ar->attr, digest, ar->DeltaSeq,
+           edit_uint64(ar->Fhinfo,ed2),
+           edit_uint64(ar->Fhnode,ed3));
+   } else {
+      /*
+       * We use the esc_obj for temporary storage otherwise
+       * we keep on copying data.
+       */
+      Mmsg(esc_obj, ",(%u,%s,'%s','%s','%s','%s',%u,'%s','%s')",
+           ar->FileIndex, edit_int64(ar->JobId,ed1), esc_path,
+           esc_name, ar->attr, digest, ar->DeltaSeq,
+           edit_uint64(ar->Fhinfo,ed2),
+           edit_uint64(ar->Fhnode,ed3));
+      pm_strcat(cmd, esc_obj);
+   }
+   changes++;
+
+   /*
+    * See if we need to flush the query buffer filled
+    * with multi-row inserts.
+    */
+   if (changes >= SQLITE_CHANGES_PER_BATCH_INSERT) {
+      changes = 0;
+      return sql_query_without_handler(cmd);
+   }
 
-   return sql_query_without_handler(cmd);
+   return true;
 }
 
 /**
@@ -44,6 +44,10 @@ static char storaddrcmd[] =
    "storage address=%s port=%d ssl=%d\n";
 static char passiveclientcmd[] =
    "passive client address=%s port=%d ssl=%d\n";
+static char accuratecmd[] =
+   "accurate files=%s\n";
+static char accuratebinarycmd[] =
+   "accurate files=%s binary=1\n";
 
 /* Responses received from File daemon */
 static char OKbackup[] =
@@ -196,14 +200,23 @@ static bool get_base_jobids(JCR *jcr, db_list_ctx *jobids)
    return jobids->count > 0;
 }
 
+struct accurate_list_ctx {
+   JCR *jcr;
+   ACCURATE_LIST_ENCODER *encoder;   /* NULL when sending the text format */
+   bool failed;                      /* Sending a frame to the FD failed */
+};
+
 /*
  * Foreach files in currrent list, send "/path/fname\0LStat\0MD5\0Delta" to FD
+ * or add it to the current binary frame when the FD supports it.
  *      row[0]=Path, row[1]=Filename, row[2]=FileIndex
  *      row[3]=JobId row[4]=LStat row[5]=DeltaSeq row[6]=MD5
  */
 static int accurate_list_handler(void *ctx, int num_fields, char **row)
 {
-   JCR *jcr = (JCR *)ctx;
+   accurate_list_ctx *alc = (accurate_list_ctx *)ctx;
+   JCR *jcr = alc->jcr;
+   bool send_chksum;
 
    if (job_canceled(jcr)) {
       return 1;
@@ -213,11 +226,18 @@ static int accurate_list_handler(void *ctx, int num_fields, char **row)
       return 0;
    }
 
-   /* sending with checksum */
-   if (jcr->use_accurate_chksum &&
-       num_fields == 9 &&
-       row[6][0] && /* skip checksum = '0' */
-       row[6][1]) {
+   send_chksum = jcr->use_accurate_chksum &&
+                 num_fields == 9 &&
+                 row[6][0] && /* skip checksum = '0' */
+                 row[6][1];
+
+   if (alc->encoder) {
+      alc->encoder->add(row[0], row[1], row[4], send_chksum ? row[6] : NULL, str_to_int32(row[5]));
+      if (alc->encoder->is_full() && !alc->encoder->flush(jcr->file_bsock)) {
+         alc->failed = true;
+         return 1;
+      }
+   } else if (send_chksum) {
       jcr->file_bsock->fsend("%s%s%c%s%c%s%c%s",
                              row[0], row[1], 0, row[4], 0, row[6], 0, row[5]);
    } else {
@@ -294,12 +314,20 @@ static bool is_checksum_needed_by_fileset(JCR *jcr)
  *    DIR -> FD : /path/to/dir/\0Lstat\0MD5\0Delta
  *    ...
  *    DIR -> FD : EOD
+ *
+ * File Daemons supporting it get the list in binary frames (see lib/accurate_list.h)
+ *    DIR -> FD : accurate files=xxxx binary=1
+ *    DIR -> FD : frame
+ *    ...
+ *    DIR -> FD : EOD
  */
 bool send_accurate_current_files(JCR *jcr)
 {
    POOL_MEM buf;
    db_list_ctx jobids;
    db_list_ctx nb;
+   accurate_list_ctx alc;
+   bool retval = false;
 
    /*
     * In base level, no previous job is used and no restart incomplete jobs
@@ -351,33 +379,59 @@ bool send_accurate_current_files(JCR *jcr)
    Mmsg(buf, "SELECT sum(JobFiles) FROM Job WHERE JobId IN (%s)", jobids.list);
    jcr->db->sql_query(buf.c_str(), db_list_handler, &nb);
    Dmsg2(200, "jobids=%s nb=%s\n", jobids.list, nb.list);
-   jcr->file_bsock->fsend("accurate files=%s\n", nb.list);
+
+   alc.jcr = jcr;
+   alc.encoder = NULL;
+   alc.failed = false;
+   if (jcr->FDVersion >= FD_VERSION_55) {
+      alc.encoder = New(ACCURATE_LIST_ENCODER(true));
+      jcr->file_bsock->fsend(accuratebinarycmd, nb.list);
+   } else {
+      jcr->file_bsock->fsend(accuratecmd, nb.list);
+   }
 
    if (jcr->HasBase) {
       jcr->nb_base_files = str_to_int64(nb.list);
       if (!jcr->db->create_base_file_list(jcr, jobids.list)){
          Jmsg(jcr, M_FATAL, 0, "error in jcr->db->create_base_file_list:%s\n"
               ,jcr->db->strerror());
-         return false;
+         goto bail_out;
       }
       if (!jcr->db->get_base_file_list(jcr, jcr->use_accurate_chksum,
-                                  accurate_list_handler, (void *)jcr)) {
+                                  accurate_list_handler, (void *)&alc)) {
          Jmsg(jcr, M_FATAL, 0, "error in jcr->db->get_base_file_list:%s\n"
               ,jcr->db->strerror());
-         return false;
+         goto bail_out;
       }
    } else {
       if (!jcr->db->open_batch_connection(jcr)) {
          Jmsg0(jcr, M_FATAL, 0, "Can't get batch sql connection");
-         return false;  /* Fail */
+         goto bail_out;
       }
 
       jcr->db_batch->get_file_list(jcr, jobids.list, jcr->use_accurate_chksum,
-                                   false /* no delta */, accurate_list_handler, (void *)jcr);
+                                   false /* no delta */, accurate_list_handler, (void *)&alc);
+   }
+
+   if (alc.encoder) {
+      if (alc.failed || !alc.encoder->flush(jcr->file_bsock)) {
+         Jmsg(jcr, M_FATAL, 0, _("Failed to send the accurate file list to the File daemon: ERR=%s\n"),
+              jcr->file_bsock->bstrerror());
+         goto bail_out;
+      }
+      Dmsg3(200, "Sent %llu accurate entries, %llu bytes encoded in %llu bytes\n",
+            alc.encoder->nr_records(), alc.encoder->bytes_in(), alc.encoder->bytes_out());
    }
 
    jcr->file_bsock->signal(BNET_EOD);
-   return true;
+   retval = true;
+
+bail_out:
+   if (alc.encoder) {
+      delete alc.encoder;
+   }
+
+   return retval;
 }
 
 /*
@@ -3,7 +3,7 @@
 
    Copyright (C) 2001-2012 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2016 Planets Communications B.V.
-   Copyright (C) 2013-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -372,6 +372,367 @@ bail_out:
    return;
 }
 
+/*
+ * Attribute records are inserted into the catalog by a separate thread
+ * using the batch connection of the Job, so reading the attributes from
+ * the Storage daemon does not wait for the database. The records are
+ * copied into batches which are queued to that thread.
+ */
+#define ATTR_BATCH_RECORDS 500             /* Records per batch */
+#define ATTR_BATCH_SIZE (256 * 1024)       /* Bytes per batch */
+#define ATTR_MAX_BATCHES 8                 /* Batches queued before the reader waits */
+
+/*
+ * Header of a queued attribute record, followed by the
+ * filename, attributes and digest strings.
+ */
+struct attr_record {
+   uint32_t FileIndex;
+   uint32_t Stream;
+   uint32_t FileType;
+   uint32_t DeltaSeq;
+   JobId_t JobId;
+   int32_t DigestType;
+   uint32_t fname_len;
+   uint32_t attr_len;
+   int32_t digest_len;                     /* -1 when there is no digest */
+};
+
+struct attr_batch {
+   dlink link;
+   int nr_records;
+   int32_t size;
+   POOLMEM *buf;
+};
+
+struct attr_pipeline {
+   pthread_t thid;
+   pthread_mutex_t mutex;
+   pthread_cond_t queued;                  /* Signaled when a batch is queued */
+   pthread_cond_t done;                    /* Signaled when a batch is inserted */
+   dlist *queue;                           /* Batches to insert */
+   dlist *free_batches;                    /* Inserted batches for reuse */
+   attr_batch *current;                    /* Batch being filled */
+   int nr_queued;
+   bool quit;
+   bool failed;                            /* An insert failed */
+   bool reported;                          /* The failure was reported */
+   POOLMEM *errmsg;                        /* Error of the failed insert */
+};
+
+static attr_batch *get_attr_batch(attr_pipeline *pipeline)
+{
+   attr_batch *batch;
+
+   P(pipeline->mutex);
+   batch = (attr_batch *)pipeline->free_batches->first();
+   if (batch) {
+      pipeline->free_batches->remove(batch);
+   }
+   V(pipeline->mutex);
+
+   if (!batch) {
+      batch = (attr_batch *)malloc(sizeof(attr_batch));
+      memset(batch, 0, sizeof(attr_batch));
+      batch->buf = get_memory(ATTR_BATCH_SIZE);
+   }
+   batch->nr_records = 0;
+   batch->size = 0;
+
+   return batch;
+}
+
+static void free_attr_batch(attr_batch *batch)
+{
+   free_pool_memory(batch->buf);
+   free(batch);
+}
+
+/*
+ * Insert all records of a batch into the catalog. The first error is
+ * kept for the message thread which reports it.
+ */
+static void insert_attr_batch(JCR *jcr, attr_pipeline *pipeline, attr_batch *batch)
+{
+   ATTR_DBR ar;
+   attr_record *rec;
+   char *p = batch->buf;
+
+   memset(&ar, 0, sizeof(ar));
+   for (int i = 0; i < batch->nr_records; i++) {
+      rec = (attr_record *)p;
+      p += sizeof(attr_record);
+      ar.FileIndex = rec->FileIndex;
+      ar.Stream = rec->Stream;
+      ar.FileType = rec->FileType;
+      ar.DeltaSeq = rec->DeltaSeq;
+      ar.JobId = rec->JobId;
+      ar.DigestType = rec->DigestType;
+      ar.fname = p;
+      p += rec->fname_len + 1;
+      ar.attr = p;
+      p += rec->attr_len + 1;
+      if (rec->digest_len >= 0) {
+         ar.Digest = p;
+         p += rec->digest_len + 1;
+      } else {
+         ar.Digest = NULL;
+      }
+      p = (char *)BALIGN((intptr_t)p);
+
+      if (job_canceled(jcr) || pipeline->failed) {
+         continue;
+      }
+      if (!jcr->db_batch->create_attributes_record(jcr, &ar)) {
+         P(pipeline->mutex);
+         pm_strcpy(pipeline->errmsg, jcr->db_batch->strerror());
+         pipeline->failed = true;
+         V(pipeline->mutex);
+      }
+   }
+}
+
+extern "C" void *attr_pipeline_thread(void *arg)
+{
+   JCR *jcr = (JCR *)arg;
+   attr_pipeline *pipeline = jcr->attr_pipeline;
+   attr_batch *batch;
+
+   set_jcr_in_tsd(jcr);
+
+   P(pipeline->mutex);
+   while (1) {
+      batch = (attr_batch *)pipeline->queue->first();
+      if (!batch) {
+         if (pipeline->quit) {
+            break;
+         }
+         pthread_cond_wait(&pipeline->queued, &pipeline->mutex);
+         continue;
+      }
+      V(pipeline->mutex);
+
+      insert_attr_batch(jcr, pipeline, batch);
+
+      P(pipeline->mutex);
+      pipeline->queue->remove(batch);
+      pipeline->free_batches->append(batch);
+      pipeline->nr_queued--;
+      pthread_cond_signal(&pipeline->done);
+   }
+   V(pipeline->mutex);
+
+   jcr->db_batch->thread_cleanup();
+
+   return NULL;
+}
+
+/*
+ * Hand the batch being filled to the insert thread,
+ * waiting while too many batches are queued.
+ */
+static void queue_attr_batch(attr_pipeline *pipeline)
+{
+   int cancel_state;
+
+   if (!pipeline->current || pipeline->current->nr_records == 0) {
+      return;
+   }
+
+   /*
+    * Waiting is no cancellation point, the mutex must be released.
+    */
+   pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+   P(pipeline->mutex);
+   while (pipeline->nr_queued >= ATTR_MAX_BATCHES) {
+      pthread_cond_wait(&pipeline->done, &pipeline->mutex);
+   }
+   pipeline->queue->append(pipeline->current);
+   pipeline->nr_queued++;
+   pthread_cond_signal(&pipeline->queued);
+   V(pipeline->mutex);
+   pthread_setcancelstate(cancel_state, NULL);
+
+   pipeline->current = NULL;
+}
+
+/*
+ * Check for a failed insert of the insert thread which was not reported yet.
+ */
+static bool attr_pipeline_failed(attr_pipeline *pipeline)
+{
+   bool failed;
+
+   P(pipeline->mutex);
+   failed = pipeline->failed && !pipeline->reported;
+   pipeline->reported = pipeline->failed;
+   V(pipeline->mutex);
+
+   return failed;
+}
+
+/*
+ * Error of the last failed attribute insert, the insert thread keeps
+ * its own error as it uses the batch connection.
+ */
+static const char *attr_create_error(JCR *jcr)
+{
+   attr_pipeline *pipeline = jcr->attr_pipeline;
+
+   if (pipeline && pipeline->failed) {
+      return pipeline->errmsg;
+   }
+   return jcr->db->strerror();
+}
+
+static void free_attr_pipeline(attr_pipeline *pipeline)
+{
+   attr_batch *batch;
+
+   if (pipeline->current) {
+      free_attr_batch(pipeline->current);
+   }
+   while ((batch = (attr_batch *)pipeline->free_batches->first())) {
+      pipeline->free_batches->remove(batch);
+      free_attr_batch(batch);
+   }
+   delete pipeline->queue;
+   delete pipeline->free_batches;
+   free_pool_memory(pipeline->errmsg);
+   pthread_cond_destroy(&pipeline->queued);
+   pthread_cond_destroy(&pipeline->done);
+   pthread_mutex_destroy(&pipeline->mutex);
+   free(pipeline);
+}
+
+/*
+ * Start the insert thread when the catalog uses batch inserts and this
+ * is the message thread of the Job, which stops it when it ends. When
+ * the thread can't be started the attributes are inserted directly.
+ */
+static void start_attr_pipeline(JCR *jcr)
+{
+   int status;
+   attr_pipeline *pipeline;
+
+   if (jcr->attr_pipeline_failed || !jcr->db->batch_insert_available() || jcr->HasBase ||
+       !jcr->SD_msg_chan_started || !pthread_equal(jcr->SD_msg_chan, pthread_self())) {
+      return;
+   }
+
+   if (!jcr->db->open_batch_connection(jcr)) {
+      return;                         /* error already printed */
+   }
+
+   pipeline = (attr_pipeline *)malloc(sizeof(attr_pipeline));
+   memset(pipeline, 0, sizeof(attr_pipeline));
+   pthread_mutex_init(&pipeline->mutex, NULL);
+   pthread_cond_init(&pipeline->queued, NULL);
+   pthread_cond_init(&pipeline->done, NULL);
+   pipeline->queue = New(dlist(pipeline->current, &pipeline->current->link));
+   pipeline->free_batches = New(dlist(pipeline->current, &pipeline->current->link));
+   pipeline->errmsg = get_pool_memory(PM_MESSAGE);
+   *pipeline->errmsg = 0;
+   jcr->attr_pipeline = pipeline;
+
+   if ((status = pthread_create(&pipeline->thid, NULL, attr_pipeline_thread, (void *)jcr)) != 0) {
+      berrno be;
+
+      Jmsg1(jcr, M_WARNING, 0, _("Cannot create attribute insert thread, inserting attributes directly: %s\n"),
+            be.bstrerror(status));
+      jcr->attr_pipeline = NULL;
+      jcr->attr_pipeline_failed = true;
+      free_attr_pipeline(pipeline);
+   }
+}
+
+/*
+ * Queue an attribute record for insertion, records which can
+ * not be queued are inserted directly. A failed insert of the
+ * insert thread fails the next call.
+ */
+static bool store_attributes_record(JCR *jcr, ATTR_DBR *ar)
+{
+   attr_record *rec;
+   attr_pipeline *pipeline = jcr->attr_pipeline;
+   int32_t fname_len, attr_len, digest_len, size;
+   char *p;
+
+   if (!pipeline || ar->FileType == FT_BASE) {
+      return jcr->db->create_attributes_record(jcr, ar);
+   }
+
+   if (attr_pipeline_failed(pipeline)) {
+      return false;
+   }
+
+   fname_len = strlen(ar->fname);
+   attr_len = strlen(ar->attr);
+   digest_len = ar->Digest ? strlen(ar->Digest) : -1;
+   size = BALIGN(sizeof(attr_record) + fname_len + 1 + attr_len + 1 + digest_len + 1);
+
+   if (pipeline->current &&
+       (pipeline->current->nr_records >= ATTR_BATCH_RECORDS ||
+        pipeline->current->size + size > ATTR_BATCH_SIZE)) {
+      queue_attr_batch(pipeline);
+   }
+   if (!pipeline->current) {
+      pipeline->current = get_attr_batch(pipeline);
+   }
+
+   pipeline->current->buf = check_pool_memory_size(pipeline->current->buf, pipeline->current->size + size);
+   p = pipeline->current->buf + pipeline->current->size;
+   rec = (attr_record *)p;
+   rec->FileIndex = ar->FileIndex;
+   rec->Stream = ar->Stream;
+   rec->FileType = ar->FileType;
+   rec->DeltaSeq = ar->DeltaSeq;
+   rec->JobId = ar->JobId;
+   rec->DigestType = ar->DigestType;
+   rec->fname_len = fname_len;
+   rec->attr_len = attr_len;
+   rec->digest_len = digest_len;
+   p += sizeof(attr_record);
+   memcpy(p, ar->fname, fname_len + 1);
+   p += fname_len + 1;
+   memcpy(p, ar->attr, attr_len + 1);
+   p += attr_len + 1;
+   if (digest_len >= 0) {
+      memcpy(p, ar->Digest, digest_len + 1);
+   }
+   pipeline->current->size += size;
+   pipeline->current->nr_records++;
+
+   return true;
+}
+
+/*
+ * Wait until all queued attribute records are inserted
+ * and stop the insert thread.
+ */
+void stop_attr_pipeline(JCR *jcr)
+{
+   attr_pipeline *pipeline = jcr->attr_pipeline;
+
+   jcr->attr_pipeline_failed = false;
+   if (!pipeline) {
+      return;
+   }
+
+   queue_attr_batch(pipeline);
+   P(pipeline->mutex);
+   pipeline->quit = true;
+   pthread_cond_signal(&pipeline->queued);
+   V(pipeline->mutex);
+   pthread_join(pipeline->thid, NULL);
+   jcr->attr_pipeline = NULL;
+
+   if (attr_pipeline_failed(pipeline)) {
+      Jmsg1(jcr, M_FATAL, 0, _("Attribute create error: ERR=%s"), pipeline->errmsg);
+   }
+   free_attr_pipeline(pipeline);
+}
+
 /**
  * Note, we receive the whole attribute record, but we select out only the stat
  * packet, VolSessionId, VolSessionTime, FileIndex, file type, and file name to
@@ -459,10 +820,14 @@ static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
    switch (Stream) {
    case STREAM_UNIX_ATTRIBUTES:
    case STREAM_UNIX_ATTRIBUTES_EX:
+      if (!jcr->attr_pipeline) {
+         start_attr_pipeline(jcr);
+      }
+
       if (jcr->cached_attribute) {
          Dmsg2(400, "Cached attr. Stream=%d fname=%s\n", ar->Stream, ar->fname);
-         if (!jcr->db->create_attributes_record(jcr, ar)) {
-            Jmsg1(jcr, M_FATAL, 0, _("Attribute create error: ERR=%s"), jcr->db->strerror());
+         if (!store_attributes_record(jcr, ar)) {
+            Jmsg1(jcr, M_FATAL, 0, _("Attribute create error: ERR=%s"), attr_create_error(jcr));
          }
          jcr->cached_attribute = false;
       }
@@ -631,8 +996,8 @@ static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
                /*
                 * Update BaseFile table
                 */
-               if (!jcr->db->create_attributes_record(jcr, ar)) {
-                  Jmsg1(jcr, M_FATAL, 0, _("attribute create error. %s"), jcr->db->strerror());
+               if (!store_attributes_record(jcr, ar)) {
+                  Jmsg1(jcr, M_FATAL, 0, _("attribute create error. %s"), attr_create_error(jcr));
                }
                jcr->cached_attribute = false;
             } else {
@@ -2129,6 +2129,18 @@ bool FILESETRES::print_config(POOL_MEM &buff, bool hide_sensitive_data, bool ver
                            break;
                         }
                         break;
+                     case 's':
+                     case 'l':
+                        if (*p == 'l') {
+                           Mmsg(temp, "ZSTDLONG\n");
+                        } else if (p[1] == '0' && p[2] == '3') {
+                           Mmsg(temp, "ZSTD\n");
+                        } else {
+                           Mmsg(temp, "ZSTD%d\n", (p[1] - '0') * 10 + (p[2] - '0'));
+                        }
+                        pm_strcat(cfg_str, temp.c_str());
+                        p += 2;             /* skip level */
+                        break;
                      default:
                         Emsg1(M_ERROR, 0, _("Unknown compression include/exclude option: %c\n"), *p);
                         break;
@@ -2140,6 +2152,21 @@ bool FILESETRES::print_config(POOL_MEM &buff, bool hide_sensitive_data, bool ver
                   case 'x':
                      indent_config_item(cfg_str, 3, "AutoExclude = No\n");
                      break;
+                  case 'Y':                 /* I/O mode */
+                     switch(*(p + 1)) {
+                     case 'c':
+                        indent_config_item(cfg_str, 3, "IoMode = NoCache\n");
+                        p++;
+                        break;
+                     case 'd':
+                        indent_config_item(cfg_str, 3, "IoMode = Direct\n");
+                        p++;
+                        break;
+                     }
+                     break;
+                  case 'Q':
+                     indent_config_item(cfg_str, 3, "Deduplication = Yes\n");
+                     break;
                   default:
                      Emsg1(M_ERROR, 0, _("Unknown include/exclude option: %c\n"), *p);
                      break;
@@ -428,10 +428,14 @@ static bool send_fileset(JCR *jcr)
                  /*
                   * Z compress option is followed by the single-digit compress level or 'o'
                   * For fastlz its Zf with a single char selecting the actual compression algo.
+                  * For zstd its Zs or Zl with a two digit compress level.
                   */
                  if (fo->opts[k] == 'Z' && fo->opts[k + 1] == 'f') {
                     done = true;
                     k += 2;             /* skip option */
+                 } else if (fo->opts[k] == 'Z' && (fo->opts[k + 1] == 's' || fo->opts[k + 1] == 'l')) {
+                    done = true;
+                    k += 3;             /* skip option and level */
                  } else if (fo->opts[k] == 'Z') {
                     done = true;
                     k++;                /* skip option and level */
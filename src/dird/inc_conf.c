@@ -103,6 +103,8 @@ RES_ITEM options_items[] = {
    { "Shadowing", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "AutoExclude", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "ForceEncryption", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
+   { "IoMode", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
+   { "Deduplication", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "Meta", CFG_TYPE_META, { 0 }, 0, 0, 0, NULL, NULL },
    { NULL, 0, { 0 }, 0, 0, NULL, NULL, NULL }
 };
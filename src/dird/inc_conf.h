@@ -61,7 +61,9 @@ enum {
    INC_KW_SIZE,
    INC_KW_SHADOWING,
    INC_KW_AUTO_EXCLUDE,
-   INC_KW_FORCE_ENCRYPTION
+   INC_KW_FORCE_ENCRYPTION,
+   INC_KW_IO_MODE,
+   INC_KW_DEDUPLICATION
 };
 
 /*
@@ -100,6 +102,8 @@ static struct s_kw FS_option_kw[] = {
    { "shadowing", INC_KW_SHADOWING },
    { "autoexclude", INC_KW_AUTO_EXCLUDE },
    { "forceencryption", INC_KW_FORCE_ENCRYPTION },
+   { "iomode", INC_KW_IO_MODE },
+   { "deduplication", INC_KW_DEDUPLICATION },
    { NULL, 0 }
 };
 
@@ -137,6 +141,27 @@ static struct s_fs_opt FS_options[] = {
    { "lzfast", INC_KW_COMPRESSION, "Zff" },
    { "lz4", INC_KW_COMPRESSION, "Zf4" },
    { "lz4hc", INC_KW_COMPRESSION, "Zfh" },
+   { "zstd", INC_KW_COMPRESSION, "Zs03" },
+   { "zstd1", INC_KW_COMPRESSION, "Zs01" },
+   { "zstd2", INC_KW_COMPRESSION, "Zs02" },
+   { "zstd3", INC_KW_COMPRESSION, "Zs03" },
+   { "zstd4", INC_KW_COMPRESSION, "Zs04" },
+   { "zstd5", INC_KW_COMPRESSION, "Zs05" },
+   { "zstd6", INC_KW_COMPRESSION, "Zs06" },
+   { "zstd7", INC_KW_COMPRESSION, "Zs07" },
+   { "zstd8", INC_KW_COMPRESSION, "Zs08" },
+   { "zstd9", INC_KW_COMPRESSION, "Zs09" },
+   { "zstd10", INC_KW_COMPRESSION, "Zs10" },
+   { "zstd11", INC_KW_COMPRESSION, "Zs11" },
+   { "zstd12", INC_KW_COMPRESSION, "Zs12" },
+   { "zstd13", INC_KW_COMPRESSION, "Zs13" },
+   { "zstd14", INC_KW_COMPRESSION, "Zs14" },
+   { "zstd15", INC_KW_COMPRESSION, "Zs15" },
+   { "zstd16", INC_KW_COMPRESSION, "Zs16" },
+   { "zstd17", INC_KW_COMPRESSION, "Zs17" },
+   { "zstd18", INC_KW_COMPRESSION, "Zs18" },
+   { "zstd19", INC_KW_COMPRESSION, "Zs19" },
+   { "zstdlong", INC_KW_COMPRESSION, "Zl03" },
    { "blowfish", INC_KW_ENCRYPTION, "Eb" },
    { "3des", INC_KW_ENCRYPTION, "E3" },
    { "aes128", INC_KW_ENCRYPTION, "Ea1" },
@@ -193,6 +218,11 @@ static struct s_fs_opt FS_options[] = {
    { "no", INC_KW_AUTO_EXCLUDE, "x" },
    { "yes", INC_KW_FORCE_ENCRYPTION, "Ef" },
    { "no", INC_KW_FORCE_ENCRYPTION, "0" },
+   { "normal", INC_KW_IO_MODE, "0" },
+   { "nocache", INC_KW_IO_MODE, "Yc" },
+   { "direct", INC_KW_IO_MODE, "Yd" },
+   { "yes", INC_KW_DEDUPLICATION, "Q" },
+   { "no", INC_KW_DEDUPLICATION, "0" },
    { NULL, 0, 0 }
 };
 
@@ -392,6 +392,7 @@ extern "C" void msg_thread_cleanup(void *arg)
 {
    JCR *jcr = (JCR *)arg;
 
+   stop_attr_pipeline(jcr);                 /* insert all queued attributes */
    jcr->db->end_transaction(jcr);           /* terminate any open transaction */
    jcr->lock();
    jcr->sd_msg_thread_done = true;
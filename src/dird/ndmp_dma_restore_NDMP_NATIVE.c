@@ -195,6 +195,7 @@ int set_files_to_restore_ndmp_native(JCR *jcr, struct ndm_job_param *job, int32_
 {
    int len;
    int cnt = 0;
+   uint64_t fhinfo, fhnode;
    TREE_NODE *node, *parent;
    POOL_MEM restore_pathname, tmp;
 
@@ -224,7 +225,9 @@ int set_files_to_restore_ndmp_native(JCR *jcr, struct ndm_job_param *job, int32_
          /*
           * only add nodes that have valid DAR info i.e. fhinfo is not NDMP9_INVALID_U_QUAD
           */
-         if (node->fhinfo != NDMP9_INVALID_U_QUAD) {
+         fhinfo = tree_node_fhinfo(jcr->restore_tree_root, node);
+         fhnode = tree_node_fhnode(jcr->restore_tree_root, node);
+         if (fhinfo != NDMP9_INVALID_U_QUAD) {
             /*
              * See if we need to strip the prefix from the filename.
              */
@@ -234,17 +237,17 @@ int set_files_to_restore_ndmp_native(JCR *jcr, struct ndm_job_param *job, int32_
             }
 
             Jmsg(jcr, M_INFO, 0, _("Namelist add: node:%llu, info:%llu, name:\"%s\" \n"),
-                  node->fhnode, node->fhinfo, restore_pathname.c_str());
+                  fhnode, fhinfo, restore_pathname.c_str());
 
             add_to_namelist(job,  restore_pathname.c_str() + len, restore_prefix,
-                  (char *)"", (char *)"", node->fhnode, node->fhinfo);
+                  (char *)"", (char *)"", fhnode, fhinfo);
 
             cnt++;
 
          } else {
             Jmsg(jcr, M_INFO, 0, _("not added node \"%s\" to namelist because "
                                         "of missing fhinfo: node:%llu info:%llu\n"),
-                  restore_pathname.c_str(), node->fhnode, node->fhinfo );
+                  restore_pathname.c_str(), fhnode, fhinfo);
          }
 
       }
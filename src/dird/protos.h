@@ -87,6 +87,7 @@ void close_bootstrap_file(bootstrap_info &info);
 void catalog_request(JCR *jcr, BSOCK *bs);
 void catalog_update(JCR *jcr, BSOCK *bs);
 bool despool_attributes_from_file(JCR *jcr, const char *file);
+void stop_attr_pipeline(JCR *jcr);
 
 /* consolidate.c */
 bool do_consolidate_init(JCR *jcr);
@@ -146,7 +146,7 @@ static struct ua_cmdstruct commands[] = {
    { NT_(".actiononpurge"), dot_aop_cmd, _("List possible actions on purge"),
      NULL, true, false },
    { NT_(".api"), dot_api_cmd, _("Switch between different api modes"),
-     NT_("[ 0 | 1 | 2 | off | on | json ] [compact=<yes|no>]"), false, false },
+     NT_("[ 0 | 1 | 2 | off | on | json ] [compact=<yes|no>] [stream=<yes|no>]"), false, false },
    { NT_(".authorized"), dot_authorized_cmd, _("Check for authorization"),
      NT_("job=<job-name> | client=<client-name> | storage=<storage-name | \n"
          "schedule=<schedule-name> | pool=<pool-name> | cmd=<command> | \n"
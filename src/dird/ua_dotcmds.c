@@ -1231,9 +1231,11 @@ bool dot_types_cmd(UAContext *ua, const char *cmd)
  */
 bool dot_api_cmd(UAContext *ua, const char *cmd)
 {
+   int i;
+
    if (ua->argc == 1) {
       ua->api = 1;
-   } else if ((ua->argc >= 2) && (ua->argc <= 3)) {
+   } else if ((ua->argc >= 2) && (ua->argc <= 4)) {
       if (bstrcasecmp(ua->argk[1], "off") || bstrcasecmp(ua->argk[1], "0")) {
          ua->api = API_MODE_OFF;
          ua->batch = false;
@@ -1243,13 +1245,24 @@ bool dot_api_cmd(UAContext *ua, const char *cmd)
       } else if (bstrcasecmp(ua->argk[1], "json") || bstrcasecmp(ua->argk[1], "2")) {
          ua->api = API_MODE_JSON;
          ua->batch = true;
-         if ((ua->argc == 3) && (find_arg_with_value(ua, "compact") == 2)) {
-            if (bstrcasecmp(ua->argv[2], "yes")) {
+         i = find_arg_with_value(ua, "compact");
+         if (i >= 2) {
+            if (bstrcasecmp(ua->argv[i], "yes")) {
                ua->send->set_compact(true);
             } else {
                ua->send->set_compact(false);
             }
          }
+#if HAVE_JANSSON
+         i = find_arg_with_value(ua, "stream");
+         if (i >= 2) {
+            if (bstrcasecmp(ua->argv[i], "yes")) {
+               ua->send->set_stream_threshold(OF_JSON_STREAM_THRESHOLD);
+            } else {
+               ua->send->set_stream_threshold(0);
+            }
+         }
+#endif
       } else {
          return false;
       }
@@ -1226,10 +1226,11 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
    }
 
    /*
-    * At this point, the tree is built, so we can garbage collect
-    * any memory released by the SQL engine that RedHat has
-    * not returned to the OS :-(
+    * At this point, the tree is built, so we can release its lookup
+    * tables and garbage collect any memory released by the SQL engine
+    * that RedHat has not returned to the OS :-(
     */
+   tree_build_children(tree.root);
    garbage_collect_memory();
 
    /*
@@ -1291,7 +1292,7 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
             if (node->extract || node->extract_dir) {
                Dmsg3(400, "JobId=%lld type=%d FI=%d\n", (uint64_t)node->JobId, node->type, node->FileIndex);
                /* TODO: optimize bsr insertion when jobid are non sorted */
-               add_delta_list_findex(rx, node->delta_list);
+               add_delta_list_findex(rx, tree_node_delta_list(tree.root, node));
                add_findex(rx->bsr, node->JobId, node->FileIndex);
                if (node->extract && node->type != TN_NEWDIR) {
                   rx->selected_files++;  /* count only saved files */
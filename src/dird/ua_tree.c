@@ -236,10 +236,9 @@ int insert_tree_handler(void *ctx, int num_fields, char **row)
    JobId = str_to_int64(row[3]);
    FileIndex = str_to_int64(row[2]);
    delta_seq = str_to_int64(row[5]);
-   node->fhinfo = str_to_int64(row[6]);
-   node->fhnode = str_to_int64(row[7]);
-   Dmsg8(150, "node=0x%p JobId=%s FileIndex=%s Delta=%s node.delta=%d LinkFI=%d, fhinfo=%d, fhnode=%d\n",
-         node, row[3], row[2], row[5], node->delta_seq, LinkFI, node->fhinfo, node->fhnode);
+   tree_set_file_history(tree->root, node, str_to_int64(row[6]), str_to_int64(row[7]));
+   Dmsg8(150, "node=0x%p JobId=%s FileIndex=%s Delta=%s node.delta=%d LinkFI=%d, fhinfo=%s, fhnode=%s\n",
+         node, row[3], row[2], row[5], node->delta_seq, LinkFI, row[6], row[7]);
 
    /*
     * TODO: check with hardlinks
@@ -137,12 +137,86 @@ bool accurate_finish(JCR *jcr)
    return retval;
 }
 
+/**
+ * Compile the accurate options into a mask of the stat summary words they
+ * compare. Returns false when an option needs more than comparing the
+ * stat fields (size decrease, always backup or checksum).
+ */
+static inline bool compile_accurate_opts(char *opts, accurate_stat *mask)
+{
+   bool only_stat = true;
+
+   memset(mask, 0, sizeof(accurate_stat));
+   for (char *p = opts; *p; p++) {
+      switch (*p) {
+      case 'i':                /** Compare INODE numbers */
+         mask->v[ACCURATE_STAT_INO] = ~(uint64_t)0;
+         break;
+      case 'p':                /** Permissions bits */
+         mask->v[ACCURATE_STAT_MODE] |= 0xffffffffULL;
+         break;
+      case 'n':                /** Number of links */
+         mask->v[ACCURATE_STAT_MODE] |= 0xffffffff00000000ULL;
+         break;
+      case 'u':                /** User id */
+         mask->v[ACCURATE_STAT_OWNER] |= 0xffffffffULL;
+         break;
+      case 'g':                /** Group id */
+         mask->v[ACCURATE_STAT_OWNER] |= 0xffffffff00000000ULL;
+         break;
+      case 's':                /** Size */
+         mask->v[ACCURATE_STAT_SIZE] = ~(uint64_t)0;
+         break;
+      case 'a':                /** Access time */
+         mask->v[ACCURATE_STAT_ATIME] = ~(uint64_t)0;
+         break;
+      case 'm':                /** Modification time */
+         mask->v[ACCURATE_STAT_MTIME] = ~(uint64_t)0;
+         break;
+      case 'c':                /** Change time */
+         mask->v[ACCURATE_STAT_CTIME] = ~(uint64_t)0;
+         break;
+      case 'd':                /** File size decrease */
+      case 'A':                /** Always backup a file */
+      case '5':                /** Compare MD5 */
+      case '1':                /** Compare SHA1 */
+         only_stat = false;
+         break;
+      default:
+         break;
+      }
+   }
+
+   return only_stat;
+}
+
+/**
+ * Compare the masked words of two stat summaries. Written without early
+ * exit so the loop is vectorized.
+ */
+static inline bool accurate_stat_differs(accurate_stat *cat, accurate_stat *file, accurate_stat *mask)
+{
+   uint64_t diff = 0;
+
+   for (int i = 0; i < ACCURATE_STAT_WORDS; i++) {
+      diff |= (cat->v[i] ^ file->v[i]) & mask->v[i];
+   }
+
+   return diff != 0;
+}
+
 /**
  * This function is called for each file seen in fileset.
  * We check in file_list hash if fname have been backuped
  * the last time. After we can compare Lstat field.
  * Full Lstat usage have been removed on 6612
  *
+ * The fields are compared using the stat summary decoded when the
+ * accurate list was loaded. For the common options that only compare
+ * stat fields an unchanged file is detected with a single masked compare,
+ * the per option loop only runs for changed files and the options that
+ * need more work.
+ *
  * Returns: true   if file has changed (must be backed up)
  *          false  file not changed
  */
@@ -150,10 +224,9 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
 {
    char *opts;
    char *fname;
-   int32_t LinkFIc;
-   struct stat statc;
    bool status = false;
    accurate_payload *payload;
+   accurate_stat *statc, statf, mask;
 
    ff_pkt->delta_seq = 0;
    ff_pkt->accurate_found = false;
@@ -195,7 +268,8 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
    ff_pkt->accurate_found = true;
    ff_pkt->delta_seq = payload->delta_seq;
 
-   decode_stat(payload->lstat, &statc, sizeof(statc), &LinkFIc); /** decode catalog stat */
+   statc = &payload->stat;              /** catalog stat summary */
+   accurate_stat_from_stat(&statf, &ff_pkt->statp);
 
    if (!jcr->rerunning && (jcr->getJobLevel() == L_FULL)) {
       opts = ff_pkt->BaseJobOpts;
@@ -203,6 +277,10 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
       opts = ff_pkt->AccurateOpts;
    }
 
+   if (compile_accurate_opts(opts, &mask) && !accurate_stat_differs(statc, &statf, &mask)) {
+      goto mark_seen;
+   }
+
    /**
     * Loop over options supplied by user and verify the fields he requests.
     */
@@ -210,11 +288,11 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
       char ed1[30], ed2[30];
       switch (*p) {
       case 'i':                /** Compare INODE numbers */
-         if (statc.st_ino != ff_pkt->statp.st_ino) {
+         if (statc->v[ACCURATE_STAT_INO] != statf.v[ACCURATE_STAT_INO]) {
             Dmsg3(dbglvl-1, "%s      st_ino   differ. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_ino, ed1),
-                  edit_uint64((uint64_t)ff_pkt->statp.st_ino, ed2));
+                  edit_uint64(statc->v[ACCURATE_STAT_INO], ed1),
+                  edit_uint64(statf.v[ACCURATE_STAT_INO], ed2));
             status = true;
          }
          break;
@@ -223,66 +301,68 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
           * TODO: If something change only in perm, user, group
           * Backup only the attribute stream
           */
-         if (statc.st_mode != ff_pkt->statp.st_mode) {
+         if ((uint32_t)statc->v[ACCURATE_STAT_MODE] != (uint32_t)statf.v[ACCURATE_STAT_MODE]) {
             Dmsg3(dbglvl-1, "%s     st_mode  differ. Cat: %x File: %x\n",
-                  fname, (uint32_t)statc.st_mode, (uint32_t)ff_pkt->statp.st_mode);
+                  fname, (uint32_t)statc->v[ACCURATE_STAT_MODE], (uint32_t)statf.v[ACCURATE_STAT_MODE]);
             status = true;
          }
          break;
       case 'n':                /** Number of links */
-         if (statc.st_nlink != ff_pkt->statp.st_nlink) {
+         if ((statc->v[ACCURATE_STAT_MODE] >> 32) != (statf.v[ACCURATE_STAT_MODE] >> 32)) {
             Dmsg3(dbglvl-1, "%s      st_nlink differ. Cat: %d File: %d\n",
-                  fname, (uint32_t)statc.st_nlink, (uint32_t)ff_pkt->statp.st_nlink);
+                  fname, (uint32_t)(statc->v[ACCURATE_STAT_MODE] >> 32),
+                  (uint32_t)(statf.v[ACCURATE_STAT_MODE] >> 32));
             status = true;
          }
          break;
       case 'u':                /** User id */
-         if (statc.st_uid != ff_pkt->statp.st_uid) {
+         if ((uint32_t)statc->v[ACCURATE_STAT_OWNER] != (uint32_t)statf.v[ACCURATE_STAT_OWNER]) {
             Dmsg3(dbglvl-1, "%s      st_uid   differ. Cat: %u File: %u\n",
-                  fname, (uint32_t)statc.st_uid, (uint32_t)ff_pkt->statp.st_uid);
+                  fname, (uint32_t)statc->v[ACCURATE_STAT_OWNER], (uint32_t)statf.v[ACCURATE_STAT_OWNER]);
             status = true;
          }
          break;
       case 'g':                /** Group id */
-         if (statc.st_gid != ff_pkt->statp.st_gid) {
+         if ((statc->v[ACCURATE_STAT_OWNER] >> 32) != (statf.v[ACCURATE_STAT_OWNER] >> 32)) {
             Dmsg3(dbglvl-1, "%s      st_gid   differ. Cat: %u File: %u\n",
-                  fname, (uint32_t)statc.st_gid, (uint32_t)ff_pkt->statp.st_gid);
+                  fname, (uint32_t)(statc->v[ACCURATE_STAT_OWNER] >> 32),
+                  (uint32_t)(statf.v[ACCURATE_STAT_OWNER] >> 32));
             status = true;
          }
          break;
       case 's':                /** Size */
-         if (statc.st_size != ff_pkt->statp.st_size) {
+         if (statc->v[ACCURATE_STAT_SIZE] != statf.v[ACCURATE_STAT_SIZE]) {
             Dmsg3(dbglvl-1, "%s      st_size  differ. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_size, ed1),
-                  edit_uint64((uint64_t)ff_pkt->statp.st_size, ed2));
+                  edit_uint64(statc->v[ACCURATE_STAT_SIZE], ed1),
+                  edit_uint64(statf.v[ACCURATE_STAT_SIZE], ed2));
             status = true;
          }
          break;
       case 'a':                /** Access time */
-         if (statc.st_atime != ff_pkt->statp.st_atime) {
+         if (statc->v[ACCURATE_STAT_ATIME] != statf.v[ACCURATE_STAT_ATIME]) {
             Dmsg1(dbglvl-1, "%s      st_atime differs\n", fname);
             status = true;
          }
          break;
       case 'm':                /** Modification time */
-         if (statc.st_mtime != ff_pkt->statp.st_mtime) {
+         if (statc->v[ACCURATE_STAT_MTIME] != statf.v[ACCURATE_STAT_MTIME]) {
             Dmsg1(dbglvl-1, "%s      st_mtime differs\n", fname);
             status = true;
          }
          break;
       case 'c':                /** Change time */
-         if (statc.st_ctime != ff_pkt->statp.st_ctime) {
+         if (statc->v[ACCURATE_STAT_CTIME] != statf.v[ACCURATE_STAT_CTIME]) {
             Dmsg1(dbglvl-1, "%s      st_ctime differs\n", fname);
             status = true;
          }
          break;
       case 'd':                /** File size decrease */
-         if (statc.st_size > ff_pkt->statp.st_size) {
+         if ((int64_t)statc->v[ACCURATE_STAT_SIZE] > (int64_t)statf.v[ACCURATE_STAT_SIZE]) {
             Dmsg3(dbglvl-1, "%s      st_size  decrease. Cat: %s File: %s\n",
                   fname,
-                  edit_uint64((uint64_t)statc.st_size, ed1),
-                  edit_uint64((uint64_t)ff_pkt->statp.st_size, ed2));
+                  edit_uint64(statc->v[ACCURATE_STAT_SIZE], ed1),
+                  edit_uint64(statf.v[ACCURATE_STAT_SIZE], ed2));
             status = true;
          }
          break;
@@ -314,6 +394,7 @@ bool accurate_check_file(JCR *jcr, FF_PKT *ff_pkt)
       }
    }
 
+mark_seen:
    /**
     * In Incr/Diff accurate mode, we mark all files as seen
     * When in Full+Base mode, we mark only if the file match exactly
@@ -334,9 +415,49 @@ bail_out:
    return status;
 }
 
+/**
+ * Load the accurate list sent in binary frames (see lib/accurate_list.h).
+ * Every frame is added to the storage class as soon as it is received so
+ * loading overlaps with the Director reading the list from the catalog.
+ */
+static bool accurate_load_binary_list(JCR *jcr)
+{
+   int status;
+   int fname_length,
+       lstat_length,
+       chksum_length;
+   char *fname, *lstat, *chksum;
+   int32_t delta_seq;
+   BSOCK *dir = jcr->dir_bsock;
+   ACCURATE_LIST_DECODER decoder;
+
+   while (dir->recv() >= 0) {
+      if (!decoder.set_frame(dir->msg, dir->msglen)) {
+         Jmsg(jcr, M_FATAL, 0, _("Received invalid accurate file list frame of %d bytes\n"), dir->msglen);
+         return false;
+      }
+
+      while ((status = decoder.next(&fname, &fname_length, &lstat, &lstat_length,
+                                    &chksum, &chksum_length, &delta_seq)) > 0) {
+         if (!jcr->file_list->add_file(jcr, fname, fname_length, lstat, lstat_length,
+                                       chksum, chksum_length, delta_seq)) {
+            return false;
+         }
+      }
+
+      if (status < 0) {
+         Jmsg(jcr, M_FATAL, 0, _("Received corrupt accurate file list frame\n"));
+         return false;
+      }
+   }
+
+   return true;
+}
+
 bool accurate_cmd(JCR *jcr)
 {
    uint32_t nb;
+   int binary = 0;
    int fname_length,
        lstat_length,
        chksum_length;
@@ -348,7 +469,7 @@ bool accurate_cmd(JCR *jcr)
       return true;
    }
 
-   if (sscanf(dir->msg, "accurate files=%u", &nb) != 1) {
+   if (sscanf(dir->msg, "accurate files=%u binary=%d", &nb, &binary) < 1) {
       dir->fsend(_("2991 Bad accurate command\n"));
       return false;
    }
@@ -359,17 +480,31 @@ bool accurate_cmd(JCR *jcr)
    } else {
       if (me->lmdb_threshold > 0 && nb >= me->lmdb_threshold) {
          jcr->file_list = New(B_ACCURATE_LMDB);
+      } else if (me->compact_accurate_table) {
+         jcr->file_list = New(B_ACCURATE_ARENA);
       } else {
          jcr->file_list = New(B_ACCURATE_HTABLE);
       }
    }
 #else
-   jcr->file_list = New(B_ACCURATE_HTABLE);
+   if (me->compact_accurate_table) {
+      jcr->file_list = New(B_ACCURATE_ARENA);
+   } else {
+      jcr->file_list = New(B_ACCURATE_HTABLE);
+   }
 #endif
 
    jcr->file_list->init(jcr, nb);
    jcr->accurate = true;
 
+   if (binary) {
+      if (!accurate_load_binary_list(jcr)) {
+         return false;
+      }
+
+      return jcr->file_list->end_load(jcr);
+   }
+
    /**
     * dirmsg = fname + \0 + lstat + \0 + checksum + \0 + delta_seq + \0
     */
@@ -40,13 +40,94 @@
  * disadvantage that we need to keep a filenr to index the bitmap which
  * also cost some bytes.
  */
+/*
+ * Fixed size binary summary of the lstat fields the accurate options
+ * compare. It is filled in once when an entry is loaded so checking a file
+ * doesn't need to decode the base64 lstat field again. All values are
+ * stored in 64 bits words so comparing them under a mask of the selected
+ * options is a short loop the compiler turns into vector instructions.
+ */
+enum {
+   ACCURATE_STAT_INO = 0,
+   ACCURATE_STAT_SIZE,
+   ACCURATE_STAT_ATIME,
+   ACCURATE_STAT_MTIME,
+   ACCURATE_STAT_CTIME,
+   ACCURATE_STAT_MODE,                /* st_mode in the low, st_nlink in the high 32 bits */
+   ACCURATE_STAT_OWNER,               /* st_uid in the low, st_gid in the high 32 bits */
+   ACCURATE_STAT_WORDS
+};
+
+struct accurate_stat {
+   uint64_t v[ACCURATE_STAT_WORDS];
+};
+
 struct accurate_payload {
    int64_t filenr;
    int32_t delta_seq;
+   accurate_stat stat;
    char *lstat;
    char *chksum;
 };
 
+/*
+ * The values are passed with the types of the stat structure, so they are
+ * truncated the same way as when decode_stat() fills in a stat structure.
+ */
+static inline void accurate_stat_set(accurate_stat *st, ino_t ino, off_t size,
+                                     time_t atime, time_t mtime, time_t ctime,
+                                     mode_t mode, nlink_t nlink, uid_t uid, gid_t gid)
+{
+   st->v[ACCURATE_STAT_INO] = (uint64_t)ino;
+   st->v[ACCURATE_STAT_SIZE] = (uint64_t)size;
+   st->v[ACCURATE_STAT_ATIME] = (uint64_t)atime;
+   st->v[ACCURATE_STAT_MTIME] = (uint64_t)mtime;
+   st->v[ACCURATE_STAT_CTIME] = (uint64_t)ctime;
+   st->v[ACCURATE_STAT_MODE] = (uint64_t)(uint32_t)mode | ((uint64_t)(uint32_t)nlink << 32);
+   st->v[ACCURATE_STAT_OWNER] = (uint64_t)(uint32_t)uid | ((uint64_t)(uint32_t)gid << 32);
+}
+
+static inline void accurate_stat_from_stat(accurate_stat *st, struct stat *statp)
+{
+   accurate_stat_set(st, statp->st_ino, statp->st_size, statp->st_atime, statp->st_mtime,
+                     statp->st_ctime, statp->st_mode, statp->st_nlink, statp->st_uid, statp->st_gid);
+}
+
+/*
+ * Fill in the summary from the values of the lstat fields in the order
+ * encode_stat() writes them.
+ */
+#define ACCURATE_STAT_NR_FIELDS 13
+
+static inline void accurate_stat_from_fields(accurate_stat *st, const int64_t *fields, int nr_fields)
+{
+   int64_t values[ACCURATE_STAT_NR_FIELDS];
+
+   for (int i = 0; i < ACCURATE_STAT_NR_FIELDS; i++) {
+      values[i] = (i < nr_fields) ? fields[i] : 0;
+   }
+
+   accurate_stat_set(st, values[1], values[7], values[10], values[11], values[12],
+                     values[2], values[3], values[4], values[5]);
+}
+
+static inline void accurate_stat_from_lstat(accurate_stat *st, char *lstat)
+{
+   int nr_fields = 0;
+   int64_t fields[ACCURATE_STAT_NR_FIELDS];
+   char *p = lstat;
+
+   while (*p && nr_fields < ACCURATE_STAT_NR_FIELDS) {
+      p += from_base64(&fields[nr_fields++], p);
+      if (*p != ' ') {
+         break;
+      }
+      p++;
+   }
+
+   accurate_stat_from_fields(st, fields, nr_fields);
+}
+
 /*
  * Accurate payload storage abstraction classes.
  */
@@ -114,6 +195,56 @@ public:
    void destroy(JCR *jcr);
 };
 
+/*
+ * Compact storage abstraction class which packs the entries in a few large memory arenas.
+ */
+struct accurate_arena_chunk;
+
+class B_ACCURATE_ARENA: public B_ACCURATE {
+protected:
+   uint32_t m_nr_slots;               /* Size of the hash table, always a power of two */
+   uint32_t m_nr_used;                /* Number of used slots in the hash table */
+   uint64_t *m_fingerprints;          /* Fingerprint of the filename per slot */
+   uint32_t *m_slot_filenrs;          /* Filenr of the entry per slot */
+   uint8_t **m_restarts;              /* Start of every Nth record which stores the full filename */
+   uint32_t m_nr_restarts;            /* Allocated size of the m_restarts array */
+   int64_t m_seen_bitmap_size;        /* Number of bits allocated in m_seen_bitmap */
+   accurate_arena_chunk *m_chunks;    /* First arena chunk */
+   accurate_arena_chunk *m_last_chunk;/* Arena chunk currently appended to */
+   uint32_t m_chunk_size;             /* Size of a new arena chunk */
+   POOLMEM *m_record;                 /* Scratch buffer for encoding a record */
+   POOLMEM *m_prev_fname;             /* Filename of the previous record, for the prefix compression */
+   int m_prev_fname_length;           /* Length of the previous filename */
+   POOLMEM *m_fname;                  /* Scratch buffer for decoding a filename */
+   POOLMEM *m_lstat;                  /* Scratch buffer for decoding the lstat field */
+   POOLMEM *m_chksum;                 /* Scratch buffer for decoding the chksum field */
+   accurate_payload m_payload;        /* Decoded payload returned by lookup_payload() */
+
+   bool grow_hash_table(JCR *jcr);
+   uint8_t *store_record(uint8_t *record, uint32_t length);
+   uint8_t *decode_payload(uint8_t *p, bool want_lstat);
+
+public:
+   /* methods */
+   B_ACCURATE_ARENA();
+   ~B_ACCURATE_ARENA();
+   bool init(JCR *jcr, uint32_t nbfile);
+   bool add_file(JCR *jcr,
+                 char *fname,
+                 int fname_length,
+                 char *lstat,
+                 int lstat_length,
+                 char *chksum,
+                 int chksum_length,
+                 int32_t delta_seq);
+   bool end_load(JCR *jcr);
+   accurate_payload *lookup_payload(JCR *jcr, char *fname);
+   bool update_payload(JCR *jcr, char *fname, accurate_payload *payload);
+   bool send_base_file_list(JCR *jcr);
+   bool send_deleted_list(JCR *jcr);
+   void destroy(JCR *jcr);
+};
+
 #ifdef HAVE_LMDB
 
 #include "lmdb.h"
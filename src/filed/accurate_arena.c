@@ -0,0 +1,733 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * This file contains the ARENA abstraction of the accurate payload storage.
+ *
+ * The entries are appended as packed records to a few large memory chunks.
+ * A record has no pointers and no per entry allocation overhead:
+ *
+ * - The filename is prefix compressed against the previous record. Every
+ *   ARENA_RESTART_INTERVAL records the full filename is stored so a single
+ *   filename can be decoded by walking at most that many records.
+ * - The lstat field is stored as the binary values of its base64 fields.
+ *   When an lstat field would not encode back to exactly the same string
+ *   it is stored as is.
+ * - The delta sequence and all lengths are stored as variable length
+ *   integers.
+ *
+ * Lookups go through an open addressing hash table of 64 bits filename
+ * fingerprints, which holds the filenr of the entry. The filename of a
+ * matching fingerprint is decoded and compared, so a fingerprint collision
+ * never returns the wrong entry.
+ */
+
+#include "bareos.h"
+#include "filed.h"
+#include "accurate.h"
+
+static int dbglvl = 100;
+
+#define ARENA_CHUNK_SIZE (8 * 1024 * 1024)
+#define ARENA_MIN_CHUNK_SIZE (64 * 1024)
+#define ARENA_AVG_NR_BYTES_PER_ENTRY 64
+#define ARENA_RESTART_INTERVAL 16
+#define ARENA_MIN_NR_SLOTS 1024
+#define ARENA_MAX_NR_SLOTS 0x80000000
+#define ARENA_EMPTY_SLOT 0xffffffff
+#define ARENA_MAX_LSTAT_FIELDS 32
+
+/*
+ * The first value of a record is the length of the shared prefix shifted
+ * left by one bit, so it is always even. An odd value of 1 marks the end
+ * of the data in a chunk and is followed by a pointer to the next chunk.
+ */
+#define ARENA_JUMP_MARKER 1
+#define ARENA_JUMP_SIZE (1 + sizeof(uint8_t *))
+
+struct accurate_arena_chunk {
+   accurate_arena_chunk *next;        /* Next chunk */
+   uint32_t size;                     /* Size of the data area */
+   uint32_t used;                     /* Number of bytes used */
+   uint8_t data[1];                   /* Packed records */
+};
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t value)
+{
+   while (value >= 0x80) {
+      *p++ = (uint8_t)(value | 0x80);
+      value >>= 7;
+   }
+   *p++ = (uint8_t)value;
+
+   return p;
+}
+
+static inline uint8_t *get_varint(uint8_t *p, uint64_t *value)
+{
+   int shift = 0;
+   uint64_t result = 0;
+
+   while (*p & 0x80) {
+      result |= (uint64_t)(*p++ & 0x7f) << shift;
+      shift += 7;
+   }
+   result |= (uint64_t)*p++ << shift;
+   *value = result;
+
+   return p;
+}
+
+static inline uint64_t zigzag_encode(int64_t value)
+{
+   return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value)
+{
+   return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * 64 bits fingerprint of a filename (FNV-1a with a final avalanche).
+ */
+static inline uint64_t fingerprint(const char *fname)
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+
+   for (const char *p = fname; *p; p++) {
+      hash ^= (uint8_t)*p;
+      hash *= 0x100000001b3ULL;
+   }
+
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdULL;
+   hash ^= hash >> 33;
+
+   return hash;
+}
+
+/**
+ * Store an lstat field in binary form, or as is when it doesn't encode back.
+ */
+static inline uint8_t *encode_lstat(uint8_t *p, char *lstat, int lstat_length)
+{
+   int nr_fields = 0;
+   int64_t fields[ARENA_MAX_LSTAT_FIELDS];
+   char check[ARENA_MAX_LSTAT_FIELDS * 13];
+   char *s = lstat;
+   char *q = check;
+
+   while (*s && nr_fields < ARENA_MAX_LSTAT_FIELDS) {
+      s += from_base64(&fields[nr_fields++], s);
+      if (*s != ' ') {
+         break;
+      }
+      s++;
+   }
+
+   if (lstat_length < (int)sizeof(check)) {
+      for (int i = 0; i < nr_fields; i++) {
+         if (i > 0) {
+            *q++ = ' ';
+         }
+         q += to_base64(fields[i], q);
+      }
+   }
+
+   if ((q - check) != lstat_length || memcmp(check, lstat, lstat_length) != 0) {
+      p = put_varint(p, ((uint64_t)lstat_length << 1) | 1);
+      memcpy(p, lstat, lstat_length);
+      return p + lstat_length;
+   }
+
+   p = put_varint(p, (uint64_t)nr_fields << 1);
+   for (int i = 0; i < nr_fields; i++) {
+      p = put_varint(p, zigzag_encode(fields[i]));
+   }
+
+   return p;
+}
+
+/**
+ * Decode the filename of a record, the filename of the previous
+ * record must be in fname unless this is a restart record.
+ */
+static inline uint8_t *decode_name(uint8_t *p, POOLMEM *&fname, int *fname_length)
+{
+   uint64_t prefix, suffix;
+
+   p = get_varint(p, &prefix);
+   if (prefix == ARENA_JUMP_MARKER) {
+      uint8_t *next;
+
+      memcpy(&next, p, sizeof(next));
+      p = get_varint(next, &prefix);
+   }
+   prefix >>= 1;
+
+   p = get_varint(p, &suffix);
+   fname = check_pool_memory_size(fname, prefix + suffix + 1);
+   memcpy(fname + prefix, p, suffix);
+   fname[prefix + suffix] = '\0';
+   *fname_length = prefix + suffix;
+
+   return p + suffix;
+}
+
+/**
+ * Skip the payload part of a record.
+ */
+static inline uint8_t *skip_payload(uint8_t *p)
+{
+   uint64_t value, nr_fields;
+
+   p = get_varint(p, &value);           /* delta_seq */
+   p = get_varint(p, &value);           /* lstat */
+   if (value & 1) {
+      p += value >> 1;
+   } else {
+      nr_fields = value >> 1;
+      for (uint64_t i = 0; i < nr_fields; i++) {
+         p = get_varint(p, &value);
+      }
+   }
+   p = get_varint(p, &value);           /* chksum */
+
+   return p + value;
+}
+
+B_ACCURATE_ARENA::B_ACCURATE_ARENA()
+{
+   m_filenr = 0;
+   m_seen_bitmap = NULL;
+   m_seen_bitmap_size = 0;
+   m_nr_slots = 0;
+   m_nr_used = 0;
+   m_fingerprints = NULL;
+   m_slot_filenrs = NULL;
+   m_restarts = NULL;
+   m_nr_restarts = 0;
+   m_chunks = NULL;
+   m_last_chunk = NULL;
+   m_chunk_size = 0;
+   m_record = NULL;
+   m_prev_fname = NULL;
+   m_prev_fname_length = 0;
+   m_fname = NULL;
+   m_lstat = NULL;
+   m_chksum = NULL;
+   memset(&m_payload, 0, sizeof(m_payload));
+}
+
+B_ACCURATE_ARENA::~B_ACCURATE_ARENA()
+{
+}
+
+bool B_ACCURATE_ARENA::init(JCR *jcr, uint32_t nbfile)
+{
+   if (!m_fingerprints) {
+      m_nr_slots = ARENA_MIN_NR_SLOTS;
+      while (m_nr_slots < ARENA_MAX_NR_SLOTS &&
+             m_nr_slots < (uint64_t)nbfile + nbfile / 3 + 1) {
+         m_nr_slots <<= 1;
+      }
+
+      m_fingerprints = (uint64_t *)malloc(m_nr_slots * sizeof(uint64_t));
+      m_slot_filenrs = (uint32_t *)malloc(m_nr_slots * sizeof(uint32_t));
+      memset(m_slot_filenrs, 0xff, m_nr_slots * sizeof(uint32_t));
+      m_nr_used = 0;
+   }
+
+   if (!m_restarts) {
+      m_nr_restarts = nbfile / ARENA_RESTART_INTERVAL + 1;
+      m_restarts = (uint8_t **)malloc(m_nr_restarts * sizeof(uint8_t *));
+   }
+
+   /*
+    * Size the first chunk for the expected number of entries.
+    */
+   m_chunk_size = MIN(MAX((uint64_t)nbfile * ARENA_AVG_NR_BYTES_PER_ENTRY, ARENA_MIN_CHUNK_SIZE), ARENA_CHUNK_SIZE);
+
+   if (!m_seen_bitmap) {
+      m_seen_bitmap_size = MAX(nbfile, 1);
+      m_seen_bitmap = (char *)malloc(nbytes_for_bits(m_seen_bitmap_size));
+      clear_all_bits(m_seen_bitmap_size, m_seen_bitmap);
+   }
+
+   if (!m_record) {
+      m_record = get_pool_memory(PM_MESSAGE);
+      m_prev_fname = get_pool_memory(PM_FNAME);
+      m_fname = get_pool_memory(PM_FNAME);
+      m_lstat = get_pool_memory(PM_MESSAGE);
+      m_chksum = get_pool_memory(PM_MESSAGE);
+   }
+
+   return true;
+}
+
+/**
+ * Double the size of the hash table.
+ */
+bool B_ACCURATE_ARENA::grow_hash_table(JCR *jcr)
+{
+   uint32_t nr_slots, mask, index;
+   uint64_t *fingerprints;
+   uint32_t *slot_filenrs;
+
+   if (m_nr_slots >= ARENA_MAX_NR_SLOTS) {
+      Jmsg(jcr, M_FATAL, 0, _("Too many files in accurate list\n"));
+      return false;
+   }
+
+   nr_slots = m_nr_slots << 1;
+   mask = nr_slots - 1;
+   fingerprints = (uint64_t *)malloc(nr_slots * sizeof(uint64_t));
+   slot_filenrs = (uint32_t *)malloc(nr_slots * sizeof(uint32_t));
+   memset(slot_filenrs, 0xff, nr_slots * sizeof(uint32_t));
+
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      if (m_slot_filenrs[i] == ARENA_EMPTY_SLOT) {
+         continue;
+      }
+
+      index = m_fingerprints[i] & mask;
+      while (slot_filenrs[index] != ARENA_EMPTY_SLOT) {
+         index = (index + 1) & mask;
+      }
+      fingerprints[index] = m_fingerprints[i];
+      slot_filenrs[index] = m_slot_filenrs[i];
+   }
+
+   free(m_fingerprints);
+   free(m_slot_filenrs);
+   m_fingerprints = fingerprints;
+   m_slot_filenrs = slot_filenrs;
+   m_nr_slots = nr_slots;
+
+   Dmsg1(dbglvl, "Accurate hash table grown to %u slots\n", m_nr_slots);
+
+   return true;
+}
+
+/**
+ * Append a record to the arena, returns where it is stored.
+ */
+uint8_t *B_ACCURATE_ARENA::store_record(uint8_t *record, uint32_t length)
+{
+   uint8_t *p;
+   uint32_t size;
+   accurate_arena_chunk *chunk = m_last_chunk;
+
+   /*
+    * Always leave room for the jump to the next chunk.
+    */
+   if (!chunk || (chunk->used + length + ARENA_JUMP_SIZE) > chunk->size) {
+      accurate_arena_chunk *new_chunk;
+
+      size = MAX(m_chunk_size, length + ARENA_JUMP_SIZE);
+      new_chunk = (accurate_arena_chunk *)malloc(offsetof(accurate_arena_chunk, data) + size);
+      new_chunk->next = NULL;
+      new_chunk->size = size;
+      new_chunk->used = 0;
+
+      if (chunk) {
+         uint8_t *next = new_chunk->data;
+
+         p = chunk->data + chunk->used;
+         *p++ = ARENA_JUMP_MARKER;
+         memcpy(p, &next, sizeof(next));
+         chunk->used += ARENA_JUMP_SIZE;
+         chunk->next = new_chunk;
+      } else {
+         m_chunks = new_chunk;
+      }
+
+      m_last_chunk = chunk = new_chunk;
+      m_chunk_size = ARENA_CHUNK_SIZE;
+   }
+
+   p = chunk->data + chunk->used;
+   memcpy(p, record, length);
+   chunk->used += length;
+
+   return p;
+}
+
+bool B_ACCURATE_ARENA::add_file(JCR *jcr,
+                                char *fname,
+                                int fname_length,
+                                char *lstat,
+                                int lstat_length,
+                                char *chksum,
+                                int chksum_length,
+                                int32_t delta_seq)
+{
+   uint8_t *p, *record;
+   int prefix_length = 0;
+   uint32_t index, mask;
+   uint64_t fp;
+
+   if (m_filenr >= ARENA_EMPTY_SLOT) {
+      Jmsg(jcr, M_FATAL, 0, _("Too many files in accurate list\n"));
+      return false;
+   }
+
+   if ((m_nr_used + 1) * 4 > (uint64_t)m_nr_slots * 3) {
+      if (!grow_hash_table(jcr)) {
+         return false;
+      }
+   }
+
+   /*
+    * Encode the record.
+    */
+   m_record = check_pool_memory_size(m_record, fname_length + lstat_length + chksum_length +
+                                     (ARENA_MAX_LSTAT_FIELDS + 5) * 10);
+   p = (uint8_t *)m_record;
+
+   if (m_filenr % ARENA_RESTART_INTERVAL) {
+      int max_length = MIN(fname_length, m_prev_fname_length);
+
+      while (prefix_length < max_length && fname[prefix_length] == m_prev_fname[prefix_length]) {
+         prefix_length++;
+      }
+   }
+
+   p = put_varint(p, (uint64_t)prefix_length << 1);
+   p = put_varint(p, fname_length - prefix_length);
+   memcpy(p, fname + prefix_length, fname_length - prefix_length);
+   p += fname_length - prefix_length;
+   p = put_varint(p, zigzag_encode(delta_seq));
+   p = encode_lstat(p, lstat, lstat_length);
+   p = put_varint(p, chksum_length);
+   if (chksum_length) {
+      memcpy(p, chksum, chksum_length);
+      p += chksum_length;
+   }
+
+   record = store_record((uint8_t *)m_record, p - (uint8_t *)m_record);
+
+   if (m_filenr % ARENA_RESTART_INTERVAL == 0) {
+      if ((uint32_t)(m_filenr / ARENA_RESTART_INTERVAL) >= m_nr_restarts) {
+         m_nr_restarts *= 2;
+         m_restarts = (uint8_t **)realloc(m_restarts, m_nr_restarts * sizeof(uint8_t *));
+      }
+      m_restarts[m_filenr / ARENA_RESTART_INTERVAL] = record;
+   }
+
+   m_prev_fname = check_pool_memory_size(m_prev_fname, fname_length + 1);
+   memcpy(m_prev_fname, fname, fname_length);
+   m_prev_fname[fname_length] = '\0';
+   m_prev_fname_length = fname_length;
+
+   /*
+    * Insert the fingerprint into the hash table.
+    */
+   fp = fingerprint(fname);
+   mask = m_nr_slots - 1;
+   index = fp & mask;
+   while (m_slot_filenrs[index] != ARENA_EMPTY_SLOT) {
+      index = (index + 1) & mask;
+   }
+   m_fingerprints[index] = fp;
+   m_slot_filenrs[index] = m_filenr;
+   m_nr_used++;
+
+   /*
+    * The director may send more entries then it announced.
+    */
+   if (m_filenr >= m_seen_bitmap_size) {
+      int64_t old_size = nbytes_for_bits(m_seen_bitmap_size);
+
+      m_seen_bitmap_size *= 2;
+      m_seen_bitmap = (char *)realloc(m_seen_bitmap, nbytes_for_bits(m_seen_bitmap_size));
+      memset(m_seen_bitmap + old_size, 0, nbytes_for_bits(m_seen_bitmap_size) - old_size);
+   }
+   m_filenr++;
+
+   if (chksum) {
+      Dmsg4(dbglvl, "add fname=<%s> lstat=%s delta_seq=%i chksum=%s\n", fname, lstat, delta_seq, chksum);
+   } else {
+      Dmsg2(dbglvl, "add fname=<%s> lstat=%s\n", fname, lstat);
+   }
+
+   return true;
+}
+
+bool B_ACCURATE_ARENA::end_load(JCR *jcr)
+{
+   uint64_t arena_size = 0;
+   accurate_arena_chunk *chunk;
+
+   for (chunk = m_chunks; chunk; chunk = chunk->next) {
+      arena_size += chunk->used;
+   }
+
+   Dmsg4(dbglvl, "Accurate arena loaded %lld entries in %llu bytes, hash table %u slots %u used\n",
+         m_filenr, arena_size, m_nr_slots, m_nr_used);
+
+   return true;
+}
+
+/**
+ * Decode the payload part of a record into m_payload. A lookup only compares
+ * the stat summary, so the lstat string is only rebuilt from the binary
+ * fields when want_lstat is set, otherwise m_payload.lstat is NULL.
+ */
+uint8_t *B_ACCURATE_ARENA::decode_payload(uint8_t *p, bool want_lstat)
+{
+   uint64_t value, length;
+
+   p = get_varint(p, &value);
+   m_payload.delta_seq = (int32_t)zigzag_decode(value);
+
+   p = get_varint(p, &value);
+   if (value & 1) {
+      length = value >> 1;
+      m_lstat = check_pool_memory_size(m_lstat, length + 1);
+      memcpy(m_lstat, p, length);
+      m_lstat[length] = '\0';
+      p += length;
+      accurate_stat_from_lstat(&m_payload.stat, m_lstat);
+      m_payload.lstat = m_lstat;
+   } else {
+      char *q = NULL;
+      int64_t field;
+      int64_t fields[ACCURATE_STAT_NR_FIELDS];
+
+      length = value >> 1;
+      if (want_lstat) {
+         m_lstat = check_pool_memory_size(m_lstat, length * 13 + 1);
+         q = m_lstat;
+      }
+      for (uint64_t i = 0; i < length; i++) {
+         p = get_varint(p, &value);
+         field = zigzag_decode(value);
+         if (i < ACCURATE_STAT_NR_FIELDS) {
+            fields[i] = field;
+         }
+         if (q) {
+            if (i > 0) {
+               *q++ = ' ';
+            }
+            q += to_base64(field, q);
+         }
+      }
+
+      /*
+       * The stat summary comes straight from the binary fields.
+       */
+      accurate_stat_from_fields(&m_payload.stat, fields, MIN(length, (uint64_t)ACCURATE_STAT_NR_FIELDS));
+      if (q) {
+         *q = '\0';
+         m_payload.lstat = m_lstat;
+      } else {
+         m_payload.lstat = NULL;
+      }
+   }
+
+   p = get_varint(p, &length);
+   m_chksum = check_pool_memory_size(m_chksum, length + 1);
+   memcpy(m_chksum, p, length);
+   m_chksum[length] = '\0';
+   m_payload.chksum = m_chksum;
+
+   return p + length;
+}
+
+accurate_payload *B_ACCURATE_ARENA::lookup_payload(JCR *jcr, char *fname)
+{
+   uint8_t *p;
+   uint64_t fp;
+   uint32_t index, mask, filenr;
+   int fname_length;
+
+   if (!m_fingerprints) {
+      return NULL;
+   }
+
+   fp = fingerprint(fname);
+   mask = m_nr_slots - 1;
+   index = fp & mask;
+   while ((filenr = m_slot_filenrs[index]) != ARENA_EMPTY_SLOT) {
+      if (m_fingerprints[index] == fp) {
+         /*
+          * Decode the filename starting at the nearest restart record.
+          */
+         p = m_restarts[filenr / ARENA_RESTART_INTERVAL];
+         for (uint32_t i = filenr % ARENA_RESTART_INTERVAL; ; i--) {
+            p = decode_name(p, m_fname, &fname_length);
+            if (i == 0) {
+               break;
+            }
+            p = skip_payload(p);
+         }
+
+         if (bstrcmp(m_fname, fname)) {
+            decode_payload(p, false);
+            m_payload.filenr = filenr;
+            return &m_payload;
+         }
+      }
+      index = (index + 1) & mask;
+   }
+
+   return NULL;
+}
+
+bool B_ACCURATE_ARENA::update_payload(JCR *jcr, char *fname, accurate_payload *payload)
+{
+   /*
+    * Nothing to do.
+    */
+   return true;
+}
+
+bool B_ACCURATE_ARENA::send_base_file_list(JCR *jcr)
+{
+   uint8_t *p;
+   int fname_length;
+   FF_PKT *ff_pkt;
+   int32_t LinkFIc;
+   struct stat statp;
+   int stream = STREAM_UNIX_ATTRIBUTES;
+
+   if (!jcr->accurate || jcr->getJobLevel() != L_FULL) {
+      return true;
+   }
+
+   if (!m_chunks) {
+      return true;
+   }
+
+   ff_pkt = init_find_files();
+   ff_pkt->type = FT_BASE;
+
+   p = m_chunks->data;
+   for (int64_t filenr = 0; filenr < m_filenr; filenr++) {
+      p = decode_name(p, m_fname, &fname_length);
+      p = decode_payload(p, bit_is_set(filenr, m_seen_bitmap));
+      if (bit_is_set(filenr, m_seen_bitmap)) {
+         Dmsg1(dbglvl, "base file fname=%s\n", m_fname);
+         decode_stat(m_payload.lstat, &statp, sizeof(statp), &LinkFIc); /* decode catalog stat */
+         ff_pkt->fname = m_fname;
+         ff_pkt->statp = statp;
+         encode_and_send_attributes(jcr, ff_pkt, stream);
+      }
+   }
+
+   term_find_files(ff_pkt);
+   return true;
+}
+
+bool B_ACCURATE_ARENA::send_deleted_list(JCR *jcr)
+{
+   uint8_t *p;
+   int fname_length;
+   FF_PKT *ff_pkt;
+   int32_t LinkFIc;
+   struct stat statp;
+   int stream = STREAM_UNIX_ATTRIBUTES;
+
+   if (!jcr->accurate) {
+      return true;
+   }
+
+   if (!m_chunks) {
+      return true;
+   }
+
+   ff_pkt = init_find_files();
+   ff_pkt->type = FT_DELETED;
+
+   p = m_chunks->data;
+   for (int64_t filenr = 0; filenr < m_filenr; filenr++) {
+      p = decode_name(p, m_fname, &fname_length);
+      if (bit_is_set(filenr, m_seen_bitmap) ||
+          plugin_check_file(jcr, m_fname)) {
+         p = skip_payload(p);
+         continue;
+      }
+      p = decode_payload(p, true);
+      Dmsg1(dbglvl, "deleted fname=%s\n", m_fname);
+      ff_pkt->fname = m_fname;
+      decode_stat(m_payload.lstat, &statp, sizeof(statp), &LinkFIc); /* decode catalog stat */
+      ff_pkt->statp.st_mtime = statp.st_mtime;
+      ff_pkt->statp.st_ctime = statp.st_ctime;
+      encode_and_send_attributes(jcr, ff_pkt, stream);
+   }
+
+   term_find_files(ff_pkt);
+   return true;
+}
+
+void B_ACCURATE_ARENA::destroy(JCR *jcr)
+{
+   accurate_arena_chunk *chunk, *next;
+
+   for (chunk = m_chunks; chunk; chunk = next) {
+      next = chunk->next;
+      free(chunk);
+   }
+   m_chunks = NULL;
+   m_last_chunk = NULL;
+
+   if (m_fingerprints) {
+      free(m_fingerprints);
+      m_fingerprints = NULL;
+   }
+
+   if (m_slot_filenrs) {
+      free(m_slot_filenrs);
+      m_slot_filenrs = NULL;
+   }
+   m_nr_slots = 0;
+   m_nr_used = 0;
+
+   if (m_restarts) {
+      free(m_restarts);
+      m_restarts = NULL;
+   }
+   m_nr_restarts = 0;
+
+   if (m_seen_bitmap) {
+      free(m_seen_bitmap);
+      m_seen_bitmap = NULL;
+   }
+   m_seen_bitmap_size = 0;
+
+   if (m_record) {
+      free_pool_memory(m_record);
+      free_pool_memory(m_prev_fname);
+      free_pool_memory(m_fname);
+      free_pool_memory(m_lstat);
+      free_pool_memory(m_chksum);
+      m_record = NULL;
+      m_prev_fname = NULL;
+      m_fname = NULL;
+      m_lstat = NULL;
+      m_chksum = NULL;
+   }
+   m_prev_fname_length = 0;
+
+   m_filenr = 0;
+}
@@ -85,6 +85,7 @@ bool B_ACCURATE_HTABLE::add_file(JCR *jcr,
    item->payload.lstat = item->fname + fname_length + 1;
    memcpy(item->payload.lstat, lstat, lstat_length);
    item->payload.lstat[lstat_length] = '\0';
+   accurate_stat_from_lstat(&item->payload.stat, item->payload.lstat);
 
    item->payload.chksum = item->payload.lstat + lstat_length + 1;
    if (chksum_length) {
@@ -60,6 +60,10 @@ bool B_ACCURATE_LMDB::init(JCR *jcr, uint32_t nbfile)
    MDB_env *env;
    size_t mapsize = 10485760;
 
+   if (!m_lmdb_name) {
+      m_lmdb_name = get_pool_memory(PM_FNAME);
+   }
+
    if (!m_db_env) {
       result = mdb_env_create(&env);
       if (result) {
@@ -121,10 +125,6 @@ bool B_ACCURATE_LMDB::init(JCR *jcr, uint32_t nbfile)
       m_pay_load = get_pool_memory(PM_MESSAGE);
    }
 
-   if (!m_lmdb_name) {
-      m_lmdb_name = get_pool_memory(PM_FNAME);
-   }
-
    if (!m_seen_bitmap) {
       m_seen_bitmap = (char *)malloc(nbytes_for_bits(nbfile));
       clear_all_bits(nbfile, m_seen_bitmap);
@@ -172,6 +172,7 @@ bool B_ACCURATE_LMDB::add_file(JCR *jcr,
    payload->lstat = (char *)payload + sizeof(accurate_payload);
    memcpy(payload->lstat, lstat, lstat_length);
    payload->lstat[lstat_length] = '\0';
+   accurate_stat_from_lstat(&payload->stat, payload->lstat);
 
    payload->chksum = (char *)payload->lstat + lstat_length + 1;
    if (chksum_length) {
@@ -348,6 +349,7 @@ bool B_ACCURATE_LMDB::update_payload(JCR *jcr, char *fname, accurate_payload *pa
    new_payload->chksum[chksum_length] = '\0';
 
    new_payload->delta_seq = payload->delta_seq;
+   new_payload->stat = payload->stat;
    new_payload->filenr = payload->filenr;
 
    key.mv_data = fname;
@@ -45,11 +45,12 @@ const int dbglvl = 50;
  *  52 13Jul13 - Added plugin options
  *  53 02Apr15 - Added setdebug timestamp
  *  54 29Oct15 - Added getSecureEraseCmd
+ *  55 17Oct17 - Added binary accurate file list
  */
 static char OK_hello_compat[] =
    "2000 OK Hello 5\n";
 static char OK_hello[] =
-   "2000 OK Hello 54\n";
+   "2000 OK Hello 55\n";
 
 static char Dir_sorry[] =
    "2999 Authentication failed.\n";
@@ -165,6 +166,7 @@ bool authenticate_storagedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   sd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    result = sd->authenticate_inbound_connection(jcr, "Storage daemon", "", password, me->tls);
 
@@ -190,6 +192,7 @@ bool authenticate_with_storagedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   sd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    result = sd->authenticate_outbound_connection(jcr, "Storage daemon", "", password, me->tls);
 
@@ -200,3 +203,19 @@ bool authenticate_with_storagedaemon(JCR *jcr)
 
    return result;
 }
+
+/**
+ * Authenticate an additional data connection with a remote storage daemon.
+ *
+ * The job is not touched, so a failing connection does not fail the job.
+ */
+bool authenticate_with_storagedaemon_stream(JCR *jcr, BSOCK *sd, char *auth_key)
+{
+   s_password password;
+
+   password.encoding = p_encoding_md5;
+   password.value = auth_key;
+   sd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
+
+   return sd->authenticate_outbound_connection(NULL, "Storage daemon", "", password, me->tls);
+}
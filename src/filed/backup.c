@@ -60,6 +60,11 @@ static int send_data(JCR *jcr, int stream, FF_PKT *ff_pkt,
                      DIGEST *digest, DIGEST *signature_digest);
 bool encode_and_send_attributes(JCR *jcr, FF_PKT *ff_pkt, int &data_stream);
 static void close_vss_backup_session(JCR *jcr);
+static inline bool setup_backup_pipeline(JCR *jcr);
+static inline void cleanup_backup_pipeline(JCR *jcr);
+static int save_file_multi_stream(JCR *jcr, FF_PKT *ff_pkt, bool top_level);
+static int plugin_save_multi_stream(JCR *jcr, FF_PKT *ff_pkt, bool top_level);
+static inline bool next_sd_stream(JCR *jcr);
 
 /**
  * Find all the requested files and send them
@@ -76,6 +81,9 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
 {
    BSOCK *sd;
    bool ok = true;
+   char ec1[50], ec2[50], ec3[50];
+   b_streams *streams = jcr->sd_streams;
+   uint64_t raw_bytes, wire_bytes;
 
    sd = jcr->store_bsock;
 
@@ -100,6 +108,26 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
 
    jcr->buf_size = sd->msglen;
 
+   /*
+    * Small messages are sent in batches, large data blocks go out directly.
+    */
+   sd->set_write_coalescing(me->network_write_coalescing_size);
+
+   if (streams) {
+      for (int i = 1; i < streams->nr_streams; i++) {
+         if (!streams->socks[i]->set_buffer_size(buf_size, BNET_SETBUF_WRITE)) {
+            jcr->setJobStatus(JS_ErrorTerminated);
+            Jmsg(jcr, M_FATAL, 0, _("Cannot set buffer size FD->SD.\n"));
+            return false;
+         }
+         streams->socks[i]->set_write_coalescing(me->network_write_coalescing_size);
+      }
+      for (int i = 0; i < streams->nr_streams; i++) {
+         streams->socks[i]->start_send_thread(SD_STREAM_SEND_QUEUE);
+      }
+      streams->current = 0;
+   }
+
    if (!adjust_compression_buffers(jcr)) {
       return false;
    }
@@ -108,6 +136,12 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
       return false;
    }
 
+   if (!setup_backup_pipeline(jcr)) {
+      cleanup_compression(jcr);
+      crypto_session_end(jcr);
+      return false;
+   }
+
    set_find_options((FF_PKT *)jcr->ff, jcr->incremental, jcr->mtime);
 
    /**
@@ -138,7 +172,19 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
    /**
     * Subroutine save_file() is called for each file
     */
-   if (!find_files(jcr, (FF_PKT *)jcr->ff, save_file, plugin_save)) {
+   if (streams) {
+      if (!find_files(jcr, (FF_PKT *)jcr->ff, save_file_multi_stream, plugin_save_multi_stream)) {
+         ok = false;                  /* error */
+         jcr->setJobStatus(JS_ErrorTerminated);
+      }
+
+      /*
+       * Go round to the primary connection, the rest is sent over it.
+       */
+      while (streams->current != 0) {
+         next_sd_stream(jcr);
+      }
+   } else if (!find_files(jcr, (FF_PKT *)jcr->ff, save_file, plugin_save)) {
       ok = false;                     /* error */
       jcr->setJobStatus(JS_ErrorTerminated);
    }
@@ -159,6 +205,30 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
    stop_heartbeat_monitor(jcr);
 
    sd->signal(BNET_EOD);            /* end of sending data */
+   sd->clear_write_coalescing();
+
+   raw_bytes = sd->get_raw_bytes_sent();
+   wire_bytes = sd->get_wire_bytes_sent();
+   if (streams) {
+      for (int i = 1; i < streams->nr_streams; i++) {
+         streams->socks[i]->clear_write_coalescing();
+         raw_bytes += streams->socks[i]->get_raw_bytes_sent();
+         wire_bytes += streams->socks[i]->get_wire_bytes_sent();
+      }
+      for (int i = 0; i < streams->nr_streams; i++) {
+         if (!streams->socks[i]->stop_send_thread() && ok) {
+            Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+                  streams->socks[i]->bstrerror());
+            ok = false;
+         }
+      }
+   }
+
+   if (sd->is_compressing()) {
+      Jmsg(jcr, M_INFO, 0, _("Network compression: %s bytes of data sent as %s bytes\n"),
+           edit_uint64_with_commas(raw_bytes, ec1),
+           edit_uint64_with_commas(wire_bytes, ec2));
+   }
 
    if (have_acl && jcr->acl_data) {
       free_pool_memory(jcr->acl_data->u.build->content);
@@ -179,6 +249,16 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
       jcr->big_buf = NULL;
    }
 
+   if (jcr->dedup) {
+      Jmsg(jcr, M_INFO, 0, _("Deduplication: %s chunks sent, %s chunks (%s bytes) sent as reference\n"),
+           edit_uint64_with_commas(jcr->dedup->chunks, ec1),
+           edit_uint64_with_commas(jcr->dedup->ref_chunks, ec2),
+           edit_uint64_with_commas(jcr->dedup->ref_bytes, ec3));
+      free_dedup_context(jcr->dedup);
+      jcr->dedup = NULL;
+   }
+
+   cleanup_backup_pipeline(jcr);
    cleanup_compression(jcr);
    crypto_session_end(jcr);
 
@@ -773,6 +853,17 @@ int save_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
       ff_pkt->bfd.reparse_point = (ff_pkt->type == FT_REPARSE ||
                                    ff_pkt->type == FT_JUNCTION);
 
+      /*
+       * Regular files and raw devices can bypass or spare the page cache.
+       */
+      if (ff_pkt->type == FT_REG || ff_pkt->type == FT_REGE || ff_pkt->type == FT_RAW) {
+         if (bit_is_set(FO_IO_DIRECT, ff_pkt->flags)) {
+            set_io_mode(&ff_pkt->bfd, BIO_DIRECT);
+         } else if (bit_is_set(FO_IO_NOCACHE, ff_pkt->flags)) {
+            set_io_mode(&ff_pkt->bfd, BIO_NOCACHE);
+         }
+      }
+
       if (bopen(&ff_pkt->bfd, ff_pkt->fname, O_RDONLY | O_BINARY | noatime, 0, ff_pkt->statp.st_rdev) < 0) {
          ff_pkt->ff_errno = errno;
          berrno be;
@@ -898,109 +989,190 @@ bail_out:
 }
 
 /**
- * Handle the data just read and send it to the SD after doing any postprocessing needed.
+ * Continue on the next data connection of a multi stream backup. The
+ * Storage daemon follows the BNET_NEXT_STREAM signal, so it reads the
+ * files in the order they were sent.
  */
-static inline bool send_data_to_sd(b_ctx *bctx)
+static inline bool next_sd_stream(JCR *jcr)
 {
-   BSOCK *sd = bctx->jcr->store_bsock;
-   bool need_more_data;
+   b_streams *streams = jcr->sd_streams;
+   bool ok;
 
-   /*
-    * Check for sparse blocks
-    */
+   ok = jcr->store_bsock->signal(BNET_NEXT_STREAM);
+   streams->current = (streams->current + 1) % streams->nr_streams;
+   jcr->store_bsock = streams->socks[streams->current];
+
+   return ok;
+}
+
+/**
+ * Switch to the next data connection when anything was sent for the file.
+ */
+static inline int end_multi_stream_file(JCR *jcr, BSOCK *sd, uint32_t out_msg_no, int status)
+{
+   if (sd->out_msg_no != out_msg_no && !next_sd_stream(jcr)) {
+      if (!jcr->is_job_canceled()) {
+         Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"), sd->bstrerror());
+      }
+      return 0;
+   }
+
+   return status;
+}
+
+/**
+ * Called by find() instead of save_file() and plugin_save() for a multi
+ * stream backup, so each file is sent over the next data connection.
+ */
+static int save_file_multi_stream(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
+{
+   BSOCK *sd = jcr->store_bsock;
+   uint32_t out_msg_no = sd->out_msg_no;
+
+   return end_multi_stream_file(jcr, sd, out_msg_no, save_file(jcr, ff_pkt, top_level));
+}
+
+static int plugin_save_multi_stream(JCR *jcr, FF_PKT *ff_pkt, bool top_level)
+{
+   BSOCK *sd = jcr->store_bsock;
+   uint32_t out_msg_no = sd->out_msg_no;
+
+   return end_multi_stream_file(jcr, sd, out_msg_no, plugin_save(jcr, ff_pkt, top_level));
+}
+
+/**
+ * Handle sparse and offset data of a block just read.
+ *
+ * Stores the file address in front of the data in the write buffer.
+ * Returns false when the block only contains zeros and can be skipped.
+ */
+static inline bool encode_file_address(b_ctx *bctx, char *rbuf, char *wbuf, uint32_t length)
+{
    if (bit_is_set(FO_SPARSE, bctx->ff_pkt->flags)) {
       bool allZeros;
       ser_declare;
 
       allZeros = false;
-      if ((sd->msglen == bctx->rsize &&
-          (bctx->fileAddr + sd->msglen < (uint64_t)bctx->ff_pkt->statp.st_size)) ||
+      if ((length == (uint32_t)bctx->rsize &&
+          (bctx->fileAddr + length < (uint64_t)bctx->ff_pkt->statp.st_size)) ||
           ((bctx->ff_pkt->type == FT_RAW ||
             bctx->ff_pkt->type == FT_FIFO) &&
           ((uint64_t)bctx->ff_pkt->statp.st_size == 0))) {
-         allZeros = is_buf_zero(bctx->rbuf, bctx->rsize);
+         allZeros = is_buf_zero(rbuf, bctx->rsize);
       }
 
       if (!allZeros) {
          /*
           * Put file address as first data in buffer
           */
-         ser_begin(bctx->wbuf, OFFSET_FADDR_SIZE);
+         ser_begin(wbuf, OFFSET_FADDR_SIZE);
          ser_uint64(bctx->fileAddr); /* store fileAddr in begin of buffer */
       }
 
-      bctx->fileAddr += sd->msglen; /* update file address */
+      bctx->fileAddr += length; /* update file address */
 
       /*
        * Skip block of all zeros
        */
       if (allZeros) {
-         return true;
+         return false;
       }
    } else if (bit_is_set(FO_OFFSETS, bctx->ff_pkt->flags)) {
       ser_declare;
-      ser_begin(bctx->wbuf, OFFSET_FADDR_SIZE);
+      ser_begin(wbuf, OFFSET_FADDR_SIZE);
       ser_uint64(bctx->ff_pkt->bfd.offset); /* store offset in begin of buffer */
    }
 
-   bctx->jcr->ReadBytes += sd->msglen; /* count bytes read */
+   return true;
+}
 
-   /*
-    * Uncompressed cipher input length
-    */
-   bctx->cipher_input_len = sd->msglen;
+/**
+ * Skip the blocks of a sparse file that lie completely in a hole, so holes
+ * are not read at all. These are the blocks the zero scan in
+ * encode_file_address() drops, the data stream stays the same.
+ */
+static inline void skip_sparse_holes(b_ctx *bctx)
+{
+   FF_PKT *ff_pkt = bctx->ff_pkt;
+
+   if (!bit_is_set(FO_SPARSE, ff_pkt->flags) ||
+       (ff_pkt->type != FT_REG && ff_pkt->type != FT_REGE)) {
+      return;
+   }
+
+   bctx->fileAddr = bskip_holes(&ff_pkt->bfd, bctx->fileAddr, ff_pkt->statp.st_size, bctx->rsize);
+}
+
+/**
+ * Account the data just read and update the checksums if requested.
+ */
+static inline void update_digests(b_ctx *bctx, char *rbuf, uint32_t length)
+{
+   bctx->jcr->ReadBytes += length; /* count bytes read */
 
    /*
     * Update checksum if requested
     */
    if (bctx->digest) {
-      crypto_digest_update(bctx->digest, (uint8_t *)bctx->rbuf, sd->msglen);
+      crypto_digest_update(bctx->digest, (uint8_t *)rbuf, length);
    }
 
    /*
     * Update signing digest if requested
     */
    if (bctx->signing_digest) {
-      crypto_digest_update(bctx->signing_digest, (uint8_t *)bctx->rbuf, sd->msglen);
+      crypto_digest_update(bctx->signing_digest, (uint8_t *)rbuf, length);
+   }
+}
+
+/**
+ * Compress a block of data using the given compression context.
+ * When chead is not NULL a compression header is put in front of the compressed data.
+ */
+static inline bool compress_block(b_ctx *bctx, CMPRS_CTX *cmprs_ctx, char *rbuf, uint32_t length,
+                                  unsigned char *chead, unsigned char *cbuf, uint32_t *compress_len)
+{
+   if (!compress_data(bctx->jcr, cmprs_ctx, bctx->ff_pkt->Compress_algo, rbuf, length,
+                      cbuf, bctx->max_compress_len, compress_len)) {
+      return false;
    }
 
    /*
-    * Compress the data.
+    * See if we need to generate a compression header.
     */
-   if (bit_is_set(FO_COMPRESS, bctx->ff_pkt->flags)) {
-      if (!compress_data(bctx->jcr, bctx->ff_pkt->Compress_algo, bctx->rbuf,
-                         bctx->jcr->store_bsock->msglen, bctx->cbuf,
-                         bctx->max_compress_len, &bctx->compress_len)) {
-         return false;
-      }
+   if (chead) {
+      ser_declare;
 
       /*
-       * See if we need to generate a compression header.
+       * Complete header
        */
-      if (bctx->chead) {
-         ser_declare;
+      ser_begin(chead, sizeof(comp_stream_header));
+      ser_uint32(bctx->ch.magic);
+      ser_uint32(*compress_len);
+      ser_uint16(bctx->ch.level);
+      ser_uint16(bctx->ch.version);
+      ser_end(chead, sizeof(comp_stream_header));
 
-         /*
-          * Complete header
-          */
-         ser_begin(bctx->chead, sizeof(comp_stream_header));
-         ser_uint32(bctx->ch.magic);
-         ser_uint32(bctx->compress_len);
-         ser_uint16(bctx->ch.level);
-         ser_uint16(bctx->ch.version);
-         ser_end(bctx->chead, sizeof(comp_stream_header));
+      *compress_len += sizeof(comp_stream_header); /* add size of header */
+   }
 
-         bctx->compress_len += sizeof(comp_stream_header); /* add size of header */
-      }
+   return true;
+}
 
-      bctx->jcr->store_bsock->msglen = bctx->compress_len; /* set compressed length */
-      bctx->cipher_input_len = bctx->compress_len;
-   }
+/**
+ * Encrypt the data (when requested) and send the buffer to the Storage daemon.
+ * On entry sd->msglen holds the length of the (possibly compressed) data.
+ */
+static inline bool encrypt_and_send_block(b_ctx *bctx, char *wbuf)
+{
+   BSOCK *sd = bctx->jcr->store_bsock;
+   bool need_more_data;
 
    /*
     * Encrypt the data.
     */
    need_more_data = false;
+   bctx->cipher_input_len = sd->msglen;
    if (bit_is_set(FO_ENCRYPT, bctx->ff_pkt->flags) && !encrypt_data(bctx, &need_more_data)) {
       if (need_more_data) {
          return true;
@@ -1014,12 +1186,13 @@ static inline bool send_data_to_sd(b_ctx *bctx)
    if (bit_is_set(FO_SPARSE, bctx->ff_pkt->flags) || bit_is_set(FO_OFFSETS, bctx->ff_pkt->flags)) {
       sd->msglen += OFFSET_FADDR_SIZE; /* include fileAddr in size */
    }
-   sd->msg = bctx->wbuf; /* set correct write buffer */
+   sd->msg = wbuf; /* set correct write buffer */
 
    if (!sd->send()) {
       if (!bctx->jcr->is_job_canceled()) {
          Jmsg1(bctx->jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"), sd->bstrerror());
       }
+      sd->msg = bctx->msgsave; /* restore read buffer */
       return false;
    }
 
@@ -1030,6 +1203,380 @@ static inline bool send_data_to_sd(b_ctx *bctx)
    return true;
 }
 
+/**
+ * Handle the data just read and send it to the SD after doing any postprocessing needed.
+ */
+static inline bool send_data_to_sd(b_ctx *bctx)
+{
+   BSOCK *sd = bctx->jcr->store_bsock;
+
+   /*
+    * Check for sparse blocks
+    */
+   if (!encode_file_address(bctx, bctx->rbuf, bctx->wbuf, sd->msglen)) {
+      return true;
+   }
+
+   update_digests(bctx, bctx->rbuf, sd->msglen);
+
+   /*
+    * Compress the data.
+    */
+   if (bit_is_set(FO_COMPRESS, bctx->ff_pkt->flags)) {
+      if (!compress_block(bctx, &bctx->jcr->compress, bctx->rbuf, sd->msglen,
+                          (unsigned char *)bctx->chead, bctx->cbuf, &bctx->compress_len)) {
+         return false;
+      }
+
+      sd->msglen = bctx->compress_len; /* set compressed length */
+   }
+
+   return encrypt_and_send_block(bctx, bctx->wbuf);
+}
+
+/**
+ * Compress a block in a pipeline worker thread.
+ */
+static inline bool compress_pipeline_block(b_pipeline *pl, CMPRS_CTX *cmprs_ctx, b_pipeline_block *block)
+{
+   b_ctx *bctx = pl->bctx;
+   unsigned char *chead, *cbuf;
+
+   if (bctx->chead) {
+      chead = (unsigned char *)block->cbuf + pl->hdr_size;
+      cbuf = chead + sizeof(comp_stream_header);
+   } else {
+      chead = NULL;
+      cbuf = (unsigned char *)block->cbuf + pl->hdr_size;
+   }
+
+   return compress_block(bctx, cmprs_ctx, block->rbuf + pl->hdr_size, block->data_len,
+                         chead, cbuf, &block->compress_len);
+}
+
+/**
+ * Encrypt and send a block in the pipeline sender thread.
+ */
+static inline bool send_pipeline_block(b_pipeline *pl, b_pipeline_block *block)
+{
+   b_ctx *bctx = pl->bctx;
+   BSOCK *sd = pl->jcr->store_bsock;
+   char *wbuf;
+
+   if (pl->compress) {
+      sd->msglen = block->compress_len;
+      bctx->cipher_input = (uint8_t *)block->cbuf;
+      wbuf = block->cbuf;
+   } else {
+      sd->msglen = block->data_len;
+      bctx->cipher_input = (uint8_t *)block->rbuf;
+      wbuf = block->rbuf;
+   }
+
+   if (bit_is_set(FO_ENCRYPT, bctx->ff_pkt->flags)) {
+      wbuf = pl->jcr->crypto.crypto_buf;
+   }
+
+   return encrypt_and_send_block(bctx, wbuf);
+}
+
+/**
+ * Pipeline worker thread, compresses blocks.
+ */
+static void *pipeline_worker(void *arg)
+{
+   b_pipeline_block *block;
+   b_pipeline_worker *worker = (b_pipeline_worker *)arg;
+   b_pipeline *pl = worker->pl;
+
+   while ((block = (b_pipeline_block *)pl->work_queue->dequeue())) {
+      if (!pl->error && !compress_pipeline_block(pl, &worker->cmprs_ctx, block)) {
+         block->failed = true;
+      }
+      pl->send_queue->enqueue(block);
+   }
+
+   return NULL;
+}
+
+/**
+ * Pipeline sender thread, puts the blocks back in order and sends them to the SD.
+ */
+static void *pipeline_sender(void *arg)
+{
+   b_pipeline *pl = (b_pipeline *)arg;
+   b_pipeline_block *block;
+
+   while ((block = (b_pipeline_block *)pl->send_queue->dequeue())) {
+      pl->pending[block->seqnr % pl->nr_blocks] = block;
+
+      /*
+       * Send all blocks that are now in sequence.
+       */
+      while ((block = pl->pending[pl->next_seqnr % pl->nr_blocks]) &&
+             block->seqnr == pl->next_seqnr) {
+         bool failed;
+
+         pl->pending[pl->next_seqnr % pl->nr_blocks] = NULL;
+         pl->next_seqnr++;
+
+         failed = block->failed || (!pl->error && !send_pipeline_block(pl, block));
+
+         P(pl->lock);
+         if (failed) {
+            pl->error = true;
+         }
+         pl->sent++;
+         pthread_cond_signal(&pl->drained);
+         V(pl->lock);
+
+         pl->free_queue->enqueue(block);
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Free the memory of the backup data pipeline, all its threads must have been stopped.
+ */
+static inline void free_backup_pipeline(b_pipeline *pl)
+{
+   int i;
+
+   for (i = 0; i < pl->nr_workers; i++) {
+      cleanup_compression_workset(&pl->workers[i].cmprs_ctx);
+   }
+
+   for (i = 0; i < pl->nr_blocks; i++) {
+      free_pool_memory(pl->blocks[i].rbuf);
+      if (pl->blocks[i].cbuf) {
+         free_pool_memory(pl->blocks[i].cbuf);
+      }
+   }
+
+   delete pl->free_queue;
+   delete pl->work_queue;
+   delete pl->send_queue;
+   pthread_cond_destroy(&pl->drained);
+   pthread_mutex_destroy(&pl->lock);
+   free(pl->workers);
+   free(pl->pending);
+   free(pl->blocks);
+   free(pl);
+}
+
+/**
+ * Setup the backup data pipeline for a Job.
+ */
+static inline bool setup_backup_pipeline(JCR *jcr)
+{
+   int i;
+   b_pipeline *pl;
+   findFILESET *fileset = jcr->ff->fileset;
+
+   if (me->backup_pipeline_workers == 0) {
+      return true;
+   }
+
+   pl = (b_pipeline *)malloc(sizeof(b_pipeline));
+   memset(pl, 0, sizeof(b_pipeline));
+   pl->jcr = jcr;
+   pl->nr_workers = me->backup_pipeline_workers;
+   pl->nr_blocks = 2 * pl->nr_workers + 2;
+
+   pthread_mutex_init(&pl->lock, NULL);
+   pthread_cond_init(&pl->drained, NULL);
+   pl->free_queue = New(circbuf(pl->nr_blocks));
+   pl->work_queue = New(circbuf(pl->nr_blocks));
+   pl->send_queue = New(circbuf(pl->nr_blocks));
+
+   pl->blocks = (b_pipeline_block *)malloc(pl->nr_blocks * sizeof(b_pipeline_block));
+   memset(pl->blocks, 0, pl->nr_blocks * sizeof(b_pipeline_block));
+   pl->pending = (b_pipeline_block **)malloc(pl->nr_blocks * sizeof(b_pipeline_block *));
+   memset(pl->pending, 0, pl->nr_blocks * sizeof(b_pipeline_block *));
+   for (i = 0; i < pl->nr_blocks; i++) {
+      pl->blocks[i].rbuf = get_memory(jcr->buf_size);
+      if (jcr->compress.deflate_buffer_size > 0) {
+         pl->blocks[i].cbuf = get_memory(jcr->compress.deflate_buffer_size);
+      }
+      pl->free_queue->enqueue(&pl->blocks[i]);
+   }
+
+   /*
+    * Each worker gets its own compression context for all compressors used in the fileset.
+    * These are all setup before any thread is started so a failure (which
+    * setup_compression_workset() already reported as fatal) only needs to free the pipeline.
+    */
+   pl->workers = (b_pipeline_worker *)malloc(pl->nr_workers * sizeof(b_pipeline_worker));
+   memset(pl->workers, 0, pl->nr_workers * sizeof(b_pipeline_worker));
+   for (i = 0; i < pl->nr_workers; i++) {
+      pl->workers[i].pl = pl;
+      if (fileset) {
+         int j, k;
+
+         for (j = 0; j < fileset->include_list.size(); j++) {
+            findINCEXE *incexe = (findINCEXE *)fileset->include_list.get(j);
+            for (k = 0; k < incexe->opts_list.size(); k++) {
+               findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(k);
+
+               if (!setup_compression_workset(jcr, &pl->workers[i].cmprs_ctx, fo->Compress_algo)) {
+                  free_backup_pipeline(pl);
+                  return false;
+               }
+            }
+         }
+      }
+   }
+
+   for (i = 0; i < pl->nr_workers; i++) {
+      pthread_create(&pl->workers[i].thread_id, NULL, pipeline_worker, (void *)&pl->workers[i]);
+   }
+   pthread_create(&pl->sender_id, NULL, pipeline_sender, (void *)pl);
+
+   Dmsg2(100, "Setup backup pipeline with %d workers and %d blocks\n", pl->nr_workers, pl->nr_blocks);
+   jcr->pipeline = pl;
+
+   return true;
+}
+
+/**
+ * Stop all pipeline threads and free the backup data pipeline of a Job.
+ */
+static inline void cleanup_backup_pipeline(JCR *jcr)
+{
+   int i;
+   b_pipeline *pl = jcr->pipeline;
+
+   if (!pl) {
+      return;
+   }
+
+   /*
+    * A NULL entry on a queue makes the consuming thread exit.
+    */
+   for (i = 0; i < pl->nr_workers; i++) {
+      pl->work_queue->enqueue(NULL);
+   }
+   for (i = 0; i < pl->nr_workers; i++) {
+      pthread_join(pl->workers[i].thread_id, NULL);
+   }
+   pl->send_queue->enqueue(NULL);
+   pthread_join(pl->sender_id, NULL);
+
+   free_backup_pipeline(pl);
+   jcr->pipeline = NULL;
+}
+
+/**
+ * See if the data of a file should be sent using the backup data pipeline.
+ * Files that fit into a single block don't gain anything from the pipeline.
+ */
+static inline bool use_backup_pipeline(b_ctx &bctx)
+{
+   if (!bctx.jcr->pipeline) {
+      return false;
+   }
+
+   if (bctx.ff_pkt->cmd_plugin) {
+      return false;
+   }
+
+   return bctx.ff_pkt->type == FT_RAW ||
+          bctx.ff_pkt->statp.st_size > bctx.rsize;
+}
+
+/**
+ * Send the content of a file using the backup data pipeline.
+ *
+ * The job thread reads the data and updates the digests (both must be done in sequence),
+ * the worker threads compress the blocks and the sender thread encrypts and sends the
+ * blocks in their original order so the data stream is identical to the one
+ * send_plain_data() produces.
+ */
+static inline bool send_pipelined_data(b_ctx &bctx)
+{
+   int i;
+   int32_t status = 0;
+   b_pipeline_block *block;
+   b_pipeline *pl = bctx.jcr->pipeline;
+   BSOCK *sd = bctx.jcr->store_bsock;
+
+   /*
+    * Setup the pipeline for this file, all pipeline threads are idle now.
+    */
+   pl->bctx = &bctx;
+   pl->compress = bit_is_set(FO_COMPRESS, bctx.ff_pkt->flags);
+   pl->hdr_size = (bit_is_set(FO_SPARSE, bctx.ff_pkt->flags) ||
+                   bit_is_set(FO_OFFSETS, bctx.ff_pkt->flags)) ? OFFSET_FADDR_SIZE : 0;
+   pl->next_seqnr = 0;
+   pl->submitted = 0;
+   pl->sent = 0;
+   pl->error = false;
+
+   if (pl->compress) {
+      for (i = 0; i < pl->nr_workers; i++) {
+         if (!setup_compression_workset_params(bctx.jcr, &pl->workers[i].cmprs_ctx,
+                                               bctx.ff_pkt->Compress_algo,
+                                               bctx.ff_pkt->Compress_level)) {
+            return false;
+         }
+      }
+   }
+
+   while (!pl->error) {
+      block = (b_pipeline_block *)pl->free_queue->dequeue();
+
+      /*
+       * Read the file data
+       */
+      skip_sparse_holes(&bctx);
+      status = (int32_t)bread(&bctx.ff_pkt->bfd, block->rbuf + pl->hdr_size, bctx.rsize);
+      if (status <= 0) {
+         pl->free_queue->enqueue(block);
+         break;
+      }
+
+      block->data_len = status;
+      block->failed = false;
+
+      /*
+       * Check for sparse blocks
+       */
+      if (!encode_file_address(&bctx, block->rbuf + pl->hdr_size,
+                               pl->compress ? block->cbuf : block->rbuf, block->data_len)) {
+         pl->free_queue->enqueue(block);
+         continue;
+      }
+
+      update_digests(&bctx, block->rbuf + pl->hdr_size, block->data_len);
+
+      P(pl->lock);
+      block->seqnr = pl->submitted++;
+      V(pl->lock);
+
+      if (pl->compress) {
+         pl->work_queue->enqueue(block);
+      } else {
+         pl->send_queue->enqueue(block);
+      }
+   }
+
+   /*
+    * Wait until all submitted blocks are sent.
+    */
+   P(pl->lock);
+   while (pl->sent < pl->submitted) {
+      pthread_cond_wait(&pl->drained, &pl->lock);
+   }
+   V(pl->lock);
+
+   pl->bctx = NULL;
+   sd->msglen = status;
+
+   return !pl->error;
+}
+
 #ifdef HAVE_WIN32
 /**
  * Callback method for ReadEncryptedFileRaw()
@@ -1112,10 +1659,12 @@ static inline bool send_plain_data(b_ctx &bctx)
    /*
     * Read the file data
     */
+   skip_sparse_holes(&bctx);
    while ((sd->msglen = (uint32_t)bread(&bctx.ff_pkt->bfd, bctx.rbuf, bctx.rsize)) > 0) {
       if (!send_data_to_sd(&bctx)) {
          goto bail_out;
       }
+      skip_sparse_holes(&bctx);
    }
    retval = true;
 
@@ -1123,6 +1672,107 @@ bail_out:
    return retval;
 }
 
+/**
+ * Send the content of a file as deduplicated chunks.
+ *
+ * Each chunk is sent in a record of its own, the file address, the SHA1 digest and
+ * the length of the chunk are put in front of its data. A chunk that was already sent
+ * during this job is sent without its data, the Storage daemon takes the data from
+ * its chunk store.
+ */
+static inline bool send_dedup_data(b_ctx &bctx)
+{
+   JCR *jcr = bctx.jcr;
+   BSOCK *sd = jcr->store_bsock;
+   b_dedup *dedup;
+   DIGEST *digest;
+   char *chunk;
+   uint8_t key[DEDUP_KEY_SIZE];
+   uint32_t start = 0, end = 0, length, digest_len;
+   int32_t status = 0;
+   bool eof = false;
+   ser_declare;
+
+   if (!jcr->dedup) {
+      jcr->dedup = new_dedup_context(jcr);
+   }
+   dedup = jcr->dedup;
+
+   while (!jcr->is_job_canceled()) {
+      /*
+       * Keep at least a chunk of maximum size in the buffer.
+       */
+      while (!eof && end - start < DEDUP_MAX_CHUNK) {
+         if (end == dedup->buf_size) {
+            memmove(dedup->buf, dedup->buf + start, end - start);
+            end -= start;
+            start = 0;
+         }
+
+         status = (int32_t)bread(&bctx.ff_pkt->bfd, dedup->buf + end,
+                                 MIN((uint32_t)bctx.rsize, dedup->buf_size - end));
+         if (status <= 0) {
+            eof = true;
+            break;
+         }
+         end += status;
+      }
+
+      if (status < 0 || start == end) {
+         break;
+      }
+
+      chunk = dedup->buf + start;
+      length = dedup_find_chunk(dedup, chunk, end - start);
+      update_digests(&bctx, chunk, length);
+
+      digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA1);
+      if (!digest) {
+         Jmsg0(jcr, M_FATAL, 0, _("Could not create the SHA1 digest of a chunk\n"));
+         return false;
+      }
+      digest_len = CRYPTO_DIGEST_SHA1_SIZE;
+      crypto_digest_update(digest, (uint8_t *)chunk, length);
+      crypto_digest_finalize(digest, key, &digest_len);
+      crypto_digest_free(digest);
+
+      ser_begin(key + CRYPTO_DIGEST_SHA1_SIZE, sizeof(uint32_t));
+      ser_uint32(length);
+
+      ser_begin(dedup->rec, DEDUP_CHUNK_HDR_SIZE);
+      ser_uint64(bctx.fileAddr);
+      ser_bytes(key, DEDUP_KEY_SIZE);
+
+      if (dedup_chunk_sent(dedup, key)) {
+         sd->msglen = DEDUP_CHUNK_HDR_SIZE;
+         dedup->ref_chunks++;
+         dedup->ref_bytes += length;
+      } else {
+         memcpy(dedup->rec + DEDUP_CHUNK_HDR_SIZE, chunk, length);
+         sd->msglen = DEDUP_CHUNK_HDR_SIZE + length;
+      }
+      dedup->chunks++;
+
+      sd->msg = dedup->rec;
+      if (!sd->send()) {
+         if (!jcr->is_job_canceled()) {
+            Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"), sd->bstrerror());
+         }
+         sd->msg = bctx.msgsave;
+         return false;
+      }
+      sd->msg = bctx.msgsave;
+      jcr->JobBytes += sd->msglen;
+
+      bctx.fileAddr += length;
+      start += length;
+   }
+
+   sd->msglen = status;
+
+   return true;
+}
+
 /**
  * Send data read from an already open file descriptor.
  *
@@ -1205,13 +1855,25 @@ static int send_data(JCR *jcr, int stream, FF_PKT *ff_pkt,
       if (!send_encrypted_data(bctx)) {
          goto bail_out;
       }
+   } else if (stream == STREAM_DEDUP_DATA) {
+      if (!send_dedup_data(bctx)) {
+         goto bail_out;
+      }
    } else {
       if (!send_plain_data(bctx)) {
          goto bail_out;
       }
    }
 #else
-   if (!send_plain_data(bctx)) {
+   if (stream == STREAM_DEDUP_DATA) {
+      if (!send_dedup_data(bctx)) {
+         goto bail_out;
+      }
+   } else if (use_backup_pipeline(bctx)) {
+      if (!send_pipelined_data(bctx)) {
+         goto bail_out;
+      }
+   } else if (!send_plain_data(bctx)) {
       goto bail_out;
    }
 #endif
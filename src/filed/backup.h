@@ -60,4 +60,99 @@ struct b_ctx {
    DIGEST *signing_digest;      /* Signing Digest */
    CIPHER_CONTEXT *cipher_ctx;  /* Cipher context */
 };
+
+/*
+ * Backup data pipeline.
+ *
+ * The job thread reads the file data and updates the digests, a pool of
+ * worker threads compresses the blocks and a sender thread encrypts and
+ * sends the blocks in their original order to the Storage daemon.
+ */
+struct b_pipeline_block {
+   uint64_t seqnr;              /* Sequence number of block within the file */
+   POOLMEM *rbuf;               /* Read buffer (file address is stored in front) */
+   POOLMEM *cbuf;               /* Compression buffer (file address is stored in front) */
+   uint32_t data_len;           /* Length of the data read */
+   uint32_t compress_len;       /* Length after compression including any header */
+   bool failed;                 /* Processing of block failed */
+};
+
+struct b_pipeline;
+
+struct b_pipeline_worker {
+   b_pipeline *pl;              /* Pipeline this worker belongs to */
+   CMPRS_CTX cmprs_ctx;         /* Private compression context */
+   pthread_t thread_id;         /* Id of the compression thread */
+};
+
+struct b_pipeline {
+   JCR *jcr;                    /* Current Job Control Record */
+   b_ctx *bctx;                 /* Backup context of the file being sent */
+   int nr_workers;              /* Number of compression threads */
+   int nr_blocks;               /* Number of blocks in flight */
+   b_pipeline_block *blocks;    /* All blocks */
+   b_pipeline_block **pending;  /* Blocks waiting to be sent in order (sender thread only) */
+   b_pipeline_worker *workers;  /* Compression threads */
+   pthread_t sender_id;         /* Id of the sender thread */
+   circbuf *free_queue;         /* Blocks available for reading */
+   circbuf *work_queue;         /* Blocks waiting for compression */
+   circbuf *send_queue;         /* Blocks waiting to be sent */
+   uint32_t hdr_size;           /* Size of file address in front of data */
+   bool compress;               /* Compress the blocks of the current file */
+   uint64_t next_seqnr;         /* Next block to send (sender thread only) */
+   uint64_t submitted;          /* Blocks submitted for the current file */
+   uint64_t sent;               /* Blocks sent (or discarded) for the current file */
+   bool error;                  /* Sending the current file failed */
+   pthread_mutex_t lock;        /* Lock the structure */
+   pthread_cond_t drained;      /* Signalled when a block was sent */
+};
+
+/*
+ * Content defined chunking of deduplicated data.
+ *
+ * The data of a file is cut into chunks of variable size, each chunk is
+ * sent in a record of its own. A chunk that was already sent during the
+ * job is sent as a reference without its data when the Storage daemon
+ * keeps a chunk store.
+ */
+#define DEDUP_MIN_CHUNK (16 * 1024)  /* Minimum chunk size */
+#define DEDUP_AVG_CHUNK (64 * 1024)  /* Average chunk size */
+#define DEDUP_MAX_CHUNK (256 * 1024) /* Maximum chunk size */
+#define DEDUP_KEY_SIZE (CRYPTO_DIGEST_SHA1_SIZE + sizeof(uint32_t)) /* Digest and length of a chunk */
+
+struct b_dedup_chunk {
+   hlink link;                  /* Hash table link */
+   uint8_t key[DEDUP_KEY_SIZE]; /* Digest and length of the chunk */
+};
+
+struct b_dedup {
+   uint64_t gear[256];          /* Random values of the gear hash */
+   POOLMEM *buf;                /* Data read from the file */
+   uint32_t buf_size;           /* Size of the read buffer */
+   POOLMEM *rec;                /* Record sent to the Storage daemon */
+   htable *sent;                /* Chunks sent during the job, NULL without chunk store */
+   uint64_t chunks;             /* Number of chunks */
+   uint64_t ref_chunks;         /* Number of chunks sent as reference */
+   uint64_t ref_bytes;          /* Bytes of the chunks sent as reference */
+};
+
+#define SD_STREAM_SEND_QUEUE 16 /* Packets queued for the sender thread of a data connection */
+
+/*
+ * Data connections to the Storage daemon of a multi stream backup.
+ *
+ * Whole files are sent round robin over the connections. After each file
+ * a BNET_NEXT_STREAM signal tells the Storage daemon to continue reading
+ * on the next connection, so it receives the files in their original order.
+ * Each connection has a sender thread, so while one connection is still
+ * writing a file the next file already goes out on the next connection.
+ */
+struct b_streams {
+   char *addr;                  /* Address of the Storage daemon */
+   int port;                    /* Port of the Storage daemon */
+   char *auth_key;              /* Session key, destroyed once all connections are open */
+   int nr_streams;              /* Number of data connections including the primary one */
+   int current;                 /* Connection the current file is sent on */
+   BSOCK **socks;               /* Data connections, [0] is the primary connection */
+};
 #endif
@@ -32,7 +32,7 @@
 #include "bareos.h"
 #include "filed.h"
 
-#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ)
+#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD)
 
 #if defined(HAVE_LIBZ)
 #include <zlib.h>
@@ -42,6 +42,10 @@
 #include <fastlzlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
 /**
  * For compression we enable all used compressors in the fileset.
  */
@@ -91,6 +95,108 @@ bool adjust_decompression_buffers(JCR *jcr)
    return true;
 }
 
+/**
+ * Set the per file compression parameters on the workset of a compression context.
+ */
+bool setup_compression_workset_params(JCR *jcr,
+                                      CMPRS_CTX *cmprs_ctx,
+                                      uint32_t compression_algorithm,
+                                      uint32_t compression_level)
+{
+   switch (compression_algorithm) {
+#if defined(HAVE_LIBZ)
+   case COMPRESS_GZIP: {
+      z_stream *pZlibStream;
+
+      /**
+       * Only change zlib parameters if there is no pending operation.
+       * This should never happen as deflateReset is called after each
+       * deflate.
+       */
+      pZlibStream = (z_stream *)cmprs_ctx->workset.pZLIB;
+      if (pZlibStream->total_in == 0) {
+         int zstat;
+
+         /*
+          * Set gzip compression level - must be done per file
+          */
+         if ((zstat = deflateParams(pZlibStream, compression_level, Z_DEFAULT_STRATEGY)) != Z_OK) {
+            Jmsg(jcr, M_FATAL, 0, _("Compression deflateParams error: %d\n"), zstat);
+            jcr->setJobStatus(JS_ErrorTerminated);
+            return false;
+         }
+      }
+      break;
+   }
+#endif
+#if defined(HAVE_LZO)
+   case COMPRESS_LZO1X:
+      break;
+#endif
+#if defined(HAVE_FASTLZ)
+   case COMPRESS_FZFZ:
+   case COMPRESS_FZ4L:
+   case COMPRESS_FZ4H: {
+      int zstat;
+      zfast_stream *pZfastStream;
+      zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
+
+      /**
+       * Only change fastlz parameters if there is no pending operation.
+       * This should never happen as fastlzlibCompressReset is called after each
+       * fastlzlibCompress.
+       */
+      pZfastStream = (zfast_stream *)cmprs_ctx->workset.pZFAST;
+      if (pZfastStream->total_in == 0) {
+
+         switch (compression_algorithm) {
+         case COMPRESS_FZ4L:
+         case COMPRESS_FZ4H:
+            compressor = COMPRESSOR_LZ4;
+            break;
+         }
+
+         if ((zstat = fastlzlibSetCompressor(pZfastStream, compressor)) != Z_OK) {
+            Jmsg(jcr, M_FATAL, 0, _("Compression fastlzlibSetCompressor error: %d\n"), zstat);
+            jcr->setJobStatus(JS_ErrorTerminated);
+            return false;
+         }
+      }
+      break;
+   }
+#endif
+#if defined(HAVE_ZSTD)
+   case COMPRESS_ZSTD: {
+      size_t zstat;
+      ZSTD_CCtx *pZstdCtx;
+
+      /*
+       * Set zstd compression level and long distance matching - must be done per file.
+       * The parameters are sticky so the context can be reused for all blocks.
+       */
+      pZstdCtx = (ZSTD_CCtx *)cmprs_ctx->workset.pZSTD;
+      zstat = ZSTD_CCtx_setParameter(pZstdCtx, ZSTD_c_compressionLevel,
+                                     COMPRESS_ZSTD_LEVEL(compression_level));
+      if (!ZSTD_isError(zstat)) {
+         zstat = ZSTD_CCtx_setParameter(pZstdCtx, ZSTD_c_enableLongDistanceMatching,
+                                        (compression_level & COMPRESS_ZSTD_LONG) ? 1 : 0);
+      }
+
+      if (ZSTD_isError(zstat)) {
+         Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD_CCtx_setParameter error: %s\n"), ZSTD_getErrorName(zstat));
+         jcr->setJobStatus(JS_ErrorTerminated);
+         return false;
+      }
+      break;
+   }
+#endif
+   default:
+      break;
+   }
+
+   return true;
+}
+
 bool setup_compression_context(b_ctx &bctx)
 {
    bool retval = false;
@@ -138,72 +244,28 @@ bool setup_compression_context(b_ctx &bctx)
       }
 
       /*
-       * Do compression specific actions and set the magic, header version and compression level.
+       * Do compression specific actions and set the compression level.
        */
+      if (!setup_compression_workset_params(bctx.jcr, &bctx.jcr->compress,
+                                            bctx.ff_pkt->Compress_algo,
+                                            bctx.ff_pkt->Compress_level)) {
+         goto bail_out;
+      }
+
       switch (bctx.ff_pkt->Compress_algo) {
 #if defined(HAVE_LIBZ)
-      case COMPRESS_GZIP: {
-         z_stream *pZlibStream;
-
-         /**
-          * Only change zlib parameters if there is no pending operation.
-          * This should never happen as deflateReset is called after each
-          * deflate.
-          */
-         pZlibStream = (z_stream *)bctx.jcr->compress.workset.pZLIB;
-         if (pZlibStream->total_in == 0) {
-            int zstat;
-
-            /*
-             * Set gzip compression level - must be done per file
-             */
-            if ((zstat = deflateParams(pZlibStream, bctx.ff_pkt->Compress_level, Z_DEFAULT_STRATEGY)) != Z_OK) {
-               Jmsg(bctx.jcr, M_FATAL, 0, _("Compression deflateParams error: %d\n"), zstat);
-               bctx.jcr->setJobStatus(JS_ErrorTerminated);
-               goto bail_out;
-            }
-         }
-         bctx.ch.level = bctx.ff_pkt->Compress_level;
-         break;
-     }
-#endif
-#if defined(HAVE_LZO)
-      case COMPRESS_LZO1X:
-         break;
+      case COMPRESS_GZIP:
 #endif
 #if defined(HAVE_FASTLZ)
       case COMPRESS_FZFZ:
       case COMPRESS_FZ4L:
-      case COMPRESS_FZ4H: {
-         int zstat;
-         zfast_stream *pZfastStream;
-         zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
-
-         /**
-          * Only change fastlz parameters if there is no pending operation.
-          * This should never happen as fastlzlibCompressReset is called after each
-          * fastlzlibCompress.
-          */
-         pZfastStream = (zfast_stream *)bctx.jcr->compress.workset.pZFAST;
-         if (pZfastStream->total_in == 0) {
-
-            switch (bctx.ff_pkt->Compress_algo) {
-            case COMPRESS_FZ4L:
-            case COMPRESS_FZ4H:
-               compressor = COMPRESSOR_LZ4;
-               break;
-            }
-
-            if ((zstat = fastlzlibSetCompressor(pZfastStream, compressor)) != Z_OK) {
-               Jmsg(bctx.jcr, M_FATAL, 0, _("Compression fastlzlibSetCompressor error: %d\n"), zstat);
-               bctx.jcr->setJobStatus(JS_ErrorTerminated);
-               goto bail_out;
-            }
-         }
+      case COMPRESS_FZ4H:
+#endif
+#if defined(HAVE_ZSTD)
+      case COMPRESS_ZSTD:
+#endif
          bctx.ch.level = bctx.ff_pkt->Compress_level;
          break;
-      }
-#endif
       default:
          break;
       }
@@ -222,8 +284,16 @@ bool adjust_compression_buffers(JCR *jcr)
    return true;
 }
 
+bool setup_compression_workset_params(JCR *jcr,
+                                      CMPRS_CTX *cmprs_ctx,
+                                      uint32_t compression_algorithm,
+                                      uint32_t compression_level)
+{
+   return true;
+}
+
 bool setup_compression_context(b_ctx &bctx)
 {
    return true;
 }
-#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) */
+#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD) */
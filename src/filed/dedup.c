@@ -0,0 +1,149 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Content defined chunking of the data of files that are backed up
+ * with deduplication.
+ *
+ * The chunk boundaries are found with a gear hash (FastCDC). The hash
+ * of the last 64 bytes decides about a boundary, so data inserted into
+ * a file only changes the chunks around the insertion and the chunks
+ * after it are found again. Normalized chunking uses a stricter mask
+ * below and a looser mask above the average chunk size, which keeps
+ * most chunks close to the average size.
+ */
+
+#include "bareos.h"
+#include "filed/filed.h"
+
+/*
+ * Masks of the most significant bits of the gear hash, the hash of the
+ * last 64 bytes shifts through these bits.
+ */
+#define DEDUP_MASK_SMALL 0xffffc00000000000ULL /* 18 bits, before the average size */
+#define DEDUP_MASK_LARGE 0xfffc000000000000ULL /* 14 bits, after the average size */
+
+/**
+ * Setup the deduplication context of a backup. The chunks sent are only
+ * remembered when the Storage daemon keeps a chunk store, otherwise every
+ * chunk must be sent with its data.
+ */
+b_dedup *new_dedup_context(JCR *jcr)
+{
+   b_dedup *dedup;
+   b_dedup_chunk *chunk = NULL;
+   uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+   dedup = (b_dedup *)malloc(sizeof(b_dedup));
+   memset(dedup, 0, sizeof(b_dedup));
+
+   /*
+    * The values of the gear table must never change, the chunk boundaries
+    * of a file depend on them. They are generated with splitmix64.
+    */
+   for (int i = 0; i < 256; i++) {
+      uint64_t z;
+
+      seed += 0x9e3779b97f4a7c15ULL;
+      z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      dedup->gear[i] = z ^ (z >> 31);
+   }
+
+   dedup->buf_size = 2 * DEDUP_MAX_CHUNK;
+   dedup->buf = get_memory(dedup->buf_size);
+   dedup->rec = get_memory(DEDUP_CHUNK_HDR_SIZE + DEDUP_MAX_CHUNK);
+
+   if (jcr->sd_dedup) {
+      dedup->sent = (htable *)malloc(sizeof(htable));
+      dedup->sent->init(chunk, &chunk->link, 1024);
+   }
+
+   return dedup;
+}
+
+void free_dedup_context(b_dedup *dedup)
+{
+   if (dedup->sent) {
+      dedup->sent->destroy();
+      free(dedup->sent);
+   }
+   free_pool_memory(dedup->buf);
+   free_pool_memory(dedup->rec);
+   free(dedup);
+}
+
+/**
+ * Return the length of the next chunk of the data. Unless the data ends
+ * there, the caller must pass at least DEDUP_MAX_CHUNK bytes.
+ */
+uint32_t dedup_find_chunk(b_dedup *dedup, const char *data, uint32_t length)
+{
+   uint32_t i, normal, end;
+   uint64_t fp = 0;
+   const uint8_t *p = (const uint8_t *)data;
+
+   if (length <= DEDUP_MIN_CHUNK) {
+      return length;
+   }
+
+   end = MIN(length, (uint32_t)DEDUP_MAX_CHUNK);
+   normal = MIN(end, (uint32_t)DEDUP_AVG_CHUNK);
+
+   for (i = DEDUP_MIN_CHUNK; i < normal; i++) {
+      fp = (fp << 1) + dedup->gear[p[i]];
+      if (!(fp & DEDUP_MASK_SMALL)) {
+         return i + 1;
+      }
+   }
+
+   for (; i < end; i++) {
+      fp = (fp << 1) + dedup->gear[p[i]];
+      if (!(fp & DEDUP_MASK_LARGE)) {
+         return i + 1;
+      }
+   }
+
+   return end;
+}
+
+/**
+ * Remember that a chunk was sent to the Storage daemon. Returns true
+ * when it was sent before, so a reference to the chunk is enough.
+ */
+bool dedup_chunk_sent(b_dedup *dedup, const uint8_t *key)
+{
+   b_dedup_chunk *chunk;
+
+   if (!dedup->sent) {
+      return false;
+   }
+
+   if (dedup->sent->lookup((uint8_t *)key, DEDUP_KEY_SIZE)) {
+      return true;
+   }
+
+   chunk = (b_dedup_chunk *)dedup->sent->hash_malloc(sizeof(b_dedup_chunk));
+   memcpy(chunk->key, key, DEDUP_KEY_SIZE);
+   dedup->sent->insert(chunk->key, DEDUP_KEY_SIZE, chunk);
+
+   return false;
+}
@@ -105,6 +105,9 @@ static bool response(JCR *jcr, BSOCK *sd, char *resp, const char *cmd);
 static void filed_free_jcr(JCR *jcr);
 static bool open_sd_read_session(JCR *jcr);
 static void set_storage_auth_key(JCR *jcr, char *key);
+static void setup_sd_data_streams(JCR *jcr, char *addr, int port);
+static int open_sd_data_streams(JCR *jcr, int nr_streams);
+static void free_sd_data_streams(JCR *jcr);
 
 /* Exported functions */
 
@@ -294,6 +297,10 @@ static char OK_close[] =
    "3000 OK close Status = %d\n";
 static char OK_open[] =
    "3000 OK open ticket = %d\n";
+static char OK_open_streams[] =
+   "3000 OK open ticket = %d streams=%d\n";
+static char OK_open_dedup[] =
+   "3000 OK open ticket = %d streams=%d dedup=%d\n";
 static char OK_data[] =
    "3000 OK data\n";
 static char OK_append[] =
@@ -306,6 +313,8 @@ static char append_open[] =
    "append open session\n";
 static char append_data[] =
    "append data %d\n";
+static char append_data_streams[] =
+   "append data %d streams=%d\n";
 static char append_end[] =
    "append end session %d\n";
 static char append_close[] =
@@ -450,6 +459,7 @@ JCR *create_new_director_session(BSOCK *dir)
    jcr = new_jcr(sizeof(JCR), filed_free_jcr); /* create JCR */
    jcr->dir_bsock = dir;
    jcr->ff = init_find_files();
+   set_find_prefetch_workers(jcr->ff, me->find_prefetch_workers);
    jcr->start_time = time(NULL);
    jcr->RunScripts = New(alist(10, not_owned_by_alist));
    jcr->last_fname = get_pool_memory(PM_FNAME);
@@ -1719,6 +1729,13 @@ static bool storage_cmd(JCR *jcr)
 
    jcr->store_bsock = sd;
 
+   /*
+    * Remember how to reach the SD, a backup may open more data connections.
+    */
+   if (me->network_data_streams > 1) {
+      setup_sd_data_streams(jcr, stored_addr, stored_port);
+   }
+
    sd->fsend("Hello Start Job %s\n", jcr->Job);
    if (!authenticate_with_storagedaemon(jcr)) {
       Jmsg(jcr, M_FATAL, 0, _("Failed to authenticate Storage daemon.\n"));
@@ -1736,6 +1753,116 @@ bail_out:
    return false;
 }
 
+/**
+ * Keep the address of the Storage daemon and the session key for opening
+ * the additional data connections of a multi stream backup.
+ */
+static void setup_sd_data_streams(JCR *jcr, char *addr, int port)
+{
+   b_streams *streams;
+
+   free_sd_data_streams(jcr);
+
+   streams = (b_streams *)malloc(sizeof(b_streams));
+   memset(streams, 0, sizeof(b_streams));
+   streams->addr = bstrdup(addr);
+   streams->port = port;
+   streams->auth_key = bstrdup(jcr->sd_auth_key);
+   streams->nr_streams = 1;
+   jcr->sd_streams = streams;
+}
+
+/**
+ * Open the additional data connections to the Storage daemon.
+ *
+ * Returns the number of data connections including the primary one,
+ * a connection that cannot be opened is left out.
+ */
+static int open_sd_data_streams(JCR *jcr, int nr_streams)
+{
+   int i;
+   BSOCK *sd;
+   b_streams *streams = jcr->sd_streams;
+
+   streams->socks = (BSOCK **)malloc(nr_streams * sizeof(BSOCK *));
+   streams->socks[0] = jcr->store_bsock;
+   streams->nr_streams = 1;
+
+   for (i = 1; i < nr_streams; i++) {
+      sd = New(BSOCK_TCP);
+      if (me->nokeepalive) {
+         sd->clear_keepalive();
+      }
+      sd->set_source_address(me->FDsrc_addr);
+      if (me->allow_bw_bursting) {
+         sd->set_bwlimit_bursting();
+      }
+
+      if (!sd->connect(jcr, 1, 10, me->heartbeat_interval, _("Storage daemon"),
+                       streams->addr, NULL, streams->port, 0)) {
+         delete sd;
+         break;
+      }
+
+      sd->fsend("Hello Start Job %s Stream %d\n", jcr->Job, i);
+      if (!authenticate_with_storagedaemon_stream(jcr, sd, streams->auth_key)) {
+         sd->close();
+         delete sd;
+         break;
+      }
+      sd->set_jcr(jcr);
+
+      streams->socks[streams->nr_streams++] = sd;
+   }
+
+   if (streams->nr_streams < nr_streams) {
+      Jmsg(jcr, M_WARNING, 0, _("Could only open %d of %d data connections to the Storage daemon.\n"),
+           streams->nr_streams, nr_streams);
+   }
+
+   /*
+    * Share the bandwidth limit of the job between the data connections.
+    */
+   if (jcr->max_bandwidth) {
+      for (i = 0; i < streams->nr_streams; i++) {
+         streams->socks[i]->set_bwlimit(jcr->max_bandwidth / streams->nr_streams);
+      }
+   }
+
+   Dmsg1(110, "Opened %d data connections to SD.\n", streams->nr_streams);
+
+   return streams->nr_streams;
+}
+
+/**
+ * Close the additional data connections to the Storage daemon and destroy
+ * the session key. The primary connection is closed with the jcr.
+ */
+static void free_sd_data_streams(JCR *jcr)
+{
+   b_streams *streams = jcr->sd_streams;
+
+   if (!streams) {
+      return;
+   }
+
+   if (streams->socks) {
+      for (int i = 1; i < streams->nr_streams; i++) {
+         streams->socks[i]->close();
+         delete streams->socks[i];
+      }
+      free(streams->socks);
+   }
+
+   if (streams->auth_key) {
+      memset(streams->auth_key, 0, strlen(streams->auth_key));
+      free(streams->auth_key);
+   }
+   free(streams->addr);
+   free(streams);
+   jcr->sd_streams = NULL;
+}
+
 /**
  * Clear a flag in the find options.
  *
@@ -1804,6 +1931,10 @@ static inline void clear_compression_flag_in_fileset(JCR *jcr)
                case COMPRESS_FZ4L:
                case COMPRESS_FZ4H:
                   break;
+#endif
+#if defined(HAVE_ZSTD)
+               case COMPRESS_ZSTD:
+                  break;
 #endif
                default:
                   /*
@@ -1912,6 +2043,7 @@ static bool backup_cmd(JCR *jcr)
 {
    int ok = 0;
    int SDJobStatus;
+   int nr_streams = 1;
    int32_t FileIndex;
    BSOCK *dir = jcr->dir_bsock;
    BSOCK *sd = jcr->store_bsock;
@@ -2005,10 +2137,43 @@ static bool backup_cmd(JCR *jcr)
       goto cleanup;
    }
 
+   /**
+    * See if the Storage daemon keeps a chunk store for deduplicated data.
+    */
+   {
+      int ticket, max_streams, dedup;
+
+      if (sscanf(sd->msg, OK_open_dedup, &ticket, &max_streams, &dedup) == 3) {
+         jcr->sd_dedup = dedup != 0;
+      }
+   }
+
+   /**
+    * Open more data connections when the Storage daemon allows them.
+    */
+   if (jcr->sd_streams) {
+      int ticket, max_streams;
+
+      if (sscanf(sd->msg, OK_open_streams, &ticket, &max_streams) == 2 && max_streams > 1) {
+         nr_streams = open_sd_data_streams(jcr, MIN((int)me->network_data_streams, max_streams));
+      }
+      if (nr_streams > 1) {
+         memset(jcr->sd_streams->auth_key, 0, strlen(jcr->sd_streams->auth_key));
+         free(jcr->sd_streams->auth_key);
+         jcr->sd_streams->auth_key = NULL;
+      } else {
+         free_sd_data_streams(jcr);
+      }
+   }
+
    /**
     * Send Append data command to Storage daemon
     */
-   sd->fsend(append_data, jcr->Ticket);
+   if (nr_streams > 1) {
+      sd->fsend(append_data_streams, jcr->Ticket, nr_streams);
+   } else {
+      sd->fsend(append_data, jcr->Ticket);
+   }
    Dmsg1(110, ">stored: %s", sd->msg);
 
    /**
@@ -2579,6 +2744,8 @@ static void filed_free_jcr(JCR *jcr)
    }
 #endif
 
+   free_sd_data_streams(jcr);
+
    if (jcr->store_bsock) {
       jcr->store_bsock->close();
       delete jcr->store_bsock;
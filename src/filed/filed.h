@@ -36,6 +36,7 @@
 #endif
 #include "jcr.h"
 #include "lib/breg.h"
+#include "lib/cbuf.h"
 #include "lib/htable.h"
 #include "lib/runscript.h"
 #include "findlib/find.h"
@@ -52,7 +53,14 @@ void terminate_filed(int sig);
 
 /*
  * File Daemon protocol version
+ *
+ * Version 55 means we accept the zlib compressed binary accurate list,
+ * so only announce it when we can inflate it.
  */
+#ifdef HAVE_LIBZ
+const int FD_PROTOCOL_VERSION = 55;
+#else
 const int FD_PROTOCOL_VERSION = 54;
+#endif
 
 #endif /* __FILED_H_ */
@@ -120,6 +120,20 @@ static RES_ITEM cli_items[] = {
    { "AbsoluteJobTimeout", CFG_TYPE_PINT32, ITEM(res_client.jcr_watchdog_time), 0, 0, NULL, NULL, NULL },
    { "AlwaysUseLmdb", CFG_TYPE_BOOL, ITEM(res_client.always_use_lmdb), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "LmdbThreshold", CFG_TYPE_PINT32, ITEM(res_client.lmdb_threshold), 0, 0, NULL, NULL, NULL },
+   { "CompactAccurateTable", CFG_TYPE_BOOL, ITEM(res_client.compact_accurate_table), 0, CFG_ITEM_DEFAULT, "false", "17.2.4-",
+     "Keep the in memory accurate data packed in a few large memory arenas instead of a hash table with separately allocated entries. This uses less memory, but lookups are slower." },
+   { "BackupPipelineWorkers", CFG_TYPE_PINT32, ITEM(res_client.backup_pipeline_workers), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Number of threads compressing file data in parallel while the job thread reads and a sender thread transmits the data. 0 disables the backup pipeline." },
+   { "NetworkWriteCoalescingSize", CFG_TYPE_SIZE32, ITEM(res_client.network_write_coalescing_size), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Collect the small messages of a backup (stream headers, attributes, digests, end of data) in a buffer of this size and send them to the Storage Daemon with one write. The buffer is sent when it is full, at the end of the backup and when a message arrives 100 ms or more after the oldest one in it, so while the File Daemon sends nothing (e.g. reading a slow file system) the messages stay in the buffer. 0 (default) sends every message on its own." },
+   { "NetworkCompression", CFG_TYPE_BOOL, ITEM(res_client.network_compression), 0, CFG_ITEM_DEFAULT, "false", "17.2.4-",
+     "Offer to compress the data sent between this File Daemon and the Storage Daemon. The data is only compressed on the network when the Storage Daemon enables it too." },
+   { "NetworkDataStreams", CFG_TYPE_PINT32, ITEM(res_client.network_data_streams), 0, CFG_ITEM_DEFAULT, "1", "17.2.4-",
+     "Number of network connections a backup sends its data to the Storage Daemon over. Whole files are spread over the connections, which helps to fill links with a high latency. Used only when the File Daemon connects to the Storage Daemon and the Storage Daemon allows it (Maximum Network Data Streams)." },
+   { "FindPrefetchWorkers", CFG_TYPE_PINT32, ITEM(res_client.find_prefetch_workers), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Number of threads reading directory listings and stat info of upcoming directories ahead of the backup. 0 disables prefetching." },
+   { "RestoreWriterThreads", CFG_TYPE_PINT32, ITEM(res_client.restore_writer_threads), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Number of threads writing the files of a restore in parallel. The records of each file go to one thread, directory attributes are set at the end of the restore. Plugin restores, encrypted or signed data and Windows backup streams are always restored by the job thread. 0 disables parallel writing." },
    { "SecureEraseCommand", CFG_TYPE_STR, ITEM(res_client.secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
      "Specify command that will be called when bareos unlinks files." },
    { "LogTimestampFormat", CFG_TYPE_STR, ITEM(res_client.log_timestamp_format), 0, 0, NULL, "15.2.3-", NULL },
@@ -93,6 +93,13 @@ public:
    bool nokeepalive;                  /* Don't use SO_KEEPALIVE on sockets */
    bool always_use_lmdb;              /* Use LMDB for accurate data */
    uint32_t lmdb_threshold;           /* Switch to using LDMD when number of accurate entries exceeds treshold. */
+   bool compact_accurate_table;       /* Use the compact arena storage for in memory accurate data */
+   uint32_t backup_pipeline_workers;  /* Number of compression threads in the backup data pipeline, 0 = disabled */
+   uint32_t find_prefetch_workers;    /* Number of directory prefetch threads, 0 = disabled */
+   uint32_t restore_writer_threads;   /* Number of threads writing restored files, 0 = disabled */
+   uint32_t network_write_coalescing_size; /* Size of the FD->SD write coalescing buffer, 0 = disabled */
+   bool network_compression;          /* Offer network compression to the SD */
+   uint32_t network_data_streams;     /* Number of data connections to the SD for a backup */
    X509_KEYPAIR *pki_keypair;         /* Shared PKI Public/Private Keypair */
    alist *pki_signers;                /* Shared PKI Trusted Signers */
    alist *pki_recipients;             /* Shared PKI Recipients */
@@ -683,6 +683,9 @@ static int set_options(findFOPTS *fo, const char *opts)
       case 'p':                         /* Use portable data format */
          set_bit(FO_PORTABLE, fo->flags);
          break;
+      case 'Q':                         /* Deduplicate the data */
+         set_bit(FO_DEDUP, fo->flags);
+         break;
       case 'R':                         /* Resource forks and Finder Info */
          set_bit(FO_HFSPLUS, fo->flags);
          break;
@@ -740,6 +743,18 @@ static int set_options(findFOPTS *fo, const char *opts)
       case 'x':
          set_bit(FO_NO_AUTOEXCL, fo->flags);
          break;
+      case 'Y':                         /* I/O mode */
+         switch(*(p + 1)) {
+         case 'c':
+            set_bit(FO_IO_NOCACHE, fo->flags);
+            p++;
+            break;
+         case 'd':
+            set_bit(FO_IO_DIRECT, fo->flags);
+            p++;
+            break;
+         }
+         break;
       case 'X':
          set_bit(FO_XATTR, fo->flags);
          break;
@@ -768,6 +783,17 @@ static int set_options(findFOPTS *fo, const char *opts)
                fo->Compress_algo = COMPRESS_FZ4H;
                fo->Compress_level = 1;     /* not used with FZ4H */
             }
+         } else if ((*p == 's' || *p == 'l') && B_ISDIGIT(p[1]) && B_ISDIGIT(p[2])) {
+            /*
+             * ZSTD is followed by a two digit compression level, 'l' selects long distance matching.
+             */
+            set_bit(FO_COMPRESS, fo->flags);
+            fo->Compress_algo = COMPRESS_ZSTD;
+            fo->Compress_level = (p[1] - '0') * 10 + (p[2] - '0');
+            if (*p == 'l') {
+               fo->Compress_level |= COMPRESS_ZSTD_LONG;
+            }
+            p += 2;                     /* Skip level */
          }
          break;
       case 'z':                         /* Min, max or approx size or size range */
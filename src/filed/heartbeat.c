@@ -55,9 +55,13 @@ extern "C" void *sd_heartbeat_thread(void *arg)
    pthread_detach(pthread_self());
 
    /*
-    * Get our own local copy
+    * Get our own local copy, of the primary connection of a multi stream backup
     */
-   sd = jcr->store_bsock->clone();
+   if (jcr->sd_streams && jcr->sd_streams->socks) {
+      sd = jcr->sd_streams->socks[0]->clone();
+   } else {
+      sd = jcr->store_bsock->clone();
+   }
    dir = jcr->dir_bsock->clone();
 
    jcr->hb_bsock = sd;
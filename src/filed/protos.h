@@ -38,6 +38,7 @@ bool authenticate_director(JCR *jcr);
 bool authenticate_with_director(JCR *jcr, DIRRES *director);
 bool authenticate_storagedaemon(JCR *jcr);
 bool authenticate_with_storagedaemon(JCR *jcr);
+bool authenticate_with_storagedaemon_stream(JCR *jcr, BSOCK *sd, char *auth_key);
 
 /* backup.c */
 bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher);
@@ -48,6 +49,9 @@ void unstrip_path(FF_PKT *ff_pkt);
 /* compression.c */
 bool adjust_compression_buffers(JCR *jcr);
 bool adjust_decompression_buffers(JCR *jcr);
+bool setup_compression_workset_params(JCR *jcr, CMPRS_CTX *cmprs_ctx,
+                                      uint32_t compression_algorithm,
+                                      uint32_t compression_level);
 bool setup_compression_context(b_ctx &bctx);
 
 /* crypto.c */
@@ -64,6 +68,12 @@ bool setup_decryption_context(r_ctx &rctx, RESTORE_CIPHER_CTX &rcctx);
 bool encrypt_data(b_ctx *bctx, bool *need_more_data);
 bool decrypt_data(JCR *jcr, char **data, uint32_t *length, RESTORE_CIPHER_CTX *cipher_ctx);
 
+/* dedup.c */
+b_dedup *new_dedup_context(JCR *jcr);
+void free_dedup_context(b_dedup *dedup);
+uint32_t dedup_find_chunk(b_dedup *dedup, const char *data, uint32_t length);
+bool dedup_chunk_sent(b_dedup *dedup, const uint8_t *key);
+
 /* dir_cmd.c */
 JCR *create_new_director_session(BSOCK *dir);
 void *process_director_commands(JCR *jcr, BSOCK *dir);
@@ -96,6 +106,7 @@ void do_restore(JCR *jcr);
 void free_session(r_ctx &rctx);
 int do_file_digest(JCR *jcr, FF_PKT *ff_pkt, bool top_level);
 bool sparse_data(JCR *jcr, BFILE *bfd, uint64_t *addr, char **data, uint32_t *length);
+bool dedup_chunk_data(JCR *jcr, const char *fname, char **data, uint32_t *length);
 bool store_data(JCR *jcr, BFILE *bfd, char *data, const int32_t length, bool win32_decomp);
 
 /* sd_cmds.c */
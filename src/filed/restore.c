@@ -87,6 +87,11 @@ const bool have_fastlz = true;
 #else
 const bool have_fastlz = false;
 #endif
+#if defined(HAVE_ZSTD)
+const bool have_zstd = true;
+#else
+const bool have_zstd = false;
+#endif
 
 static void free_signature(r_ctx &rctx);
 static bool close_previous_stream(JCR *jcr, r_ctx &rctx);
@@ -164,23 +169,23 @@ static inline void drop_delayed_data_streams(r_ctx &rctx, bool reuse)
 }
 
 /**
- * Push a data stream onto the delayed restore stack for later processing.
+ * Push a data stream onto a delayed restore stack for later processing.
  */
-static inline void push_delayed_data_stream(r_ctx &rctx, BSOCK *sd)
+static inline void push_delayed_data_stream(alist **delayed_streams, int32_t stream, BSOCK *sd)
 {
    DELAYED_DATA_STREAM *dds;
 
-   if (!rctx.delayed_streams) {
-      rctx.delayed_streams = New(alist(10, owned_by_alist));
+   if (!*delayed_streams) {
+      *delayed_streams = New(alist(10, owned_by_alist));
    }
 
    dds = (DELAYED_DATA_STREAM *)malloc(sizeof(DELAYED_DATA_STREAM));
-   dds->stream = rctx.stream;
+   dds->stream = stream;
    dds->content = (char *)malloc(sd->msglen);
    memcpy(dds->content, sd->msg, sd->msglen);
    dds->content_length = sd->msglen;
 
-   rctx.delayed_streams->append(dds);
+   (*delayed_streams)->append(dds);
 }
 
 /**
@@ -370,6 +375,465 @@ bail_out:
    return false;
 }
 
+/**
+ * Duplicate the attributes of a file, the original is reused for the next file.
+ */
+static ATTR *dup_attr(JCR *jcr, ATTR *attr)
+{
+   ATTR *copy;
+
+   copy = new_attr(jcr);
+   copy->stream = attr->stream;
+   copy->data_stream = attr->data_stream;
+   copy->type = attr->type;
+   copy->file_index = attr->file_index;
+   copy->LinkFI = attr->LinkFI;
+   copy->delta_seq = attr->delta_seq;
+   copy->uid = attr->uid;
+   memcpy(&copy->statp, &attr->statp, sizeof(copy->statp));
+   pm_strcpy(copy->attrEx, attr->attrEx);
+   pm_strcpy(copy->ofname, attr->ofname);
+   pm_strcpy(copy->olname, attr->olname);
+
+   return copy;
+}
+
+/**
+ * Create a file, serialized with the writer threads as both change the umask.
+ */
+static inline int restore_create_file(JCR *jcr, r_ctx &rctx, ATTR *attr)
+{
+   int status;
+
+   if (rctx.writers) {
+      P(rctx.writers->attr_lock);
+   }
+   status = create_file(jcr, attr, &rctx.bfd, jcr->replace);
+   if (rctx.writers) {
+      V(rctx.writers->attr_lock);
+   }
+
+   return status;
+}
+
+/**
+ * Set the attributes of a file, serialized with the writer threads as both change the umask.
+ */
+static inline void restore_set_attributes(JCR *jcr, r_ctx &rctx, ATTR *attr)
+{
+   if (rctx.writers) {
+      P(rctx.writers->attr_lock);
+   }
+   set_attributes(jcr, attr, &rctx.bfd);
+   if (rctx.writers) {
+      V(rctx.writers->attr_lock);
+   }
+}
+
+static inline void free_writer_file(r_writer_file *file)
+{
+   free_attr(file->attr);
+   free(file);
+}
+
+/**
+ * Write a record in a writer thread, like extract_data() for unencrypted data.
+ */
+static inline bool writer_extract_data(r_writer *writer, r_writer_file *file, r_writer_record *rec)
+{
+   r_writers *wr = writer->wr;
+   JCR *jcr = wr->jcr;
+   char *wbuf = rec->data;
+   uint32_t wsize = rec->data_len;
+   char ec1[50];
+
+   if (bit_is_set(FO_SPARSE, file->flags)) {
+      uint64_t faddr;
+
+      unser_declare;
+      unser_begin(wbuf, OFFSET_FADDR_SIZE);
+      unser_uint64(faddr);
+      if (file->fileAddr != faddr) {
+         file->fileAddr = faddr;
+         if (blseek(&file->bfd, (boffset_t)faddr, SEEK_SET) < 0) {
+            berrno be;
+            Jmsg3(jcr, M_ERROR, 0, _("Seek to %s error on %s: ERR=%s\n"),
+                  edit_uint64(faddr, ec1), file->attr->ofname, be.bstrerror(file->bfd.berrno));
+            return false;
+         }
+      }
+      wbuf += OFFSET_FADDR_SIZE;
+      wsize -= OFFSET_FADDR_SIZE;
+   }
+
+   if (bit_is_set(FO_DEDUP, file->flags)) {
+      if (!dedup_chunk_data(jcr, file->attr->ofname, &wbuf, &wsize)) {
+         return false;
+      }
+   }
+
+   if (bit_is_set(FO_COMPRESS, file->flags)) {
+      if (!decompress_data(jcr, &writer->cmprs_ctx, file->attr->ofname, file->stream,
+                           &wbuf, &wsize, false)) {
+         return false;
+      }
+   }
+
+   if (bwrite(&file->bfd, wbuf, wsize) != (ssize_t)wsize) {
+      berrno be;
+      Jmsg2(jcr, M_ERROR, 0, _("Write error on %s: %s\n"),
+            file->attr->ofname, be.bstrerror(file->bfd.berrno));
+      return false;
+   }
+   file->fileAddr += wsize;
+
+   P(wr->lock);
+   jcr->JobBytes += wsize;
+   V(wr->lock);
+
+   return true;
+}
+
+/**
+ * Close a file and set its attributes in a writer thread.
+ */
+static inline void close_writer_file(r_writer *writer, r_writer_file *file)
+{
+   r_writers *wr = writer->wr;
+
+   if (file->failed) {
+      bclose(&file->bfd);
+   } else {
+      P(wr->attr_lock);
+      set_attributes(wr->jcr, file->attr, &file->bfd);
+      V(wr->attr_lock);
+   }
+
+   P(wr->lock);
+   writer->nr_files--;
+   if (file->wait) {
+      file->done = true;
+      pthread_cond_broadcast(&wr->file_done);
+      V(wr->lock);
+   } else {
+      V(wr->lock);
+      free_writer_file(file);
+   }
+}
+
+/**
+ * Writer thread, writes the records of the files assigned to it.
+ */
+static void *restore_writer(void *arg)
+{
+   r_writer *writer = (r_writer *)arg;
+   r_writers *wr = writer->wr;
+   r_writer_record *rec;
+
+   while ((rec = (r_writer_record *)writer->queue->dequeue())) {
+      r_writer_file *file = rec->file;
+
+      if (rec->data_len == 0) {
+         close_writer_file(writer, file);
+      } else if (!file->failed && !writer_extract_data(writer, file, rec)) {
+         file->failed = true;
+      }
+      wr->free_queue->enqueue(rec);
+   }
+
+   return NULL;
+}
+
+/**
+ * Hand the file being restored to the writer with the fewest files queued.
+ * Returns false when the file must be restored by the job thread.
+ */
+static inline bool start_writer_file(JCR *jcr, r_ctx &rctx)
+{
+   int i, writer;
+   r_writer_file *file;
+   r_writers *wr = rctx.writers;
+
+   if (!wr || jcr->is_plugin() || rctx.cs ||
+       bit_is_set(FO_ENCRYPT, rctx.flags) ||
+       bit_is_set(FO_WIN32DECOMP, rctx.flags) ||
+       is_win32_stream(rctx.stream)) {
+      return false;
+   }
+
+   file = (r_writer_file *)malloc(sizeof(r_writer_file));
+   memset(file, 0, sizeof(r_writer_file));
+   memcpy(&file->bfd, &rctx.bfd, sizeof(BFILE));
+   binit(&rctx.bfd);
+   file->attr = dup_attr(jcr, rctx.attr);
+   file->fileAddr = rctx.fileAddr;
+   file->stream = rctx.stream;
+   memcpy(file->flags, rctx.flags, sizeof(file->flags));
+
+   P(wr->lock);
+   writer = 0;
+   for (i = 1; i < wr->nr_writers; i++) {
+      if (wr->writers[i].nr_files < wr->writers[writer].nr_files) {
+         writer = i;
+      }
+   }
+   wr->writers[writer].nr_files++;
+   V(wr->lock);
+
+   file->writer = writer;
+   rctx.writer_file = file;
+
+   return true;
+}
+
+/**
+ * Queue a data record of the current file for its writer. The record buffer
+ * is swapped with the socket buffer so the data is not copied.
+ */
+static inline void queue_writer_record(JCR *jcr, r_ctx &rctx, BSOCK *sd)
+{
+   POOLMEM *data;
+   r_writer_record *rec;
+   r_writers *wr = rctx.writers;
+
+   if (sd->msglen <= 0) {
+      return;
+   }
+
+   rec = (r_writer_record *)wr->free_queue->dequeue();
+   rec->file = rctx.writer_file;
+   data = rec->data;
+   rec->data = sd->msg;
+   rec->data_len = sd->msglen;
+   sd->msg = data;
+   jcr->ReadBytes += rec->data_len;
+
+   wr->writers[rec->file->writer].queue->enqueue(rec);
+}
+
+/**
+ * Tell the writer of the current file to close it. We only wait for the
+ * writer when delayed streams must be restored after the attributes are set.
+ */
+static inline void finish_writer_file(r_ctx &rctx)
+{
+   bool wait;
+   r_writer_record *rec;
+   r_writers *wr = rctx.writers;
+   r_writer_file *file = rctx.writer_file;
+
+   /*
+    * Unless we wait for it the writer frees the file once it is closed.
+    */
+   wait = rctx.delayed_streams && !rctx.delayed_streams->empty();
+   file->wait = wait;
+   rctx.writer_file = NULL;
+
+   rec = (r_writer_record *)wr->free_queue->dequeue();
+   rec->file = file;
+   rec->data_len = 0;
+   wr->writers[file->writer].queue->enqueue(rec);
+
+   if (wait) {
+      P(wr->lock);
+      while (!file->done) {
+         pthread_cond_wait(&wr->file_done, &wr->lock);
+      }
+      V(wr->lock);
+      free_writer_file(file);
+   }
+}
+
+/**
+ * Remember a directory for the final pass that sets the directory attributes.
+ */
+static inline void defer_directory(JCR *jcr, r_ctx &rctx, ATTR *attr)
+{
+   r_deferred_dir *dir;
+
+   dir = (r_deferred_dir *)malloc(sizeof(r_deferred_dir));
+   memset(dir, 0, sizeof(r_deferred_dir));
+   dir->attr = dup_attr(jcr, attr);
+   rctx.writers->deferred_dirs->append(dir);
+   rctx.deferred_dir = dir;
+}
+
+static inline void free_deferred_dir(r_deferred_dir *dir)
+{
+   DELAYED_DATA_STREAM *dds;
+
+   if (dir->delayed_streams) {
+      foreach_alist(dds, dir->delayed_streams) {
+         free(dds->content);
+      }
+      delete dir->delayed_streams;
+   }
+   free_attr(dir->attr);
+   free(dir);
+}
+
+/**
+ * Set the attributes of all deferred directories in the order they were
+ * received, which restores the innermost directories first.
+ */
+static inline bool apply_deferred_dirs(JCR *jcr, r_ctx &rctx)
+{
+   bool ok = true;
+   r_deferred_dir *dir;
+   alist *delayed_streams = rctx.delayed_streams;
+
+   foreach_alist(dir, rctx.writers->deferred_dirs) {
+      if (!ok || job_canceled(jcr)) {
+         free_deferred_dir(dir);
+         continue;
+      }
+
+      jcr->lock();
+      pm_strcpy(jcr->last_fname, dir->attr->ofname);
+      jcr->last_type = dir->attr->type;
+      jcr->unlock();
+      set_attributes(jcr, dir->attr, &rctx.bfd);
+
+      if (dir->delayed_streams) {
+         rctx.delayed_streams = dir->delayed_streams;
+         ok = pop_delayed_data_streams(jcr, rctx);
+      }
+      free_deferred_dir(dir);
+   }
+   rctx.delayed_streams = delayed_streams;
+   rctx.writers->deferred_dirs->destroy();
+   rctx.writers->deferred_dirs->init(100, not_owned_by_alist);
+   rctx.deferred_dir = NULL;
+
+   return ok;
+}
+
+/**
+ * Setup the writer threads of a parallel restore.
+ */
+static inline void setup_restore_writers(JCR *jcr, r_ctx &rctx)
+{
+   int i;
+   r_writers *wr;
+
+   if (me->restore_writer_threads == 0 || have_darwin_os ||
+       have_win32_api() || jcr->crypto.pki_sign) {
+      return;
+   }
+
+   wr = (r_writers *)malloc(sizeof(r_writers));
+   memset(wr, 0, sizeof(r_writers));
+   wr->jcr = jcr;
+   wr->nr_writers = me->restore_writer_threads;
+   wr->nr_records = 8 * wr->nr_writers + 8;
+
+   pthread_mutex_init(&wr->lock, NULL);
+   pthread_mutex_init(&wr->attr_lock, NULL);
+   pthread_cond_init(&wr->file_done, NULL);
+   wr->free_queue = New(circbuf(wr->nr_records));
+   wr->deferred_dirs = New(alist(100, not_owned_by_alist));
+
+   wr->records = (r_writer_record *)malloc(wr->nr_records * sizeof(r_writer_record));
+   memset(wr->records, 0, wr->nr_records * sizeof(r_writer_record));
+   for (i = 0; i < wr->nr_records; i++) {
+      wr->records[i].data = get_pool_memory(PM_MESSAGE);
+      wr->free_queue->enqueue(&wr->records[i]);
+   }
+
+   /*
+    * The writers report their errors themselves.
+    */
+   if (jcr->dir_bsock) {
+      jcr->dir_bsock->set_locking();
+   }
+
+   /*
+    * Each writer gets its own decompression buffer.
+    */
+   wr->writers = (r_writer *)malloc(wr->nr_writers * sizeof(r_writer));
+   memset(wr->writers, 0, wr->nr_writers * sizeof(r_writer));
+   for (i = 0; i < wr->nr_writers; i++) {
+      wr->writers[i].wr = wr;
+      wr->writers[i].queue = New(circbuf(wr->nr_records));
+      if (jcr->compress.inflate_buffer) {
+         wr->writers[i].cmprs_ctx.inflate_buffer_size = jcr->compress.inflate_buffer_size;
+         wr->writers[i].cmprs_ctx.inflate_buffer = get_memory(jcr->compress.inflate_buffer_size);
+      }
+      pthread_create(&wr->writers[i].thread_id, NULL, restore_writer, (void *)&wr->writers[i]);
+   }
+
+   Dmsg2(100, "Setup %d restore writers with %d records\n", wr->nr_writers, wr->nr_records);
+   rctx.writers = wr;
+}
+
+/**
+ * Close the file still being written and wait for all writer threads to exit.
+ */
+static inline void stop_restore_writers(r_ctx &rctx)
+{
+   int i;
+   r_writers *wr = rctx.writers;
+
+   if (!wr || wr->stopped) {
+      return;
+   }
+
+   if (rctx.writer_file) {
+      finish_writer_file(rctx);
+   }
+
+   /*
+    * A NULL entry on a queue makes the writer exit.
+    */
+   for (i = 0; i < wr->nr_writers; i++) {
+      wr->writers[i].queue->enqueue(NULL);
+   }
+   for (i = 0; i < wr->nr_writers; i++) {
+      pthread_join(wr->writers[i].thread_id, NULL);
+   }
+   wr->stopped = true;
+}
+
+/**
+ * Stop the writer threads and free the writer pool of a parallel restore.
+ */
+static inline void cleanup_restore_writers(r_ctx &rctx)
+{
+   int i;
+   r_deferred_dir *dir;
+   r_writers *wr = rctx.writers;
+
+   if (!wr) {
+      return;
+   }
+
+   stop_restore_writers(rctx);
+
+   for (i = 0; i < wr->nr_writers; i++) {
+      if (wr->writers[i].cmprs_ctx.inflate_buffer) {
+         free_pool_memory(wr->writers[i].cmprs_ctx.inflate_buffer);
+      }
+      cleanup_compression_workset(&wr->writers[i].cmprs_ctx);
+      delete wr->writers[i].queue;
+   }
+   for (i = 0; i < wr->nr_records; i++) {
+      free_pool_memory(wr->records[i].data);
+   }
+   foreach_alist(dir, wr->deferred_dirs) {
+      free_deferred_dir(dir);
+   }
+
+   delete wr->deferred_dirs;
+   delete wr->free_queue;
+   pthread_cond_destroy(&wr->file_done);
+   pthread_mutex_destroy(&wr->attr_lock);
+   pthread_mutex_destroy(&wr->lock);
+   free(wr->writers);
+   free(wr->records);
+   free(wr);
+   rctx.writers = NULL;
+}
+
 /**
  * Restore the requested files.
  */
@@ -378,7 +842,7 @@ void do_restore(JCR *jcr)
    BSOCK *sd;
    uint32_t VolSessionId, VolSessionTime;
    int32_t file_index;
-   char ec1[50];                      /* Buffer printing huge values */
+   char ec1[50], ec2[50];             /* Buffer printing huge values */
    uint32_t buf_size;                 /* client buffer size */
    int status;
    int64_t rsrc_len = 0;              /* Original length of resource fork */
@@ -419,12 +883,14 @@ void do_restore(JCR *jcr)
    }
    jcr->buf_size = sd->msglen;
 
-   if (have_libz || have_lzo || have_fastlz) {
+   if (have_libz || have_lzo || have_fastlz || have_zstd) {
       if (!adjust_decompression_buffers(jcr)) {
          goto bail_out;
       }
    }
 
+   setup_restore_writers(jcr, rctx);
+
    if (have_crypto) {
       rctx.cipher_ctx.buf = get_memory(CRYPTO_CIPHER_MAX_BLOCK_SIZE);
       if (have_darwin_os) {
@@ -540,6 +1006,7 @@ void do_restore(JCR *jcr)
          if (!close_previous_stream(jcr, rctx)) {
             goto bail_out;
          }
+         rctx.deferred_dir = NULL;
 
          /*
           * TODO: manage deleted files
@@ -592,7 +1059,7 @@ void do_restore(JCR *jcr)
          }
 
          if (status == CF_CORE) {
-            status = create_file(jcr, attr, &rctx.bfd, jcr->replace);
+            status = restore_create_file(jcr, rctx, attr);
          }
          jcr->lock();
          pm_strcpy(jcr->last_fname, attr->ofname);
@@ -641,12 +1108,15 @@ void do_restore(JCR *jcr)
 
             if (!rctx.extract) {
                /*
-                * Set attributes now because file will not be extracted
+                * Set attributes now because file will not be extracted,
+                * a parallel restore sets directory attributes at the end.
                 */
                if (jcr->is_plugin()) {
                   plugin_set_attributes(jcr, attr, &rctx.bfd);
+               } else if (rctx.writers && attr->type == FT_DIREND) {
+                  defer_directory(jcr, rctx, attr);
                } else {
-                  set_attributes(jcr, attr, &rctx.bfd);
+                  restore_set_attributes(jcr, rctx, attr);
                }
             }
             break;
@@ -739,6 +1209,7 @@ void do_restore(JCR *jcr)
       case STREAM_ENCRYPTED_WIN32_GZIP_DATA:
       case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
       case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA:
+      case STREAM_DEDUP_DATA:
          if (rctx.extract) {
             bool process_data = false;
 
@@ -771,6 +1242,10 @@ void do_restore(JCR *jcr)
                case STREAM_SPARSE_DATA:
                   set_bit(FO_SPARSE, rctx.flags);
                   break;
+               case STREAM_DEDUP_DATA:
+                  set_bit(FO_SPARSE, rctx.flags);
+                  set_bit(FO_DEDUP, rctx.flags);
+                  break;
                case STREAM_SPARSE_GZIP_DATA:
                case STREAM_SPARSE_COMPRESSED_DATA:
                   set_bit(FO_SPARSE, rctx.flags);
@@ -826,6 +1301,14 @@ void do_restore(JCR *jcr)
                   set_bit(FO_WIN32DECOMP, rctx.flags);
                }
 
+               /*
+                * In a parallel restore a writer thread writes the file.
+                */
+               if (rctx.writer_file || start_writer_file(jcr, rctx)) {
+                  queue_writer_record(jcr, rctx, sd);
+                  break;
+               }
+
                if (extract_data(jcr, &rctx.bfd, sd->msg, sd->msglen, &rctx.fileAddr,
                                 rctx.flags, rctx.stream, &rctx.cipher_ctx) < 0) {
                   rctx.extract = false;
@@ -930,7 +1413,9 @@ void do_restore(JCR *jcr)
              * the restore of acls till a later stage.
              */
             if (jcr->last_type != FT_DIREND) {
-               push_delayed_data_stream(rctx, sd);
+               push_delayed_data_stream(&rctx.delayed_streams, rctx.stream, sd);
+            } else if (rctx.deferred_dir) {
+               push_delayed_data_stream(&rctx.deferred_dir->delayed_streams, rctx.stream, sd);
             } else {
                if (!do_restore_acl(jcr, rctx.stream, sd->msg, sd->msglen)) {
                   goto bail_out;
@@ -969,7 +1454,9 @@ void do_restore(JCR *jcr)
              * the restore of xattr till a later stage.
              */
             if (jcr->last_type != FT_DIREND) {
-               push_delayed_data_stream(rctx, sd);
+               push_delayed_data_stream(&rctx.delayed_streams, rctx.stream, sd);
+            } else if (rctx.deferred_dir) {
+               push_delayed_data_stream(&rctx.deferred_dir->delayed_streams, rctx.stream, sd);
             } else {
                if (!do_restore_xattr(jcr, rctx.stream, sd->msg, sd->msglen)) {
                   goto bail_out;
@@ -1065,6 +1552,16 @@ void do_restore(JCR *jcr)
    if (!close_previous_stream(jcr, rctx)) {
       goto bail_out;
    }
+
+   /*
+    * Wait for the writers of a parallel restore and set the directory attributes.
+    */
+   if (rctx.writers) {
+      stop_restore_writers(rctx);
+      if (!apply_deferred_dirs(jcr, rctx)) {
+         goto bail_out;
+      }
+   }
    jcr->setJobStatus(JS_Terminated);
    goto ok_out;
 
@@ -1072,6 +1569,8 @@ bail_out:
    jcr->setJobStatus(JS_ErrorTerminated);
 
 ok_out:
+   cleanup_restore_writers(rctx);
+
 #ifdef HAVE_WIN32
    /*
     * Cleanup the copy thread if we restored any EFS data.
@@ -1113,6 +1612,11 @@ ok_out:
    if (non_support_xattr) {
       Jmsg(jcr, M_INFO, 0, _("%d non-supported xattr streams ignored.\n"), non_support_xattr);
    }
+   if (sd->is_compressing()) {
+      Jmsg(jcr, M_INFO, 0, _("Network compression: %s bytes of data received as %s bytes\n"),
+           edit_uint64_with_commas(sd->get_raw_bytes_recv(), ec1),
+           edit_uint64_with_commas(sd->get_wire_bytes_recv(), ec2));
+   }
 
    /*
     * Free Signature & Crypto Data
@@ -1204,6 +1708,35 @@ bool sparse_data(JCR *jcr, BFILE *bfd, uint64_t *addr, char **data, uint32_t *le
    return true;
 }
 
+/**
+ * Strip the chunk header from the data of a deduplicated data record.
+ * The Storage daemon fills in the data of chunk references, so the
+ * data of the chunk must always be there.
+ */
+bool dedup_chunk_data(JCR *jcr, const char *fname, char **data, uint32_t *length)
+{
+   unser_declare;
+   uint32_t chunk_len;
+
+   if (*length < DEDUP_CHUNK_HDR_SIZE - OFFSET_FADDR_SIZE) {
+      Jmsg1(jcr, M_ERROR, 0, _("Invalid deduplicated data record for %s\n"), fname);
+      return false;
+   }
+
+   unser_begin(*data + CRYPTO_DIGEST_SHA1_SIZE, sizeof(uint32_t));
+   unser_uint32(chunk_len);
+   *data += DEDUP_CHUNK_HDR_SIZE - OFFSET_FADDR_SIZE;
+   *length -= DEDUP_CHUNK_HDR_SIZE - OFFSET_FADDR_SIZE;
+
+   if (*length != chunk_len) {
+      Jmsg3(jcr, M_ERROR, 0, _("Deduplicated chunk of %s has %u bytes, expected %u\n"),
+            fname, *length, chunk_len);
+      return false;
+   }
+
+   return true;
+}
+
 bool store_data(JCR *jcr, BFILE *bfd, char *data, const int32_t length, bool win32_decomp)
 {
    if (jcr->crypto.digest) {
@@ -1280,6 +1813,12 @@ int32_t extract_data(JCR *jcr, BFILE *bfd, POOLMEM *buf, int32_t buflen,
       }
    }
 
+   if (bit_is_set(FO_DEDUP, flags)) {
+      if (!dedup_chunk_data(jcr, jcr->last_fname, &wbuf, &wsize)) {
+         goto bail_out;
+      }
+   }
+
    if (bit_is_set(FO_COMPRESS, flags)) {
       if (!decompress_data(jcr, jcr->last_fname, stream, &wbuf, &wsize, false)) {
          goto bail_out;
@@ -1327,7 +1866,7 @@ static bool close_previous_stream(JCR *jcr, r_ctx &rctx)
     * close the output file and validate the signature.
     */
    if (rctx.extract) {
-      if (rctx.size > 0 && !is_bopen(&rctx.bfd)) {
+      if (rctx.size > 0 && !is_bopen(&rctx.bfd) && !rctx.writer_file) {
          Jmsg0(rctx.jcr, M_ERROR, 0, _("Logic error: output file should be open\n"));
          Dmsg2(000, "=== logic error size=%d bopen=%d\n", rctx.size,
             is_bopen(&rctx.bfd));
@@ -1344,10 +1883,12 @@ static bool close_previous_stream(JCR *jcr, r_ctx &rctx)
       }
 #endif
 
-      if (jcr->is_plugin()) {
+      if (rctx.writer_file) {
+         finish_writer_file(rctx);
+      } else if (jcr->is_plugin()) {
          plugin_set_attributes(rctx.jcr, rctx.attr, &rctx.bfd);
       } else {
-         set_attributes(rctx.jcr, rctx.attr, &rctx.bfd);
+         restore_set_attributes(rctx.jcr, rctx, rctx.attr);
       }
       rctx.extract = false;
 
@@ -37,6 +37,63 @@ struct RESTORE_CIPHER_CTX {
    int32_t packet_len;                 /* Total bytes in packet */
 };
 
+/*
+ * Parallel restore.
+ *
+ * The job thread keeps creating the files in the order they arrive from the
+ * Storage daemon but hands the data of regular files to a pool of writer
+ * threads. All records of a file go to the same writer, so every file is
+ * written sequentially while different files are written concurrently.
+ * Directory attributes are set by the job thread in a final pass in their
+ * original order once all writers are done.
+ */
+struct r_writers;
+
+struct r_writer_file {
+   BFILE bfd;                          /* Output file, owned by the writer */
+   ATTR *attr;                         /* Copy of the attributes of the file */
+   uint64_t fileAddr;                  /* file write address */
+   int32_t stream;                     /* Data stream of the file */
+   char flags[FOPTS_BYTES];            /* Options for writer_extract_data() */
+   int writer;                         /* Writer the file is assigned to */
+   bool failed;                        /* Writing the file failed, drop its records */
+   bool wait;                          /* Job thread waits for the file to be closed */
+   bool done;                          /* File closed and attributes set */
+};
+
+struct r_writer_record {
+   r_writer_file *file;                /* File the record belongs to */
+   POOLMEM *data;                      /* Record data, swapped with the socket buffer */
+   uint32_t data_len;                  /* Length of the data, 0 closes the file */
+};
+
+struct r_writer {
+   r_writers *wr;                      /* Writer pool this writer belongs to */
+   CMPRS_CTX cmprs_ctx;                /* Private decompression buffer */
+   circbuf *queue;                     /* Records waiting to be written */
+   int nr_files;                       /* Files assigned and not yet closed */
+   pthread_t thread_id;                /* Id of the writer thread */
+};
+
+struct r_deferred_dir {
+   ATTR *attr;                         /* Copy of the attributes of the directory */
+   alist *delayed_streams;             /* ACL and XATTR streams of the directory */
+};
+
+struct r_writers {
+   JCR *jcr;                           /* Current Job Control Record */
+   int nr_writers;                     /* Number of writer threads */
+   int nr_records;                     /* Number of records in flight */
+   r_writer *writers;                  /* Writer threads */
+   r_writer_record *records;           /* All records */
+   circbuf *free_queue;                /* Records available for receiving */
+   alist *deferred_dirs;               /* Directories waiting for their attributes */
+   bool stopped;                       /* All writer threads have exited */
+   pthread_mutex_t lock;               /* Lock the structure */
+   pthread_mutex_t attr_lock;          /* Serialize file creation and attributes, both change the umask */
+   pthread_cond_t file_done;           /* Signalled when a waited for file was closed */
+};
+
 struct r_ctx {
    JCR *jcr;
    int32_t stream;                     /* stream less new bits */
@@ -55,6 +112,9 @@ struct r_ctx {
    ATTR *attr;                         /* Pointer to attributes */
    bool extract;                       /* set when extracting */
    alist *delayed_streams;             /* streams that should be restored as last */
+   r_writers *writers;                 /* Writer threads of a parallel restore (if any) */
+   r_writer_file *writer_file;         /* File being written by a writer thread (if any) */
+   r_deferred_dir *deferred_dir;       /* Directory whose attributes are deferred (if any) */
 
    SIGNATURE *sig;                     /* Cryptographic signature (if any) for file */
    CRYPTO_SESSION *cs;                 /* Cryptographic session data (if any) for file */
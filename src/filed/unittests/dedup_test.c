@@ -0,0 +1,166 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test the content defined chunking of the data of files that are
+ * backed up with deduplication.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+#include "filed/filed.h"
+
+#define TEST_DATA_SIZE (8 * 1024 * 1024)
+#define TEST_INSERT_OFFSET 1000
+#define TEST_INSERT_SIZE 100
+#define TEST_MAX_CHUNKS (TEST_DATA_SIZE / DEDUP_MIN_CHUNK + 2)
+
+/*
+ * Fill the buffer with the same pseudo random data on every run.
+ */
+static void fill_data(char *data, uint32_t length)
+{
+   uint64_t x = 0x2545f4914f6cdd1dULL;
+
+   for (uint32_t i = 0; i < length; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      data[i] = (char)(x >> 32);
+   }
+}
+
+/*
+ * Cut the data into chunks, check the size of every chunk and rebuild
+ * the data from them. Returns the number of chunks, the end offsets of
+ * the chunks are stored in bounds.
+ */
+static int cut_chunks(b_dedup *dedup, const char *data, uint32_t length, uint32_t *bounds)
+{
+   int nr_chunks = 0;
+   uint32_t offset = 0;
+   char *rebuild;
+
+   rebuild = (char *)malloc(length);
+   while (offset < length) {
+      uint32_t chunk_len;
+
+      chunk_len = dedup_find_chunk(dedup, data + offset, length - offset);
+      assert_true(chunk_len <= DEDUP_MAX_CHUNK);
+      if (offset + chunk_len < length) {
+         assert_true(chunk_len >= DEDUP_MIN_CHUNK);
+      } else {
+         assert_true(chunk_len > 0);
+      }
+
+      memcpy(rebuild + offset, data + offset, chunk_len);
+      offset += chunk_len;
+      assert_true(nr_chunks < TEST_MAX_CHUNKS);
+      bounds[nr_chunks++] = offset;
+   }
+
+   assert_int_equal(offset, length);
+   assert_memory_equal(rebuild, data, length);
+   free(rebuild);
+
+   return nr_chunks;
+}
+
+void test_dedup_chunker(void **state)
+{
+   JCR *jcr;
+   b_dedup *dedup;
+   char *data, *changed;
+   uint32_t *bounds, *changed_bounds;
+   uint32_t average;
+   int nr_chunks, nr_changed, i, j;
+
+   (void) state;
+
+   jcr = new_jcr(sizeof(JCR), NULL);
+   dedup = new_dedup_context(jcr);
+   assert_non_null(dedup);
+   assert_null(dedup->sent);
+
+   data = (char *)malloc(TEST_DATA_SIZE);
+   fill_data(data, TEST_DATA_SIZE);
+   bounds = (uint32_t *)malloc(TEST_MAX_CHUNKS * sizeof(uint32_t));
+   changed_bounds = (uint32_t *)malloc(TEST_MAX_CHUNKS * sizeof(uint32_t));
+
+   /*
+    * Short data is a single chunk.
+    */
+   assert_int_equal(dedup_find_chunk(dedup, data, DEDUP_MIN_CHUNK), DEDUP_MIN_CHUNK);
+   assert_int_equal(dedup_find_chunk(dedup, data, 10), 10);
+
+   /*
+    * Normalized chunking keeps the chunks close to the average size.
+    */
+   nr_chunks = cut_chunks(dedup, data, TEST_DATA_SIZE, bounds);
+   average = TEST_DATA_SIZE / nr_chunks;
+   assert_in_range(average, DEDUP_AVG_CHUNK / 2, DEDUP_AVG_CHUNK * 2);
+
+   /*
+    * The same data is cut the same way.
+    */
+   assert_int_equal(cut_chunks(dedup, data, TEST_DATA_SIZE, changed_bounds), nr_chunks);
+   assert_memory_equal(changed_bounds, bounds, nr_chunks * sizeof(uint32_t));
+
+   /*
+    * Insert data into the first chunk. The boundaries after the insertion
+    * must be found again within a few chunks and match from there on.
+    */
+   changed = (char *)malloc(TEST_DATA_SIZE + TEST_INSERT_SIZE);
+   memcpy(changed, data, TEST_INSERT_OFFSET);
+   memset(changed + TEST_INSERT_OFFSET, 'x', TEST_INSERT_SIZE);
+   memcpy(changed + TEST_INSERT_OFFSET + TEST_INSERT_SIZE, data + TEST_INSERT_OFFSET,
+          TEST_DATA_SIZE - TEST_INSERT_OFFSET);
+
+   nr_changed = cut_chunks(dedup, changed, TEST_DATA_SIZE + TEST_INSERT_SIZE, changed_bounds);
+
+   for (i = 0; i < nr_changed; i++) {
+      for (j = 0; j < nr_chunks; j++) {
+         if (changed_bounds[i] == bounds[j] + TEST_INSERT_SIZE) {
+            break;
+         }
+      }
+      if (j < nr_chunks) {
+         break;
+      }
+   }
+   assert_true(i < 4);
+   assert_int_equal(nr_changed - i, nr_chunks - j);
+   for (; i < nr_changed; i++, j++) {
+      assert_int_equal(changed_bounds[i], bounds[j] + TEST_INSERT_SIZE);
+   }
+
+   free(changed);
+   free(changed_bounds);
+   free(bounds);
+   free(data);
+   free_dedup_context(dedup);
+   free_jcr(jcr);
+}
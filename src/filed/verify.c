@@ -318,7 +318,16 @@ static int read_digest(BFILE *bfd, DIGEST *digest, JCR *jcr)
 
 
    Dmsg0(50, "=== read_digest\n");
-   while ((n=bread(bfd, buf, bufsiz)) > 0) {
+   for (;;) {
+      /* Don't read the blocks in holes of sparse files, they are skipped anyway */
+      if (bit_is_set(FO_SPARSE, ff_pkt->flags) &&
+          (ff_pkt->type == FT_REG || ff_pkt->type == FT_REGE)) {
+         fileAddr = bskip_holes(bfd, fileAddr, ff_pkt->statp.st_size, bufsiz);
+      }
+      if ((n = bread(bfd, buf, bufsiz)) <= 0) {
+         break;
+      }
+
       /* Check for sparse blocks */
       if (bit_is_set(FO_SPARSE, ff_pkt->flags)) {
          bool allZeros = false;
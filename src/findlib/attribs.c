@@ -106,6 +106,23 @@ int select_data_stream(FF_PKT *ff_pkt, bool compatible)
       stream = STREAM_SPARSE_DATA;
    }
 
+   /*
+    * Deduplication is only supported for portable unencrypted file data,
+    * it replaces the sparse handling and the compression of the data.
+    */
+   if (bit_is_set(FO_DEDUP, ff_pkt->flags)) {
+      if (stream != STREAM_WIN32_DATA &&
+          !ff_pkt->cmd_plugin &&
+          !bit_is_set(FO_OFFSETS, ff_pkt->flags) &&
+          !bit_is_set(FO_ENCRYPT, ff_pkt->flags)) {
+         stream = STREAM_DEDUP_DATA;
+         clear_bit(FO_SPARSE, ff_pkt->flags);
+         clear_bit(FO_COMPRESS, ff_pkt->flags);
+      } else {
+         clear_bit(FO_DEDUP, ff_pkt->flags);
+      }
+   }
+
    /*
     * Encryption is only supported for file data
     */
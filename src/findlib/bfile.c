@@ -3,7 +3,7 @@
 
    Copyright (C) 2003-2010 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -106,6 +106,8 @@ const char *stream_to_ascii(int stream)
       return _("GZIP sparse data");
    case STREAM_SPARSE_COMPRESSED_DATA:
       return _("Compressed sparse data");
+   case STREAM_DEDUP_DATA:
+      return _("Deduplicated data");
    case STREAM_PROGRAM_NAMES:
       return _("Program names");
    case STREAM_PROGRAM_DATA:
@@ -400,6 +402,14 @@ bool set_cmd_plugin(BFILE *bfd, JCR *jcr)
    return true;
 }
 
+/**
+ * Only plain reads are implemented on Win32.
+ */
+bool set_io_mode(BFILE *bfd, int io_mode)
+{
+   return io_mode == BIO_NORMAL;
+}
+
 /**
  * Return 1 if we are NOT using Win32 BackupWrite()
  * return 0 if are
@@ -454,6 +464,7 @@ bool is_restore_stream_supported(int stream)
    case STREAM_MD5_DIGEST:
    case STREAM_UNIX_ATTRIBUTES_EX:
    case STREAM_SPARSE_DATA:
+   case STREAM_DEDUP_DATA:
    case STREAM_PROGRAM_NAMES:
    case STREAM_PROGRAM_DATA:
    case STREAM_SHA1_DIGEST:
@@ -978,6 +989,11 @@ boffset_t blseek(BFILE *bfd, boffset_t offset, int whence)
    return ((boffset_t)offset_high << 32) | dwResult;
 }
 
+boffset_t bskip_holes(BFILE *bfd, boffset_t offset, boffset_t size, int32_t block_size)
+{
+   return offset;
+}
+
 #else  /* Unix systems */
 
 /* ===============================================================
@@ -1033,6 +1049,185 @@ bool set_cmd_plugin(BFILE *bfd, JCR *jcr)
    return true;
 }
 
+/*
+ * Tuning of the BIO_NOCACHE and BIO_DIRECT read modes.
+ */
+#define BIO_ALIGNMENT 4096               /* Alignment of O_DIRECT buffers and offsets */
+#define BIO_MIN_READ (256 * 1024)        /* First readahead window or O_DIRECT read */
+#define BIO_MAX_READ (8 * 1024 * 1024)   /* Largest readahead window or O_DIRECT read */
+#define BIO_DROP_BEHIND (1024 * 1024)    /* Drop read data from the page cache in chunks of this size */
+
+/**
+ * Select how the data of the file is read, must be called before bopen().
+ *
+ * BIO_NOCACHE tells the kernel the file is read sequentially, keeps a
+ * readahead window ahead of the reads that doubles up to BIO_MAX_READ for
+ * large files and drops the data already read from the page cache.
+ *
+ * BIO_DIRECT reads the file with O_DIRECT into an aligned buffer, bypassing
+ * the page cache. The size of the reads doubles up to BIO_MAX_READ. When the
+ * filesystem doesn't support O_DIRECT it falls back to BIO_NOCACHE.
+ */
+bool set_io_mode(BFILE *bfd, int io_mode)
+{
+   bfd->io_mode = io_mode;
+   return true;
+}
+
+/**
+ * Setup the read mode of a just opened file.
+ */
+static void setup_io_mode(BFILE *bfd)
+{
+   bfd->read_pos = 0;
+   bfd->ra_end = 0;
+   bfd->dropped = 0;
+   bfd->ra_size = BIO_MIN_READ;
+   bfd->dbuf_len = 0;
+   bfd->dbuf_pos = 0;
+
+   if (bfd->io_mode == BIO_DIRECT) {
+#ifdef O_DIRECT
+      int oldflags;
+
+      oldflags = fcntl(bfd->fid, F_GETFL, 0);
+      if (oldflags == -1 || fcntl(bfd->fid, F_SETFL, oldflags | O_DIRECT) == -1) {
+         Dmsg1(dbglvl, "O_DIRECT not supported on fid %d, using nocache reads\n", bfd->fid);
+         bfd->io_mode = BIO_NOCACHE;
+      }
+#else
+      bfd->io_mode = BIO_NOCACHE;
+#endif
+   }
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+   if (bfd->io_mode == BIO_NOCACHE) {
+      posix_fadvise(bfd->fid, 0, 0, POSIX_FADV_SEQUENTIAL);
+   }
+#endif
+}
+
+/**
+ * Keep the readahead window ahead of the reads and drop what has been read
+ * from the page cache.
+ */
+static inline void advise_nocache_read(BFILE *bfd)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED) && defined(POSIX_FADV_DONTNEED)
+   boffset_t end;
+
+   if (bfd->read_pos + (boffset_t)(bfd->ra_size / 2) >= bfd->ra_end) {
+      if (bfd->ra_end < bfd->read_pos) {
+         bfd->ra_end = bfd->read_pos;
+      }
+      posix_fadvise(bfd->fid, bfd->ra_end, bfd->ra_size, POSIX_FADV_WILLNEED);
+      bfd->ra_end += bfd->ra_size;
+      if (bfd->ra_size < BIO_MAX_READ) {
+         bfd->ra_size *= 2;
+      }
+   }
+
+   if (bfd->read_pos - bfd->dropped >= BIO_DROP_BEHIND) {
+      end = bfd->read_pos & ~((boffset_t)BIO_ALIGNMENT - 1);
+      posix_fadvise(bfd->fid, bfd->dropped, end - bfd->dropped, POSIX_FADV_DONTNEED);
+      bfd->dropped = end;
+   }
+#endif
+}
+
+#ifdef O_DIRECT
+/**
+ * Refill the aligned buffer of a file opened with O_DIRECT at read_pos.
+ *
+ * The reads go into the aligned dbuf at aligned offsets using pread().
+ * Returns the number of bytes available, 0 at the end of the file.
+ */
+static ssize_t fill_direct_buffer(BFILE *bfd)
+{
+   size_t skip;
+   ssize_t status;
+   boffset_t offset;
+
+   if (!bfd->dbuf || bfd->dbuf_size < bfd->ra_size) {
+      void *dbuf;
+
+      if (bfd->dbuf) {
+         actuallyfree(bfd->dbuf);     /* allocated by posix_memalign() */
+         bfd->dbuf = NULL;
+      }
+      if ((errno = posix_memalign(&dbuf, BIO_ALIGNMENT, bfd->ra_size)) != 0) {
+         bfd->berrno = errno;
+         return -1;
+      }
+      bfd->dbuf = (char *)dbuf;
+      bfd->dbuf_size = bfd->ra_size;
+   }
+
+   offset = bfd->read_pos & ~((boffset_t)BIO_ALIGNMENT - 1);
+   skip = bfd->read_pos - offset;
+   status = pread(bfd->fid, bfd->dbuf, bfd->dbuf_size, offset);
+   if (status < 0) {
+      bfd->berrno = errno;
+      return -1;
+   }
+
+   bfd->dbuf_len = status;
+   bfd->dbuf_pos = MIN(skip, bfd->dbuf_len);
+   if (bfd->ra_size < BIO_MAX_READ) {
+      bfd->ra_size *= 2;
+   }
+
+   return bfd->dbuf_len - bfd->dbuf_pos;
+}
+
+/**
+ * Read from a file opened with O_DIRECT.
+ *
+ * Like read() on a regular file only the end of the file gives a short read.
+ * When the filesystem refuses the O_DIRECT read we switch to nocache reads at
+ * the current position.
+ */
+static ssize_t bread_direct(BFILE *bfd, void *buf, size_t count)
+{
+   size_t len, done = 0;
+   ssize_t status;
+
+   while (done < count) {
+      if (bfd->dbuf_pos >= bfd->dbuf_len) {
+         status = fill_direct_buffer(bfd);
+         if (status < 0 && bfd->berrno == EINVAL) {
+            Dmsg1(dbglvl, "O_DIRECT read refused on fid %d, using nocache reads\n", bfd->fid);
+            fcntl(bfd->fid, F_SETFL, fcntl(bfd->fid, F_GETFL, 0) & ~O_DIRECT);
+            if (lseek(bfd->fid, bfd->read_pos, SEEK_SET) < 0) {
+               bfd->berrno = errno;
+               return -1;
+            }
+            bfd->io_mode = BIO_NOCACHE;
+            status = bread(bfd, (char *)buf + done, count - done);
+            if (status < 0) {
+               return done ? (ssize_t)done : -1;
+            }
+            return done + status;
+         }
+         if (status < 0) {
+            return done ? (ssize_t)done : -1;
+         }
+         if (status == 0) {
+            break;                    /* end of file */
+         }
+      }
+
+      len = MIN(count - done, bfd->dbuf_len - bfd->dbuf_pos);
+      memcpy((char *)buf + done, bfd->dbuf + bfd->dbuf_pos, len);
+      bfd->dbuf_pos += len;
+      bfd->read_pos += len;
+      done += len;
+   }
+
+   return done;
+}
+#endif
+
 /**
  * This code is running on a non-Win32 machine
  */
@@ -1068,6 +1263,7 @@ bool is_restore_stream_supported(int stream)
    case STREAM_MD5_DIGEST:
    case STREAM_UNIX_ATTRIBUTES_EX:
    case STREAM_SPARSE_DATA:
+   case STREAM_DEDUP_DATA:
    case STREAM_PROGRAM_NAMES:
    case STREAM_PROGRAM_DATA:
    case STREAM_SHA1_DIGEST:
@@ -1138,6 +1334,11 @@ int bopen(BFILE *bfd, const char *fname, int flags, mode_t mode, dev_t rdev)
    bfd->win32DecompContext.bIsInData = false;
    bfd->win32DecompContext.liNextHeader = 0;
 
+   if (bfd->fid != -1 && bfd->io_mode != BIO_NORMAL) {
+      setup_io_mode(bfd);
+      errno = bfd->berrno;
+   }
+
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
    if (bfd->fid != -1 && flags & O_RDONLY) {
       int status = posix_fadvise(bfd->fid, 0, 0, POSIX_FADV_WILLNEED);
@@ -1194,6 +1395,17 @@ int bclose(BFILE *bfd)
       }
 #endif
 
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_DONTNEED)
+      if (bfd->io_mode == BIO_NOCACHE) {
+         posix_fadvise(bfd->fid, bfd->dropped, 0, POSIX_FADV_DONTNEED);
+      }
+#endif
+      if (bfd->dbuf) {
+         actuallyfree(bfd->dbuf);     /* allocated by posix_memalign() */
+         bfd->dbuf = NULL;
+         bfd->dbuf_size = 0;
+      }
+
       /* Close normal file */
       status = close(bfd->fid);
       bfd->berrno = errno;
@@ -1212,9 +1424,24 @@ ssize_t bread(BFILE *bfd, void *buf, size_t count)
       return plugin_bread(bfd, buf, count);
    }
 
-   status = read(bfd->fid, buf, count);
-   bfd->berrno = errno;
-   return status;
+   switch (bfd->io_mode) {
+#ifdef O_DIRECT
+   case BIO_DIRECT:
+      return bread_direct(bfd, buf, count);
+#endif
+   case BIO_NOCACHE:
+      status = read(bfd->fid, buf, count);
+      bfd->berrno = errno;
+      if (status > 0) {
+         bfd->read_pos += status;
+         advise_nocache_read(bfd);
+      }
+      return status;
+   default:
+      status = read(bfd->fid, buf, count);
+      bfd->berrno = errno;
+      return status;
+   }
 }
 
 ssize_t bwrite(BFILE *bfd, void *buf, size_t count)
@@ -1241,8 +1468,115 @@ boffset_t blseek(BFILE *bfd, boffset_t offset, int whence)
    if (bfd->cmd_plugin && plugin_bwrite) {
       return plugin_blseek(bfd, offset, whence);
    }
+
+   /*
+    * O_DIRECT reads use pread() from read_pos, so relative seeks are relative to that.
+    */
+   if (bfd->io_mode == BIO_DIRECT && whence == SEEK_CUR) {
+      offset += bfd->read_pos;
+      whence = SEEK_SET;
+   }
+
    pos = (boffset_t)lseek(bfd->fid, offset, whence);
    bfd->berrno = errno;
+
+   if (pos >= 0 && bfd->io_mode != BIO_NORMAL) {
+      bfd->read_pos = pos;
+      bfd->dbuf_len = 0;
+      bfd->dbuf_pos = 0;
+   }
+
    return pos;
 }
+
+/**
+ * Return the offset of the first data at or after offset, using
+ * SEEK_DATA/SEEK_HOLE. The data extent found is remembered, so reading
+ * through it needs no further system calls. Returns offset when holes
+ * can't be detected and size when there is no more data.
+ */
+static boffset_t bnext_data(BFILE *bfd, boffset_t offset, boffset_t size)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+   boffset_t data, hole;
+
+   if (bfd->no_seek_data) {
+      return offset;
+   }
+
+   if (offset >= bfd->data_start && offset < bfd->data_end) {
+      return offset;
+   }
+
+   data = lseek(bfd->fid, offset, SEEK_DATA);
+   if (data < 0) {
+      if (errno != ENXIO) {
+         Dmsg1(dbglvl, "SEEK_DATA not supported on fid %d\n", bfd->fid);
+         bfd->no_seek_data = true;
+         lseek(bfd->fid, offset, SEEK_SET);
+         return offset;
+      }
+      data = size;                     /* only a hole up to the end of the file */
+      hole = size;
+   } else {
+      hole = lseek(bfd->fid, data, SEEK_HOLE);
+      if (hole < 0) {
+         hole = size;
+      }
+   }
+
+   bfd->data_start = data;
+   bfd->data_end = hole;
+
+   /*
+    * SEEK_DATA and SEEK_HOLE moved the file offset.
+    */
+   lseek(bfd->fid, offset, SEEK_SET);
+
+   return data;
+#else
+   return offset;
+#endif
+}
+
+/**
+ * Skip the blocks of a sparse file that lie completely in a hole.
+ *
+ * The file is read in blocks of block_size starting at offset, the blocks
+ * in holes read as zeros and would be dropped by the zero scan of sparse
+ * files. Like the zero scan this never skips the block that reaches the
+ * end of the file. Returns the offset of the next block to read, the file
+ * is positioned there.
+ */
+boffset_t bskip_holes(BFILE *bfd, boffset_t offset, boffset_t size, int32_t block_size)
+{
+   boffset_t data, nr_blocks;
+
+   if (bfd->cmd_plugin || block_size <= 0) {
+      return offset;
+   }
+
+   data = bnext_data(bfd, offset, size);
+   if (data > size) {
+      data = size;
+   }
+   if (data <= offset) {
+      return offset;
+   }
+
+   nr_blocks = (data - offset) / block_size;
+   if (nr_blocks > 0 && offset + nr_blocks * block_size >= size) {
+      nr_blocks--;
+   }
+   if (nr_blocks == 0) {
+      return offset;
+   }
+
+   if (blseek(bfd, offset + nr_blocks * block_size, SEEK_SET) < 0) {
+      lseek(bfd->fid, offset, SEEK_SET);
+      return offset;
+   }
+
+   return offset + nr_blocks * block_size;
+}
 #endif
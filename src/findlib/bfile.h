@@ -3,7 +3,7 @@
 
    Copyright (C) 2003-2010 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -60,6 +60,15 @@ typedef struct _PROCESS_WIN32_BACKUPAPIBLOCK_CONTEXT {
  *
  *  =======================================================
  */
+/**
+ * Read modes of a BFILE, see set_io_mode().
+ */
+enum {
+   BIO_NORMAL = 0,                    /**< Plain reads */
+   BIO_NOCACHE = 1,                   /**< Sequential readahead, drop read data from the page cache */
+   BIO_DIRECT = 2                     /**< O_DIRECT reads into an aligned buffer */
+};
+
 #if defined(HAVE_WIN32)
 
 enum {
@@ -114,6 +123,18 @@ struct BFILE {
    int use_backup_decomp;             /**< set if using BackupRead Stream Decomposition */
    bool reparse_point;                /**< not used in Unix */
    bool cmd_plugin;                   /**< set if we have a command plugin */
+   int io_mode;                       /**< BIO_* read mode */
+   boffset_t read_pos;                /**< Position of the next read (BIO_NOCACHE/BIO_DIRECT) */
+   boffset_t ra_end;                  /**< End of the advised readahead window */
+   boffset_t dropped;                 /**< Data before this offset is dropped from the page cache */
+   size_t ra_size;                    /**< Size of the next readahead window or O_DIRECT read */
+   char *dbuf;                        /**< Aligned buffer for O_DIRECT reads */
+   size_t dbuf_size;                  /**< Size of dbuf */
+   size_t dbuf_len;                   /**< Bytes of data in dbuf */
+   size_t dbuf_pos;                   /**< Offset of the next byte to return from dbuf */
+   boffset_t data_start;              /**< Start of the last data extent found by bskip_holes() */
+   boffset_t data_end;                /**< End of the last data extent found by bskip_holes() */
+   bool no_seek_data;                 /**< SEEK_DATA/SEEK_HOLE not supported for this file */
 };
 
 #endif
@@ -123,6 +144,7 @@ bool is_bopen(BFILE *bfd);
 bool set_win32_backup(BFILE *bfd);
 bool set_portable_backup(BFILE *bfd);
 bool set_cmd_plugin(BFILE *bfd, JCR *jcr);
+bool set_io_mode(BFILE *bfd, int io_mode);
 bool have_win32_api();
 bool is_portable_backup(BFILE *bfd);
 bool is_restore_stream_supported(int stream);
@@ -133,6 +155,7 @@ int bclose(BFILE *bfd);
 ssize_t bread(BFILE *bfd, void *buf, size_t count);
 ssize_t bwrite(BFILE *bfd, void *buf, size_t count);
 boffset_t blseek(BFILE *bfd, boffset_t offset, int whence);
+boffset_t bskip_holes(BFILE *bfd, boffset_t offset, boffset_t size, int32_t block_size);
 const char *stream_to_ascii(int stream);
 
 bool processWin32BackupAPIBlock (BFILE *bfd, void *pBuffer, ssize_t dwSize);
@@ -97,6 +97,15 @@ void set_find_changed_function(FF_PKT *ff, bool check_fct(JCR *jcr, FF_PKT *ff))
    ff->check_fct = check_fct;
 }
 
+/**
+ * Set the number of threads prefetching the directory listings
+ * and stat info ahead of the walker, zero disables prefetching.
+ */
+void set_find_prefetch_workers(FF_PKT *ff, int workers)
+{
+   ff->prefetch_workers = workers;
+}
+
 /**
  * Call this subroutine with a callback subroutine as the first
  * argument and a packet as the second argument, this packet
@@ -441,6 +450,10 @@ int term_find_files(FF_PKT *ff)
    int hard_links = 0;
 
    if (ff) {
+      if (ff->prefetch) {
+         stop_prefetch(ff->prefetch);
+         ff->prefetch = NULL;
+      }
       free_pool_memory(ff->sys_fname);
       if (ff->fname_save) {
          free_pool_memory(ff->fname_save);
@@ -198,6 +198,27 @@ struct CurLink {
     char name[1];                     /**< The name */
 };
 
+/**
+ * Directory prefetching, see find_prefetch.c
+ */
+#define PREFETCH_SEGMENT_SIZE 256     /**< Number of directory entries read and stat'ed in one go */
+
+struct f_prefetch;
+struct f_prefetch_dir;
+
+/**
+ * A single directory entry with its prefetched lstat() result.
+ */
+struct f_prefetch_entry {
+   char *name;                        /**< Name of the entry */
+   int name_length;                   /**< Length of the name */
+   int ff_errno;                      /**< Errno of lstat(), statp only valid when zero */
+   bool excluded;                     /**< Excluded by the exclude list, not stat'ed */
+   bool too_long;                     /**< Name longer then name_max, not stat'ed */
+   struct stat statp;                 /**< Stat packet */
+   f_prefetch_dir *subdir;            /**< Prefetched listing when this is a directory */
+};
+
 /**
  * Definition of the find_files packet passed as the
  * first argument to the find_files callback subroutine.
@@ -256,6 +277,13 @@ struct FF_PKT {
    alist fstypes;                     /**< Allowed file system types */
    alist drivetypes;                  /**< Allowed drive types */
 
+   /*
+    * Parallel directory prefetching
+    */
+   int prefetch_workers;              /**< Number of prefetch threads, zero disables prefetching */
+   f_prefetch *prefetch;              /**< Prefetch engine, started on first use */
+   f_prefetch_dir *prefetch_subdir;   /**< Prefetched listing for the directory find_one_file() is called for */
+
    /*
     * List of all hard linked files found
     */
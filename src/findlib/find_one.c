@@ -43,6 +43,10 @@
 extern int32_t name_max;              /* filename max length */
 extern int32_t path_max;              /* path name max length */
 
+static int find_one_prefetched_file(JCR *jcr, FF_PKT *ff_pkt,
+                                    int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                                    char *fname, f_prefetch_entry *entry, dev_t parent_device);
+
 /**
  * Create a new directory Find File packet, but copy
  * some of the essential info from the current packet.
@@ -558,18 +562,210 @@ static inline int process_symlink(JCR *jcr, FF_PKT *ff_pkt,
 }
 
 /**
- * Handling of a directory.
+ * Read all entries of an open directory and process them (recursing).
  */
-static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
-                                    int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
-                                    char *fname, dev_t parent_device, bool top_level)
+static inline int process_directory_entries(JCR *jcr, FF_PKT *ff_pkt,
+                                            int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                                            DIR *directory, char *link, int len, int link_len,
+                                            dev_t our_device)
 {
    int rtn_stat;
-   DIR *directory;
    struct dirent *result;
 #ifdef USE_READDIR_R
    struct dirent *entry;
 #endif
+
+   /*
+    * Process all files in this directory entry (recursing).
+    * This would possibly run faster if we chdir to the directory
+    * before traversing it.
+    */
+   rtn_stat = 1;
+
+   /*
+    * Allocate some extra room so an overflow of the d_name with more then
+    * name_max bytes doesn't kill us right away. We check in the loop if
+    * an overflow has not happened.
+    */
+#ifdef USE_READDIR_R
+   int status;
+
+   entry = (struct dirent *)malloc(sizeof(struct dirent) + name_max + 100);
+   while (!job_canceled(jcr)) {
+      int name_length;
+
+      status = readdir_r(directory, entry, &result);
+      if (status != 0 || result == NULL) {
+         break;
+      }
+
+      name_length = (int)NAMELEN(entry);
+
+      /*
+       * Some filesystems violate against the rules and return filenames
+       * longer than _PC_NAME_MAX. Log the error and continue.
+       */
+      if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
+         Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"), entry->d_name, name_length);
+         continue;
+      }
+
+      /*
+       * Skip `.', `..', and excluded file names.
+       */
+      if (entry->d_name[0] == '\0' ||
+         (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))) {
+         continue;
+      }
+
+      /*
+       * Make sure there is enough room to store the whole name.
+       */
+      if (name_length + len >= link_len) {
+         link_len = len + name_length + 1;
+         link = (char *)brealloc(link, link_len + 1);
+      }
+
+      memcpy(link + len, entry->d_name, name_length);
+      link[len + name_length] = '\0';
+
+      if (!file_is_excluded(ff_pkt, link)) {
+         rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, our_device, false);
+         if (ff_pkt->linked) {
+            ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
+         }
+      }
+   }
+
+   closedir(directory);
+   free(link);
+   free(entry);
+
+#else
+
+   while (!job_canceled(jcr)) {
+      int name_length;
+      result = readdir(directory);
+      if (result == NULL) {
+         break;
+      }
+
+      name_length = (int)NAMELEN(result);
+
+      /*
+       * Some filesystems violate against the rules and return filenames
+       * longer than _PC_NAME_MAX. Log the error and continue.
+       */
+      if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
+         Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"), result->d_name, name_length);
+         continue;
+      }
+
+      /*
+       * Skip `.', `..', and excluded file names.
+       */
+      if (result->d_name[0] == '\0' ||
+         (result->d_name[0] == '.' && (result->d_name[1] == '\0' ||
+         (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
+         continue;
+      }
+
+      /*
+       * Make sure there is enough room to store the whole name.
+       */
+      if (name_length + len >= link_len) {
+         link_len = len + name_length + 1;
+         link = (char *)brealloc(link, link_len + 1);
+      }
+
+      memcpy(link + len, result->d_name, name_length);
+      link[len + name_length] = '\0';
+
+      if (!file_is_excluded(ff_pkt, link)) {
+         rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, our_device, false);
+         if (ff_pkt->linked) {
+            ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
+         }
+      }
+   }
+
+   closedir(directory);
+   free(link);
+#endif
+
+   return rtn_stat;
+}
+
+/**
+ * Process all entries of a directory from its prefetched listing (recursing).
+ */
+static inline int process_prefetched_entries(JCR *jcr, FF_PKT *ff_pkt,
+                                             int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                                             f_prefetch_dir *prefetch_dir, char *link, int len, int link_len,
+                                             dev_t our_device)
+{
+   int rtn_stat = 1;
+   f_prefetch_entry *entry;
+
+   while (!job_canceled(jcr) && (entry = prefetch_next_entry(ff_pkt, prefetch_dir))) {
+      if (entry->too_long) {
+         Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"), entry->name, entry->name_length);
+         continue;
+      }
+
+      if (entry->excluded) {
+         continue;
+      }
+
+      /*
+       * Make sure there is enough room to store the whole name.
+       */
+      if (entry->name_length + len >= link_len) {
+         link_len = len + entry->name_length + 1;
+         link = (char *)brealloc(link, link_len + 1);
+      }
+
+      memcpy(link + len, entry->name, entry->name_length);
+      link[len + entry->name_length] = '\0';
+
+      /*
+       * Hand over the prefetched listing of a subdirectory to process_directory().
+       */
+      ff_pkt->prefetch_subdir = entry->subdir;
+      entry->subdir = NULL;
+
+      rtn_stat = find_one_prefetched_file(jcr, ff_pkt, handle_file, link, entry, our_device);
+      if (ff_pkt->linked) {
+         ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
+      }
+
+      /*
+       * Directory was not descended into.
+       */
+      if (ff_pkt->prefetch_subdir) {
+         prefetch_close_dir(ff_pkt, ff_pkt->prefetch_subdir);
+         ff_pkt->prefetch_subdir = NULL;
+      }
+   }
+
+   prefetch_close_dir(ff_pkt, prefetch_dir);
+   free(link);
+
+   return rtn_stat;
+}
+
+/**
+ * Handling of a directory.
+ */
+static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
+                                    int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                                    char *fname, dev_t parent_device, bool top_level)
+{
+   int rtn_stat;
+   DIR *directory = NULL;
+   f_prefetch_dir *prefetch_dir = NULL;
+   int ff_errno;
    char *link;
    int link_len;
    int len;
@@ -707,7 +903,25 @@ static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
     * Descend into or "recurse" into the directory to read all the files in it.
     */
    errno = 0;
-   if ((directory = opendir(fname)) == NULL) {
+   if (ff_pkt->prefetch_workers > 0) {
+      if (!ff_pkt->prefetch) {
+         ff_pkt->prefetch = start_prefetch(jcr, ff_pkt, ff_pkt->prefetch_workers);
+      }
+
+      /*
+       * Use the listing prefetched as part of the parent directory if there is one.
+       */
+      prefetch_dir = prefetch_open_dir(ff_pkt, link, our_device);
+      if (!prefetch_dir_opened(prefetch_dir, &ff_errno)) {
+         prefetch_close_dir(ff_pkt, prefetch_dir);
+         prefetch_dir = NULL;
+         errno = ff_errno;
+      }
+   } else {
+      directory = opendir(fname);
+   }
+
+   if (!directory && !prefetch_dir) {
       ff_pkt->type = FT_NOOPEN;
       ff_pkt->ff_errno = errno;
       rtn_stat = handle_file(jcr, ff_pkt, top_level);
@@ -719,124 +933,14 @@ static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
       return rtn_stat;
    }
 
-   /*
-    * Process all files in this directory entry (recursing).
-    * This would possibly run faster if we chdir to the directory
-    * before traversing it.
-    */
-   rtn_stat = 1;
-
-   /*
-    * Allocate some extra room so an overflow of the d_name with more then
-    * name_max bytes doesn't kill us right away. We check in the loop if
-    * an overflow has not happened.
-    */
-#ifdef USE_READDIR_R
-   int status;
-
-   entry = (struct dirent *)malloc(sizeof(struct dirent) + name_max + 100);
-   while (!job_canceled(jcr)) {
-      int name_length;
-
-      status = readdir_r(directory, entry, &result);
-      if (status != 0 || result == NULL) {
-         break;
-      }
-
-      name_length = (int)NAMELEN(entry);
-
-      /*
-       * Some filesystems violate against the rules and return filenames
-       * longer than _PC_NAME_MAX. Log the error and continue.
-       */
-      if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
-         Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"), entry->d_name, name_length);
-         continue;
-      }
-
-      /*
-       * Skip `.', `..', and excluded file names.
-       */
-      if (entry->d_name[0] == '\0' ||
-         (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
-         (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))) {
-         continue;
-      }
-
-      /*
-       * Make sure there is enough room to store the whole name.
-       */
-      if (name_length + len >= link_len) {
-         link_len = len + name_length + 1;
-         link = (char *)brealloc(link, link_len + 1);
-      }
-
-      memcpy(link + len, entry->d_name, name_length);
-      link[len + name_length] = '\0';
-
-      if (!file_is_excluded(ff_pkt, link)) {
-         rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, our_device, false);
-         if (ff_pkt->linked) {
-            ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
-         }
-      }
-   }
-
-   closedir(directory);
-   free(link);
-   free(entry);
-
-#else
-
-   while (!job_canceled(jcr)) {
-      int name_length;
-      result = readdir(directory);
-      if (result == NULL) {
-         break;
-      }
-
-      name_length = (int)NAMELEN(result);
-
-      /*
-       * Some filesystems violate against the rules and return filenames
-       * longer than _PC_NAME_MAX. Log the error and continue.
-       */
-      if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
-         Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"), result->d_name, name_length);
-         continue;
-      }
-
-      /*
-       * Skip `.', `..', and excluded file names.
-       */
-      if (result->d_name[0] == '\0' ||
-         (result->d_name[0] == '.' && (result->d_name[1] == '\0' ||
-         (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
-         continue;
-      }
-
-      /*
-       * Make sure there is enough room to store the whole name.
-       */
-      if (name_length + len >= link_len) {
-         link_len = len + name_length + 1;
-         link = (char *)brealloc(link, link_len + 1);
-      }
-
-      memcpy(link + len, result->d_name, name_length);
-      link[len + name_length] = '\0';
-
-      if (!file_is_excluded(ff_pkt, link)) {
-         rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, our_device, false);
-         if (ff_pkt->linked) {
-            ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
-         }
-      }
+   if (prefetch_dir) {
+      rtn_stat = process_prefetched_entries(jcr, ff_pkt, handle_file, prefetch_dir,
+                                            link, len, link_len, our_device);
+   } else {
+      rtn_stat = process_directory_entries(jcr, ff_pkt, handle_file, directory,
+                                           link, len, link_len, our_device);
    }
 
-   closedir(directory);
-   free(link);
-#endif
    /*
     * Now that we have recursed through all the files in the
     * directory, we "save" the directory so that after all
@@ -952,31 +1056,15 @@ static inline bool needs_processing(JCR *jcr, FF_PKT *ff_pkt, char *fname)
 }
 
 /**
- * Find a single file.
- *
- * handle_file is the callback for handling the file.
- *    p is the filename
- *    parent_device is the device we are currently on
- *    top_level is 1 when not recursing or 0 when descending into a directory.
+ * Process a single file of which the stat info is filled in ff_pkt->statp.
  */
-int find_one_file(JCR *jcr, FF_PKT *ff_pkt,
-                  int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
-                  char *fname, dev_t parent_device, bool top_level)
+static int process_one_file(JCR *jcr, FF_PKT *ff_pkt,
+                            int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                            char *fname, dev_t parent_device, bool top_level)
 {
    int rtn_stat;
    bool done = false;
 
-   ff_pkt->fname = ff_pkt->link = fname;
-   ff_pkt->type = FT_UNSET;
-   if (lstat(fname, &ff_pkt->statp) != 0) {
-       /*
-        * Cannot stat file
-        */
-       ff_pkt->type = FT_NOSTAT;
-       ff_pkt->ff_errno = errno;
-       return handle_file(jcr, ff_pkt, top_level);
-   }
-
    Dmsg1(300, "File ----: %s\n", fname);
 
    /*
@@ -1085,6 +1173,54 @@ int find_one_file(JCR *jcr, FF_PKT *ff_pkt,
    }
 }
 
+/**
+ * Find a single file.
+ *
+ * handle_file is the callback for handling the file.
+ *    p is the filename
+ *    parent_device is the device we are currently on
+ *    top_level is 1 when not recursing or 0 when descending into a directory.
+ */
+int find_one_file(JCR *jcr, FF_PKT *ff_pkt,
+                  int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                  char *fname, dev_t parent_device, bool top_level)
+{
+   ff_pkt->fname = ff_pkt->link = fname;
+   ff_pkt->type = FT_UNSET;
+   if (lstat(fname, &ff_pkt->statp) != 0) {
+       /*
+        * Cannot stat file
+        */
+       ff_pkt->type = FT_NOSTAT;
+       ff_pkt->ff_errno = errno;
+       return handle_file(jcr, ff_pkt, top_level);
+   }
+
+   return process_one_file(jcr, ff_pkt, handle_file, fname, parent_device, top_level);
+}
+
+/**
+ * Find a single file of which the stat info was prefetched.
+ */
+static int find_one_prefetched_file(JCR *jcr, FF_PKT *ff_pkt,
+                                    int handle_file(JCR *jcr, FF_PKT *ff, bool top_level),
+                                    char *fname, f_prefetch_entry *entry, dev_t parent_device)
+{
+   ff_pkt->fname = ff_pkt->link = fname;
+   ff_pkt->type = FT_UNSET;
+   if (entry->ff_errno != 0) {
+       /*
+        * Cannot stat file
+        */
+       ff_pkt->type = FT_NOSTAT;
+       ff_pkt->ff_errno = entry->ff_errno;
+       return handle_file(jcr, ff_pkt, false);
+   }
+   memcpy(&ff_pkt->statp, &entry->statp, sizeof(ff_pkt->statp));
+
+   return process_one_file(jcr, ff_pkt, handle_file, fname, parent_device, false);
+}
+
 int term_find_one(FF_PKT *ff)
 {
    int count;
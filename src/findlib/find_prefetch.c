@@ -0,0 +1,616 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel prefetching of directory listings for the find_files walker.
+ *
+ * The walker in find_one.c stays single threaded and hands the files
+ * to the callback in exactly the same order as without prefetching.
+ * What is done in parallel is reading the directory entries and the
+ * lstat() of each entry. When the walker reads a directory, the sibling
+ * subdirectories that come next in the listing are scanned ahead of
+ * time by a pool of worker threads. This hides the metadata latency on
+ * network filesystems.
+ *
+ * Directory listings are read in segments of PREFETCH_SEGMENT_SIZE
+ * entries. A worker reads the names of one segment while holding the
+ * directory lock and then lstat()s them without any lock. The walker
+ * consumes the segments in readdir order. When the segment it needs is
+ * still queued it fills it itself, so it never waits behind lookahead
+ * work. The number of directories scanned ahead is bounded, and so is
+ * the queue of work for the threads.
+ *
+ * Prefetching never crosses a filesystem boundary. The walker handles
+ * a mountpoint itself, so onefs and the fstype and drivetype
+ * restrictions are applied exactly as before. Entries excluded by the
+ * exclude list are not stat'ed at all.
+ */
+
+#include "bareos.h"
+#include "jcr.h"
+#include "find.h"
+#include "lib/cbuf.h"
+
+#if defined(HAVE_SYS_XATTR_H)
+#include <sys/xattr.h>
+#endif
+
+static const int dbglvl = 450;
+
+extern int32_t name_max;              /* filename max length */
+
+/*
+ * Number of directories that can be prefetched ahead per worker thread.
+ */
+#define PREFETCH_DIRS_PER_WORKER 4
+
+struct f_prefetch_segment {
+   f_prefetch_segment *next;          /* Next segment of this directory */
+   bool done;                         /* All entries are stat'ed */
+   int nr_entries;                    /* Number of entries in this segment */
+   int next_entry;                    /* Next entry to hand out */
+   int next_lookahead;                /* Next entry to look at for prefetching subdirectories */
+   f_prefetch_entry entries[PREFETCH_SEGMENT_SIZE];
+};
+
+struct f_prefetch_dir {
+   f_prefetch *pf;                    /* Prefetch engine this directory belongs to */
+   char *dirname;                     /* Directory name with a trailing slash */
+   int dirname_len;                   /* Length of the directory name */
+   dev_t device;                      /* Device the directory lives on */
+   DIR *directory;                    /* Open directory stream */
+   int ff_errno;                      /* Errno of opendir() */
+   bool opened;                       /* opendir() was done */
+   bool eof;                          /* All entries are read */
+   bool closed;                       /* Walker is done with this directory */
+   bool lookahead;                    /* Counted as a lookahead directory */
+   int queued;                        /* Number of fills queued for the workers */
+   int running;                       /* Number of fills in progress */
+   int refcnt;                        /* Number of references (walker + queued fills) */
+   f_prefetch_segment *head;          /* First unconsumed segment */
+   f_prefetch_segment *tail;          /* Last segment */
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+};
+
+struct f_prefetch {
+   JCR *jcr;                          /* Job we are prefetching for */
+   FF_PKT *ff;                        /* Find files packet of the walker */
+   int nr_workers;                    /* Number of worker threads */
+   int max_dirs;                      /* Maximum number of lookahead directories */
+   int nr_dirs;                       /* Current number of lookahead directories */
+   bool warm_xattr;                   /* Also prefetch the xattr (and ACL) names */
+   circbuf *queue;                    /* Queue of directories to fill a segment for */
+   pthread_t *thread_ids;             /* Worker threads */
+};
+
+static inline void free_segment(f_prefetch_segment *seg)
+{
+   for (int i = 0; i < seg->nr_entries; i++) {
+      free(seg->entries[i].name);
+   }
+   free(seg);
+}
+
+/**
+ * Drop a reference to a directory, the last one frees it.
+ */
+static void release_dir(f_prefetch_dir *dir)
+{
+   f_prefetch_segment *seg;
+
+   P(dir->lock);
+   if (--dir->refcnt > 0) {
+      V(dir->lock);
+      return;
+   }
+   V(dir->lock);
+
+   while ((seg = dir->head)) {
+      dir->head = seg->next;
+      free_segment(seg);
+   }
+
+   if (dir->directory) {
+      closedir(dir->directory);
+   }
+
+   pthread_cond_destroy(&dir->cond);
+   pthread_mutex_destroy(&dir->lock);
+   free(dir->dirname);
+   free(dir);
+}
+
+static f_prefetch_dir *new_prefetch_dir(f_prefetch *pf, const char *dirname, dev_t device)
+{
+   f_prefetch_dir *dir;
+
+   dir = (f_prefetch_dir *)malloc(sizeof(f_prefetch_dir));
+   memset(dir, 0, sizeof(f_prefetch_dir));
+   dir->pf = pf;
+   dir->dirname = bstrdup(dirname);
+   dir->dirname_len = strlen(dirname);
+   dir->device = device;
+   dir->refcnt = 1;
+   pthread_mutex_init(&dir->lock, NULL);
+   pthread_cond_init(&dir->cond, NULL);
+
+   return dir;
+}
+
+/**
+ * Queue a fill of the next segment of a directory for the workers.
+ * Must be called with the directory locked, it never blocks.
+ */
+static inline bool queue_fill(f_prefetch_dir *dir)
+{
+   f_prefetch *pf = dir->pf;
+
+   /*
+    * Only the walker thread enqueues so when the queue is not full
+    * now the enqueue below will not block.
+    */
+   if (pf->queue->full()) {
+      return false;
+   }
+
+   dir->queued++;
+   dir->refcnt++;
+   pf->queue->enqueue(dir);
+
+   return true;
+}
+
+/**
+ * Open the directory stream, must be called with the directory locked.
+ */
+static inline void open_dir(f_prefetch_dir *dir)
+{
+   errno = 0;
+   dir->directory = opendir(dir->dirname);
+   if (!dir->directory) {
+      dir->ff_errno = errno;
+      dir->eof = true;
+   }
+   dir->opened = true;
+}
+
+/**
+ * Warm the attribute cache for the xattrs and ACLs which are read
+ * later by build_xattr_streams() and build_acl_streams().
+ */
+static inline void prefetch_xattr(const char *fname)
+{
+#if defined(HAVE_LLISTXATTR)
+   char buf[4096];
+
+   llistxattr(fname, buf, sizeof(buf));
+#endif
+}
+
+/**
+ * Read the next segment of a directory and lstat() all its entries.
+ *
+ * The caller has accounted for this fill in dir->running.
+ */
+static void fill_segment(f_prefetch_dir *dir)
+{
+   f_prefetch *pf = dir->pf;
+   f_prefetch_segment *seg = NULL;
+   f_prefetch_entry *entry;
+   struct dirent *result;
+#ifdef USE_READDIR_R
+   struct dirent *dentry;
+   int status;
+#endif
+   POOL_MEM fname(PM_FNAME);
+
+   P(dir->lock);
+   if (!dir->opened) {
+      open_dir(dir);
+   }
+
+   if (dir->eof || dir->closed) {
+      goto bail_out;
+   }
+
+   /*
+    * Append the segment now so the segments stay in readdir order.
+    */
+   seg = (f_prefetch_segment *)malloc(sizeof(f_prefetch_segment));
+   memset(seg, 0, offsetof(f_prefetch_segment, entries));
+   if (dir->tail) {
+      dir->tail->next = seg;
+   } else {
+      dir->head = seg;
+   }
+   dir->tail = seg;
+
+#ifdef USE_READDIR_R
+   dentry = (struct dirent *)malloc(sizeof(struct dirent) + name_max + 100);
+#endif
+   while (seg->nr_entries < PREFETCH_SEGMENT_SIZE) {
+#ifdef USE_READDIR_R
+      status = readdir_r(dir->directory, dentry, &result);
+      if (status != 0) {
+         result = NULL;
+      }
+#else
+      result = readdir(dir->directory);
+#endif
+      if (result == NULL) {
+         dir->eof = true;
+         break;
+      }
+
+      /*
+       * Skip `.' and `..'.
+       */
+      if (result->d_name[0] == '\0' ||
+         (result->d_name[0] == '.' && (result->d_name[1] == '\0' ||
+         (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
+         continue;
+      }
+
+      entry = &seg->entries[seg->nr_entries++];
+      memset(entry, 0, sizeof(f_prefetch_entry));
+      entry->name_length = (int)NAMELEN(result);
+      entry->name = bstrdup(result->d_name);
+
+      /*
+       * Some filesystems violate against the rules and return filenames
+       * longer than _PC_NAME_MAX. The walker logs the error.
+       */
+      if ((name_max + 1) <= ((int)sizeof(struct dirent) + entry->name_length)) {
+         entry->too_long = true;
+      }
+   }
+#ifdef USE_READDIR_R
+   free(dentry);
+#endif
+   V(dir->lock);
+
+   /*
+    * Now do the slow part without holding any lock.
+    */
+   for (int i = 0; i < seg->nr_entries; i++) {
+      entry = &seg->entries[i];
+      if (entry->too_long) {
+         continue;
+      }
+
+      Mmsg(fname, "%s%s", dir->dirname, entry->name);
+      if (file_is_excluded(pf->ff, fname.c_str())) {
+         entry->excluded = true;
+         continue;
+      }
+
+      if (lstat(fname.c_str(), &entry->statp) != 0) {
+         entry->ff_errno = errno;
+         if (entry->ff_errno == 0) {
+            entry->ff_errno = ENOENT;
+         }
+         continue;
+      }
+
+      if (pf->warm_xattr) {
+         prefetch_xattr(fname.c_str());
+      }
+   }
+
+   P(dir->lock);
+   seg->done = true;
+
+bail_out:
+   dir->running--;
+   pthread_cond_broadcast(&dir->cond);
+   V(dir->lock);
+}
+
+/**
+ * Prefetch worker thread.
+ */
+static void *prefetch_worker(void *arg)
+{
+   f_prefetch *pf = (f_prefetch *)arg;
+   f_prefetch_dir *dir;
+
+   while ((dir = (f_prefetch_dir *)pf->queue->dequeue())) {
+      bool claimed = false;
+
+      /*
+       * The walker may have filled this segment itself or
+       * may already be done with the directory.
+       */
+      P(dir->lock);
+      if (dir->queued > 0) {
+         dir->queued--;
+         if (!dir->closed) {
+            dir->running++;
+            claimed = true;
+         }
+      }
+      V(dir->lock);
+
+      if (claimed) {
+         fill_segment(dir);
+      }
+      release_dir(dir);
+   }
+
+   return NULL;
+}
+
+/**
+ * Start prefetching the subdirectories that follow in the current
+ * segment of the directory the walker is reading.
+ */
+static void schedule_lookahead(f_prefetch_dir *dir, f_prefetch_segment *seg)
+{
+   f_prefetch *pf = dir->pf;
+   f_prefetch_entry *entry;
+   f_prefetch_dir *subdir;
+   POOL_MEM dirname(PM_FNAME);
+
+   if (bit_is_set(FO_NO_RECURSION, pf->ff->flags)) {
+      return;
+   }
+
+   /*
+    * Only look at the entries not yet handed out to the walker.
+    */
+   if (seg->next_lookahead < seg->next_entry) {
+      seg->next_lookahead = seg->next_entry;
+   }
+
+   while (seg->next_lookahead < seg->nr_entries && pf->nr_dirs < pf->max_dirs) {
+      entry = &seg->entries[seg->next_lookahead++];
+
+      if (entry->too_long || entry->excluded || entry->ff_errno ||
+          !S_ISDIR(entry->statp.st_mode) ||
+          entry->statp.st_dev != dir->device) {
+         continue;
+      }
+
+      Mmsg(dirname, "%s%s/", dir->dirname, entry->name);
+      subdir = new_prefetch_dir(pf, dirname.c_str(), entry->statp.st_dev);
+      P(subdir->lock);
+      if (!queue_fill(subdir)) {
+         V(subdir->lock);
+         release_dir(subdir);
+         seg->next_lookahead--;
+         break;
+      }
+      subdir->lookahead = true;
+      V(subdir->lock);
+
+      entry->subdir = subdir;
+      pf->nr_dirs++;
+   }
+}
+
+/**
+ * Start the prefetch engine with the given number of worker threads.
+ */
+f_prefetch *start_prefetch(JCR *jcr, FF_PKT *ff, int workers)
+{
+   f_prefetch *pf;
+
+   pf = (f_prefetch *)malloc(sizeof(f_prefetch));
+   memset(pf, 0, sizeof(f_prefetch));
+   pf->jcr = jcr;
+   pf->ff = ff;
+   pf->nr_workers = workers;
+   pf->max_dirs = workers * PREFETCH_DIRS_PER_WORKER;
+
+   /*
+    * Each lookahead directory has at most one fill queued, and so do the
+    * directories the walker is in. Size the queue to leave room for both.
+    */
+   pf->queue = New(circbuf(2 * pf->max_dirs + workers));
+
+   /*
+    * See if any of the options in the fileset wants ACLs or xattrs saved.
+    */
+   if (ff->fileset) {
+      for (int i = 0; i < ff->fileset->include_list.size() && !pf->warm_xattr; i++) {
+         findINCEXE *incexe = (findINCEXE *)ff->fileset->include_list.get(i);
+
+         for (int j = 0; j < incexe->opts_list.size(); j++) {
+            findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
+
+            if (bit_is_set(FO_ACL, fo->flags) || bit_is_set(FO_XATTR, fo->flags)) {
+               pf->warm_xattr = true;
+               break;
+            }
+         }
+      }
+   }
+
+   pf->thread_ids = (pthread_t *)malloc(workers * sizeof(pthread_t));
+   for (int i = 0; i < workers; i++) {
+      pthread_create(&pf->thread_ids[i], NULL, prefetch_worker, (void *)pf);
+   }
+
+   Dmsg2(dbglvl, "Started directory prefetching with %d workers and %d lookahead dirs\n",
+         pf->nr_workers, pf->max_dirs);
+
+   return pf;
+}
+
+/**
+ * Stop the prefetch engine, all directories must be closed.
+ */
+void stop_prefetch(f_prefetch *pf)
+{
+   for (int i = 0; i < pf->nr_workers; i++) {
+      pf->queue->enqueue(NULL);
+   }
+
+   for (int i = 0; i < pf->nr_workers; i++) {
+      pthread_join(pf->thread_ids[i], NULL);
+   }
+
+   delete pf->queue;
+   free(pf->thread_ids);
+   free(pf);
+}
+
+/**
+ * Get the listing of a directory the walker descends into.
+ *
+ * When the directory was prefetched as a sibling the prefetched listing
+ * is used, which the walker passes in ff->prefetch_subdir.
+ */
+f_prefetch_dir *prefetch_open_dir(FF_PKT *ff, const char *dirname, dev_t device)
+{
+   f_prefetch_dir *dir;
+
+   dir = ff->prefetch_subdir;
+   if (dir) {
+      ff->prefetch_subdir = NULL;
+      return dir;
+   }
+
+   return new_prefetch_dir(ff->prefetch, dirname, device);
+}
+
+/**
+ * See if the directory could be opened.
+ */
+bool prefetch_dir_opened(f_prefetch_dir *dir, int *ff_errno)
+{
+   bool retval;
+
+   P(dir->lock);
+   if (!dir->opened) {
+      open_dir(dir);
+   }
+   retval = (dir->directory != NULL);
+   *ff_errno = dir->ff_errno;
+   V(dir->lock);
+
+   return retval;
+}
+
+/**
+ * Get the next entry of a directory in readdir order, NULL at the end.
+ */
+f_prefetch_entry *prefetch_next_entry(FF_PKT *ff, f_prefetch_dir *dir)
+{
+   f_prefetch_segment *seg;
+   f_prefetch_entry *entry = NULL;
+
+   P(dir->lock);
+   while (!job_canceled(ff->prefetch->jcr)) {
+      seg = dir->head;
+      if (seg) {
+         if (!seg->done) {
+            pthread_cond_wait(&dir->cond, &dir->lock);
+            continue;
+         }
+
+         if (seg->next_entry < seg->nr_entries) {
+            /*
+             * When starting on a new segment already queue the read of the next one.
+             */
+            if (seg->next_entry == 0 && seg->next == NULL &&
+                !dir->eof && dir->queued == 0 && dir->running == 0) {
+               queue_fill(dir);
+            }
+
+            entry = &seg->entries[seg->next_entry++];
+            break;
+         }
+
+         /*
+          * Segment consumed, any subdirectory in it is handled by now.
+          */
+         dir->head = seg->next;
+         if (!dir->head) {
+            dir->tail = NULL;
+         }
+         free_segment(seg);
+         continue;
+      }
+
+      if (dir->eof && dir->running == 0) {
+         break;
+      }
+
+      if (dir->queued > 0 || dir->running == 0) {
+         /*
+          * Fill the segment we need ourself instead of waiting for a worker.
+          */
+         if (dir->queued > 0) {
+            dir->queued--;
+         }
+         dir->running++;
+         V(dir->lock);
+         fill_segment(dir);
+         P(dir->lock);
+      } else {
+         pthread_cond_wait(&dir->cond, &dir->lock);
+      }
+   }
+   V(dir->lock);
+
+   if (entry) {
+      schedule_lookahead(dir, seg);
+   }
+
+   return entry;
+}
+
+/**
+ * The walker is done with a directory.
+ */
+void prefetch_close_dir(FF_PKT *ff, f_prefetch_dir *dir)
+{
+   f_prefetch *pf = dir->pf;
+   f_prefetch_segment *seg;
+
+   P(dir->lock);
+   dir->closed = true;
+
+   /*
+    * Close the lookahead directories nobody will use anymore.
+    */
+   for (seg = dir->head; seg; seg = seg->next) {
+      if (!seg->done) {
+         continue;
+      }
+
+      for (int i = 0; i < seg->nr_entries; i++) {
+         if (seg->entries[i].subdir) {
+            prefetch_close_dir(ff, seg->entries[i].subdir);
+            seg->entries[i].subdir = NULL;
+         }
+      }
+   }
+   V(dir->lock);
+
+   if (dir->lookahead) {
+      pf->nr_dirs--;
+   }
+
+   release_dir(dir);
+}
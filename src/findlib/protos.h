@@ -43,6 +43,7 @@ int create_file(JCR *jcr, ATTR *attr, BFILE *ofd, int replace);
 FF_PKT *init_find_files();
 void set_find_options(FF_PKT *ff, bool incremental, time_t mtime);
 void set_find_changed_function(FF_PKT *ff, bool check_fct(JCR *jcr, FF_PKT *ff));
+void set_find_prefetch_workers(FF_PKT *ff, int workers);
 int find_files(JCR *jcr, FF_PKT *ff, int file_sub(JCR *, FF_PKT *ff_pkt, bool),
                int plugin_sub(JCR *, FF_PKT *ff_pkt, bool));
 bool match_files(JCR *jcr, FF_PKT *ff, int sub(JCR *, FF_PKT *ff_pkt, bool));
@@ -74,6 +75,14 @@ int find_one_file(JCR *jcr, FF_PKT *ff,
                   int handle_file(JCR *jcr, FF_PKT *ff_pkt, bool top_level),
                   char *p, dev_t parent_device, bool top_level);
 int term_find_one(FF_PKT *ff);
+
+/* find_prefetch.c */
+f_prefetch *start_prefetch(JCR *jcr, FF_PKT *ff, int workers);
+void stop_prefetch(f_prefetch *pf);
+f_prefetch_dir *prefetch_open_dir(FF_PKT *ff, const char *dirname, dev_t device);
+bool prefetch_dir_opened(f_prefetch_dir *dir, int *ff_errno);
+f_prefetch_entry *prefetch_next_entry(FF_PKT *ff, f_prefetch_dir *dir);
+void prefetch_close_dir(FF_PKT *ff, f_prefetch_dir *dir);
 bool has_file_changed(JCR *jcr, FF_PKT *ff_pkt);
 bool check_changes(JCR *jcr, FF_PKT *ff_pkt);
 
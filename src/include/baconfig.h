@@ -232,6 +232,9 @@ void InitWinAPIWrapper();
 /* Size of File Address stored in STREAM_SPARSE_DATA. Do NOT change! */
 #define OFFSET_FADDR_SIZE (sizeof(uint64_t))
 
+/* Size of the chunk header (file address, SHA1 digest and length) of STREAM_DEDUP_DATA. Do NOT change! */
+#define DEDUP_CHUNK_HDR_SIZE (OFFSET_FADDR_SIZE + 20 + sizeof(uint32_t))
+
 /* Size of crypto length stored at head of crypto buffer. Do NOT change! */
 #define CRYPTO_LEN_SIZE ((int)sizeof(uint32_t))
 
@@ -39,6 +39,14 @@
 #define COMPRESS_FZFZ  0x465A465A
 #define COMPRESS_FZ4L  0x465A344C
 #define COMPRESS_FZ4H  0x465A3448
+#define COMPRESS_ZSTD  0x5a535444
+
+/**
+ * For ZSTD the compression level can have this flag or'ed in
+ * to request long distance matching.
+ */
+#define COMPRESS_ZSTD_LONG 0x8000
+#define COMPRESS_ZSTD_LEVEL(level) ((level) & ~COMPRESS_ZSTD_LONG)
 
 /**
  * Compression header version
@@ -70,13 +70,16 @@ enum {
    FO_PLUGIN = 29,       /**< Plugin data stream -- return to plugin on restore */
    FO_OFFSETS = 30,      /**< Keep I/O file offsets */
    FO_NO_AUTOEXCL = 31,  /**< Don't use autoexclude methods */
-   FO_FORCE_ENCRYPT = 32 /**< Force encryption */
+   FO_FORCE_ENCRYPT = 32, /**< Force encryption */
+   FO_IO_NOCACHE = 33,   /**< Read sequentially and drop the data from the page cache */
+   FO_IO_DIRECT = 34,    /**< Read using O_DIRECT */
+   FO_DEDUP = 35         /**< Send the data as deduplicated chunks */
 };
 
 /**
  * Keep this set to the last entry in the enum.
  */
-#define FO_MAX FO_FORCE_ENCRYPT
+#define FO_MAX FO_DEDUP
 
 /**
  * Make sure you have enough bits to store all above bit fields.
@@ -194,6 +194,9 @@ struct CP_THREAD_CTX;
 #ifdef FILE_DAEMON
 class htable;
 class B_ACCURATE;
+struct b_pipeline;
+struct b_streams;
+struct b_dedup;
 struct acl_data_t;
 struct xattr_data_t;
 
@@ -262,6 +265,10 @@ struct CMPRS_CTX {
 #endif
 #ifdef HAVE_FASTLZ
       void *pZFAST;                       /**< FASTLZ compression session data */
+#endif
+#ifdef HAVE_ZSTD
+      void *pZSTD;                        /**< ZSTD compression session data */
+      void *pZSTDD;                       /**< ZSTD decompression session data */
 #endif
    } workset;
 };
@@ -429,6 +436,8 @@ public:
     */
    pthread_t SD_msg_chan;                 /**< Message channel thread id */
    bool SD_msg_chan_started;              /**< Message channel thread started */
+   struct attr_pipeline *attr_pipeline;   /**< Attribute insert thread of the message channel */
+   bool attr_pipeline_failed;             /**< Attribute insert thread could not be started */
    pthread_cond_t start_wait;             /**< Wait for FD to start Job */
    pthread_cond_t term_wait;              /**< Wait for job termination */
    pthread_cond_t nextrun_ready;          /**< Wait for job next run to become ready */
@@ -531,6 +540,10 @@ public:
    bool got_metadata;                     /**< Set when found job_metadata */
    bool multi_restore;                    /**< Dir can do multiple storage restore */
    B_ACCURATE *file_list;                 /**< Previous file list (accurate mode) */
+   b_pipeline *pipeline;                  /**< Backup data pipeline (multi-threaded read/compress/send) */
+   b_streams *sd_streams;                 /**< Data connections to the SD of a multi stream backup */
+   b_dedup *dedup;                        /**< Chunking of deduplicated data */
+   bool sd_dedup;                         /**< SD keeps a chunk store for deduplicated data */
    uint64_t base_size;                    /**< Compute space saved with base job */
 #ifdef HAVE_WIN32
    VSSClient *pVSSClient;                 /**< VSS Client Instance */
@@ -560,6 +573,10 @@ public:
    int32_t CurReadVolume;                 /**< Current read volume number */
    int32_t label_errors;                  /**< Count of label errors */
    bool session_opened;
+   BSOCK **fd_streams;                    /**< Data connections of a multi stream backup, [0] is file_bsock */
+   int32_t max_fd_streams;                /**< Number of slots in fd_streams */
+   int32_t nr_fd_streams;                 /**< Number of data connections used by the FD */
+   char *fd_streams_auth_key;             /**< Key for the additional data connections of the FD */
    bool remote_replicate;                 /**< Replicate data to remote SD */
    long Ticket;                           /**< Ticket for this job */
    bool ignore_label_errors;              /**< Ignore Volume label errors */
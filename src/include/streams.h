@@ -109,6 +109,14 @@
 #define STREAM_ENCRYPTED_FILE_COMPRESSED_DATA  32       /**< Encrypted, compressed data */
 #define STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA 33       /**< Encrypted, compressed Win32 BackupRead data */
 
+/**
+ * Deduplicated data stream. Each record holds one content defined chunk of the file:
+ * the file address, the SHA1 digest and the length of the chunk followed by the chunk
+ * data. When the data is left out the record references a chunk that is kept in the
+ * chunk store of the Storage daemon.
+ */
+#define STREAM_DEDUP_DATA                      34       /**< Deduplicated file data */
+
 #define STREAM_NDMP_SEPARATOR                 999       /**< NDMP separator between multiple data streams of one job */
 
 /**
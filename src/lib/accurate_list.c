@@ -0,0 +1,492 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Binary encoding of the accurate file list the Director sends to the File Daemon.
+ *
+ * The Director collects the rows of the catalog query into frames, sorts
+ * them on filename, prefix compresses the filenames and compresses every
+ * frame with zlib. The File Daemon decodes frame by frame so it can load
+ * the entries into its accurate storage class while the Director is still
+ * reading the rest of the list from the catalog.
+ */
+
+#include "bareos.h"
+#include "ch.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+static const int dbglvl = 200;
+
+struct accurate_list_entry {
+   const char *fname;                /**< Only valid while encoding a frame */
+   uint32_t fname_offset;
+   uint32_t fname_length;
+   uint32_t lstat_offset;
+   uint32_t lstat_length;
+   uint32_t chksum_offset;
+   uint32_t chksum_length;
+   int32_t delta_seq;
+};
+
+/*
+ * Maximum size of one varint encoded 32 bits number.
+ */
+#define VARINT_MAX_SIZE 5
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t value)
+{
+   while (value >= 0x80) {
+      *p++ = (uint8_t)(value | 0x80);
+      value >>= 7;
+   }
+   *p++ = (uint8_t)value;
+
+   return p;
+}
+
+/*
+ * Decode a varint, returns NULL when it runs past the end of the buffer.
+ */
+static inline uint8_t *get_varint(uint8_t *p, uint8_t *end, uint32_t *value)
+{
+   uint32_t result = 0;
+
+   for (int shift = 0; shift < 35 && p < end; shift += 7) {
+      result |= (uint32_t)(*p & 0x7f) << shift;
+      if (!(*p++ & 0x80)) {
+         *value = result;
+         return p;
+      }
+   }
+
+   return NULL;
+}
+
+static int compare_entries(const void *e1, const void *e2)
+{
+   const accurate_list_entry *a = (const accurate_list_entry *)e1;
+   const accurate_list_entry *b = (const accurate_list_entry *)e2;
+   int result;
+
+   result = memcmp(a->fname, b->fname, MIN(a->fname_length, b->fname_length));
+   if (result == 0) {
+      result = (a->fname_length > b->fname_length) - (a->fname_length < b->fname_length);
+   }
+
+   return result;
+}
+
+ACCURATE_LIST_ENCODER::ACCURATE_LIST_ENCODER(bool compress)
+{
+   m_zstream = NULL;
+#ifdef HAVE_LIBZ
+   if (compress) {
+      z_stream *strm = (z_stream *)malloc(sizeof(z_stream));
+
+      memset(strm, 0, sizeof(z_stream));
+      if (deflateInit(strm, Z_BEST_SPEED) == Z_OK) {
+         m_zstream = strm;
+      } else {
+         free(strm);
+      }
+   }
+#endif
+
+   m_entries = (accurate_list_entry *)malloc(ACCURATE_LIST_MAX_RECORDS * sizeof(accurate_list_entry));
+   m_nr_entries = 0;
+   m_data = get_pool_memory(PM_MESSAGE);
+   m_data_length = 0;
+   m_payload = get_pool_memory(PM_MESSAGE);
+   m_frame = get_pool_memory(PM_MESSAGE);
+   m_nr_records = 0;
+   m_bytes_in = 0;
+   m_bytes_out = 0;
+}
+
+ACCURATE_LIST_ENCODER::~ACCURATE_LIST_ENCODER()
+{
+#ifdef HAVE_LIBZ
+   if (m_zstream) {
+      deflateEnd((z_stream *)m_zstream);
+      free(m_zstream);
+   }
+#endif
+
+   free(m_entries);
+   free_pool_memory(m_data);
+   free_pool_memory(m_payload);
+   free_pool_memory(m_frame);
+}
+
+uint32_t ACCURATE_LIST_ENCODER::append_string(const char *str, uint32_t length)
+{
+   uint32_t offset = m_data_length;
+
+   m_data = check_pool_memory_size(m_data, m_data_length + length + 1);
+   memcpy(m_data + m_data_length, str, length);
+   m_data_length += length;
+   m_data[m_data_length] = '\0';
+
+   return offset;
+}
+
+/**
+ * Add one file to the current frame, the caller should flush the frame
+ * when is_full() returns true.
+ */
+bool ACCURATE_LIST_ENCODER::add(const char *path, const char *fname, const char *lstat,
+                                const char *chksum, int32_t delta_seq)
+{
+   accurate_list_entry *entry;
+   uint32_t path_length;
+
+   if (m_nr_entries >= ACCURATE_LIST_MAX_RECORDS) {
+      return false;
+   }
+
+   entry = &m_entries[m_nr_entries++];
+   path_length = strlen(path);
+   entry->fname_offset = append_string(path, path_length);
+   entry->fname_length = path_length + strlen(fname);
+   append_string(fname, entry->fname_length - path_length);
+   entry->lstat_length = strlen(lstat);
+   entry->lstat_offset = append_string(lstat, entry->lstat_length);
+   entry->chksum_length = chksum ? strlen(chksum) : 0;
+   entry->chksum_offset = append_string(chksum ? chksum : "", entry->chksum_length);
+   entry->delta_seq = delta_seq;
+
+   return true;
+}
+
+/**
+ * Sort and encode the records collected so far into one frame.
+ * Returns the length of the frame, the frame itself is available
+ * via get_frame() until the next call.
+ */
+uint32_t ACCURATE_LIST_ENCODER::encode_frame()
+{
+   ser_declare;
+   uint8_t *p;
+   uint32_t payload_length, frame_length;
+   uint32_t compression = 0;
+   accurate_list_entry *prev = NULL;
+   uint8_t record[5 * VARINT_MAX_SIZE];
+
+   /*
+    * The data buffer is stable now so we can point into it for sorting.
+    */
+   for (uint32_t i = 0; i < m_nr_entries; i++) {
+      m_entries[i].fname = m_data + m_entries[i].fname_offset;
+   }
+   qsort(m_entries, m_nr_entries, sizeof(accurate_list_entry), compare_entries);
+
+   m_payload = check_pool_memory_size(m_payload, m_data_length + m_nr_entries * 6 * VARINT_MAX_SIZE);
+   p = (uint8_t *)m_payload;
+   for (uint32_t i = 0; i < m_nr_entries; i++) {
+      accurate_list_entry *entry = &m_entries[i];
+      uint32_t shared = 0;
+      uint32_t record_length;
+      uint8_t *q;
+
+      if (prev) {
+         uint32_t max = MIN(prev->fname_length, entry->fname_length);
+
+         while (shared < max && prev->fname[shared] == entry->fname[shared]) {
+            shared++;
+         }
+      }
+
+      /*
+       * First encode the varints in a scratch buffer to find out the record length.
+       */
+      q = put_varint(record, shared);
+      q = put_varint(q, entry->fname_length - shared);
+      record_length = (q - record) + entry->fname_length - shared;
+      q = put_varint(record, entry->lstat_length);
+      record_length += (q - record) + entry->lstat_length;
+      q = put_varint(record, entry->chksum_length);
+      record_length += (q - record) + entry->chksum_length;
+      q = put_varint(record, (uint32_t)entry->delta_seq);
+      record_length += q - record;
+
+      p = put_varint(p, record_length);
+      p = put_varint(p, shared);
+      p = put_varint(p, entry->fname_length - shared);
+      memcpy(p, entry->fname + shared, entry->fname_length - shared);
+      p += entry->fname_length - shared;
+      p = put_varint(p, entry->lstat_length);
+      memcpy(p, m_data + entry->lstat_offset, entry->lstat_length);
+      p += entry->lstat_length;
+      p = put_varint(p, entry->chksum_length);
+      memcpy(p, m_data + entry->chksum_offset, entry->chksum_length);
+      p += entry->chksum_length;
+      p = put_varint(p, (uint32_t)entry->delta_seq);
+
+      prev = entry;
+   }
+   payload_length = p - (uint8_t *)m_payload;
+
+   /*
+    * Build the frame, fall back to an uncompressed payload when compressing
+    * fails or does not pay off.
+    */
+   frame_length = payload_length;
+#ifdef HAVE_LIBZ
+   if (m_zstream) {
+      z_stream *strm = (z_stream *)m_zstream;
+
+      m_frame = check_pool_memory_size(m_frame, ACCURATE_LIST_FRAME_HEADER_SIZE +
+                                       deflateBound(strm, payload_length));
+      strm->next_in = (Bytef *)m_payload;
+      strm->avail_in = payload_length;
+      strm->next_out = (Bytef *)m_frame + ACCURATE_LIST_FRAME_HEADER_SIZE;
+      strm->avail_out = sizeof_pool_memory(m_frame) - ACCURATE_LIST_FRAME_HEADER_SIZE;
+      if (deflate(strm, Z_FINISH) == Z_STREAM_END && strm->total_out < payload_length) {
+         compression = COMPRESS_GZIP;
+         frame_length = strm->total_out;
+      }
+      deflateReset(strm);
+   }
+#endif
+
+   if (!compression) {
+      m_frame = check_pool_memory_size(m_frame, ACCURATE_LIST_FRAME_HEADER_SIZE + payload_length);
+      memcpy(m_frame + ACCURATE_LIST_FRAME_HEADER_SIZE, m_payload, payload_length);
+   }
+
+   ser_begin(m_frame, ACCURATE_LIST_FRAME_HEADER_SIZE);
+   ser_uint32(compression);
+   ser_uint32(m_nr_entries);
+   ser_uint32(payload_length);
+   ser_end(m_frame, ACCURATE_LIST_FRAME_HEADER_SIZE);
+
+   Dmsg3(dbglvl, "Encoded accurate frame with %u records, %u bytes payload, %u bytes frame\n",
+         m_nr_entries, payload_length, frame_length);
+
+   m_nr_records += m_nr_entries;
+   m_bytes_in += payload_length;
+   m_bytes_out += ACCURATE_LIST_FRAME_HEADER_SIZE + frame_length;
+   m_nr_entries = 0;
+   m_data_length = 0;
+
+   return ACCURATE_LIST_FRAME_HEADER_SIZE + frame_length;
+}
+
+/**
+ * Encode and send the records collected so far.
+ */
+bool ACCURATE_LIST_ENCODER::flush(BSOCK *sock)
+{
+   POOLMEM *tmp;
+
+   if (m_nr_entries == 0) {
+      return true;
+   }
+
+   sock->msglen = encode_frame();
+
+   /*
+    * Swap in the frame buffer to send it without copying.
+    */
+   tmp = sock->msg;
+   sock->msg = m_frame;
+   m_frame = tmp;
+
+   return sock->send();
+}
+
+ACCURATE_LIST_DECODER::ACCURATE_LIST_DECODER()
+{
+   m_zstream = NULL;
+#ifdef HAVE_LIBZ
+   z_stream *strm = (z_stream *)malloc(sizeof(z_stream));
+
+   memset(strm, 0, sizeof(z_stream));
+   if (inflateInit(strm) == Z_OK) {
+      m_zstream = strm;
+   } else {
+      free(strm);
+   }
+#endif
+
+   m_payload = get_pool_memory(PM_MESSAGE);
+   m_next = NULL;
+   m_end = NULL;
+   m_nr_left = 0;
+   m_fname = get_pool_memory(PM_FNAME);
+   m_fname_length = 0;
+   m_lstat = get_pool_memory(PM_MESSAGE);
+   m_chksum = get_pool_memory(PM_MESSAGE);
+}
+
+ACCURATE_LIST_DECODER::~ACCURATE_LIST_DECODER()
+{
+#ifdef HAVE_LIBZ
+   if (m_zstream) {
+      inflateEnd((z_stream *)m_zstream);
+      free(m_zstream);
+   }
+#endif
+
+   free_pool_memory(m_payload);
+   free_pool_memory(m_fname);
+   free_pool_memory(m_lstat);
+   free_pool_memory(m_chksum);
+}
+
+/**
+ * Start decoding a new frame, returns false when the frame is invalid.
+ */
+bool ACCURATE_LIST_DECODER::set_frame(const char *frame, int32_t length)
+{
+   unser_declare;
+   uint32_t compression, nr_records, payload_length;
+
+   if (length < (int32_t)ACCURATE_LIST_FRAME_HEADER_SIZE) {
+      return false;
+   }
+
+   unser_begin(frame, ACCURATE_LIST_FRAME_HEADER_SIZE);
+   unser_uint32(compression);
+   unser_uint32(nr_records);
+   unser_uint32(payload_length);
+   unser_end(frame, ACCURATE_LIST_FRAME_HEADER_SIZE);
+
+   frame += ACCURATE_LIST_FRAME_HEADER_SIZE;
+   length -= ACCURATE_LIST_FRAME_HEADER_SIZE;
+
+   switch (compression) {
+   case 0:
+      if ((uint32_t)length != payload_length) {
+         return false;
+      }
+      m_payload = check_pool_memory_size(m_payload, payload_length + 1);
+      memcpy(m_payload, frame, payload_length);
+      break;
+#ifdef HAVE_LIBZ
+   case COMPRESS_GZIP: {
+      z_stream *strm = (z_stream *)m_zstream;
+      int zstat;
+
+      if (!strm || payload_length > 8 * ACCURATE_LIST_MAX_PAYLOAD_SIZE) {
+         return false;
+      }
+
+      m_payload = check_pool_memory_size(m_payload, payload_length + 1);
+      strm->next_in = (Bytef *)frame;
+      strm->avail_in = length;
+      strm->next_out = (Bytef *)m_payload;
+      strm->avail_out = payload_length;
+      zstat = inflate(strm, Z_FINISH);
+      if (zstat == Z_STREAM_END && strm->total_out != payload_length) {
+         zstat = Z_DATA_ERROR;
+      }
+      inflateReset(strm);
+      if (zstat != Z_STREAM_END) {
+         Dmsg1(dbglvl, "Inflate of accurate frame failed zstat=%d\n", zstat);
+         return false;
+      }
+      break;
+   }
+#endif
+   default:
+      Dmsg1(dbglvl, "Unsupported compression 0x%x of accurate frame\n", compression);
+      return false;
+   }
+
+   m_next = (uint8_t *)m_payload;
+   m_end = m_next + payload_length;
+   m_nr_left = nr_records;
+   m_fname_length = 0;
+
+   return true;
+}
+
+/**
+ * Decode the next record of the current frame.
+ *
+ * Returns 1 when a record was decoded, 0 when the frame is exhausted
+ * and -1 when the frame is corrupt. The returned strings are valid
+ * until the next call.
+ */
+int ACCURATE_LIST_DECODER::next(char **fname, int *fname_length, char **lstat, int *lstat_length,
+                                char **chksum, int *chksum_length, int32_t *delta_seq)
+{
+   uint8_t *p, *end;
+   uint32_t record_length, shared, suffix_length, length, value;
+
+   if (m_nr_left == 0) {
+      return m_next == m_end ? 0 : -1;
+   }
+
+   p = get_varint(m_next, m_end, &record_length);
+   if (!p || record_length > (uint32_t)(m_end - p)) {
+      return -1;
+   }
+   end = p + record_length;
+   m_next = end;
+   m_nr_left--;
+
+   if (!(p = get_varint(p, end, &shared)) ||
+       !(p = get_varint(p, end, &suffix_length)) ||
+       shared > (uint32_t)m_fname_length ||
+       suffix_length > (uint32_t)(end - p)) {
+      return -1;
+   }
+   m_fname = check_pool_memory_size(m_fname, shared + suffix_length + 1);
+   memcpy(m_fname + shared, p, suffix_length);
+   m_fname_length = shared + suffix_length;
+   m_fname[m_fname_length] = '\0';
+   p += suffix_length;
+
+   if (!(p = get_varint(p, end, &length)) || length > (uint32_t)(end - p)) {
+      return -1;
+   }
+   m_lstat = check_pool_memory_size(m_lstat, length + 1);
+   memcpy(m_lstat, p, length);
+   m_lstat[length] = '\0';
+   *lstat_length = length;
+   p += length;
+
+   if (!(p = get_varint(p, end, &length)) || length > (uint32_t)(end - p)) {
+      return -1;
+   }
+   m_chksum = check_pool_memory_size(m_chksum, length + 1);
+   memcpy(m_chksum, p, length);
+   m_chksum[length] = '\0';
+   *chksum_length = length;
+   p += length;
+
+   if (!(p = get_varint(p, end, &value))) {
+      return -1;
+   }
+
+   *fname = m_fname;
+   *fname_length = m_fname_length;
+   *lstat = m_lstat;
+   *chksum = length ? m_chksum : NULL;
+   *delta_seq = (int32_t)value;
+
+   return 1;
+}
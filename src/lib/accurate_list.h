@@ -0,0 +1,106 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Binary encoding of the accurate file list the Director sends to the File Daemon.
+ *
+ * The list is sent as a sequence of frames, each frame is one network message:
+ *
+ *    uint32_t compression   (0 or COMPRESS_GZIP)
+ *    uint32_t nr_records
+ *    uint32_t payload_length (uncompressed)
+ *    payload
+ *
+ * The payload holds nr_records length prefixed records sorted on filename.
+ * The filename of every record is prefix compressed against the previous
+ * record of the same frame so every frame can be decoded on its own:
+ *
+ *    varint record_length
+ *    varint shared_length, varint suffix_length, suffix
+ *    varint lstat_length, lstat
+ *    varint chksum_length, chksum
+ *    varint delta_seq
+ */
+
+#ifndef BAREOS_LIB_ACCURATE_LIST_H_
+#define BAREOS_LIB_ACCURATE_LIST_H_ 1
+
+#define ACCURATE_LIST_FRAME_HEADER_SIZE (3 * sizeof(uint32_t))
+#define ACCURATE_LIST_MAX_PAYLOAD_SIZE (128 * 1024)
+#define ACCURATE_LIST_MAX_RECORDS 4096
+
+struct accurate_list_entry;
+
+class ACCURATE_LIST_ENCODER: public SMARTALLOC {
+private:
+   void *m_zstream;                  /**< zlib deflate state, NULL when not compressing */
+   accurate_list_entry *m_entries;   /**< Records of the current frame */
+   uint32_t m_nr_entries;
+   POOLMEM *m_data;                  /**< Strings of the records of the current frame */
+   uint32_t m_data_length;
+   POOLMEM *m_payload;               /**< Encoded records */
+   POOLMEM *m_frame;                 /**< Frame as sent on the wire */
+   uint64_t m_nr_records;            /**< Statistics */
+   uint64_t m_bytes_in;
+   uint64_t m_bytes_out;
+
+   uint32_t append_string(const char *str, uint32_t length);
+
+public:
+   ACCURATE_LIST_ENCODER(bool compress);
+   ~ACCURATE_LIST_ENCODER();
+
+   bool add(const char *path, const char *fname, const char *lstat,
+            const char *chksum, int32_t delta_seq);
+   bool is_full() const {
+      return m_nr_entries >= ACCURATE_LIST_MAX_RECORDS ||
+             m_data_length >= ACCURATE_LIST_MAX_PAYLOAD_SIZE / 2;
+   };
+   uint32_t encode_frame();
+   const char *get_frame() const { return m_frame; };
+   bool flush(BSOCK *sock);
+   uint64_t nr_records() const { return m_nr_records; };
+   uint64_t bytes_in() const { return m_bytes_in; };
+   uint64_t bytes_out() const { return m_bytes_out; };
+};
+
+class ACCURATE_LIST_DECODER: public SMARTALLOC {
+private:
+   void *m_zstream;                  /**< zlib inflate state */
+   POOLMEM *m_payload;               /**< Decoded payload of the current frame */
+   uint8_t *m_next;                  /**< Next record in the payload */
+   uint8_t *m_end;                   /**< End of the payload */
+   uint32_t m_nr_left;               /**< Records left in the current frame */
+   POOLMEM *m_fname;                 /**< Filename of the last decoded record */
+   int m_fname_length;
+   POOLMEM *m_lstat;
+   POOLMEM *m_chksum;
+
+public:
+   ACCURATE_LIST_DECODER();
+   ~ACCURATE_LIST_DECODER();
+
+   bool set_frame(const char *frame, int32_t length);
+   int next(char **fname, int *fname_length, char **lstat, int *lstat_length,
+            char **chksum, int *chksum_length, int32_t *delta_seq);
+};
+
+#endif /* BAREOS_LIB_ACCURATE_LIST_H_ */
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2001-2011 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -41,16 +41,23 @@ static char TERM_msg[] = "2999 Terminate\n";
  *   bne_recv() except the BNET_SIGNAL messages that can
  *   be handled are done so without returning.
  *
+ * When a buffer is given the data of a message of at most bufsize
+ *   bytes is read into it instead of sock->msg, see recv_into().
+ *
  * Returns number of bytes read (may return zero)
  * Returns -1 on signal (BNET_SIGNAL)
  * Returns -2 on hard end of file (BNET_HARDEOF)
  * Returns -3 on error  (BNET_ERROR)
  */
-int bget_msg(BSOCK *sock)
+int bget_msg(BSOCK *sock, char *buf, int32_t bufsize)
 {
    int n;
    for ( ;; ) {
-      n = sock->recv();
+      if (buf) {
+         n = sock->recv_into(buf, bufsize);
+      } else {
+         n = sock->recv();
+      }
       if (n >= 0) {                  /* normal return */
          return n;
       }
@@ -71,6 +78,9 @@ int bget_msg(BSOCK *sock)
             sock->fsend(OK_msg); /* send response */
          }
          return n;                 /* end of data */
+      case BNET_NEXT_STREAM:       /* continue on the next data connection */
+         Dmsg0(msglvl, "Got BNET_NEXT_STREAM\n");
+         return n;
       case BNET_TERMINATE:
          Dmsg0(msglvl, "Got BNET_TERMINATE\n");
          sock->set_terminated();
@@ -3,7 +3,7 @@
 
    Copyright (C) 2000-2011 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -589,6 +589,8 @@ const char *bnet_sig_to_ascii(BSOCK * bs)
       return "BNET_SUB_PROMPT";
    case BNET_TEXT_INPUT:
       return "BNET_TEXT_INPUT";
+   case BNET_NEXT_STREAM:
+      return "BNET_NEXT_STREAM";
    default:
       sprintf(buf, _("Unknown sig %d"), (int)bs->msglen);
       return buf;
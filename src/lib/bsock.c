@@ -3,7 +3,7 @@
 
    Copyright (C) 2007-2011 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2013 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -28,6 +28,22 @@
 
 #include "bareos.h"
 #include "jcr.h"
+#include "cbuf.h"
+
+/*
+ * A packet buffered 100 ms (in usec) or more after the oldest pending one
+ * writes the write coalescing buffer. There is no timer, so while nothing
+ * is sent the pending packets wait for the next send, read or flush().
+ */
+static const btime_t max_coalescing_delay = 100000;
+
+/*
+ * A packet waiting in the queue of the sender thread.
+ */
+struct bsock_packet {
+   POOLMEM *data;                     /* Header and data of the packet(s) */
+   int32_t len;                       /* Bytes to write */
+};
 
 BSOCK::BSOCK()
 {
@@ -112,6 +128,273 @@ void BSOCK::clear_locking()
    return;
 }
 
+/*
+ * Collect small packets in a buffer and write them with one system call.
+ *
+ * The buffer is written when the next packet does not fit, when a signal
+ * other than BNET_EOD is sent, before reading from the socket, on flush()
+ * and when a packet is buffered max_coalescing_delay after the oldest
+ * pending one. The packets on the wire are the same, so the peer does not
+ * notice. Only use it where the caller keeps sending or ends with one of
+ * the above, pending packets are not written on their own.
+ */
+void BSOCK::set_write_coalescing(int32_t size)
+{
+   if (m_wbuf) {
+      clear_write_coalescing();
+   }
+   if (size <= 0) {
+      return;
+   }
+
+   if (m_use_locking) {
+      P(m_mutex);
+   }
+   m_wbuf = get_memory(size);
+   m_wbuf_size = size;
+   m_wbuf_len = 0;
+   if (m_use_locking) {
+      V(m_mutex);
+   }
+}
+
+/*
+ * Write the pending packets and stop coalescing writes.
+ */
+bool BSOCK::clear_write_coalescing()
+{
+   bool ok;
+
+   if (!m_wbuf) {
+      return true;
+   }
+
+   if (m_use_locking) {
+      P(m_mutex);
+   }
+   ok = flush_write_buffer();
+   free_pool_memory(m_wbuf);
+   m_wbuf = NULL;
+   m_wbuf_size = 0;
+   if (m_use_locking) {
+      V(m_mutex);
+   }
+
+   return ok;
+}
+
+/*
+ * Write the pending packets of the write coalescing buffer.
+ */
+bool BSOCK::flush()
+{
+   bool ok;
+
+   if (!m_wbuf) {
+      return true;
+   }
+
+   if (m_use_locking) {
+      P(m_mutex);
+   }
+   ok = flush_write_buffer();
+   if (m_use_locking) {
+      V(m_mutex);
+   }
+
+   return ok;
+}
+
+/*
+ * Release the network compression buffer and contexts.
+ */
+void BSOCK::free_compression()
+{
+   if (m_cbuf) {
+      free_pool_memory(m_cbuf);
+      m_cbuf = NULL;
+   }
+   cleanup_packet_compression(m_compress, &m_cctx, &m_dctx);
+}
+
+/*
+ * Append a packet (header and data) to the write coalescing buffer.
+ * Called with the socket locked, the packet must be smaller than the buffer.
+ */
+bool BSOCK::buffer_packet(char *pkt, int32_t pktsiz)
+{
+   btime_t now;
+
+   if (m_wbuf_len + pktsiz > m_wbuf_size && !flush_write_buffer()) {
+      return false;
+   }
+
+   now = get_current_btime();
+   if (m_wbuf_len == 0) {
+      m_wbuf_time = now;
+   }
+   memcpy(m_wbuf + m_wbuf_len, pkt, pktsiz);
+   m_wbuf_len += pktsiz;
+
+   if ((now - m_wbuf_time) >= max_coalescing_delay) {
+      return flush_write_buffer();
+   }
+
+   return true;
+}
+
+/*
+ * Write the write coalescing buffer, called with the socket locked.
+ */
+bool BSOCK::flush_write_buffer()
+{
+   POOLMEM *pkt;
+   int32_t len = m_wbuf_len;
+
+   if (len == 0) {
+      return true;
+   }
+   m_wbuf_len = 0;
+
+   /*
+    * The sender thread gets the buffer itself, we continue with a new one.
+    */
+   if (m_send_queue) {
+      pkt = m_wbuf;
+      m_wbuf = get_memory(m_wbuf_size);
+      return queue_packet(pkt, len);
+   }
+
+   return write_packet(m_wbuf, len);
+}
+
+/*
+ * Write one or more packets to the socket.
+ */
+bool BSOCK::write_packet(char *pkt, int32_t pktsiz)
+{
+   int32_t rc;
+
+   timer_start = watchdog_time;  /* start timer */
+   clear_timed_out();
+   rc = write_nbytes(pkt, pktsiz);
+   timer_start = 0;              /* clear timer */
+   if (rc != pktsiz) {
+      errors++;
+      if (errno == 0) {
+         b_errno = EIO;
+      } else {
+         b_errno = errno;
+      }
+      if (!m_suppress_error_msgs) {
+         if (rc < 0) {
+            Qmsg5(m_jcr, M_ERROR, 0, _("Write error sending %d bytes to %s:%s:%d: ERR=%s\n"),
+                  pktsiz, m_who, m_host, m_port, this->bstrerror());
+         } else {
+            Qmsg5(m_jcr, M_ERROR, 0, _("Wrote %d bytes to %s:%s:%d, but only %d accepted.\n"),
+                  pktsiz, m_who, m_host, m_port, rc);
+         }
+      }
+      return false;
+   }
+
+   return true;
+}
+
+/*
+ * Hand packets over to the sender thread, which frees them once written.
+ * A write error of the sender thread shows up on the next packet.
+ */
+bool BSOCK::queue_packet(POOLMEM *pkt, int32_t pktsiz)
+{
+   bsock_packet *qp;
+
+   if (m_send_failed) {
+      free_pool_memory(pkt);
+      return false;
+   }
+
+   qp = (bsock_packet *)malloc(sizeof(bsock_packet));
+   qp->data = pkt;
+   qp->len = pktsiz;
+   m_send_queue->enqueue(qp);
+
+   return true;
+}
+
+static void *bsock_sender(void *arg)
+{
+   BSOCK *bsock = (BSOCK *)arg;
+
+   bsock->send_queued_packets();
+
+   return NULL;
+}
+
+/*
+ * Let a thread of its own write the packets to the socket, so the caller
+ * can prepare the next ones (or send on another socket) while the network
+ * takes them. At most depth packets are queued, sending blocks when the
+ * queue is full.
+ */
+bool BSOCK::start_send_thread(int depth)
+{
+   int status;
+
+   if (m_send_queue) {
+      return true;
+   }
+
+   m_send_failed = false;
+   m_send_queue = New(circbuf(depth));
+   if ((status = pthread_create(&m_send_tid, NULL, bsock_sender, (void *)this)) != 0) {
+      berrno be;
+
+      Qmsg4(m_jcr, M_WARNING, 0, _("Cannot create sender thread for %s:%s:%d: ERR=%s\n"),
+            m_who, m_host, m_port, be.bstrerror(status));
+      delete m_send_queue;
+      m_send_queue = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+/*
+ * Wait until the sender thread wrote all queued packets and stop it.
+ * Returns false when it got a write error.
+ */
+bool BSOCK::stop_send_thread()
+{
+   if (!m_send_queue) {
+      return true;
+   }
+
+   m_send_queue->flush();
+   pthread_join(m_send_tid, NULL);
+   delete m_send_queue;
+   m_send_queue = NULL;
+
+   return !m_send_failed;
+}
+
+/*
+ * Sender thread, writes the queued packets until stop_send_thread() is called.
+ * After a write error the remaining packets are only freed.
+ */
+void BSOCK::send_queued_packets()
+{
+   bsock_packet *qp;
+
+   while ((qp = (bsock_packet *)m_send_queue->dequeue())) {
+      if (!m_send_failed && !write_packet(qp->data, qp->len)) {
+         m_send_failed = true;
+      }
+      free_pool_memory(qp->data);
+      free(qp);
+   }
+}
+
 /*
  * Send a signal
  */
@@ -441,6 +724,14 @@ bool BSOCK::two_way_authenticate(JCR *jcr, const char *what,
       }
    }
 
+   /*
+    * Compress the data packets when both sides offered a common algorithm.
+    */
+   if ((m_compress_offer & m_compress_remote) & BNET_COMPRESS_ZSTD) {
+      m_compress = BNET_COMPRESS_ZSTD;
+      Dmsg1(dbglvl, "Using network compression with %s\n", who());
+   }
+
 auth_fatal:
    if (tid) {
       stop_bsock_timer(tid);
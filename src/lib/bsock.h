@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2000-2009 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -40,6 +40,7 @@
 
 struct btimer_t;                      /* forward reference */
 class BSOCK;
+class circbuf;
 btimer_t *start_bsock_timer(BSOCK *bs, uint32_t wait);
 void stop_bsock_timer(btimer_t *wid);
 
@@ -88,6 +89,28 @@ protected:
    int64_t m_bwlimit;                 /* Set to limit bandwidth */
    int64_t m_nb_bytes;                /* Bytes sent/recv since the last tick */
    btime_t m_last_tick;               /* Last tick used by bwlimit */
+   POOLMEM *m_wbuf;                   /* Write coalescing buffer, NULL if not coalescing */
+   int32_t m_wbuf_len;                /* Bytes pending in the write coalescing buffer */
+   int32_t m_wbuf_size;               /* Flush threshold of the write coalescing buffer */
+   btime_t m_wbuf_time;               /* Time the oldest pending packet was buffered */
+   uint32_t m_compress_offer;         /* BNET_COMPRESS_* algorithms we offer */
+   uint32_t m_compress_remote;        /* BNET_COMPRESS_* algorithms the remote offers */
+   uint32_t m_compress;               /* Negotiated network compression, 0 if none */
+   POOLMEM *m_cbuf;                   /* Network compression buffer */
+   void *m_cctx;                      /* Network compression context */
+   void *m_dctx;                      /* Network decompression context */
+   uint64_t m_raw_bytes_sent;         /* Data bytes before network compression */
+   uint64_t m_wire_bytes_sent;        /* Data bytes after network compression */
+   uint64_t m_raw_bytes_recv;         /* Data bytes after network decompression */
+   uint64_t m_wire_bytes_recv;        /* Data bytes before network decompression */
+   circbuf *m_send_queue;             /* Packets for the sender thread, NULL without one */
+   pthread_t m_send_tid;              /* Sender thread writing the queued packets */
+   volatile bool m_send_failed;       /* Set when the sender thread got a write error */
+
+   bool buffer_packet(char *pkt, int32_t pktsiz); /* in bsock.c */
+   bool flush_write_buffer();         /* in bsock.c */
+   bool write_packet(char *pkt, int32_t pktsiz); /* in bsock.c */
+   bool queue_packet(POOLMEM *pkt, int32_t pktsiz); /* in bsock.c */
 
    virtual void fin_init(JCR * jcr, int sockfd, const char *who, const char *host, int port,
                          struct sockaddr *lclient_addr) = 0;
@@ -111,6 +134,7 @@ public:
                         utime_t heart_beat, const char *name, char *host,
                         char *service, int port, bool verbose) = 0;
    virtual int32_t recv() = 0;
+   virtual int32_t recv_into(char *buf, int32_t bufsize) = 0;
    virtual bool send() = 0;
    virtual int32_t read_nbytes(char *ptr, int32_t nbytes) = 0;
    virtual int32_t write_nbytes(char *ptr, int32_t nbytes) = 0;
@@ -138,6 +162,13 @@ public:
    void clear_locking();              /* in bsock.c */
    void set_source_address(dlist *src_addr_list);
    void control_bwlimit(int bytes);   /* in bsock.c */
+   void set_write_coalescing(int32_t size); /* in bsock.c */
+   bool clear_write_coalescing();     /* in bsock.c */
+   bool flush();                      /* in bsock.c */
+   void free_compression();           /* in bsock.c */
+   bool start_send_thread(int depth); /* in bsock.c */
+   bool stop_send_thread();           /* in bsock.c */
+   void send_queued_packets();        /* in bsock.c, run by the sender thread */
 
    /* Inline functions */
    bool authenticate_outbound_connection(JCR *jcr, const char *what,
@@ -160,6 +191,15 @@ public:
    JCR *jcr() { return m_jcr; };
    JCR *get_jcr() { return m_jcr; };
    bool is_spooling() { return m_spool; };
+   bool is_coalescing() { return m_wbuf != NULL; };
+   bool is_compressing() { return m_compress != 0; };
+   void set_compression_offer(uint32_t algorithms) { m_compress_offer = algorithms; };
+   void set_compression_remote(uint32_t algorithms) { m_compress_remote = algorithms; };
+   uint32_t get_compression_offer() { return m_compress_offer; };
+   uint64_t get_raw_bytes_sent() { return m_raw_bytes_sent; };
+   uint64_t get_wire_bytes_sent() { return m_wire_bytes_sent; };
+   uint64_t get_raw_bytes_recv() { return m_raw_bytes_recv; };
+   uint64_t get_wire_bytes_recv() { return m_wire_bytes_recv; };
    bool is_terminated() { return m_terminated; };
    bool is_timed_out() { return m_timed_out; };
    bool is_stop() { return errors || is_terminated(); }
@@ -220,9 +260,25 @@ enum {
    BNET_START_RTREE    = -25,         /* Start restore tree mode */
    BNET_END_RTREE      = -26,         /* End restore tree mode */
    BNET_SUB_PROMPT     = -27,         /* Indicate we are at a subprompt */
-   BNET_TEXT_INPUT     = -28          /* Get text input from user */
+   BNET_TEXT_INPUT     = -28,         /* Get text input from user */
+   BNET_NEXT_STREAM    = -29          /* Continue on the next data connection */
 };
 
+/**
+ * Network compression algorithms, offered as a bit mask during authentication.
+ * The packet header of a compressed data packet has BNET_COMPRESSED_PACKET
+ * set, the payload is the uncompressed length followed by the compressed data.
+ */
+#define BNET_COMPRESS_ZSTD        (1 << 0)
+
+#ifdef HAVE_ZSTD
+#define BNET_COMPRESS_SUPPORTED   BNET_COMPRESS_ZSTD
+#else
+#define BNET_COMPRESS_SUPPORTED   0
+#endif
+
+#define BNET_COMPRESSED_PACKET    0x40000000
+
 #define BNET_SETBUF_READ  1           /* Arg for bnet_set_buffer_size */
 #define BNET_SETBUF_WRITE 2           /* Arg for bnet_set_buffer_size */
 
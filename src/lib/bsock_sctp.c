@@ -133,6 +133,11 @@ int32_t BSOCK_SCTP::recv()
    return -1;
 }
 
+int32_t BSOCK_SCTP::recv_into(char *buf, int32_t bufsize)
+{
+   return -1;
+}
+
 int BSOCK_SCTP::get_peer(char *buf, socklen_t buflen)
 {
    return -1;
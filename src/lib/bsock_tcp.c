@@ -84,6 +84,13 @@ BSOCK *BSOCK_TCP::clone()
    if (src_addr) {
       clone->src_addr = New(IPADDR(*(src_addr)));
    }
+   clone->m_wbuf = NULL;
+   clone->m_wbuf_len = 0;
+   clone->m_wbuf_size = 0;
+   clone->m_send_queue = NULL;
+   clone->m_cbuf = NULL;
+   clone->m_cctx = NULL;
+   clone->m_dctx = NULL;
    clone->m_cloned = true;
 
    return (BSOCK *)clone;
@@ -376,42 +383,36 @@ bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
 {
    Enter(400);
 
-   int32_t rc;
+   POOLMEM *pkt;
    bool ok = true;
 
    out_msg_no++;            /* increment message number */
 
    /*
-    * Send data packet
+    * Small packets are collected in the write coalescing buffer,
+    * bigger ones are written after the pending packets.
     */
-   timer_start = watchdog_time;  /* start timer */
-   clear_timed_out();
+   if (m_wbuf) {
+      if (pktsiz < m_wbuf_size && !is_spooling()) {
+         ok = buffer_packet((char *)hdr, pktsiz);
+         Leave(400);
+         return ok;
+      }
+      if (!flush_write_buffer()) {
+         Leave(400);
+         return false;
+      }
+   }
 
    /*
-    * Full I/O done in one write
+    * Send data packet, the sender thread gets a copy as the caller reuses msg.
     */
-   rc = write_nbytes((char *)hdr, pktsiz);
-   timer_start = 0;         /* clear timer */
-   if (rc != pktsiz) {
-      errors++;
-      if (errno == 0) {
-         b_errno = EIO;
-      } else {
-         b_errno = errno;
-      }
-      if (rc < 0) {
-         if (!m_suppress_error_msgs) {
-            Qmsg5(m_jcr, M_ERROR, 0,
-                  _("Write error sending %d bytes to %s:%s:%d: ERR=%s\n"),
-                  msglen, m_who,
-                  m_host, m_port, this->bstrerror());
-         }
-      } else {
-         Qmsg5(m_jcr, M_ERROR, 0,
-               _("Wrote %d bytes to %s:%s:%d, but only %d accepted.\n"),
-               msglen, m_who, m_host, m_port, rc);
-      }
-      ok = false;
+   if (m_send_queue) {
+      pkt = get_memory(pktsiz);
+      memcpy(pkt, hdr, pktsiz);
+      ok = queue_packet(pkt, pktsiz);
+   } else {
+      ok = write_packet((char *)hdr, pktsiz);
    }
 
    Leave(400);
@@ -419,6 +420,39 @@ bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
    return ok;
 }
 
+/*
+ * Send a data packet compressed when that makes it smaller.
+ * A compressed packet has BNET_COMPRESSED_PACKET set in its header
+ * and carries the uncompressed length before the compressed data.
+ */
+bool BSOCK_TCP::send_compressed_packet(int32_t *hdr, int32_t pktsiz)
+{
+   int32_t len = pktsiz - header_length;
+   uint32_t bound, compress_len;
+   int32_t *chdr;
+
+   bound = compress_packet_bound(m_compress, len);
+   if (!m_cbuf) {
+      m_cbuf = get_pool_memory(PM_BSOCK);
+   }
+   m_cbuf = check_pool_memory_size(m_cbuf, 2 * header_length + bound);
+
+   m_raw_bytes_sent += len;
+   if (!compress_packet(m_compress, &m_cctx, (char *)hdr + header_length, len,
+                        m_cbuf + 2 * header_length, bound, &compress_len) ||
+       (int32_t)compress_len + header_length >= len) {
+      m_wire_bytes_sent += len;
+      return send_packet(hdr, pktsiz);
+   }
+   m_wire_bytes_sent += header_length + compress_len;
+
+   chdr = (int32_t *)m_cbuf;
+   chdr[0] = htonl(BNET_COMPRESSED_PACKET | (header_length + compress_len));
+   chdr[1] = htonl(len);
+
+   return send_packet(chdr, 2 * header_length + compress_len);
+}
+
 /*
  * Send a message over the network. The send consists of
  * two network packets. The first is sends a 32 bit integer containing
@@ -473,6 +507,13 @@ bool BSOCK_TCP::send()
       pktsiz = header_length;                /* signal, no data */
       *hdr = htonl(o_msglen);                /* store signal */
       ok = send_packet(hdr, pktsiz);
+
+      /*
+       * A BNET_EOD only ends a data stream, other signals may expect an answer.
+       */
+      if (ok && m_wbuf && o_msglen < 0 && o_msglen != BNET_EOD) {
+         ok = flush_write_buffer();
+      }
    } else {
       /*
        * msg might be to long for a single Bareos packet.
@@ -495,7 +536,15 @@ bool BSOCK_TCP::send()
          }
 
          *hdr = htonl(packet_msglen);        /* store length */
-         ok = send_packet(hdr, pktsiz);
+         if (m_compress && !is_spooling() && packet_msglen >= min_compress_len) {
+            ok = send_compressed_packet(hdr, pktsiz);
+         } else {
+            if (m_compress) {
+               m_raw_bytes_sent += packet_msglen;
+               m_wire_bytes_sent += packet_msglen;
+            }
+            ok = send_packet(hdr, pktsiz);
+         }
          written += packet_msglen;
          hdr = (int32_t *)(msg + written - (int)header_length);
       }
@@ -526,9 +575,99 @@ bool BSOCK_TCP::send()
  *  Using is_bnet_stop() and is_bnet_error() you can figure this all out.
  */
 int32_t BSOCK_TCP::recv()
+{
+   return recv_into(NULL, 0);
+}
+
+/*
+ * Receive the payload of a compressed data packet and decompress it into
+ * the given buffer when it fits, into msg otherwise.
+ * Returns the uncompressed length or BNET_ERROR.
+ */
+int32_t BSOCK_TCP::recv_compressed_packet(int32_t pktsiz, char *buf, int32_t bufsize)
+{
+   int32_t nbytes, raw_len;
+   uint32_t decompress_len;
+   char *data;
+
+   if (pktsiz <= header_length || pktsiz > max_packet_size) {
+      errors++;
+      b_errno = EIO;
+      Qmsg4(m_jcr, M_ERROR, 0, _("Invalid compressed packet of %d bytes from %s:%s:%d\n"),
+            pktsiz, m_who, m_host, m_port);
+      return BNET_ERROR;
+   }
+
+   if (!m_cbuf) {
+      m_cbuf = get_pool_memory(PM_BSOCK);
+   }
+   m_cbuf = check_pool_memory_size(m_cbuf, pktsiz);
+
+   timer_start = watchdog_time;  /* set start wait time */
+   clear_timed_out();
+   nbytes = read_nbytes(m_cbuf, pktsiz);
+   timer_start = 0;         /* clear timer */
+   if (nbytes != pktsiz) {
+      if (nbytes <= 0 && errno != 0) {
+         b_errno = errno;
+      } else {
+         b_errno = EIO;
+      }
+      errors++;
+      Qmsg4(m_jcr, M_ERROR, 0, _("Read error from %s:%s:%d: ERR=%s\n"),
+            m_who, m_host, m_port, this->bstrerror());
+      return BNET_ERROR;
+   }
+
+   raw_len = ntohl(*(int32_t *)m_cbuf);
+   if (raw_len <= 0 || raw_len > max_message_len) {
+      errors++;
+      b_errno = EIO;
+      Qmsg4(m_jcr, M_ERROR, 0, _("Invalid compressed packet of %d bytes from %s:%s:%d\n"),
+            raw_len, m_who, m_host, m_port);
+      return BNET_ERROR;
+   }
+
+   if (raw_len <= bufsize) {
+      data = buf;
+   } else {
+      if (raw_len >= (int32_t) sizeof_pool_memory(msg)) {
+         msg = realloc_pool_memory(msg, raw_len + 100);
+      }
+      data = msg;
+   }
+
+   if (!decompress_packet(m_compress, &m_dctx, m_cbuf + header_length, pktsiz - header_length,
+                          data, raw_len, &decompress_len) ||
+       (int32_t)decompress_len != raw_len) {
+      errors++;
+      b_errno = EIO;
+      Qmsg3(m_jcr, M_ERROR, 0, _("Network decompression error on data from %s:%s:%d\n"),
+            m_who, m_host, m_port);
+      return BNET_ERROR;
+   }
+
+   m_raw_bytes_recv += raw_len;
+   m_wire_bytes_recv += pktsiz - header_length;
+   in_msg_no++;
+   msglen = raw_len;
+   if (data == msg) {
+      msg[raw_len] = 0; /* terminate in case it is a string */
+   }
+
+   return raw_len;
+}
+
+/*
+ * Receive a message like recv(), but read the data of a message of at
+ * most bufsize bytes into buf instead of msg. So after a successful
+ * return the data is in buf if msglen <= bufsize and in msg otherwise.
+ */
+int32_t BSOCK_TCP::recv_into(char *buf, int32_t bufsize)
 {
    int32_t nbytes;
    int32_t pktsiz;
+   char *data;
 
    msg[0] = 0;
    msglen = 0;
@@ -540,6 +679,14 @@ int32_t BSOCK_TCP::recv()
       P(m_mutex);
    }
 
+   /*
+    * The peer might wait for the pending packets before it answers.
+    */
+   if (m_wbuf && !flush_write_buffer()) {
+      nbytes = BNET_ERROR;
+      goto get_out;
+   }
+
    read_seqno++;            /* bump sequence number */
    timer_start = watchdog_time;  /* set start wait time */
    clear_timed_out();
@@ -573,6 +720,11 @@ int32_t BSOCK_TCP::recv()
 
    pktsiz = ntohl(pktsiz);         /* decode no. of bytes that follow */
 
+   if (m_compress && pktsiz > 0 && (pktsiz & BNET_COMPRESSED_PACKET)) {
+      nbytes = recv_compressed_packet(pktsiz & ~BNET_COMPRESSED_PACKET, buf, bufsize);
+      goto get_out;
+   }
+
    if (pktsiz == 0) {              /* No data transferred */
       timer_start = 0;             /* clear timer */
       in_msg_no++;
@@ -604,8 +756,13 @@ int32_t BSOCK_TCP::recv()
    /*
     * Make sure the buffer is big enough + one byte for EOS
     */
-   if (pktsiz >= (int32_t) sizeof_pool_memory(msg)) {
-      msg = realloc_pool_memory(msg, pktsiz + 100);
+   if (pktsiz <= bufsize) {
+      data = buf;
+   } else {
+      if (pktsiz >= (int32_t) sizeof_pool_memory(msg)) {
+         msg = realloc_pool_memory(msg, pktsiz + 100);
+      }
+      data = msg;
    }
 
    timer_start = watchdog_time;  /* set start wait time */
@@ -614,7 +771,7 @@ int32_t BSOCK_TCP::recv()
    /*
     * Now read the actual data
     */
-   if ((nbytes = read_nbytes(msg, pktsiz)) <= 0) {
+   if ((nbytes = read_nbytes(data, pktsiz)) <= 0) {
       timer_start = 0;      /* clear timer */
       if (errno == 0) {
          b_errno = ENODATA;
@@ -642,9 +799,16 @@ int32_t BSOCK_TCP::recv()
    /*
     * Always add a zero by to properly terminate any string that was send to us.
     * Note, we ensured above that the buffer is at least one byte longer than
-    * the message length.
+    * the message length. The caller's buffer holds only the data.
     */
-   msg[nbytes] = 0; /* terminate in case it is a string */
+   if (data == msg) {
+      msg[nbytes] = 0; /* terminate in case it is a string */
+   }
+
+   if (m_compress) {
+      m_raw_bytes_recv += nbytes;
+      m_wire_bytes_recv += nbytes;
+   }
 
    /*
     * The following uses *lots* of resources so turn it on only for serious debugging.
@@ -864,6 +1028,10 @@ int BSOCK_TCP::wait_data(int sec, int usec)
 {
    int msec;
 
+   if (!flush()) {
+      return -1;                /* error return */
+   }
+
    msec = (sec * 1000) + (usec / 1000);
    switch (wait_for_readable_fd(m_fd, msec, true)) {
    case 0:
@@ -885,6 +1053,10 @@ int BSOCK_TCP::wait_data_intr(int sec, int usec)
 {
    int msec;
 
+   if (!flush()) {
+      return -1;                /* error return */
+   }
+
    msec = (sec * 1000) + (usec / 1000);
    switch (wait_for_readable_fd(m_fd, msec, false)) {
    case 0:
@@ -906,6 +1078,8 @@ int BSOCK_TCP::wait_data_intr(int sec, int usec)
 void BSOCK_TCP::close()
 {
    if (!m_cloned) {
+      clear_write_coalescing();
+      stop_send_thread();
       clear_locking();
    }
 
@@ -930,6 +1104,11 @@ void BSOCK_TCP::close()
 
 void BSOCK_TCP::destroy()
 {
+   if (m_wbuf) {
+      free_pool_memory(m_wbuf);
+      m_wbuf = NULL;
+   }
+   free_compression();
    if (msg) {
       free_pool_memory(msg);
       msg = NULL;
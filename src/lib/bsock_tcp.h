@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2013-2015 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -40,6 +40,11 @@ private:
    static const int32_t max_packet_size = 1000000;
    static const int32_t max_message_len = max_packet_size - header_length;
 
+   /*
+    * Data packets smaller than this are never network compressed.
+    */
+   static const int32_t min_compress_len = 512;
+
    /* methods -- in bsock_tcp.c */
    void fin_init(JCR * jcr, int sockfd, const char *who, const char *host, int port,
                  struct sockaddr *lclient_addr);
@@ -47,6 +52,8 @@ private:
              int port, utime_t heart_beat, int *fatal);
    bool set_keepalive(JCR *jcr, int sockfd, bool enable, int keepalive_start, int keepalive_interval);
    bool send_packet(int32_t *hdr, int32_t pktsiz);
+   bool send_compressed_packet(int32_t *hdr, int32_t pktsiz);
+   int32_t recv_compressed_packet(int32_t pktsiz, char *buf, int32_t bufsize);
 
 public:
    BSOCK_TCP();
@@ -58,6 +65,7 @@ public:
                 utime_t heart_beat, const char *name, char *host,
                 char *service, int port, bool verbose);
    int32_t recv();
+   int32_t recv_into(char *buf, int32_t bufsize);
    bool send();
    bool fsend(const char*, ...);
    int32_t read_nbytes(char *ptr, int32_t nbytes);
@@ -133,6 +133,11 @@ int32_t BSOCK_UDT::recv()
    return -1;
 }
 
+int32_t BSOCK_UDT::recv_into(char *buf, int32_t bufsize)
+{
+   return -1;
+}
+
 int BSOCK_UDT::get_peer(char *buf, socklen_t buflen)
 {
    return -1;
@@ -40,6 +40,7 @@ public:
                 utime_t heart_beat, const char *name, char *host,
                 char *service, int port, bool verbose);
    int32_t recv();
+   int32_t recv_into(char *buf, int32_t bufsize);
    bool send();
    bool fsend(const char*, ...);
    int32_t read_nbytes(char *ptr, int32_t nbytes);
@@ -138,6 +138,23 @@ struct BSR_STREAM {
    int32_t stream;                    /* stream desired */
 };
 
+/**
+ * The FileIndex and VolAddr lists of a bsr are compiled by parse_bsr()
+ * into arrays of ranges sorted on their start with overlapping and
+ * adjacent ranges merged. A record is then matched with a binary search
+ * instead of walking the lists, which hold millions of ranges for large
+ * restores.
+ */
+struct BSR_FINDEX_RANGE {
+   int32_t findex;                    /* start file index */
+   int32_t findex2;                   /* end file index */
+};
+
+struct BSR_VOLADDR_RANGE {
+   uint64_t saddr;                    /* start address */
+   uint64_t eaddr;                    /* end address */
+};
+
 struct BSR {
    /* NOTE!!! next must be the first item */
    BSR *next;                         /* pointer to next one */
@@ -167,6 +184,17 @@ struct BSR {
    char *fileregex;                   /* set if restore is filtered on filename */
    regex_t *fileregex_re;
    ATTR *attr;                        /* scratch space for unpacking */
+   BSR_FINDEX *last_findex;           /* last item of the FileIndex list */
+   BSR_VOLADDR *last_voladdr;         /* last item of the VolAddr list */
+   BSR *first_active;                 /* root bsr: first bsr not done */
+   uint32_t nr_findex_ranges;         /* number of compiled FileIndex ranges */
+   uint32_t findex_cursor;            /* first FileIndex range not done */
+   BSR_FINDEX_RANGE *findex_ranges;   /* compiled FileIndex ranges */
+   uint32_t nr_voladdr_ranges;        /* number of compiled VolAddr ranges */
+   uint32_t voladdr_cursor;           /* first VolAddr in voladdr_by_end not done */
+   BSR_VOLADDR_RANGE *voladdr_ranges; /* compiled VolAddr ranges */
+   BSR_VOLADDR **voladdr_by_end;      /* VolAddr items sorted on end address */
+   uint64_t min_saddr;                /* no record before this address can match */
 };
 
 BSR *parse_bsr(JCR *jcr, char *lf);
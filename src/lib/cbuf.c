@@ -31,8 +31,13 @@
 /*
  * Initialize a new circular buffer.
  */
-int circbuf::init()
+int circbuf::init(int capacity)
 {
+   m_data = NULL;
+   if (capacity <= 0) {
+      capacity = QSIZE;
+   }
+
    if (pthread_mutex_init(&m_lock, NULL) != 0) {
       return -1;
    }
@@ -51,7 +56,9 @@ int circbuf::init()
    m_next_in = 0;
    m_next_out = 0;
    m_size = 0;
-   m_capacity = QSIZE;
+   m_capacity = capacity;
+   m_flush = false;
+   m_data = (void **)malloc(m_capacity * sizeof(void *));
 
    return 0;
 }
@@ -64,6 +71,10 @@ void circbuf::destroy()
    pthread_cond_destroy(&m_notempty);
    pthread_cond_destroy(&m_notfull);
    pthread_mutex_destroy(&m_lock);
+   if (m_data) {
+      free(m_data);
+      m_data = NULL;
+   }
 }
 
 /*
@@ -38,12 +38,12 @@ class circbuf : public SMARTALLOC {
    pthread_mutex_t m_lock;    /**< Lock the structure */
    pthread_cond_t m_notfull;  /**< Full -> not full condition */
    pthread_cond_t m_notempty; /**< Empty -> not empty condition */
-   void *m_data[QSIZE];       /**< Circular buffer of pointers */
+   void **m_data;             /**< Circular buffer of pointers */
 
 public:
-   circbuf();
+   circbuf(int capacity = QSIZE);
    ~circbuf();
-   int init();
+   int init(int capacity);
    void destroy();
    int enqueue(void *data);
    void *dequeue();
@@ -57,9 +57,9 @@ public:
 /**
  * Constructor
  */
-inline circbuf::circbuf()
+inline circbuf::circbuf(int capacity)
 {
-   init();
+   init(capacity);
 }
 
 /**
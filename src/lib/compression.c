@@ -3,7 +3,7 @@
 
    Copyright (C) 2000-2011 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2013 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -34,7 +34,7 @@
 #include "ch.h"
 #include "streams.h"
 
-#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ)
+#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD)
 
 #ifdef HAVE_LIBZ
 #include <zlib.h>
@@ -49,6 +49,11 @@
 #include <fastlzlib.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
 #ifdef HAVE_LIBZ
 
 #ifndef HAVE_COMPRESS_BOUND
@@ -68,6 +73,8 @@ const char *cmprs_algo_to_text(uint32_t compression_algorithm)
       return "LZ4";
    case COMPRESS_FZ4H:
       return "LZ4HC";
+   case COMPRESS_ZSTD:
+      return "ZSTD";
    default:
       return "Unknown";
    }
@@ -126,9 +133,7 @@ bool setup_compression_buffers(JCR *jcr,
        */
       break;
 #ifdef HAVE_LIBZ
-   case COMPRESS_GZIP: {
-      z_stream *pZlibStream;
-
+   case COMPRESS_GZIP:
       /**
        * Use compressBound() to get an idea what zlib thinks
        * what the upper limit is of what it needs to compress
@@ -138,20 +143,98 @@ bool setup_compression_buffers(JCR *jcr,
        * This gives a bit extra plus room for the sparse addr if any.
        * Note, we adjust the read size to be smaller so that the
        * same output buffer can be used without growing it.
-       *
-       * The zlib compression workset is initialized here to minimize
-       * the "per file" load. The jcr member is only set, if the init
-       * was successful.
        */
       wanted_compress_buf_size = compressBound(jcr->buf_size) + 18 + (int)sizeof(comp_stream_header);
       if (wanted_compress_buf_size > *compress_buf_size) {
          *compress_buf_size = wanted_compress_buf_size;
       }
+      break;
+#endif
+#ifdef HAVE_LZO
+   case COMPRESS_LZO1X:
+      /**
+       * For LZO1X compression the recommended value is:
+       *    output_block_size = input_block_size + (input_block_size / 16) + 64 + 3 + sizeof(comp_stream_header)
+       */
+      wanted_compress_buf_size = jcr->buf_size + (jcr->buf_size / 16) + 64 + 3 + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+         *compress_buf_size = wanted_compress_buf_size;
+      }
+      break;
+#endif
+#ifdef HAVE_FASTLZ
+   case COMPRESS_FZFZ:
+   case COMPRESS_FZ4L:
+   case COMPRESS_FZ4H:
+      if (compatible) {
+         non_compatible_compression_algorithm(jcr, compression_algorithm);
+         return false;
+      }
+
+      /*
+       * For FASTLZ compression the recommended value is:
+       *    output_block_size = input_block_size + (input_block_size / 10 + 16 * 2) + sizeof(comp_stream_header)
+       */
+      wanted_compress_buf_size = jcr->buf_size + (jcr->buf_size / 10 + 16 * 2) + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+         *compress_buf_size = wanted_compress_buf_size;
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD
+   case COMPRESS_ZSTD:
+      if (compatible) {
+         non_compatible_compression_algorithm(jcr, compression_algorithm);
+         return false;
+      }
+
+      /*
+       * For ZSTD compression use ZSTD_compressBound() which gives the worst case
+       * size of a single frame holding the input buffer.
+       */
+      wanted_compress_buf_size = ZSTD_compressBound(jcr->buf_size) + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+         *compress_buf_size = wanted_compress_buf_size;
+      }
+      break;
+#endif
+   default:
+      unknown_compression_algorithm(jcr, compression_algorithm);
+      return false;
+   }
+
+   /*
+    * The compression workset is initialized here to minimize
+    * the "per file" load.
+    */
+   return setup_compression_workset(jcr, &jcr->compress, compression_algorithm);
+}
+
+/**
+ * Initialize the compression workset of a compression context for the given algorithm.
+ * The workset member is only set, if the init was successful.
+ *
+ * Normally the workset of the JCR is used but threads that compress data in parallel
+ * each need their own private compression context.
+ */
+bool setup_compression_workset(JCR *jcr,
+                               CMPRS_CTX *cmprs_ctx,
+                               uint32_t compression_algorithm)
+{
+   switch (compression_algorithm) {
+   case 0:
+      /*
+       * No compression requested.
+       */
+      break;
+#ifdef HAVE_LIBZ
+   case COMPRESS_GZIP: {
+      z_stream *pZlibStream;
 
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZLIB) {
+      if (cmprs_ctx->workset.pZLIB) {
          return true;
       }
 
@@ -163,7 +246,7 @@ bool setup_compression_buffers(JCR *jcr,
       pZlibStream->state = Z_NULL;
 
       if (deflateInit(pZlibStream, Z_DEFAULT_COMPRESSION) == Z_OK) {
-         jcr->compress.workset.pZLIB = pZlibStream;
+         cmprs_ctx->workset.pZLIB = pZlibStream;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZLIB compression\n"));
          free(pZlibStream);
@@ -176,23 +259,10 @@ bool setup_compression_buffers(JCR *jcr,
    case COMPRESS_LZO1X: {
       lzo_voidp pLzoMem;
 
-      /**
-       * For LZO1X compression the recommended value is:
-       *    output_block_size = input_block_size + (input_block_size / 16) + 64 + 3 + sizeof(comp_stream_header)
-       *
-       * The LZO compression workset is initialized here to minimize
-       * the "per file" load. The jcr member is only set, if the init
-       * was successful.
-       */
-      wanted_compress_buf_size = jcr->buf_size + (jcr->buf_size / 16) + 64 + 3 + (int)sizeof(comp_stream_header);
-      if (wanted_compress_buf_size > *compress_buf_size) {
-         *compress_buf_size = wanted_compress_buf_size;
-      }
-
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pLZO) {
+      if (cmprs_ctx->workset.pLZO) {
          return true;
       }
 
@@ -200,7 +270,7 @@ bool setup_compression_buffers(JCR *jcr,
       memset(pLzoMem, 0, LZO1X_1_MEM_COMPRESS);
 
       if (lzo_init() == LZO_E_OK) {
-         jcr->compress.workset.pLZO = pLzoMem;
+         cmprs_ctx->workset.pLZO = pLzoMem;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize LZO compression\n"));
          free(pLzoMem);
@@ -216,34 +286,16 @@ bool setup_compression_buffers(JCR *jcr,
       int level, zstat;
       zfast_stream *pZfastStream;
 
-      if (compatible) {
-         non_compatible_compression_algorithm(jcr, compression_algorithm);
-         return false;
-      }
-
       if (compression_algorithm == COMPRESS_FZ4H) {
          level = Z_BEST_COMPRESSION;
       } else {
          level = Z_BEST_SPEED;
       }
 
-      /*
-       * For FASTLZ compression the recommended value is:
-       *    output_block_size = input_block_size + (input_block_size / 10 + 16 * 2) + sizeof(comp_stream_header)
-       *
-       * The FASTLZ compression workset is initialized here to minimize
-       * the "per file" load. The jcr member is only set, if the init
-       * was successful.
-       */
-      wanted_compress_buf_size = jcr->buf_size + (jcr->buf_size / 10 + 16 * 2) + (int)sizeof(comp_stream_header);
-      if (wanted_compress_buf_size > *compress_buf_size) {
-         *compress_buf_size = wanted_compress_buf_size;
-      }
-
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZFAST) {
+      if (cmprs_ctx->workset.pZFAST) {
          return true;
       }
 
@@ -255,7 +307,7 @@ bool setup_compression_buffers(JCR *jcr,
       pZfastStream->state = Z_NULL;
 
       if ((zstat = fastlzlibCompressInit(pZfastStream, level)) == Z_OK) {
-         jcr->compress.workset.pZFAST = pZfastStream;
+         cmprs_ctx->workset.pZFAST = pZfastStream;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize FASTLZ compression\n"));
          free(pZfastStream);
@@ -263,6 +315,31 @@ bool setup_compression_buffers(JCR *jcr,
       }
       break;
    }
+#endif
+#ifdef HAVE_ZSTD
+   case COMPRESS_ZSTD: {
+      ZSTD_CCtx *pZstdCtx;
+
+      /*
+       * See if this compression algorithm is already setup.
+       */
+      if (cmprs_ctx->workset.pZSTD) {
+         return true;
+      }
+
+      /*
+       * The compression context keeps its internal tables allocated between
+       * calls so we create it once and reuse it for all data of the Job.
+       */
+      pZstdCtx = ZSTD_createCCtx();
+      if (pZstdCtx) {
+         cmprs_ctx->workset.pZSTD = pZstdCtx;
+      } else {
+         Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZSTD compression\n"));
+         return false;
+      }
+      break;
+   }
 #endif
    default:
       unknown_compression_algorithm(jcr, compression_algorithm);
@@ -297,6 +374,7 @@ bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size)
 
 #ifdef HAVE_LIBZ
 static bool compress_with_zlib(JCR *jcr,
+                               CMPRS_CTX *cmprs_ctx,
                                char *rbuf,
                                uint32_t rsize,
                                unsigned char *cbuf,
@@ -308,7 +386,7 @@ static bool compress_with_zlib(JCR *jcr,
 
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-   pZlibStream = (z_stream *)jcr->compress.workset.pZLIB;
+   pZlibStream = (z_stream *)cmprs_ctx->workset.pZLIB;
    pZlibStream->next_in = (Bytef *)rbuf;
    pZlibStream->avail_in = rsize;
    pZlibStream->next_out = (Bytef *)cbuf;
@@ -339,6 +417,7 @@ static bool compress_with_zlib(JCR *jcr,
 
 #ifdef HAVE_LZO
 static bool compress_with_lzo(JCR *jcr,
+                              CMPRS_CTX *cmprs_ctx,
                               char *rbuf,
                               uint32_t rsize,
                               unsigned char *cbuf,
@@ -351,7 +430,7 @@ static bool compress_with_lzo(JCR *jcr,
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
    lzores = lzo1x_1_compress((const unsigned char *)rbuf, rsize,
-                             cbuf, &len, jcr->compress.workset.pLZO);
+                             cbuf, &len, cmprs_ctx->workset.pLZO);
    *compress_len = len;
 
    if (lzores != LZO_E_OK || *compress_len > max_compress_len) {
@@ -371,6 +450,7 @@ static bool compress_with_lzo(JCR *jcr,
 
 #ifdef HAVE_FASTLZ
 static bool compress_with_fastlz(JCR *jcr,
+                                 CMPRS_CTX *cmprs_ctx,
                                  char *rbuf,
                                  uint32_t rsize,
                                  unsigned char *cbuf,
@@ -382,7 +462,7 @@ static bool compress_with_fastlz(JCR *jcr,
 
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-   pZfastStream = (zfast_stream *)jcr->compress.workset.pZFAST;
+   pZfastStream = (zfast_stream *)cmprs_ctx->workset.pZFAST;
    pZfastStream->next_in = (Bytef *)rbuf;
    pZfastStream->avail_in = rsize;
    pZfastStream->next_out = (Bytef *)cbuf;
@@ -411,7 +491,55 @@ static bool compress_with_fastlz(JCR *jcr,
 }
 #endif
 
+#ifdef HAVE_ZSTD
+static bool compress_with_zstd(JCR *jcr,
+                               CMPRS_CTX *cmprs_ctx,
+                               char *rbuf,
+                               uint32_t rsize,
+                               unsigned char *cbuf,
+                               uint32_t max_compress_len,
+                               uint32_t *compress_len)
+{
+   size_t zstat;
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
+
+   /*
+    * Each block is compressed into a self contained frame using the
+    * parameters set on the context so it can be decompressed on its own.
+    */
+   zstat = ZSTD_compress2((ZSTD_CCtx *)cmprs_ctx->workset.pZSTD, cbuf, max_compress_len, rbuf, rsize);
+   if (ZSTD_isError(zstat)) {
+      Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD_compress2 error: %s\n"), ZSTD_getErrorName(zstat));
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+
+   *compress_len = zstat;
+
+   Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", *compress_len, rsize);
+
+   return true;
+}
+#endif
+
+bool compress_data(JCR *jcr,
+                   uint32_t compression_algorithm,
+                   char *rbuf,
+                   uint32_t rsize,
+                   unsigned char *cbuf,
+                   uint32_t max_compress_len,
+                   uint32_t *compress_len)
+{
+   return compress_data(jcr, &jcr->compress, compression_algorithm, rbuf,
+                        rsize, cbuf, max_compress_len, compress_len);
+}
+
+/**
+ * Compress data using the workset of a specific compression context.
+ */
 bool compress_data(JCR *jcr,
+                   CMPRS_CTX *cmprs_ctx,
                    uint32_t compression_algorithm,
                    char *rbuf,
                    uint32_t rsize,
@@ -423,8 +551,8 @@ bool compress_data(JCR *jcr,
    switch (compression_algorithm) {
 #ifdef HAVE_LIBZ
    case COMPRESS_GZIP:
-      if (jcr->compress.workset.pZLIB) {
-         if (!compress_with_zlib(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (cmprs_ctx->workset.pZLIB) {
+         if (!compress_with_zlib(jcr, cmprs_ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -432,8 +560,8 @@ bool compress_data(JCR *jcr,
 #endif
 #ifdef HAVE_LZO
    case COMPRESS_LZO1X:
-      if (jcr->compress.workset.pLZO) {
-         if (!compress_with_lzo(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (cmprs_ctx->workset.pLZO) {
+         if (!compress_with_lzo(jcr, cmprs_ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -443,8 +571,17 @@ bool compress_data(JCR *jcr,
    case COMPRESS_FZFZ:
    case COMPRESS_FZ4L:
    case COMPRESS_FZ4H:
-      if (jcr->compress.workset.pZFAST) {
-         if (!compress_with_fastlz(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (cmprs_ctx->workset.pZFAST) {
+         if (!compress_with_fastlz(jcr, cmprs_ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+            return false;
+         }
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD
+   case COMPRESS_ZSTD:
+      if (cmprs_ctx->workset.pZSTD) {
+         if (!compress_with_zstd(jcr, cmprs_ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -459,6 +596,7 @@ bool compress_data(JCR *jcr,
 
 #ifdef HAVE_LIBZ
 static bool decompress_with_zlib(JCR *jcr,
+                                 CMPRS_CTX *cmprs_ctx,
                                  const char *last_fname,
                                  char **data,
                                  uint32_t *length,
@@ -478,11 +616,11 @@ static bool decompress_with_zlib(JCR *jcr,
     * be used in Bareos.
     */
    if (sparse && want_data_stream) {
-      wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+      wbuf = cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
+      compress_len = cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
    } else {
-      wbuf = jcr->compress.inflate_buffer;
-      compress_len = jcr->compress.inflate_buffer_size;
+      wbuf = cmprs_ctx->inflate_buffer;
+      compress_len = cmprs_ctx->inflate_buffer_size;
    }
 
    /*
@@ -502,15 +640,15 @@ static bool decompress_with_zlib(JCR *jcr,
       /*
        * The buffer size is too small, try with a bigger one
        */
-      jcr->compress.inflate_buffer_size = jcr->compress.inflate_buffer_size + (jcr->compress.inflate_buffer_size >> 1);
-      jcr->compress.inflate_buffer = check_pool_memory_size(jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+      cmprs_ctx->inflate_buffer_size = cmprs_ctx->inflate_buffer_size + (cmprs_ctx->inflate_buffer_size >> 1);
+      cmprs_ctx->inflate_buffer = check_pool_memory_size(cmprs_ctx->inflate_buffer, cmprs_ctx->inflate_buffer_size);
 
       if (sparse && want_data_stream) {
-         wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-         compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+         wbuf = cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
+         compress_len = cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
       } else {
-         wbuf = jcr->compress.inflate_buffer;
-         compress_len = jcr->compress.inflate_buffer_size;
+         wbuf = cmprs_ctx->inflate_buffer;
+         compress_len = cmprs_ctx->inflate_buffer_size;
       }
       Dmsg2(400, "Comp_len=%d msglen=%d\n", compress_len, *length);
    }
@@ -524,10 +662,10 @@ static bool decompress_with_zlib(JCR *jcr,
     * We return a decompressed data stream with the fileoffset encoded when this was a sparse stream.
     */
    if (sparse && want_data_stream) {
-      memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+      memcpy(cmprs_ctx->inflate_buffer, *data, OFFSET_FADDR_SIZE);
    }
 
-   *data = jcr->compress.inflate_buffer;
+   *data = cmprs_ctx->inflate_buffer;
    *length = compress_len;
 
    Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", compress_len, edit_uint64(jcr->JobBytes, ec1));
@@ -537,6 +675,7 @@ static bool decompress_with_zlib(JCR *jcr,
 #endif
 #ifdef HAVE_LZO
 static bool decompress_with_lzo(JCR *jcr,
+                                CMPRS_CTX *cmprs_ctx,
                                 const char *last_fname,
                                 char **data,
                                 uint32_t *length,
@@ -550,13 +689,13 @@ static bool decompress_with_lzo(JCR *jcr,
    int status, real_compress_len;
 
    if (sparse && want_data_stream) {
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+      compress_len = cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
       cbuf = (const unsigned char *)*data + OFFSET_FADDR_SIZE + sizeof(comp_stream_header);
-      wbuf = (unsigned char *)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+      wbuf = (unsigned char *)cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
    } else {
-      compress_len = jcr->compress.inflate_buffer_size;
+      compress_len = cmprs_ctx->inflate_buffer_size;
       cbuf = (const unsigned char *)*data + sizeof(comp_stream_header);
-      wbuf = (unsigned char *)jcr->compress.inflate_buffer;
+      wbuf = (unsigned char *)cmprs_ctx->inflate_buffer;
    }
 
    real_compress_len = *length - sizeof(comp_stream_header);
@@ -565,15 +704,15 @@ static bool decompress_with_lzo(JCR *jcr,
       /*
        * The buffer size is too small, try with a bigger one
        */
-      jcr->compress.inflate_buffer_size = jcr->compress.inflate_buffer_size + (jcr->compress.inflate_buffer_size >> 1);
-      jcr->compress.inflate_buffer = check_pool_memory_size(jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+      cmprs_ctx->inflate_buffer_size = cmprs_ctx->inflate_buffer_size + (cmprs_ctx->inflate_buffer_size >> 1);
+      cmprs_ctx->inflate_buffer = check_pool_memory_size(cmprs_ctx->inflate_buffer, cmprs_ctx->inflate_buffer_size);
 
       if (sparse && want_data_stream) {
-         compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-         wbuf = (unsigned char *)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+         compress_len = cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
+         wbuf = (unsigned char *)cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
       } else {
-         compress_len = jcr->compress.inflate_buffer_size;
-         wbuf = (unsigned char *)jcr->compress.inflate_buffer;
+         compress_len = cmprs_ctx->inflate_buffer_size;
+         wbuf = (unsigned char *)cmprs_ctx->inflate_buffer;
       }
       Dmsg2(400, "Comp_len=%d msglen=%d\n", compress_len, *length);
    }
@@ -587,10 +726,10 @@ static bool decompress_with_lzo(JCR *jcr,
     * We return a decompressed data stream with the fileoffset encoded when this was a sparse stream.
     */
    if (sparse && want_data_stream) {
-      memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+      memcpy(cmprs_ctx->inflate_buffer, *data, OFFSET_FADDR_SIZE);
    }
 
-   *data = jcr->compress.inflate_buffer;
+   *data = cmprs_ctx->inflate_buffer;
    *length = compress_len;
 
    Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", compress_len, edit_uint64(jcr->JobBytes, ec1));
@@ -601,6 +740,7 @@ static bool decompress_with_lzo(JCR *jcr,
 
 #ifdef HAVE_FASTLZ
 static bool decompress_with_fastlz(JCR *jcr,
+                                   CMPRS_CTX *cmprs_ctx,
                                    const char *last_fname,
                                    char **data,
                                    uint32_t *length,
@@ -629,11 +769,11 @@ static bool decompress_with_fastlz(JCR *jcr,
    stream.next_in = (Bytef *)*data + sizeof(comp_stream_header);
    stream.avail_in = (uInt)*length - sizeof(comp_stream_header);
    if (sparse && want_data_stream) {
-      stream.next_out = (Bytef *)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-      stream.avail_out = (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+      stream.next_out = (Bytef *)cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
+      stream.avail_out = (uInt)cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
    } else {
-      stream.next_out = (Bytef *)jcr->compress.inflate_buffer;
-      stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
+      stream.next_out = (Bytef *)cmprs_ctx->inflate_buffer;
+      stream.avail_out = (uInt)cmprs_ctx->inflate_buffer_size;
    }
 
    Dmsg2(400, "Comp_len=%d msglen=%d\n", stream.avail_in, *length);
@@ -653,14 +793,14 @@ static bool decompress_with_fastlz(JCR *jcr,
          /*
           * The buffer size is too small, try with a bigger one
           */
-         jcr->compress.inflate_buffer_size = jcr->compress.inflate_buffer_size + (jcr->compress.inflate_buffer_size >> 1);
-         jcr->compress.inflate_buffer = check_pool_memory_size(jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+         cmprs_ctx->inflate_buffer_size = cmprs_ctx->inflate_buffer_size + (cmprs_ctx->inflate_buffer_size >> 1);
+         cmprs_ctx->inflate_buffer = check_pool_memory_size(cmprs_ctx->inflate_buffer, cmprs_ctx->inflate_buffer_size);
          if (sparse && want_data_stream) {
-            stream.next_out = (Bytef *)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-            stream.avail_out = (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+            stream.next_out = (Bytef *)cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
+            stream.avail_out = (uInt)cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
          } else {
-            stream.next_out = (Bytef *)jcr->compress.inflate_buffer;
-            stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
+            stream.next_out = (Bytef *)cmprs_ctx->inflate_buffer;
+            stream.avail_out = (uInt)cmprs_ctx->inflate_buffer_size;
          }
          continue;
       case Z_OK:
@@ -676,10 +816,10 @@ static bool decompress_with_fastlz(JCR *jcr,
     * We return a decompressed data stream with the fileoffset encoded when this was a sparse stream.
     */
    if (sparse && want_data_stream) {
-      memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+      memcpy(cmprs_ctx->inflate_buffer, *data, OFFSET_FADDR_SIZE);
    }
 
-   *data = jcr->compress.inflate_buffer;
+   *data = cmprs_ctx->inflate_buffer;
    *length = stream.total_out;
    Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length, edit_uint64(jcr->JobBytes, ec1));
    fastlzlibDecompressEnd(&stream);
@@ -694,12 +834,127 @@ cleanup:
 }
 #endif
 
+#ifdef HAVE_ZSTD
+/*
+ * A data record holds at most one read buffer of the File Daemon, which is
+ * sent as one network packet. Bigger frames are only accepted when our own
+ * buffer size is bigger.
+ */
+#define ZSTD_MAX_RECORD_SIZE 1000000
+
+static bool decompress_with_zstd(JCR *jcr,
+                                 CMPRS_CTX *cmprs_ctx,
+                                 const char *last_fname,
+                                 char **data,
+                                 uint32_t *length,
+                                 bool sparse,
+                                 bool want_data_stream)
+{
+   char ec1[50]; /* Buffer printing huge values */
+   size_t status, compress_len, real_compress_len;
+   unsigned long long content_size;
+   uint32_t max_inflate_buffer_size;
+   const char *cbuf;
+   char *wbuf;
+
+   /*
+    * The decompression context is kept for all records of the job.
+    */
+   if (!cmprs_ctx->workset.pZSTDD) {
+      cmprs_ctx->workset.pZSTDD = ZSTD_createDCtx();
+      if (!cmprs_ctx->workset.pZSTDD) {
+         Qmsg(jcr, M_ERROR, 0, _("Failed to create ZSTD decompression context\n"));
+         return false;
+      }
+   }
+
+   cbuf = *data + sizeof(comp_stream_header);
+   real_compress_len = *length - sizeof(comp_stream_header);
+
+   /*
+    * The content size in the frame header comes from the volume,
+    * so it only sizes the buffer up front within the record limit.
+    */
+   max_inflate_buffer_size = MAX(ZSTD_MAX_RECORD_SIZE, jcr->buf_size) + OFFSET_FADDR_SIZE;
+   content_size = ZSTD_getFrameContentSize(cbuf, real_compress_len);
+   if (content_size == ZSTD_CONTENTSIZE_ERROR ||
+       (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+        content_size + OFFSET_FADDR_SIZE > max_inflate_buffer_size)) {
+      Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=Invalid frame header\n"), last_fname);
+      return false;
+   }
+   if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+       content_size + OFFSET_FADDR_SIZE > cmprs_ctx->inflate_buffer_size) {
+      cmprs_ctx->inflate_buffer_size = content_size + OFFSET_FADDR_SIZE;
+      cmprs_ctx->inflate_buffer = check_pool_memory_size(cmprs_ctx->inflate_buffer, cmprs_ctx->inflate_buffer_size);
+   }
+
+   while (1) {
+      if (sparse && want_data_stream) {
+         wbuf = cmprs_ctx->inflate_buffer + OFFSET_FADDR_SIZE;
+         compress_len = cmprs_ctx->inflate_buffer_size - OFFSET_FADDR_SIZE;
+      } else {
+         wbuf = cmprs_ctx->inflate_buffer;
+         compress_len = cmprs_ctx->inflate_buffer_size;
+      }
+      Dmsg2(400, "Comp_len=%d msglen=%d\n", compress_len, *length);
+
+      status = ZSTD_decompressDCtx((ZSTD_DCtx *)cmprs_ctx->workset.pZSTDD, wbuf, compress_len, cbuf, real_compress_len);
+      if (!ZSTD_isError(status) || ZSTD_getErrorCode(status) != ZSTD_error_dstSize_tooSmall ||
+          cmprs_ctx->inflate_buffer_size >= max_inflate_buffer_size) {
+         break;
+      }
+
+      /*
+       * The buffer size is too small, try with a bigger one
+       */
+      cmprs_ctx->inflate_buffer_size = MIN(cmprs_ctx->inflate_buffer_size + (cmprs_ctx->inflate_buffer_size >> 1),
+                                           max_inflate_buffer_size);
+      cmprs_ctx->inflate_buffer = check_pool_memory_size(cmprs_ctx->inflate_buffer, cmprs_ctx->inflate_buffer_size);
+   }
+
+   if (ZSTD_isError(status)) {
+      Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=%s\n"), last_fname, ZSTD_getErrorName(status));
+      return false;
+   }
+
+   /*
+    * We return a decompressed data stream with the fileoffset encoded when this was a sparse stream.
+    */
+   if (sparse && want_data_stream) {
+      memcpy(cmprs_ctx->inflate_buffer, *data, OFFSET_FADDR_SIZE);
+   }
+
+   *data = cmprs_ctx->inflate_buffer;
+   *length = status;
+
+   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length, edit_uint64(jcr->JobBytes, ec1));
+
+   return true;
+}
+#endif
+
 bool decompress_data(JCR *jcr,
                      const char *last_fname,
                      int32_t stream,
                      char **data,
                      uint32_t *length,
                      bool want_data_stream)
+{
+   return decompress_data(jcr, &jcr->compress, last_fname, stream,
+                          data, length, want_data_stream);
+}
+
+/**
+ * Decompress data into the inflate buffer of a specific compression context.
+ */
+bool decompress_data(JCR *jcr,
+                     CMPRS_CTX *cmprs_ctx,
+                     const char *last_fname,
+                     int32_t stream,
+                     char **data,
+                     uint32_t *length,
+                     bool want_data_stream)
 {
    Dmsg1(400, "Stream found in decompress_data(): %d\n", stream);
    switch (stream) {
@@ -749,18 +1004,18 @@ bool decompress_data(JCR *jcr,
          case COMPRESS_GZIP:
             switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-               return decompress_with_zlib(jcr, last_fname, data, length, true, true, want_data_stream);
+               return decompress_with_zlib(jcr, cmprs_ctx, last_fname, data, length, true, true, want_data_stream);
             default:
-               return decompress_with_zlib(jcr, last_fname, data, length, false, true, want_data_stream);
+               return decompress_with_zlib(jcr, cmprs_ctx, last_fname, data, length, false, true, want_data_stream);
             }
 #endif
 #ifdef HAVE_LZO
          case COMPRESS_LZO1X:
             switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-               return decompress_with_lzo(jcr, last_fname, data, length, true, want_data_stream);
+               return decompress_with_lzo(jcr, cmprs_ctx, last_fname, data, length, true, want_data_stream);
             default:
-               return decompress_with_lzo(jcr, last_fname, data, length, false, want_data_stream);
+               return decompress_with_lzo(jcr, cmprs_ctx, last_fname, data, length, false, want_data_stream);
             }
 #endif
 #ifdef HAVE_FASTLZ
@@ -769,9 +1024,18 @@ bool decompress_data(JCR *jcr,
          case COMPRESS_FZ4H:
             switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-               return decompress_with_fastlz(jcr, last_fname, data, length, comp_magic, true, want_data_stream);
+               return decompress_with_fastlz(jcr, cmprs_ctx, last_fname, data, length, comp_magic, true, want_data_stream);
+            default:
+               return decompress_with_fastlz(jcr, cmprs_ctx, last_fname, data, length, comp_magic, false, want_data_stream);
+            }
+#endif
+#ifdef HAVE_ZSTD
+         case COMPRESS_ZSTD:
+            switch (stream) {
+            case STREAM_SPARSE_COMPRESSED_DATA:
+               return decompress_with_zstd(jcr, cmprs_ctx, last_fname, data, length, true, want_data_stream);
             default:
-               return decompress_with_fastlz(jcr, last_fname, data, length, comp_magic, false, want_data_stream);
+               return decompress_with_zstd(jcr, cmprs_ctx, last_fname, data, length, false, want_data_stream);
             }
 #endif
          default:
@@ -784,9 +1048,9 @@ bool decompress_data(JCR *jcr,
 #ifdef HAVE_LIBZ
       switch (stream) {
       case STREAM_SPARSE_GZIP_DATA:
-         return decompress_with_zlib(jcr, last_fname, data, length, true, false, want_data_stream);
+         return decompress_with_zlib(jcr, cmprs_ctx, last_fname, data, length, true, false, want_data_stream);
       default:
-         return decompress_with_zlib(jcr, last_fname, data, length, false, false, want_data_stream);
+         return decompress_with_zlib(jcr, cmprs_ctx, last_fname, data, length, false, false, want_data_stream);
       }
 #else
       Qmsg(jcr, M_ERROR, 0, _("Compression algorithm GZIP found, but not supported!\n"));
@@ -807,31 +1071,156 @@ void cleanup_compression(JCR *jcr)
       jcr->compress.inflate_buffer = NULL;
    }
 
+   cleanup_compression_workset(&jcr->compress);
+}
+
+void cleanup_compression_workset(CMPRS_CTX *cmprs_ctx)
+{
 #ifdef HAVE_LIBZ
-   if (jcr->compress.workset.pZLIB) {
+   if (cmprs_ctx->workset.pZLIB) {
       /*
        * Free the zlib stream
        */
-      deflateEnd((z_stream *)jcr->compress.workset.pZLIB);
-      free(jcr->compress.workset.pZLIB);
-      jcr->compress.workset.pZLIB = NULL;
+      deflateEnd((z_stream *)cmprs_ctx->workset.pZLIB);
+      free(cmprs_ctx->workset.pZLIB);
+      cmprs_ctx->workset.pZLIB = NULL;
    }
 #endif
 
 #ifdef HAVE_LZO
-   if (jcr->compress.workset.pLZO) {
-      free(jcr->compress.workset.pLZO);
-      jcr->compress.workset.pLZO = NULL;
+   if (cmprs_ctx->workset.pLZO) {
+      free(cmprs_ctx->workset.pLZO);
+      cmprs_ctx->workset.pLZO = NULL;
    }
 #endif
 
 #ifdef HAVE_FASTLZ
-   if (jcr->compress.workset.pZFAST) {
-      free(jcr->compress.workset.pZFAST);
-      jcr->compress.workset.pZFAST = NULL;
+   if (cmprs_ctx->workset.pZFAST) {
+      free(cmprs_ctx->workset.pZFAST);
+      cmprs_ctx->workset.pZFAST = NULL;
    }
 #endif
 
+#ifdef HAVE_ZSTD
+   if (cmprs_ctx->workset.pZSTD) {
+      ZSTD_freeCCtx((ZSTD_CCtx *)cmprs_ctx->workset.pZSTD);
+      cmprs_ctx->workset.pZSTD = NULL;
+   }
+
+   if (cmprs_ctx->workset.pZSTDD) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)cmprs_ctx->workset.pZSTDD);
+      cmprs_ctx->workset.pZSTDD = NULL;
+   }
+#endif
+}
+/**
+ * Network compression of single packets. The algorithm is one of the
+ * BNET_COMPRESS_* values negotiated by the BSOCK layer, the contexts are
+ * owned by the socket and created on first use.
+ */
+uint32_t compress_packet_bound(uint32_t algorithm, uint32_t len)
+{
+   switch (algorithm) {
+#ifdef HAVE_ZSTD
+   case BNET_COMPRESS_ZSTD:
+      return ZSTD_compressBound(len);
+#endif
+   default:
+      return 0;
+   }
+}
+
+bool compress_packet(uint32_t algorithm,
+                     void **cctx,
+                     char *src,
+                     uint32_t src_len,
+                     char *dst,
+                     uint32_t dst_len,
+                     uint32_t *compress_len)
+{
+   switch (algorithm) {
+#ifdef HAVE_ZSTD
+   case BNET_COMPRESS_ZSTD: {
+      size_t zstat;
+
+      if (!*cctx) {
+         *cctx = ZSTD_createCCtx();
+         if (!*cctx) {
+            return false;
+         }
+      }
+
+      /*
+       * Use a fast level, the data is compressed again on every hop.
+       */
+      zstat = ZSTD_compressCCtx((ZSTD_CCtx *)*cctx, dst, dst_len, src, src_len, 1);
+      if (ZSTD_isError(zstat)) {
+         Dmsg1(100, "Network compression ZSTD_compressCCtx error: %s\n", ZSTD_getErrorName(zstat));
+         return false;
+      }
+      *compress_len = zstat;
+
+      return true;
+   }
+#endif
+   default:
+      return false;
+   }
+}
+
+bool decompress_packet(uint32_t algorithm,
+                       void **dctx,
+                       char *src,
+                       uint32_t src_len,
+                       char *dst,
+                       uint32_t dst_len,
+                       uint32_t *decompress_len)
+{
+   switch (algorithm) {
+#ifdef HAVE_ZSTD
+   case BNET_COMPRESS_ZSTD: {
+      size_t zstat;
+
+      if (!*dctx) {
+         *dctx = ZSTD_createDCtx();
+         if (!*dctx) {
+            return false;
+         }
+      }
+
+      zstat = ZSTD_decompressDCtx((ZSTD_DCtx *)*dctx, dst, dst_len, src, src_len);
+      if (ZSTD_isError(zstat)) {
+         Dmsg1(100, "Network compression ZSTD_decompressDCtx error: %s\n", ZSTD_getErrorName(zstat));
+         return false;
+      }
+      *decompress_len = zstat;
+
+      return true;
+   }
+#endif
+   default:
+      return false;
+   }
+}
+
+void cleanup_packet_compression(uint32_t algorithm, void **cctx, void **dctx)
+{
+   switch (algorithm) {
+#ifdef HAVE_ZSTD
+   case BNET_COMPRESS_ZSTD:
+      if (*cctx) {
+         ZSTD_freeCCtx((ZSTD_CCtx *)*cctx);
+      }
+      if (*dctx) {
+         ZSTD_freeDCtx((ZSTD_DCtx *)*dctx);
+      }
+      break;
+#endif
+   default:
+      break;
+   }
+   *cctx = NULL;
+   *dctx = NULL;
 }
 #else
 const char *cmprs_algo_to_text(uint32_t compression_algorithm)
@@ -847,6 +1236,13 @@ bool setup_compression_buffers(JCR *jcr,
    return true;
 }
 
+bool setup_compression_workset(JCR *jcr,
+                               CMPRS_CTX *cmprs_ctx,
+                               uint32_t compression_algorithm)
+{
+   return true;
+}
+
 bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size)
 {
    *decompress_buf_size = 0;
@@ -864,6 +1260,18 @@ bool compress_data(JCR *jcr,
    return true;
 }
 
+bool compress_data(JCR *jcr,
+                   CMPRS_CTX *cmprs_ctx,
+                   uint32_t compression_algorithm,
+                   char *rbuf,
+                   uint32_t rsize,
+                   unsigned char *cbuf,
+                   uint32_t max_compress_len,
+                   uint32_t *compress_len)
+{
+   return true;
+}
+
 bool decompress_data(JCR *jcr,
                      const char *last_fname,
                      int32_t stream,
@@ -878,4 +1286,40 @@ bool decompress_data(JCR *jcr,
 void cleanup_compression(JCR *jcr)
 {
 }
-#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) */
+
+void cleanup_compression_workset(CMPRS_CTX *cmprs_ctx)
+{
+}
+uint32_t compress_packet_bound(uint32_t algorithm, uint32_t len)
+{
+   return 0;
+}
+
+bool compress_packet(uint32_t algorithm,
+                     void **cctx,
+                     char *src,
+                     uint32_t src_len,
+                     char *dst,
+                     uint32_t dst_len,
+                     uint32_t *compress_len)
+{
+   return false;
+}
+
+bool decompress_packet(uint32_t algorithm,
+                       void **dctx,
+                       char *src,
+                       uint32_t src_len,
+                       char *dst,
+                       uint32_t dst_len,
+                       uint32_t *decompress_len)
+{
+   return false;
+}
+
+void cleanup_packet_compression(uint32_t algorithm, void **cctx, void **dctx)
+{
+   *cctx = NULL;
+   *dctx = NULL;
+}
+#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD) */
@@ -47,7 +47,8 @@ bool cram_md5_challenge(BSOCK *bs, const char *password, int tls_local_need, boo
    int i;
    bool ok;
    POOL_MEM chal(PM_NAME),
-            host(PM_NAME);
+            host(PM_NAME),
+            offer(PM_NAME);
    uint8_t hmac[20];
 
    gettimeofday(&t1, &tz);
@@ -64,16 +65,23 @@ bool cram_md5_challenge(BSOCK *bs, const char *password, int tls_local_need, boo
    /* Send challenge -- no hashing yet */
    Mmsg(chal, "<%u.%u@%s>", (uint32_t)random(), (uint32_t)time(NULL), host.c_str());
 
+   /*
+    * Peers that do not know about network compression ignore the offer.
+    */
+   if (bs->get_compression_offer()) {
+      Mmsg(offer, " compress=%u", bs->get_compression_offer());
+   }
+
    if (compatible) {
-      Dmsg2(dbglvl, "send: auth cram-md5 %s ssl=%d\n", chal.c_str(), tls_local_need);
-      if (!bs->fsend("auth cram-md5 %s ssl=%d\n", chal.c_str(), tls_local_need)) {
+      Dmsg3(dbglvl, "send: auth cram-md5 %s ssl=%d%s\n", chal.c_str(), tls_local_need, offer.c_str());
+      if (!bs->fsend("auth cram-md5 %s ssl=%d%s\n", chal.c_str(), tls_local_need, offer.c_str())) {
          Dmsg1(dbglvl, "Bnet send challenge comm error. ERR=%s\n", bs->bstrerror());
          return false;
       }
    } else {
       /* Old non-compatible system */
-      Dmsg2(dbglvl, "send: auth cram-md5 %s ssl=%d\n", chal.c_str(), tls_local_need);
-      if (!bs->fsend("auth cram-md5 %s ssl=%d\n", chal.c_str(), tls_local_need)) {
+      Dmsg3(dbglvl, "send: auth cram-md5 %s ssl=%d%s\n", chal.c_str(), tls_local_need, offer.c_str());
+      if (!bs->fsend("auth cram-md5 %s ssl=%d%s\n", chal.c_str(), tls_local_need, offer.c_str())) {
          Dmsg1(dbglvl, "Bnet send challenge comm error. ERR=%s\n", bs->bstrerror());
          return false;
       }
@@ -112,6 +120,7 @@ bool cram_md5_challenge(BSOCK *bs, const char *password, int tls_local_need, boo
 bool cram_md5_respond(BSOCK *bs, const char *password, int *tls_remote_need, bool *compatible)
 {
    POOL_MEM chal(PM_NAME);
+   char *offer;
    uint8_t hmac[20];
 
    *compatible = false;
@@ -121,6 +130,10 @@ bool cram_md5_respond(BSOCK *bs, const char *password, int *tls_remote_need, boo
    }
 
    Dmsg1(100, "cram-get received: %s", bs->msg);
+   bs->set_compression_remote(0);
+   if ((offer = strstr(bs->msg, " compress="))) {
+      bs->set_compression_remote(str_to_uint64(offer + 10));
+   }
    chal.check_size(bs->msglen);
    if (sscanf(bs->msg, "auth cram-md5c %s ssl=%d", chal.c_str(), tls_remote_need) == 2) {
       *compatible = true;
@@ -0,0 +1,220 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * CRC32C (Castagnoli) checksum.
+ *
+ * Uses the CRC32 instructions of SSE 4.2 on x86 and of ARMv8 when the CPU
+ * supports them, which is detected at runtime. Otherwise a slicing-by-8
+ * table driven implementation is used.
+ */
+
+#include "bareos.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(HAVE_LINUX_OS)
+#define HAVE_CRC32C_ARMV8 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+/*
+ * Reflected CRC32C polynomial.
+ */
+#define CRC32C_POLY 0x82f63b78
+
+typedef uint32_t (crc32c_function)(uint32_t crc, const uint8_t *buf, size_t len);
+
+static uint32_t crc32c_table[8][256];
+static crc32c_function *crc32c_impl = NULL;
+static const char *crc32c_impl_name = NULL;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Slicing-by-8, processes 8 bytes per step using 8 lookup tables.
+ */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   while (len && ((uintptr_t)buf & 7)) {
+      crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+      len--;
+   }
+
+#ifdef HAVE_LITTLE_ENDIAN
+   while (len >= 8) {
+      uint64_t word = *(const uint64_t *)buf ^ crc;
+
+      crc = crc32c_table[7][word & 0xff] ^
+            crc32c_table[6][(word >> 8) & 0xff] ^
+            crc32c_table[5][(word >> 16) & 0xff] ^
+            crc32c_table[4][(word >> 24) & 0xff] ^
+            crc32c_table[3][(word >> 32) & 0xff] ^
+            crc32c_table[2][(word >> 40) & 0xff] ^
+            crc32c_table[1][(word >> 48) & 0xff] ^
+            crc32c_table[0][word >> 56];
+      buf += 8;
+      len -= 8;
+   }
+#endif
+
+   while (len) {
+      crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+      len--;
+   }
+
+   return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   while (len && ((uintptr_t)buf & 7)) {
+      crc = _mm_crc32_u8(crc, *buf++);
+      len--;
+   }
+
+#ifdef __x86_64__
+   uint64_t crc64 = crc;
+
+   while (len >= 8) {
+      crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)buf);
+      buf += 8;
+      len -= 8;
+   }
+   crc = (uint32_t)crc64;
+#endif
+
+   while (len >= 4) {
+      crc = _mm_crc32_u32(crc, *(const uint32_t *)buf);
+      buf += 4;
+      len -= 4;
+   }
+
+   while (len) {
+      crc = _mm_crc32_u8(crc, *buf++);
+      len--;
+   }
+
+   return crc;
+}
+#endif
+
+#ifdef HAVE_CRC32C_ARMV8
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   while (len && ((uintptr_t)buf & 7)) {
+      crc = __crc32cb(crc, *buf++);
+      len--;
+   }
+
+   while (len >= 8) {
+      crc = __crc32cd(crc, *(const uint64_t *)buf);
+      buf += 8;
+      len -= 8;
+   }
+
+   while (len) {
+      crc = __crc32cb(crc, *buf++);
+      len--;
+   }
+
+   return crc;
+}
+#endif
+
+static void init_crc32c()
+{
+   uint32_t crc;
+
+   for (int i = 0; i < 256; i++) {
+      crc = i;
+      for (int j = 0; j < 8; j++) {
+         crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      }
+      crc32c_table[0][i] = crc;
+   }
+
+   for (int i = 0; i < 256; i++) {
+      crc = crc32c_table[0][i];
+      for (int j = 1; j < 8; j++) {
+         crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+         crc32c_table[j][i] = crc;
+      }
+   }
+
+   crc32c_impl = crc32c_sw;
+   crc32c_impl_name = "slicing-by-8";
+
+#ifdef HAVE_CRC32C_SSE42
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse4.2")) {
+      crc32c_impl = crc32c_sse42;
+      crc32c_impl_name = "sse4.2";
+   }
+#endif
+
+#ifdef HAVE_CRC32C_ARMV8
+   if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+      crc32c_impl = crc32c_armv8;
+      crc32c_impl_name = "armv8";
+   }
+#endif
+}
+
+/**
+ * Calculate the CRC32C on a buffer using the fastest implementation
+ * available on this CPU.
+ */
+uint32_t bcrc32c(uint8_t *buf, int len)
+{
+   pthread_once(&crc32c_once, init_crc32c);
+
+   return ~crc32c_impl(~0U, buf, len);
+}
+
+/**
+ * Calculate the CRC32C on a buffer using the table driven implementation.
+ */
+uint32_t bcrc32c_sw(uint8_t *buf, int len)
+{
+   pthread_once(&crc32c_once, init_crc32c);
+
+   return ~crc32c_sw(~0U, buf, len);
+}
+
+/**
+ * Name of the implementation bcrc32c() uses.
+ */
+const char *bcrc32c_implementation()
+{
+   pthread_once(&crc32c_once, init_crc32c);
+
+   return crc32c_impl_name;
+}
@@ -64,4 +64,5 @@
 #include "guid_to_name.h"
 #include "htable.h"
 #include "sellist.h"
+#include "accurate_list.h"
 #include "protos.h"
@@ -26,6 +26,14 @@
  * The idea behind these routines is that output to the user (user inferfaces, UIs)
  * is handled centrally with this class.
  *
+ * In JSON mode the result is built as a jansson tree and sent when it is
+ * finalized. When streaming is enabled, big arrays, e.g. of catalog rows,
+ * are instead streamed: once an array holds stream_threshold entries, the
+ * result up to that array is sent and every further completed entry is
+ * sent and freed right away. The output goes out in chunks, so memory use
+ * is bounded and a slow console throttles the producer through the
+ * blocking socket write.
+ *
  * Joerg Steffens, April 2015
  */
 
@@ -41,6 +49,16 @@ const char *json_error_message_template = "{ "
   "} "
 "}\n";
 
+#if HAVE_JANSSON
+static inline void free_json_level(of_json_level *level)
+{
+   if (level->name) {
+      free(level->name);
+   }
+   free(level);
+}
+#endif
+
 OUTPUT_FORMATTER::OUTPUT_FORMATTER(SEND_HANDLER *send_func_arg,
                                    void *send_ctx_arg,
                                    FILTER_HANDLER *filter_func_arg,
@@ -62,8 +80,11 @@ OUTPUT_FORMATTER::OUTPUT_FORMATTER(SEND_HANDLER *send_func_arg,
 #if HAVE_JANSSON
    result_json = json_object();
    result_stack_json = New(alist(10, false));
-   result_stack_json->push(result_json);
+   json_push_level(result_json, NULL, false);
    message_object_json = json_object();
+   stream_threshold = 0;
+   stream_failed = false;
+   stream_buffer = new POOL_MEM(PM_MESSAGE);
 #endif
 }
 
@@ -77,17 +98,22 @@ OUTPUT_FORMATTER::~OUTPUT_FORMATTER()
    }
    delete result_message_plain;
 #if HAVE_JANSSON
+   while (result_stack_json->size() > 0) {
+      free_json_level((of_json_level *)result_stack_json->pop());
+   }
    json_object_clear(result_json);
    json_decref(result_json);
    delete result_stack_json;
    json_object_clear(message_object_json);
    json_decref(message_object_json);
+   delete stream_buffer;
 #endif
 }
 
 void OUTPUT_FORMATTER::object_start(const char *name)
 {
 #if HAVE_JANSSON
+   of_json_level *level = NULL;
    json_t *json_object_current = NULL;
    json_t *json_object_existing = NULL;
    json_t *json_object_new = NULL;
@@ -97,12 +123,13 @@ void OUTPUT_FORMATTER::object_start(const char *name)
    switch (api) {
 #if HAVE_JANSSON
    case API_MODE_JSON:
-      json_object_current = (json_t *)result_stack_json->last();
-      if (json_object_current == NULL) {
+      level = json_current_level();
+      if (level == NULL) {
          Emsg0(M_ERROR, 0, "Failed to retrieve current JSON reference from stack.\n"
                            "This should not happen. Giving up.\n");
          return;
       }
+      json_object_current = level->json;
       if (name == NULL) {
          /*
           * Add nameless object.
@@ -110,14 +137,14 @@ void OUTPUT_FORMATTER::object_start(const char *name)
          if (json_is_array(json_object_current)) {
             json_object_new = json_object();
             json_array_append_new(json_object_current, json_object_new);
-            result_stack_json->push(json_object_new);
+            json_push_level(json_object_new, NULL, false);
          } else {
             /*
              * nameless objects only are indented to be added to arrays.
              * We do a workaround here, but this will only keep the last added entry (others will be overwritten).
              */
             Dmsg0(800, "Warning: requested to add a nameless object to another object. This does not match.\n");
-            result_stack_json->push(json_object_current);
+            json_push_level(json_object_current, NULL, true);
          }
       } else {
          json_object_existing = json_object_get(json_object_current, name);
@@ -131,7 +158,7 @@ void OUTPUT_FORMATTER::object_start(const char *name)
             json_object_new = json_object();
             json_object_set_new(json_object_current, name, json_object_new);
          }
-         result_stack_json->push(json_object_new);
+         json_push_level(json_object_new, name, false);
       }
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
       break;
@@ -147,7 +174,7 @@ void OUTPUT_FORMATTER::object_end(const char *name)
    switch (api) {
 #if HAVE_JANSSON
    case API_MODE_JSON:
-      result_stack_json->pop();
+      json_pop_level();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
       break;
 #endif
@@ -160,6 +187,7 @@ void OUTPUT_FORMATTER::object_end(const char *name)
 void OUTPUT_FORMATTER::array_start(const char *name)
 {
 #if HAVE_JANSSON
+   of_json_level *level = NULL;
    json_t *json_object_current = NULL;
    json_t *json_object_existing = NULL;
    json_t *json_new = NULL;
@@ -169,13 +197,14 @@ void OUTPUT_FORMATTER::array_start(const char *name)
    switch (api) {
 #if HAVE_JANSSON
    case API_MODE_JSON:
-      json_object_current = (json_t *)result_stack_json->last();
-      if (json_object_current == NULL) {
+      level = json_current_level();
+      if (level == NULL) {
          Emsg0(M_ERROR, 0, "Failed to retrieve current JSON reference from stack.\n"
                            "This should not happen. Giving up.\n");
          return;
       }
 
+      json_object_current = level->json;
       if (!json_is_object(json_object_current)) {
          Emsg0(M_ERROR, 0, "Failed to retrieve object from JSON stack.\n"
                            "This should not happen. Giving up.\n");
@@ -190,7 +219,7 @@ void OUTPUT_FORMATTER::array_start(const char *name)
       }
       json_new = json_array();
       json_object_set_new(json_object_current, name, json_new);
-      result_stack_json->push(json_new);
+      json_push_level(json_new, name, false);
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
       break;
 #endif
@@ -205,7 +234,7 @@ void OUTPUT_FORMATTER::array_end(const char *name)
    switch (api) {
 #if HAVE_JANSSON
    case API_MODE_JSON:
-      result_stack_json->pop();
+      json_pop_level();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
       break;
 #endif
@@ -684,6 +713,7 @@ void OUTPUT_FORMATTER::finalize_result(bool result)
 #if HAVE_JANSSON
 bool OUTPUT_FORMATTER::json_key_value_add_bool(const char *key, bool value)
 {
+   of_json_level *level;
    json_t *json_obj = NULL;
 #if JANSSON_VERSION_HEX < 0x020400
    json_t *json_bool = NULL;
@@ -691,10 +721,12 @@ bool OUTPUT_FORMATTER::json_key_value_add_bool(const char *key, bool value)
    POOL_MEM lkey(key);
 
    lkey.toLower();
-   json_obj = (json_t *)result_stack_json->last();
-   if (json_obj == NULL) {
+   level = json_current_level();
+   if (level == NULL) {
       Emsg2(M_ERROR, 0, "No json object defined to add %s: %llu", key, value);
+      return false;
    }
+   json_obj = level->json;
 
 #if JANSSON_VERSION_HEX >= 0x020400
    json_object_set_new(json_obj, lkey.c_str(), json_boolean(value));
@@ -710,37 +742,45 @@ bool OUTPUT_FORMATTER::json_key_value_add_bool(const char *key, bool value)
    }
    json_object_set_new(json_obj, lkey.c_str(), json_bool);
 #endif
+   json_stream_member(level, lkey.c_str());
 
    return true;
 }
 
 bool OUTPUT_FORMATTER::json_key_value_add(const char *key, uint64_t value)
 {
+   of_json_level *level;
    json_t *json_obj = NULL;
    POOL_MEM lkey(key);
 
    lkey.toLower();
-   json_obj = (json_t *)result_stack_json->last();
-   if (json_obj == NULL) {
+   level = json_current_level();
+   if (level == NULL) {
       Emsg2(M_ERROR, 0, "No json object defined to add %s: %llu", key, value);
+      return false;
    }
+   json_obj = level->json;
    json_object_set_new(json_obj, lkey.c_str(), json_integer(value));
+   json_stream_member(level, lkey.c_str());
 
    return true;
 }
 
 bool OUTPUT_FORMATTER::json_key_value_add(const char *key, const char *value)
 {
+   of_json_level *level;
    json_t *json_obj = NULL;
    POOL_MEM lkey(key);
 
    lkey.toLower();
-   json_obj = (json_t *)result_stack_json->last();
-   if (json_obj == NULL) {
+   level = json_current_level();
+   if (level == NULL) {
       Emsg2(M_ERROR, 0, "No json object defined to add %s: %s", key, value);
       return false;
    }
+   json_obj = level->json;
    json_object_set_new(json_obj, lkey.c_str(), json_string(value));
+   json_stream_member(level, lkey.c_str());
 
    return true;
 }
@@ -781,6 +821,412 @@ bool OUTPUT_FORMATTER::json_send_error_message(const char *message)
    return send_func(send_ctx, json_error_message.c_str());
 }
 
+/*
+ * Dump a json value of any type.
+ * json_dumps() only encodes objects and arrays with older jansson versions,
+ * so the value is wrapped in an array which is stripped afterwards,
+ * together with the indentation it added.
+ * Returns a malloced string or NULL on failure.
+ */
+static char *json_dump_value(json_t *value, size_t flags)
+{
+   json_t *wrapper;
+   char *string, *start, *end, *p, *q;
+   int indent = flags & 0x1F;
+
+   wrapper = json_array();
+   json_array_append(wrapper, value);
+   string = json_dumps(wrapper, flags);
+   json_decref(wrapper);
+   if (!string) {
+      return NULL;
+   }
+
+   start = strchr(string, '[') + 1;
+   end = strrchr(string, ']');
+   while (start < end && B_ISSPACE(*start)) {
+      start++;
+   }
+   while (end > start && B_ISSPACE(*(end - 1))) {
+      end--;
+   }
+
+   q = string;
+   for (p = start; p < end; p++) {
+      *q++ = *p;
+      if (*p == '\n') {
+         for (int i = 0; i < indent && *(p + 1) == ' '; i++) {
+            p++;
+         }
+      }
+   }
+   *q = '\0';
+
+   return string;
+}
+
+void OUTPUT_FORMATTER::json_push_level(json_t *json, const char *name, bool alias)
+{
+   of_json_level *level;
+
+   level = (of_json_level *)malloc(sizeof(of_json_level));
+   memset(level, 0, sizeof(of_json_level));
+   level->json = json;
+   if (name) {
+      level->name = bstrdup(name);
+   }
+   level->alias = alias;
+   if (result_stack_json->size() > 0) {
+      level->depth = ((of_json_level *)result_stack_json->last())->depth;
+      if (!alias) {
+         level->depth++;
+      }
+   } else {
+      level->depth = 1;
+   }
+   result_stack_json->push(level);
+}
+
+/*
+ * End the object or array on top of the result stack.
+ *
+ * When the parent was already sent, the finished entry is sent as well
+ * and removed from the parent, so only the entries under construction
+ * are kept in memory. When an array not sent yet reaches the stream
+ * threshold, the array and all levels below it are sent.
+ */
+void OUTPUT_FORMATTER::json_pop_level()
+{
+   int i;
+   of_json_level *level, *parent = NULL;
+
+   /*
+    * Never remove the result object itself.
+    */
+   if (result_stack_json->size() <= 1) {
+      Dmsg0(800, "Warning: requested to end the JSON result object. Ignoring.\n");
+      return;
+   }
+
+   level = (of_json_level *)result_stack_json->last();
+   if (level->alias) {
+      free_json_level((of_json_level *)result_stack_json->pop());
+      return;
+   }
+
+   for (i = result_stack_json->size() - 2; i >= 0; i--) {
+      parent = (of_json_level *)result_stack_json->get(i);
+      if (!parent->alias) {
+         break;
+      }
+   }
+
+   if (level->streamed) {
+      json_stream_write_indented(json_is_array(level->json) ? "\n]" : "\n}", level->depth);
+   } else if (parent->streamed) {
+      json_stream_value(parent, level->name, level->json);
+   } else {
+      if (stream_threshold > 0 && json_is_array(parent->json) &&
+          json_array_size(parent->json) >= (size_t)stream_threshold) {
+         free_json_level((of_json_level *)result_stack_json->pop());
+         json_stream_open(i);
+      } else {
+         free_json_level((of_json_level *)result_stack_json->pop());
+      }
+      return;
+   }
+
+   /*
+    * The entry has been sent, drop it from its parent.
+    */
+   if (json_is_array(parent->json)) {
+      json_array_remove(parent->json, json_array_size(parent->json) - 1);
+   } else {
+      json_object_del(parent->json, level->name);
+   }
+   free_json_level((of_json_level *)result_stack_json->pop());
+   json_stream_flush(false);
+}
+
+/*
+ * Return the level new entries are added to.
+ */
+of_json_level *OUTPUT_FORMATTER::json_current_level()
+{
+   of_json_level *level;
+
+   for (int i = result_stack_json->size() - 1; i >= 0; i--) {
+      level = (of_json_level *)result_stack_json->get(i);
+      if (!level->alias) {
+         return level;
+      }
+   }
+
+   return NULL;
+}
+
+bool OUTPUT_FORMATTER::json_is_streaming()
+{
+   of_json_level *level;
+
+   level = (of_json_level *)result_stack_json->first();
+   return level && level->streamed;
+}
+
+void OUTPUT_FORMATTER::json_stream_write(const char *string)
+{
+   if (!stream_failed) {
+      stream_buffer->strcat(string);
+   }
+}
+
+/*
+ * Write a string, indenting each new line to the given depth.
+ * In compact mode the new lines are dropped.
+ */
+void OUTPUT_FORMATTER::json_stream_write_indented(const char *string, int depth)
+{
+   const char *p;
+   POOL_MEM line;
+
+   while ((p = strchr(string, '\n')) != NULL) {
+      pm_memcpy(line, string, p - string + 1);
+      line.c_str()[p - string] = '\0';
+      json_stream_write(line.c_str());
+      if (!compact) {
+         json_stream_write("\n");
+         for (int i = 0; i < depth; i++) {
+            json_stream_write("  ");
+         }
+      }
+      string = p + 1;
+   }
+   json_stream_write(string);
+}
+
+/*
+ * Send a member of a level that has already been opened.
+ * For objects key is the name of the member, for arrays it is NULL.
+ */
+void OUTPUT_FORMATTER::json_stream_value(of_json_level *level, const char *key, json_t *value)
+{
+   char *string;
+   json_t *json_key;
+   size_t flags = compact ? UA_JSON_FLAGS_COMPACT : UA_JSON_FLAGS_NORMAL;
+
+   if (level->has_members) {
+      json_stream_write(",");
+   }
+   level->has_members = true;
+   json_stream_write_indented("\n", level->depth + 1);
+
+   if (key) {
+      json_key = json_string(key);
+      string = json_dump_value(json_key, flags);
+      json_decref(json_key);
+      if (string) {
+         json_stream_write(string);
+         json_stream_write(compact ? ":" : ": ");
+         free(string);
+      }
+   }
+
+   if (value) {
+      string = json_dump_value(value, flags);
+      if (!string) {
+         Emsg0(M_ERROR, 0, "Failed to generate json string.\n");
+         json_stream_write("null");
+      } else {
+         json_stream_write_indented(string, level->depth + 1);
+         free(string);
+      }
+   }
+}
+
+/*
+ * Send a key just added to an object that has already been opened.
+ */
+void OUTPUT_FORMATTER::json_stream_member(of_json_level *level, const char *key)
+{
+   if (!level->streamed) {
+      return;
+   }
+
+   json_stream_value(level, key, json_object_get(level->json, key));
+   json_object_del(level->json, key);
+   json_stream_flush(false);
+}
+
+/*
+ * Start streaming the result. All levels of the result stack up to
+ * and including upto are opened, the entries they already hold are
+ * sent and dropped from memory.
+ */
+void OUTPUT_FORMATTER::json_stream_open(int upto)
+{
+   size_t index, nr_entries;
+   void *iter;
+   json_t *json;
+   of_json_level *level, *parent = NULL, *child;
+
+   Dmsg1(800, "start streaming json result (stack size: %d)\n", result_stack_json->size());
+   for (int i = 0; i <= upto; i++) {
+      level = (of_json_level *)result_stack_json->get(i);
+      if (level->alias) {
+         continue;
+      }
+
+      child = NULL;
+      for (int j = i + 1; j <= upto; j++) {
+         child = (of_json_level *)result_stack_json->get(j);
+         if (!child->alias) {
+            break;
+         }
+         child = NULL;
+      }
+
+      if (!level->streamed) {
+         if (parent) {
+            json_stream_value(parent, level->name, NULL);
+         } else {
+            /*
+             * The envelope is the same as the one of json_finalize_result().
+             */
+            json_stream_write_indented(compact ? "{\n\"jsonrpc\":\"2.0\",\n\"id\":null,\n\"result\":"
+                                               : "{\n\"jsonrpc\": \"2.0\",\n\"id\": null,\n\"result\": ", 1);
+         }
+         json_stream_write(json_is_array(level->json) ? "[" : "{");
+         level->streamed = true;
+
+         /*
+          * Send what is already there, except the entry on the stack.
+          */
+         json = level->json;
+         if (json_is_array(json)) {
+            nr_entries = json_array_size(json);
+            if (child) {
+               nr_entries--;
+            }
+            for (index = 0; index < nr_entries; index++) {
+               json_stream_value(level, NULL, json_array_get(json, index));
+            }
+            if (child) {
+               json_incref(child->json);
+               json_array_clear(json);
+               json_array_append_new(json, child->json);
+            } else {
+               json_array_clear(json);
+            }
+         } else {
+            iter = json_object_iter(json);
+            while (iter) {
+               if (!child || !bstrcmp(json_object_iter_key(iter), child->name)) {
+                  json_stream_value(level, json_object_iter_key(iter), json_object_iter_value(iter));
+               }
+               iter = json_object_iter_next(json, iter);
+            }
+            if (child) {
+               json_incref(child->json);
+               json_object_clear(json);
+               json_object_set_new(json, child->name, child->json);
+            } else {
+               json_object_clear(json);
+            }
+         }
+      }
+      parent = level;
+   }
+
+   json_stream_flush(false);
+}
+
+/*
+ * Send the streamed output collected so far.
+ * Unless all is set, this only happens when a full chunk is available.
+ * If sending fails, e.g. because the console went away,
+ * the rest of the result is dropped.
+ */
+void OUTPUT_FORMATTER::json_stream_flush(bool all)
+{
+   size_t string_length;
+
+   string_length = stream_buffer->strlen();
+   if (string_length == 0 || (!all && string_length < OF_JSON_STREAM_CHUNK_SIZE)) {
+      return;
+   }
+
+   if (!stream_failed && !send_func(send_ctx, stream_buffer->c_str())) {
+      Dmsg1(100, "Failed to send json stream chunk (length=%lld). Dropping rest of result.\n",
+            string_length);
+      stream_failed = true;
+   }
+   stream_buffer->strcpy("");
+}
+
+/*
+ * Finish a streamed result. The result member has been sent already,
+ * so the result message is completed and a failure is reported in a
+ * separate error response without the result.
+ */
+void OUTPUT_FORMATTER::json_stream_finalize(bool result)
+{
+   json_t *msg_obj;
+   json_t *error_obj;
+   json_t *data_obj;
+   char *string;
+
+   while (result_stack_json->size() > 1) {
+      json_pop_level();
+   }
+   json_stream_write_indented("\n}", 1);
+   json_stream_write_indented("\n}", 0);
+   json_stream_flush(true);
+
+   if (result && !json_has_error_message()) {
+      return;
+   }
+
+   msg_obj = json_object();
+   json_object_set_new(msg_obj, "jsonrpc", json_string("2.0"));
+   json_object_set_new(msg_obj, "id", json_null());
+   error_obj = json_object();
+   json_object_set_new(error_obj, "code", json_integer(1));
+   json_object_set_new(error_obj, "message", json_string("failed"));
+   data_obj = json_object();
+   json_object_set(data_obj, "messages", message_object_json);
+   json_object_set_new(error_obj, "data", data_obj);
+   json_object_set_new(msg_obj, "error", error_obj);
+
+   string = json_dumps(msg_obj, compact ? UA_JSON_FLAGS_COMPACT : UA_JSON_FLAGS_NORMAL);
+   if (string) {
+      if (!stream_failed && !send_func(send_ctx, string)) {
+         Dmsg0(100, "Failed to send json error response of streamed result.\n");
+      }
+      free(string);
+   }
+   json_decref(msg_obj);
+}
+
+/*
+ * Reset the result for the next command.
+ */
+void OUTPUT_FORMATTER::json_clear_result()
+{
+   of_json_level *level;
+
+   while (result_stack_json->size() > 1) {
+      free_json_level((of_json_level *)result_stack_json->pop());
+   }
+   level = (of_json_level *)result_stack_json->first();
+   level->streamed = false;
+   level->has_members = false;
+   stream_failed = false;
+   stream_buffer->strcpy("");
+
+   json_object_clear(result_json);
+   json_object_clear(message_object_json);
+}
+
 void OUTPUT_FORMATTER::json_finalize_result(bool result)
 {
    json_t *msg_obj = json_object();
@@ -790,6 +1236,13 @@ void OUTPUT_FORMATTER::json_finalize_result(bool result)
    char *string;
    size_t string_length = 0;
 
+   if (json_is_streaming()) {
+      json_stream_finalize(result);
+      json_clear_result();
+      json_decref(msg_obj);
+      return;
+   }
+
    /*
     * We mimic json-rpc result and error messages,
     * To make it easier to implement real json-rpc later on.
@@ -848,11 +1301,8 @@ void OUTPUT_FORMATTER::json_finalize_result(bool result)
    /*
     * empty result stack
     */
-   while (result_stack_json->pop()) {};
-   result_stack_json->push(result_json);
-
-   json_object_clear(result_json);
-   json_object_clear(message_object_json);
+   json_clear_result();
    json_object_clear(msg_obj);
+   json_decref(msg_obj);
 }
 #endif
@@ -36,6 +36,14 @@
 
 #define OF_MAX_NR_HIDDEN_COLUMNS 64
 
+/*
+ * In JSON mode with streaming enabled an array is streamed to the other
+ * end once it holds this many entries, the streamed output is sent in
+ * chunks of about OF_JSON_STREAM_CHUNK_SIZE bytes.
+ */
+#define OF_JSON_STREAM_THRESHOLD 100
+#define OF_JSON_STREAM_CHUNK_SIZE (64 * 1024)
+
 #if HAVE_JANSSON
 #define UA_JSON_FLAGS_NORMAL JSON_INDENT(2)
 #define UA_JSON_FLAGS_COMPACT JSON_COMPACT
@@ -94,6 +102,20 @@ typedef struct of_filter_tuple {
    } u;
 } of_filter_tuple;
 
+#if HAVE_JANSSON
+/**
+ * Entry of the JSON result stack.
+ */
+typedef struct of_json_level {
+   json_t *json;                      /* Object or array at this level */
+   char *name;                        /* Key in the parent object, NULL for array entries */
+   int depth;                         /* Nesting depth, used for indenting streamed output */
+   bool alias;                        /* Nameless object added to an object, json is the parent */
+   bool streamed;                     /* Opening bracket has been sent */
+   bool has_members;                  /* Members have been sent after the opening bracket */
+} of_json_level;
+#endif
+
 /**
  * Actual output formatter class.
  */
@@ -123,6 +145,9 @@ private:
    json_t *result_json;
    alist *result_stack_json;
    json_t *message_object_json;
+   int stream_threshold;
+   bool stream_failed;
+   POOL_MEM *stream_buffer;
 #endif
 
 private:
@@ -143,6 +168,22 @@ private:
 
 #if HAVE_JANSSON
    bool json_send_error_message(const char *message);
+
+   /*
+    * Result stack and streaming.
+    */
+   void json_push_level(json_t *json, const char *name, bool alias);
+   void json_pop_level();
+   of_json_level *json_current_level();
+   bool json_is_streaming();
+   void json_stream_write(const char *string);
+   void json_stream_write_indented(const char *string, int depth);
+   void json_stream_value(of_json_level *level, const char *key, json_t *value);
+   void json_stream_member(of_json_level *level, const char *key);
+   void json_stream_open(int upto);
+   void json_stream_flush(bool all);
+   void json_stream_finalize(bool result);
+   void json_clear_result();
 #endif
 
 public:
@@ -166,6 +207,18 @@ public:
    void set_compact(bool value) { compact = value; };
    bool get_compact() { return compact; };
 
+#if HAVE_JANSSON
+   /*
+    * In json api mode big arrays can be sent while they are filled,
+    * instead of building the whole result in memory first.
+    * An array is streamed when it holds threshold entries, 0 (the default)
+    * disables streaming. When a streamed result fails, the result message
+    * is completed as sent so far and followed by a separate error response.
+    */
+   void set_stream_threshold(int value) { stream_threshold = value; };
+   int get_stream_threshold() { return stream_threshold; };
+#endif
+
    void object_start(const char *name = NULL);
    void object_end(const char *name = NULL);
    void array_start(const char *name);
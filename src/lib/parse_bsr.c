@@ -197,6 +197,116 @@ static inline bool is_positioning_ok(BSR *bsr)
    return true;
 }
 
+static int compare_findex_range(const void *a, const void *b)
+{
+   const BSR_FINDEX_RANGE *ra = (const BSR_FINDEX_RANGE *)a;
+   const BSR_FINDEX_RANGE *rb = (const BSR_FINDEX_RANGE *)b;
+
+   if (ra->findex != rb->findex) {
+      return (ra->findex < rb->findex) ? -1 : 1;
+   }
+   return 0;
+}
+
+static int compare_voladdr_range(const void *a, const void *b)
+{
+   const BSR_VOLADDR_RANGE *ra = (const BSR_VOLADDR_RANGE *)a;
+   const BSR_VOLADDR_RANGE *rb = (const BSR_VOLADDR_RANGE *)b;
+
+   if (ra->saddr != rb->saddr) {
+      return (ra->saddr < rb->saddr) ? -1 : 1;
+   }
+   return 0;
+}
+
+static int compare_voladdr_end(const void *a, const void *b)
+{
+   const BSR_VOLADDR *va = *(const BSR_VOLADDR **)a;
+   const BSR_VOLADDR *vb = *(const BSR_VOLADDR **)b;
+
+   if (va->eaddr != vb->eaddr) {
+      return (va->eaddr < vb->eaddr) ? -1 : 1;
+   }
+   return 0;
+}
+
+/*
+ * Compile the FileIndex and VolAddr lists of a bsr into sorted arrays
+ * of merged ranges (see BSR_FINDEX_RANGE in bsr.h).
+ */
+static inline void compile_bsr(BSR *bsr)
+{
+   uint32_t cnt, i, j;
+
+   cnt = 0;
+   for (BSR_FINDEX *fi = bsr->FileIndex; fi; fi = fi->next) {
+      cnt++;
+   }
+   if (cnt > 0) {
+      bsr->findex_ranges = (BSR_FINDEX_RANGE *)malloc(cnt * sizeof(BSR_FINDEX_RANGE));
+      i = 0;
+      for (BSR_FINDEX *fi = bsr->FileIndex; fi; fi = fi->next) {
+         bsr->findex_ranges[i].findex = fi->findex;
+         bsr->findex_ranges[i].findex2 = fi->findex2;
+         i++;
+      }
+      qsort(bsr->findex_ranges, cnt, sizeof(BSR_FINDEX_RANGE), compare_findex_range);
+
+      /*
+       * Merge overlapping and adjacent ranges.
+       */
+      for (i = 0, j = 1; j < cnt; j++) {
+         if ((int64_t)bsr->findex_ranges[j].findex <= (int64_t)bsr->findex_ranges[i].findex2 + 1) {
+            bsr->findex_ranges[i].findex2 = MAX(bsr->findex_ranges[i].findex2,
+                                                bsr->findex_ranges[j].findex2);
+         } else {
+            bsr->findex_ranges[++i] = bsr->findex_ranges[j];
+         }
+      }
+      bsr->nr_findex_ranges = i + 1;
+   }
+
+   /*
+    * Records before the start of all VolAddr ranges cannot match and have
+    * no side effects on the done state, so they are skipped early. This
+    * doesn't hold when a VolFile is given as well.
+    */
+   bsr->min_saddr = 0;
+   cnt = 0;
+   for (BSR_VOLADDR *va = bsr->voladdr; va; va = va->next) {
+      cnt++;
+   }
+   if (cnt > 0) {
+      bsr->voladdr_ranges = (BSR_VOLADDR_RANGE *)malloc(cnt * sizeof(BSR_VOLADDR_RANGE));
+      bsr->voladdr_by_end = (BSR_VOLADDR **)malloc((cnt + 1) * sizeof(BSR_VOLADDR *));
+      i = 0;
+      for (BSR_VOLADDR *va = bsr->voladdr; va; va = va->next) {
+         bsr->voladdr_ranges[i].saddr = va->saddr;
+         bsr->voladdr_ranges[i].eaddr = va->eaddr;
+         bsr->voladdr_by_end[i] = va;
+         i++;
+      }
+      bsr->voladdr_by_end[cnt] = NULL;
+      qsort(bsr->voladdr_ranges, cnt, sizeof(BSR_VOLADDR_RANGE), compare_voladdr_range);
+      qsort(bsr->voladdr_by_end, cnt, sizeof(BSR_VOLADDR *), compare_voladdr_end);
+
+      for (i = 0, j = 1; j < cnt; j++) {
+         if (bsr->voladdr_ranges[j].saddr <= bsr->voladdr_ranges[i].eaddr ||
+             bsr->voladdr_ranges[j].saddr == bsr->voladdr_ranges[i].eaddr + 1) {
+            bsr->voladdr_ranges[i].eaddr = MAX(bsr->voladdr_ranges[i].eaddr,
+                                               bsr->voladdr_ranges[j].eaddr);
+         } else {
+            bsr->voladdr_ranges[++i] = bsr->voladdr_ranges[j];
+         }
+      }
+      bsr->nr_voladdr_ranges = i + 1;
+
+      if (!bsr->volfile) {
+         bsr->min_saddr = bsr->voladdr_ranges[0].saddr;
+      }
+   }
+}
+
 /*
  * Parse Bootstrap file
  */
@@ -259,6 +369,7 @@ BSR *parse_bsr(JCR *jcr, char *fname)
    }
    for (bsr=root_bsr; bsr; bsr=bsr->next) {
       bsr->root = root_bsr;
+      compile_bsr(bsr);
    }
    return root_bsr;
 }
@@ -453,14 +564,9 @@ static BSR *store_findex(LEX *lc, BSR *bsr)
       if (!bsr->FileIndex) {
          bsr->FileIndex = findex;
       } else {
-         /*
-	  * Add to end of chain
-	  */
-         BSR_FINDEX *bs = bsr->FileIndex;
-         for ( ;bs->next; bs=bs->next)
-            {  }
-         bs->next = findex;
+         bsr->last_findex->next = findex;
       }
+      bsr->last_findex = findex;
       token = lex_get_token(lc, T_ALL);
       if (token != T_COMMA) {
          break;
@@ -664,14 +770,9 @@ static BSR *store_voladdr(LEX *lc, BSR *bsr)
       if (!bsr->voladdr) {
          bsr->voladdr = voladdr;
       } else {
-         /*
-	  * Add to end of chain
-	  */
-         BSR_VOLADDR *bs = bsr->voladdr;
-         for ( ;bs->next; bs=bs->next)
-            {  }
-         bs->next = voladdr;
+         bsr->last_voladdr->next = voladdr;
       }
+      bsr->last_voladdr = voladdr;
       token = lex_get_token(lc, T_ALL);
       if (token != T_COMMA) {
          break;
@@ -954,9 +1055,15 @@ void dump_bsr(BSR *bsr, bool recurse)
  */
 static inline void free_bsr_item(BSR *bsr)
 {
-   if (bsr) {
-      free_bsr_item(bsr->next);
+   BSR *next;
+
+   /*
+    * Not recursive, the lists can be millions of items long.
+    */
+   while (bsr) {
+      next = bsr->next;
       free(bsr);
+      bsr = next;
    }
 }
 
@@ -987,6 +1094,15 @@ static inline void remove_bsr(BSR *bsr)
    if (bsr->attr) {
       free_attr(bsr->attr);
    }
+   if (bsr->findex_ranges) {
+      free(bsr->findex_ranges);
+   }
+   if (bsr->voladdr_ranges) {
+      free(bsr->voladdr_ranges);
+   }
+   if (bsr->voladdr_by_end) {
+      free(bsr->voladdr_by_end);
+   }
    if (bsr->next) {
       bsr->next->prev = bsr->prev;
    }
@@ -29,6 +29,7 @@
 #define __LIBPROTOS_H
 
 class JCR;
+struct CMPRS_CTX;
 
 /* attr.c */
 ATTR *new_attr(JCR *jcr);
@@ -51,7 +52,7 @@ int bin_to_base64(char *buf, int buflen, char *bin, int binlen, bool compatible)
 int base64_to_bin(char *dest, int destlen, char *src, int srclen);
 
 /* bget_msg.c */
-int bget_msg(BSOCK *sock);
+int bget_msg(BSOCK *sock, char *buf = NULL, int32_t bufsize = 0);
 
 /* bnet.c */
 int32_t bnet_recv(BSOCK *bsock);
@@ -154,13 +155,33 @@ const char *cmprs_algo_to_text(uint32_t compression_algorithm);
 bool setup_compression_buffers(JCR *jcr, bool compatible,
                                uint32_t compression_algorithm,
                                uint32_t *compress_buf_size);
+bool setup_compression_workset(JCR *jcr, CMPRS_CTX *cmprs_ctx,
+                               uint32_t compression_algorithm);
 bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size);
 bool compress_data(JCR *jcr, uint32_t compression_algorithm, char *rbuf,
                    uint32_t rsize, unsigned char *cbuf,
                    uint32_t max_compress_len, uint32_t *compress_len);
+bool compress_data(JCR *jcr, CMPRS_CTX *cmprs_ctx, uint32_t compression_algorithm,
+                   char *rbuf, uint32_t rsize, unsigned char *cbuf,
+                   uint32_t max_compress_len, uint32_t *compress_len);
 bool decompress_data(JCR *jcr, const char *last_fname, int32_t stream,
                      char **data, uint32_t *length, bool want_data_stream);
+bool decompress_data(JCR *jcr, CMPRS_CTX *cmprs_ctx, const char *last_fname,
+                     int32_t stream, char **data, uint32_t *length,
+                     bool want_data_stream);
 void cleanup_compression(JCR *jcr);
+void cleanup_compression_workset(CMPRS_CTX *cmprs_ctx);
+uint32_t compress_packet_bound(uint32_t algorithm, uint32_t len);
+bool compress_packet(uint32_t algorithm, void **cctx, char *src, uint32_t src_len,
+                     char *dst, uint32_t dst_len, uint32_t *compress_len);
+bool decompress_packet(uint32_t algorithm, void **dctx, char *src, uint32_t src_len,
+                       char *dst, uint32_t dst_len, uint32_t *decompress_len);
+void cleanup_packet_compression(uint32_t algorithm, void **cctx, void **dctx);
+
+/* crc32c.c */
+uint32_t bcrc32c(uint8_t *buf, int len);
+uint32_t bcrc32c_sw(uint8_t *buf, int len);
+const char *bcrc32c_implementation();
 
 /* cram-md5.c */
 bool cram_md5_respond(BSOCK *bs, const char *password, int *tls_remote_need, bool *compatible);
@@ -2,6 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2002-2012 Free Software Foundation Europe e.V.
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -22,6 +23,14 @@
  * Directory tree build/traverse routines
  *
  * Kern Sibbald, June MMII
+ *
+ * The nodes are kept small as a restore tree can hold tens of millions
+ * of them. File names are stored once per tree and shared by all nodes
+ * with the same name. While the tree is built, nodes are found through
+ * a hash table on parent and name. Once it is built, the children of
+ * all nodes are put sorted into one array, each node refers to its
+ * range in there, and the hash tables are released. Inserting nodes
+ * later on rebuilds them as needed.
  */
 
 #include "bareos.h"
@@ -34,6 +43,26 @@
 static TREE_NODE *search_and_insert_tree_node(char *fname, int type,
                                               TREE_ROOT *root, TREE_NODE *parent);
 static char *tree_alloc(TREE_ROOT *root, int size);
+static void remove_from_node_table(TREE_ROOT *root, TREE_NODE *node);
+
+#define MIN_TABLE_SIZE 1024
+
+/* delta parts hashtable entry */
+struct s_delta_entry {
+   uint64_t key;
+   hlink link;
+   struct delta_list *delta_list;
+};
+typedef struct s_delta_entry DELTA_ENTRY;
+
+/* NDMP file history hashtable entry */
+struct s_fh_entry {
+   uint64_t key;
+   hlink link;
+   uint64_t fhinfo;                   /* NDMP Fh_info */
+   uint64_t fhnode;                   /* NDMP Fh_node */
+};
+typedef struct s_fh_entry FH_ENTRY;
 
 /*
  * NOTE !!!!! we turn off Debug messages for performance reasons.
@@ -93,9 +122,27 @@ TREE_ROOT *new_tree(int count)
    root->cached_path_len = -1;
    root->cached_path = get_pool_memory(PM_FNAME);
    root->type = TN_ROOT;
-   root->fname = "";
+   root->fname = (char *)"";
    HL_ENTRY* entry = NULL;
    root->hardlinks.init(entry, &entry->link, 0, 1);
+   DELTA_ENTRY *delta_entry = NULL;
+   root->delta_parts.init(delta_entry, &delta_entry->link, 0, 1);
+   FH_ENTRY *fh_entry = NULL;
+   root->file_history.init(fh_entry, &fh_entry->link, 0, 1);
+
+   /*
+    * Size the lookup tables for the expected number of files.
+    */
+   root->node_table_size = MIN_TABLE_SIZE;
+   while (root->node_table_size < (uint32_t)count + (count >> 1)) {
+      root->node_table_size <<= 1;
+   }
+   root->node_table = (TREE_NODE **)malloc(root->node_table_size * sizeof(TREE_NODE *));
+   memset(root->node_table, 0, root->node_table_size * sizeof(TREE_NODE *));
+   root->name_table_size = MIN_TABLE_SIZE;
+   root->name_table = (char **)malloc(root->name_table_size * sizeof(char *));
+   memset(root->name_table, 0, root->name_table_size * sizeof(char *));
+
    return root;
 }
 
@@ -113,24 +160,46 @@ static TREE_NODE *new_tree_node(TREE_ROOT *root)
 }
 
 /*
- * This routine can be called to release the previously allocated tree node.
+ * Unlink a single node from its parent.
  */
-static void free_tree_node(TREE_ROOT *root)
+static void unlink_tree_node(TREE_ROOT *root, TREE_NODE *node)
 {
-   int asize = BALIGN(sizeof(TREE_NODE));
-   root->mem->rem += asize;
-   root->mem->mem -= asize;
+   if (root->node_table) {
+      remove_from_node_table(root, node);
+   }
+   node->parent->nr_children--;
+   node->removed = true;
+   root->nr_nodes--;
 }
 
+/*
+ * Remove a node and everything below it from its parent. The nodes
+ * stay in the list of all nodes but are no longer found by a lookup or
+ * a walk of the children.
+ */
 void tree_remove_node(TREE_ROOT *root, TREE_NODE *node)
 {
-   int asize = BALIGN(sizeof(TREE_NODE));
-   node->parent->child.remove(node);
-   if ((root->mem->mem - asize) == (char *)node) {
-      free_tree_node(root);
-   } else {
-      Dmsg0(0, "Can't release tree node\n");
+   TREE_NODE *next;
+
+   if (node->removed) {
+      return;
    }
+
+   unlink_tree_node(root, node);
+
+   /*
+    * A parent is always inserted before its children, so all
+    * descendants follow the node in the list of all nodes.
+    */
+   if (node->nr_children > 0) {
+      for (next = node->next; next; next = next->next) {
+         if (!next->removed && next->parent->removed) {
+            unlink_tree_node(root, next);
+         }
+      }
+   }
+   root->cached_path_len = -1;        /* the cached parent may be gone */
+   root->children_valid = false;
 }
 
 /*
@@ -167,6 +236,17 @@ void free_tree(TREE_ROOT *root)
    uint32_t freed_blocks = 0;
 
    root->hardlinks.destroy();
+   root->delta_parts.destroy();
+   root->file_history.destroy();
+   if (root->node_table) {
+      free(root->node_table);
+   }
+   if (root->name_table) {
+      free(root->name_table);
+   }
+   if (root->children) {
+      free(root->children);
+   }
    for (mem=root->mem; mem; ) {
       rel = mem;
       mem = mem->next;
@@ -177,7 +257,7 @@ void free_tree(TREE_ROOT *root)
       free_pool_memory(root->cached_path);
       root->cached_path = NULL;
    }
-   Dmsg3(100, "Total size=%u blocks=%u freed_blocks=%u\n", root->total_size, root->blocks, freed_blocks);
+   Dmsg3(100, "Total size=%llu blocks=%u freed_blocks=%u\n", root->total_size, root->blocks, freed_blocks);
    free(root);
    garbage_collect_memory();
    return;
@@ -189,13 +269,88 @@ void free_tree(TREE_ROOT *root)
 void tree_add_delta_part(TREE_ROOT *root, TREE_NODE *node,
                          JobId_t JobId, int32_t FileIndex)
 {
+   DELTA_ENTRY *entry;
    struct delta_list *elt = (struct delta_list *)
                             tree_alloc(root, sizeof(struct delta_list));
 
-   elt->next = node->delta_list;
+   if (node->has_delta) {
+      entry = (DELTA_ENTRY *)root->delta_parts.lookup((uint64_t)(intptr_t)node);
+   } else {
+      entry = (DELTA_ENTRY *)root->delta_parts.hash_malloc(sizeof(DELTA_ENTRY));
+      entry->key = (uint64_t)(intptr_t)node;
+      entry->delta_list = NULL;
+      root->delta_parts.insert(entry->key, entry);
+      node->has_delta = true;
+   }
+
+   elt->next = entry->delta_list;
    elt->JobId = JobId;
    elt->FileIndex = FileIndex;
-   node->delta_list = elt;
+   entry->delta_list = elt;
+}
+
+/*
+ * Return the Delta parts of this node, the last added first.
+ */
+struct delta_list *tree_node_delta_list(TREE_ROOT *root, TREE_NODE *node)
+{
+   DELTA_ENTRY *entry;
+
+   if (!node->has_delta) {
+      return NULL;
+   }
+
+   entry = (DELTA_ENTRY *)root->delta_parts.lookup((uint64_t)(intptr_t)node);
+   return entry ? entry->delta_list : NULL;
+}
+
+/*
+ * Set the NDMP file history of this node. Only nodes that have
+ * any get an entry in the side table.
+ */
+void tree_set_file_history(TREE_ROOT *root, TREE_NODE *node,
+                           uint64_t fhinfo, uint64_t fhnode)
+{
+   FH_ENTRY *entry;
+
+   if (node->has_fhinfo) {
+      entry = (FH_ENTRY *)root->file_history.lookup((uint64_t)(intptr_t)node);
+   } else {
+      if (fhinfo == 0 && fhnode == 0) {
+         return;
+      }
+      entry = (FH_ENTRY *)root->file_history.hash_malloc(sizeof(FH_ENTRY));
+      entry->key = (uint64_t)(intptr_t)node;
+      root->file_history.insert(entry->key, entry);
+      node->has_fhinfo = true;
+   }
+
+   entry->fhinfo = fhinfo;
+   entry->fhnode = fhnode;
+}
+
+uint64_t tree_node_fhinfo(TREE_ROOT *root, TREE_NODE *node)
+{
+   FH_ENTRY *entry;
+
+   if (!node->has_fhinfo) {
+      return 0;
+   }
+
+   entry = (FH_ENTRY *)root->file_history.lookup((uint64_t)(intptr_t)node);
+   return entry ? entry->fhinfo : 0;
+}
+
+uint64_t tree_node_fhnode(TREE_ROOT *root, TREE_NODE *node)
+{
+   FH_ENTRY *entry;
+
+   if (!node->has_fhinfo) {
+      return 0;
+   }
+
+   entry = (FH_ENTRY *)root->file_history.lookup((uint64_t)(intptr_t)node);
+   return entry ? entry->fhnode : 0;
 }
 
 /*
@@ -310,18 +465,201 @@ TREE_NODE *make_tree_path(char *path, TREE_ROOT *root)
    return node;
 }
 
-static int node_compare(void *item1, void *item2)
+static inline int name_compare(const char *name1, const char *name2)
 {
-   TREE_NODE *tn1 = (TREE_NODE *)item1;
-   TREE_NODE *tn2 = (TREE_NODE *)item2;
-
-   if (tn1->fname[0] > tn2->fname[0]) {
+   if (name1[0] > name2[0]) {
       return 1;
-   } else if (tn1->fname[0] < tn2->fname[0]) {
+   } else if (name1[0] < name2[0]) {
       return -1;
    }
 
-   return strcmp(tn1->fname, tn2->fname);
+   return strcmp(name1, name2);
+}
+
+static int node_compare(const void *item1, const void *item2)
+{
+   TREE_NODE *tn1 = *(TREE_NODE **)item1;
+   TREE_NODE *tn2 = *(TREE_NODE **)item2;
+
+   return name_compare(tn1->fname, tn2->fname);
+}
+
+static inline uint64_t name_hash(const char *name)
+{
+   uint64_t hash = 14695981039346656037ULL;
+
+   while (*name) {
+      hash ^= (uint8_t)*name++;
+      hash *= 1099511628211ULL;
+   }
+
+   return hash;
+}
+
+/*
+ * Names are shared, so a node is identified by the addresses
+ * of its parent and its name.
+ */
+static inline uint32_t node_slot(TREE_ROOT *root, TREE_NODE *parent, const char *name)
+{
+   uint64_t hash;
+
+   hash = ((uint64_t)(intptr_t)parent * 0x9E3779B97F4A7C15ULL) ^
+          ((uint64_t)(intptr_t)name * 0xC2B2AE3D27D4EB4FULL);
+   hash ^= hash >> 32;
+
+   return (uint32_t)hash & (root->node_table_size - 1);
+}
+
+static void add_to_name_table(TREE_ROOT *root, char *name)
+{
+   uint32_t i;
+
+   i = (uint32_t)name_hash(name) & (root->name_table_size - 1);
+   while (root->name_table[i]) {
+      if (root->name_table[i] == name) {
+         return;
+      }
+      i = (i + 1) & (root->name_table_size - 1);
+   }
+   root->name_table[i] = name;
+   root->nr_names++;
+}
+
+static void add_to_node_table(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t i;
+
+   i = node_slot(root, node->parent, node->fname);
+   while (root->node_table[i]) {
+      i = (i + 1) & (root->node_table_size - 1);
+   }
+   root->node_table[i] = node;
+}
+
+static void grow_name_table(TREE_ROOT *root)
+{
+   uint32_t old_size = root->name_table_size;
+   char **old_table = root->name_table;
+
+   root->name_table_size = old_size * 2;
+   root->name_table = (char **)malloc(root->name_table_size * sizeof(char *));
+   memset(root->name_table, 0, root->name_table_size * sizeof(char *));
+   root->nr_names = 0;
+   for (uint32_t i = 0; i < old_size; i++) {
+      if (old_table[i]) {
+         add_to_name_table(root, old_table[i]);
+      }
+   }
+   free(old_table);
+}
+
+static void grow_node_table(TREE_ROOT *root)
+{
+   uint32_t old_size = root->node_table_size;
+   TREE_NODE **old_table = root->node_table;
+
+   root->node_table_size = old_size * 2;
+   root->node_table = (TREE_NODE **)malloc(root->node_table_size * sizeof(TREE_NODE *));
+   memset(root->node_table, 0, root->node_table_size * sizeof(TREE_NODE *));
+   for (uint32_t i = 0; i < old_size; i++) {
+      if (old_table[i]) {
+         add_to_node_table(root, old_table[i]);
+      }
+   }
+   free(old_table);
+}
+
+/*
+ * Recreate the lookup tables released by tree_build_children().
+ */
+static void rebuild_lookup_tables(TREE_ROOT *root)
+{
+   TREE_NODE *node;
+
+   root->node_table_size = MIN_TABLE_SIZE;
+   while (root->node_table_size < root->nr_nodes + (root->nr_nodes >> 1)) {
+      root->node_table_size <<= 1;
+   }
+   root->node_table = (TREE_NODE **)malloc(root->node_table_size * sizeof(TREE_NODE *));
+   memset(root->node_table, 0, root->node_table_size * sizeof(TREE_NODE *));
+   root->name_table_size = MIN_TABLE_SIZE;
+   root->name_table = (char **)malloc(root->name_table_size * sizeof(char *));
+   memset(root->name_table, 0, root->name_table_size * sizeof(char *));
+   root->nr_names = 0;
+
+   for (node = root->first; node; node = node->next) {
+      if (node->removed) {
+         continue;
+      }
+      if (root->nr_names >= (root->name_table_size >> 1)) {
+         grow_name_table(root);
+      }
+      add_to_name_table(root, node->fname);
+      add_to_node_table(root, node);
+   }
+}
+
+static void remove_from_node_table(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t i, j, k;
+   uint32_t mask = root->node_table_size - 1;
+
+   i = node_slot(root, node->parent, node->fname);
+   while (root->node_table[i] != node) {
+      if (!root->node_table[i]) {
+         return;
+      }
+      i = (i + 1) & mask;
+   }
+
+   /*
+    * Move up entries that would no longer be found behind the hole.
+    */
+   root->node_table[i] = NULL;
+   j = i;
+   while (1) {
+      j = (j + 1) & mask;
+      if (!root->node_table[j]) {
+         break;
+      }
+      k = node_slot(root, root->node_table[j]->parent, root->node_table[j]->fname);
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+         root->node_table[i] = root->node_table[j];
+         root->node_table[j] = NULL;
+         i = j;
+      }
+   }
+}
+
+/*
+ * Return the shared copy of a file name, adding it if it is new.
+ */
+static char *intern_name(TREE_ROOT *root, const char *fname)
+{
+   uint32_t i;
+   int len;
+   char *name;
+
+   if (root->nr_names >= (root->name_table_size >> 1)) {
+      grow_name_table(root);
+   }
+
+   i = (uint32_t)name_hash(fname) & (root->name_table_size - 1);
+   while ((name = root->name_table[i]) != NULL) {
+      if (bstrcmp(name, fname)) {
+         return name;
+      }
+      i = (i + 1) & (root->name_table_size - 1);
+   }
+
+   len = strlen(fname);
+   name = tree_alloc(root, len + 1);
+   memcpy(name, fname, len + 1);
+   root->name_table[i] = name;
+   root->nr_names++;
+
+   return name;
 }
 
 /*
@@ -330,25 +668,38 @@ static int node_compare(void *item1, void *item2)
 static TREE_NODE *search_and_insert_tree_node(char *fname, int type,
                                               TREE_ROOT *root, TREE_NODE *parent)
 {
-   TREE_NODE *node, *found_node;
+   uint32_t i;
+   char *name;
+   TREE_NODE *node;
 
-   node = new_tree_node(root);
-   node->fname = fname;
-   found_node = (TREE_NODE *)parent->child.insert(node, node_compare);
-   if (found_node != node) {          /* already in list */
-      free_tree_node(root);           /* free node allocated above */
-      found_node->inserted = false;
-      return found_node;
+   if (!root->node_table) {
+      rebuild_lookup_tables(root);
+   }
+
+   name = intern_name(root, fname);
+   i = node_slot(root, parent, name);
+   while ((node = root->node_table[i]) != NULL) {
+      if (node->parent == parent && node->fname == name) {
+         node->inserted = false;      /* already in tree */
+         return node;
+      }
+      i = (i + 1) & (root->node_table_size - 1);
    }
 
    /*
-    * It was not found, but is now inserted
+    * It was not found, so insert it
     */
-   node->fname_len = strlen(fname);
-   node->fname = tree_alloc(root, node->fname_len + 1);
-   strcpy(node->fname, fname);
+   node = new_tree_node(root);
+   node->fname = name;
    node->parent = parent;
    node->type = type;
+   root->node_table[i] = node;
+   parent->nr_children++;
+   root->nr_nodes++;
+   root->children_valid = false;
+   if (root->nr_nodes + (root->nr_nodes >> 1) > root->node_table_size) {
+      grow_node_table(root);
+   }
 
    /*
     * Maintain a linear chain of nodes
@@ -365,6 +716,104 @@ static TREE_NODE *search_and_insert_tree_node(char *fname, int type,
    return node;
 }
 
+/*
+ * Put the children of all nodes sorted by name into the children array
+ * and release the lookup tables. This is done implicitly by the first
+ * walk of the children, but can be called when the tree is complete to
+ * release the memory of the lookup tables early.
+ */
+void tree_build_children(TREE_ROOT *root)
+{
+   uint32_t index;
+   TREE_NODE *node;
+
+   if (root->children) {
+      free(root->children);
+   }
+   root->children = (TREE_NODE **)malloc(MAX(root->nr_nodes, 1) * sizeof(TREE_NODE *));
+
+   /*
+    * Assign the ranges, then fill them using child_index as cursor.
+    */
+   root->child_index = 0;
+   index = root->nr_children;
+   for (node = root->first; node; node = node->next) {
+      if (!node->removed) {
+         node->child_index = index;
+         index += node->nr_children;
+      }
+   }
+   ASSERT(index == root->nr_nodes);
+
+   for (node = root->first; node; node = node->next) {
+      if (!node->removed) {
+         root->children[node->parent->child_index++] = node;
+      }
+   }
+
+   root->child_index -= root->nr_children;
+   if (root->nr_children > 1) {
+      qsort(root->children, root->nr_children, sizeof(TREE_NODE *), node_compare);
+   }
+   for (node = root->first; node; node = node->next) {
+      if (!node->removed) {
+         node->child_index -= node->nr_children;
+         if (node->nr_children > 1) {
+            qsort(root->children + node->child_index, node->nr_children,
+                  sizeof(TREE_NODE *), node_compare);
+         }
+      }
+   }
+   root->children_valid = true;
+
+   if (root->node_table) {
+      free(root->node_table);
+      root->node_table = NULL;
+      root->node_table_size = 0;
+   }
+   if (root->name_table) {
+      free(root->name_table);
+      root->name_table = NULL;
+      root->name_table_size = 0;
+      root->nr_names = 0;
+   }
+}
+
+/*
+ * Return the sorted children of a node, see foreach_child().
+ */
+TREE_NODE **tree_children(TREE_NODE *node)
+{
+   TREE_NODE *top;
+   TREE_ROOT *root;
+
+   for (top = node; top->parent; top = top->parent) ;
+   root = (TREE_ROOT *)top;
+
+   if (!root->children_valid) {
+      tree_build_children(root);
+   }
+
+   return root->children + node->child_index;
+}
+
+/*
+ * Return the number of bytes allocated for the tree.
+ */
+uint64_t tree_memory_usage(TREE_ROOT *root)
+{
+   uint64_t size;
+
+   size = sizeof(TREE_ROOT) + root->total_size;
+   size += root->node_table_size * sizeof(TREE_NODE *);
+   size += root->name_table_size * sizeof(char *);
+   if (root->children) {
+      size += MAX(root->nr_nodes, 1) * sizeof(TREE_NODE *);
+   }
+
+   return size;
+}
+
 static void tree_getpath_item(TREE_NODE *node, POOLMEM *&path)
 {
    if (!node) {
@@ -447,6 +896,42 @@ TREE_NODE *tree_cwd(char *path, TREE_ROOT *root, TREE_NODE *node)
    return tree_relcwd(path, root, node);
 }
 
+/*
+ * Find the child with the first len characters of path as name.
+ */
+static TREE_NODE *find_child(TREE_NODE *node, char *path, int len)
+{
+   int result;
+   char save_char;
+   uint32_t low, high, middle;
+   TREE_NODE **children, *found = NULL;
+
+   if (!tree_node_has_child(node)) {
+      return NULL;
+   }
+
+   children = tree_children(node);
+   save_char = path[len];
+   path[len] = 0;
+   low = 0;
+   high = node->nr_children;
+   while (low < high) {
+      middle = low + (high - low) / 2;
+      result = name_compare(path, children[middle]->fname);
+      if (result == 0) {
+         found = children[middle];
+         break;
+      } else if (result < 0) {
+         high = middle;
+      } else {
+         low = middle + 1;
+      }
+   }
+   path[len] = save_char;
+
+   return found;
+}
+
 /*
  * Do a relative cwd -- i.e. relative to current node rather than root node
  */
@@ -473,6 +958,15 @@ TREE_NODE *tree_relcwd(char *path, TREE_ROOT *root, TREE_NODE *node)
 
    Dmsg2(100, "tree_relcwd: len=%d path=%s\n", len, path);
 
+   /*
+    * Without wildcards only an exact match is possible,
+    * which can be searched for in the sorted children.
+    */
+   if (strcspn(path, "*?[\\") >= (size_t)len) {
+      cd = find_child(node, path, len);
+      goto found;
+   }
+
    foreach_child(cd, node) {
       Dmsg1(100, "tree_relcwd: test cd=%s\n", cd->fname);
       if (cd->fname[0] == path[0] && len == (int)strlen(cd->fname)
@@ -493,6 +987,7 @@ TREE_NODE *tree_relcwd(char *path, TREE_ROOT *root, TREE_NODE *node)
       }
    }
 
+found:
    if (!cd || (cd->type == TN_FILE && !tree_node_has_child(cd))) {
       return NULL;
    }
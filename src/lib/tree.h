@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2002-2009 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -36,16 +36,20 @@ struct s_mem {
    char first[1];                     /* first byte */
 };
 
-#define USE_DLIST
-
+/**
+ * The children of a node are a range of the sorted children array
+ *   of the tree, see tree_children(). The loop variable is NULL
+ *   when the loop ends without a break.
+ */
 #define foreach_child(var, list) \
-    for((var)=NULL; (*((TREE_NODE **)&(var))=(TREE_NODE*)(list->child.next(var))); )
+    for (TREE_NODE **_child = tree_children(list), **_last_child = _child + (list)->nr_children; \
+         ((var) = (_child < _last_child) ? *_child : NULL) != NULL; _child++)
 
 #define tree_node_has_child(node) \
-        ((node)->child.size() > 0)
+        ((node)->nr_children > 0)
 
 #define first_child(node) \
-        ((TREE_NODE *)(node->child.first())
+        ((node)->nr_children > 0 ? *tree_children(node) : NULL)
 
 struct delta_list {
    struct delta_list *next;
@@ -56,17 +60,19 @@ struct delta_list {
 /**
  * Keep this node as small as possible because
  *   there is one for each file.
+ *
+ * Fields only a few nodes use, like the delta parts or the NDMP
+ *   file history, are kept in side tables of the root.
  */
 struct s_tree_node {
-   /* KEEP sibling as the first member to avoid having to
-    *  do initialization of child */
-   rblink sibling;
-   rblist child;
-   char *fname;                       /* file name */
+   char *fname;                       /* file name, shared between nodes with the same name */
+   struct s_tree_node *parent;
+   struct s_tree_node *next;          /* next node in insertion order */
+   uint32_t child_index;              /* first child in the children array of the root */
+   uint32_t nr_children;              /* number of children */
    int32_t FileIndex;                 /* file index */
    uint32_t JobId;                    /* JobId */
    int32_t delta_seq;                 /* current delta sequence */
-   uint16_t fname_len;                /* filename length */
    unsigned int type:8;               /* node type */
    unsigned int extract:1;            /* extract item */
    unsigned int extract_dir:1;        /* extract dir entry only */
@@ -74,44 +80,58 @@ struct s_tree_node {
    unsigned int soft_link:1;          /* set if is soft link */
    unsigned int inserted:1;           /* set when node newly inserted */
    unsigned int loaded:1;             /* set when the dir is in the tree */
-   struct s_tree_node *parent;
-   struct s_tree_node *next;          /* next hash of FileIndex */
-   struct delta_list *delta_list;     /* delta parts for this node */
-   uint64_t fhinfo;                   /* NDMP Fh_info */
-   uint64_t fhnode;                   /* NDMP Fh_node */
+   unsigned int removed:1;            /* set when removed from its parent */
+   unsigned int has_delta:1;          /* set if node has delta parts */
+   unsigned int has_fhinfo:1;         /* set if node has NDMP file history */
 };
 typedef struct s_tree_node TREE_NODE;
 
 struct s_tree_root {
-   /* KEEP sibling as the first member to avoid having to
-    *  do initialization of child */
-   rblink sibling;
-   rblist child;
-   const char *fname;                 /* file name */
+   char *fname;                       /* file name */
+   struct s_tree_node *parent;
+   struct s_tree_node *next;          /* next node in insertion order */
+   uint32_t child_index;              /* first child in the children array */
+   uint32_t nr_children;              /* number of children */
    int32_t FileIndex;                 /* file index */
    uint32_t JobId;                    /* JobId */
    int32_t delta_seq;                 /* current delta sequence */
-   uint16_t fname_len;                /* filename length */
    unsigned int type:8;               /* node type */
    unsigned int extract:1;            /* extract item */
    unsigned int extract_dir:1;        /* extract dir entry only */
-   unsigned int have_link:1;          /* set if have hard link */
+   unsigned int hard_link:1;          /* set if have hard link */
+   unsigned int soft_link:1;          /* set if is soft link */
    unsigned int inserted:1;           /* set when newly inserted */
    unsigned int loaded:1;             /* set when the dir is in the tree */
-   struct s_tree_node *parent;
-   struct s_tree_node *next;          /* next hash of FileIndex */
-   struct delta_list *delta_list;     /* delta parts for this node */
+   unsigned int removed:1;            /* not used */
+   unsigned int has_delta:1;          /* not used */
+   unsigned int has_fhinfo:1;         /* not used */
 
    /* The above ^^^ must be identical to a TREE_NODE structure */
    struct s_tree_node *first;         /* first entry in the tree */
    struct s_tree_node *last;          /* last entry in tree */
    struct s_mem *mem;                 /* tree memory */
-   uint32_t total_size;               /* total bytes allocated */
+   uint64_t total_size;               /* total bytes allocated */
    uint32_t blocks;                   /* total mallocs */
+   uint32_t nr_nodes;                 /* number of nodes in the tree */
    int cached_path_len;               /* length of cached path */
    char *cached_path;                 /* cached current path */
    TREE_NODE *cached_parent;          /* cached parent for above path */
    htable hardlinks;                  /* references to first occurence of hardlinks */
+
+   /* Lookup tables, only used while inserting */
+   TREE_NODE **node_table;            /* nodes hashed by parent and name */
+   uint32_t node_table_size;
+   char **name_table;                 /* unique file names */
+   uint32_t name_table_size;
+   uint32_t nr_names;
+
+   /* Sorted children of all nodes */
+   TREE_NODE **children;
+   bool children_valid;               /* children array matches the tree */
+
+   /* Side tables for rare fields */
+   htable delta_parts;                /* delta parts of a node */
+   htable file_history;               /* NDMP file history of a node */
 };
 typedef struct s_tree_root TREE_ROOT;
 
@@ -139,6 +159,14 @@ TREE_NODE *tree_cwd(char *path, TREE_ROOT *root, TREE_NODE *node);
 TREE_NODE *tree_relcwd(char *path, TREE_ROOT *root, TREE_NODE *node);
 void tree_add_delta_part(TREE_ROOT *root, TREE_NODE *node,
                          JobId_t JobId, int32_t FileIndex);
+struct delta_list *tree_node_delta_list(TREE_ROOT *root, TREE_NODE *node);
+void tree_set_file_history(TREE_ROOT *root, TREE_NODE *node,
+                           uint64_t fhinfo, uint64_t fhnode);
+uint64_t tree_node_fhinfo(TREE_ROOT *root, TREE_NODE *node);
+uint64_t tree_node_fhnode(TREE_ROOT *root, TREE_NODE *node);
+void tree_build_children(TREE_ROOT *root);
+TREE_NODE **tree_children(TREE_NODE *node);
+uint64_t tree_memory_usage(TREE_ROOT *root);
 void free_tree(TREE_ROOT *root);
 POOLMEM *tree_getpath(TREE_NODE *node);
 void tree_remove_node(TREE_ROOT *root, TREE_NODE *node);
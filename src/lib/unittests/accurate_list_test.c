@@ -0,0 +1,138 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test the binary accurate file list encoding.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+
+#define NR_FILES 10000
+
+static void check_frame(ACCURATE_LIST_DECODER *decoder, int *nr)
+{
+   int status;
+   int fname_length, lstat_length, chksum_length;
+   char *fname, *lstat, *chksum;
+   int32_t delta_seq;
+   char expected[100];
+
+   while ((status = decoder->next(&fname, &fname_length, &lstat, &lstat_length,
+                                  &chksum, &chksum_length, &delta_seq)) > 0) {
+      bsnprintf(expected, sizeof(expected), "/data/dir%03d/file%05d", *nr / 100, *nr);
+      assert_string_equal(fname, expected);
+      assert_int_equal(fname_length, strlen(expected));
+      bsnprintf(expected, sizeof(expected), "P0C BAAA Iw B A A A %d", *nr);
+      assert_string_equal(lstat, expected);
+      assert_int_equal(lstat_length, strlen(expected));
+      if (*nr % 2) {
+         assert_string_equal(chksum, "tKm6L2QcBD+xV0RBVf1dPg");
+         assert_int_equal(chksum_length, 22);
+      } else {
+         assert_null(chksum);
+      }
+      assert_int_equal(delta_seq, *nr % 3);
+      (*nr)++;
+   }
+   assert_int_equal(status, 0);
+}
+
+static void roundtrip(bool compress)
+{
+   ACCURATE_LIST_ENCODER encoder(compress);
+   ACCURATE_LIST_DECODER decoder;
+   char path[100], fname[100], lstat[100];
+   uint32_t length;
+   int nr_decoded = 0;
+
+   for (int i = 0; i < NR_FILES; i++) {
+      bsnprintf(path, sizeof(path), "/data/dir%03d/", i / 100);
+      bsnprintf(fname, sizeof(fname), "file%05d", i);
+      bsnprintf(lstat, sizeof(lstat), "P0C BAAA Iw B A A A %d", i);
+      assert_true(encoder.add(path, fname, lstat, (i % 2) ? "tKm6L2QcBD+xV0RBVf1dPg" : NULL, i % 3));
+
+      if (encoder.is_full() || i == NR_FILES - 1) {
+         length = encoder.encode_frame();
+         assert_true(decoder.set_frame(encoder.get_frame(), length));
+         check_frame(&decoder, &nr_decoded);
+      }
+   }
+
+   assert_int_equal(nr_decoded, NR_FILES);
+   assert_int_equal(encoder.nr_records(), NR_FILES);
+   if (compress) {
+      assert_true(encoder.bytes_out() < encoder.bytes_in());
+   }
+}
+
+void test_accurate_list(void **state)
+{
+   (void) state; /* unused */
+   ACCURATE_LIST_ENCODER encoder(true);
+   ACCURATE_LIST_DECODER decoder;
+   int fname_length, lstat_length, chksum_length;
+   char *fname, *lstat, *chksum;
+   int32_t delta_seq;
+   uint32_t length;
+   char *frame;
+
+   roundtrip(false);
+   roundtrip(true);
+
+   /*
+    * Records within a frame are sent sorted on filename.
+    */
+   encoder.add("/b/", "2", "A", NULL, 0);
+   encoder.add("/a/", "1", "B", NULL, 0);
+   encoder.add("/b/", "1", "C", NULL, 0);
+   length = encoder.encode_frame();
+   assert_true(decoder.set_frame(encoder.get_frame(), length));
+   assert_int_equal(decoder.next(&fname, &fname_length, &lstat, &lstat_length, &chksum, &chksum_length, &delta_seq), 1);
+   assert_string_equal(fname, "/a/1");
+   assert_string_equal(lstat, "B");
+   assert_int_equal(decoder.next(&fname, &fname_length, &lstat, &lstat_length, &chksum, &chksum_length, &delta_seq), 1);
+   assert_string_equal(fname, "/b/1");
+   assert_string_equal(lstat, "C");
+   assert_int_equal(decoder.next(&fname, &fname_length, &lstat, &lstat_length, &chksum, &chksum_length, &delta_seq), 1);
+   assert_string_equal(fname, "/b/2");
+   assert_string_equal(lstat, "A");
+   assert_int_equal(decoder.next(&fname, &fname_length, &lstat, &lstat_length, &chksum, &chksum_length, &delta_seq), 0);
+
+   /*
+    * Truncated and corrupted frames are rejected.
+    */
+   encoder.add("/a/", "1", "B", NULL, 0);
+   length = encoder.encode_frame();
+   assert_false(decoder.set_frame(encoder.get_frame(), ACCURATE_LIST_FRAME_HEADER_SIZE - 1));
+   assert_false(decoder.set_frame(encoder.get_frame(), length - 1));
+
+   frame = (char *)malloc(length);
+   memcpy(frame, encoder.get_frame(), length);
+   frame[3] = 'X';
+   assert_false(decoder.set_frame(frame, length));
+   free(frame);
+}
@@ -0,0 +1,176 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test the streaming json mode of the output formatter.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+
+#if HAVE_JANSSON
+struct collected_output {
+   POOL_MEM *output;
+   int nr_sends;
+};
+
+static bool collect(void *ctx, const char *msg)
+{
+   collected_output *collected = (collected_output *)ctx;
+
+   collected->output->strcat(msg);
+   collected->nr_sends++;
+
+   return true;
+}
+
+/*
+ * Build a result with a big array of rows and a big array nested in an object.
+ * Returns the number of sends done before the result was finalized.
+ */
+static int build_result(OUTPUT_FORMATTER *send, collected_output *collected,
+                        int nr_rows, bool result)
+{
+   char name[100];
+   int nr_sends;
+
+   send->object_key_value("api", 2);
+   send->array_start("files");
+   for (int i = 0; i < nr_rows; i++) {
+      bsnprintf(name, sizeof(name), "/data/dir%03d/\"file\"%05d", i / 100, i);
+      send->object_start();
+      send->object_key_value("FileId", i);
+      send->object_key_value("Name", name);
+      send->object_key_value_bool("Enabled", i % 2);
+      send->object_end();
+   }
+   send->array_end("files");
+
+   send->object_start("volumes");
+   send->array_start("Default");
+   for (int i = 0; i < nr_rows; i++) {
+      bsnprintf(name, sizeof(name), "Vol-%05d", i);
+      send->object_start();
+      send->object_key_value("VolumeName", name);
+      send->object_end();
+   }
+   send->array_end("Default");
+   send->array_start("Empty");
+   send->array_end("Empty");
+   send->object_end("volumes");
+   send->object_key_value("count", nr_rows);
+
+   if (!result) {
+      POOL_MEM msg("something went wrong\n");
+      send->message(MSG_TYPE_ERROR, msg);
+   }
+
+   nr_sends = collected->nr_sends;
+   send->finalize_result(result);
+
+   return nr_sends;
+}
+
+static void compare(int nr_rows, bool compact, bool result)
+{
+   POOL_MEM streamed_output(PM_MESSAGE), buffered_output(PM_MESSAGE);
+   collected_output streamed = { &streamed_output, 0 };
+   collected_output buffered = { &buffered_output, 0 };
+   const char *error_response;
+   OUTPUT_FORMATTER streaming_send(collect, &streamed, NULL, NULL, API_MODE_JSON);
+   OUTPUT_FORMATTER buffering_send(collect, &buffered, NULL, NULL, API_MODE_JSON);
+
+   streaming_send.set_compact(compact);
+   buffering_send.set_compact(compact);
+   streaming_send.set_stream_threshold(OF_JSON_STREAM_THRESHOLD);
+
+   build_result(&streaming_send, &streamed, nr_rows, result);
+   assert_int_equal(build_result(&buffering_send, &buffered, nr_rows, result), 0);
+
+   if (result) {
+      assert_string_equal(streamed_output.c_str(), buffered_output.c_str());
+   } else if (nr_rows < OF_JSON_STREAM_THRESHOLD) {
+      assert_string_equal(streamed_output.c_str(), buffered_output.c_str());
+   } else {
+      /*
+       * A failed streamed result is followed by a separate error response.
+       */
+      error_response = strstr(streamed_output.c_str(), "}\n}{");
+      assert_non_null(error_response);
+      assert_null(strstr(error_response, "\"result\""));
+      assert_non_null(strstr(error_response, "\"error\""));
+      assert_non_null(strstr(error_response, "something went wrong"));
+      assert_true(strstr(streamed_output.c_str(), "\"error\"") > error_response);
+   }
+
+   /*
+    * The formatter must be reusable for the next command.
+    */
+   streamed_output.strcpy("");
+   buffered_output.strcpy("");
+   streaming_send.object_key_value("api", 2);
+   streaming_send.finalize_result(true);
+   buffering_send.object_key_value("api", 2);
+   buffering_send.finalize_result(true);
+   assert_string_equal(streamed_output.c_str(), buffered_output.c_str());
+}
+
+void test_output_formatter(void **state)
+{
+   POOL_MEM output(PM_MESSAGE);
+   collected_output collected = { &output, 0 };
+   OUTPUT_FORMATTER send(collect, &collected, NULL, NULL, API_MODE_JSON);
+
+   (void)state;
+
+   /*
+    * Streaming has to be enabled.
+    */
+   assert_int_equal(send.get_stream_threshold(), 0);
+   send.set_stream_threshold(OF_JSON_STREAM_THRESHOLD);
+
+   /*
+    * Streamed and buffered results are identical.
+    */
+   compare(10, true, true);
+   compare(10, false, true);
+   compare(5000, true, true);
+   compare(5000, false, true);
+   compare(10, false, false);
+   compare(5000, false, false);
+
+   /*
+    * A big result is sent in chunks while it is built.
+    */
+   assert_true(build_result(&send, &collected, 20000, true) > 1);
+   assert_true(collected.nr_sends > 2);
+}
+#else
+void test_output_formatter(void **state)
+{
+   (void)state;
+}
+#endif
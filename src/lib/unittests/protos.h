@@ -31,6 +31,9 @@ void test_scan(void **state);
 void test_base64(void **state);
 void test_rwlock(void **state);
 void test_devlock(void **state);
+void test_accurate_list(void **state);
+void test_output_formatter(void **state);
+void test_tree(void **state);
 #ifdef HAVE_WIN32
 void test_junction(void **state);
 #endif
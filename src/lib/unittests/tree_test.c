@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2002-2012 Free Software Foundation Europe e.V.
-   Copyright (C) 2015      Bareos GmbH & Co. KG
+   Copyright (C) 2015-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -19,171 +19,170 @@
    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
    02110-1301, USA.
 */
-/* originally was Kern Sibbald, June MMII */
 /*
- * extracted the TEST_PROGRAM functionality from the files in ..
- * and adapted for unittest framework cmocka
- *
- * Philipp Storz, April 2015
+ * Test the restore tree.
  */
-#include "bareos.h"
-
-#define B_PAGE_SIZE 4096
-#define MAX_PAGES 2400
-void FillDirectoryTree(char *path, TREE_ROOT *root, TREE_NODE *parent);
-static uint32_t FileIndex = 0;
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
 
-/*
- * Simple test program for tree routines
- */
-int main(int argc, char *argv[])
-{
-    TREE_ROOT *root;
-    TREE_NODE *node;
-    char buf[MAXPATHLEN];
-
-    root = new_tree();
-    root->fname = tree_alloc(root, 1);
-    *root->fname = 0;
-    root->fname_len = 0;
-
-    FillDirectoryTree("/home/user/bareos", root, NULL);
-
-    for (node = first_tree_node(root); node; node=next_tree_node(node)) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "%d: %s\n", node->FileIndex, buf);
-    }
-
-    node = (TREE_NODE *)root;
-    Pmsg0(000, "doing cd /home/user/bareos/techlogs\n");
-    node = tree_cwd("/home/user/bareos/techlogs", root, node);
-    if (node) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "findex=%d: cwd=%s\n", node->FileIndex, buf);
-    }
-
-    Pmsg0(000, "doing cd /home/user/bareos/src/testprogs\n");
-    node = tree_cwd("/home/user/bareos/src/testprogs", root, node);
-    if (node) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "findex=%d: cwd=%s\n", node->FileIndex, buf);
-    } else {
-       Dmsg0(100, "testprogs not found.\n");
-    }
-
-    free_tree((TREE_NODE *)root);
-
-    return 0;
+extern "C" {
+#include <cmocka.h>
 }
 
-void FillDirectoryTree(char *path, TREE_ROOT *root, TREE_NODE *parent)
+#include "bareos.h"
+
+static TREE_NODE *insert(TREE_ROOT *root, const char *path, const char *fname, int type)
 {
-   TREE_NODE *newparent = NULL;
+   char pathbuf[256], fnamebuf[256];
    TREE_NODE *node;
-   struct stat statbuf;
-   DIR *dp;
-   struct dirent *dir;
-   char pathbuf[MAXPATHLEN];
-   char file[MAXPATHLEN];
-   int type;
-   int i;
-
-   Dmsg1(100, "FillDirectoryTree: %s\n", path);
-
-   dp = opendir(path);
-   if (!dp) {
-      return;
-   }
-
-   while ((dir = readdir(dp))) {
-      if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
-         continue;
-      }
-      bstrncpy(file, dir->d_name, sizeof(file));
-      snprintf(pathbuf, MAXPATHLEN-1, "%s/%s", path, file);
-      if (lstat(pathbuf, &statbuf) < 0) {
-         berrno be;
-         printf("lstat() failed. ERR=%s\n", be.bstrerror(errno));
-         continue;
-      }
-//      printf("got file=%s, pathbuf=%s\n", file, pathbuf);
-      type = TN_FILE;
-      if (S_ISLNK(statbuf.st_mode))
-         type =  TN_FILE;  /* link */
-      else if (S_ISREG(statbuf.st_mode))
-         type = TN_FILE;
-      else if (S_ISDIR(statbuf.st_mode)) {
-         type = TN_DIR;
-      } else if (S_ISCHR(statbuf.st_mode))
-         type = TN_FILE; /* char dev */
-      else if (S_ISBLK(statbuf.st_mode))
-         type = TN_FILE; /* block dev */
-      else if (S_ISFIFO(statbuf.st_mode))
-         type = TN_FILE; /* fifo */
-      else if (S_ISSOCK(statbuf.st_mode))
-         type = TN_FILE; /* sock */
-      else {
-         type = TN_FILE;
-         printf("Unknown file type: 0x%x\n", statbuf.st_mode);
-      }
 
-      Dmsg2(100, "Doing: %d %s\n", type, pathbuf);
-      node = new_tree_node(root);
-      node->FileIndex = ++FileIndex;
-      parent = insert_tree_node(pathbuf, node, root, parent);
+   bstrncpy(pathbuf, path, sizeof(pathbuf));
+   bstrncpy(fnamebuf, fname, sizeof(fnamebuf));
+   node = insert_tree_node(pathbuf, fnamebuf, type, root, NULL);
+   node->type = type;
 
-      if (S_ISDIR(statbuf.st_mode) && !S_ISLNK(statbuf.st_mode)) {
-         Dmsg2(100, "calling fill. pathbuf=%s, file=%s\n", pathbuf, file);
-         FillDirectoryTree(pathbuf, root, node);
-      }
-   }
-   closedir(dp);
+   return node;
 }
 
-#ifndef MAXPATHLEN
-#define MAXPATHLEN 2000
-#endif
+static void assert_path(TREE_NODE *node, const char *expected)
+{
+   POOLMEM *path;
+
+   assert_non_null(node);
+   path = tree_getpath(node);
+   assert_string_equal(path, expected);
+   free_pool_memory(path);
+}
 
-void print_tree(char *path, TREE_NODE *tree)
+static TREE_NODE *cd(TREE_ROOT *root, TREE_NODE *node, const char *path)
 {
-   char buf[MAXPATHLEN];
-   char *termchr;
+   char pathbuf[256];
 
-   if (!tree) {
-      return;
-   }
+   bstrncpy(pathbuf, path, sizeof(pathbuf));
+   return tree_cwd(pathbuf, root, node);
+}
 
-   switch (tree->type) {
-   case TN_DIR_NLS:
-   case TN_DIR:
-   case TN_NEWDIR:
-      termchr = "/";
-      break;
-   case TN_ROOT:
-   case TN_FILE:
-   default:
-      termchr = "";
-      break;
+void test_tree(void **state)
+{
+   char name[100];
+   TREE_ROOT *root;
+   TREE_NODE *node, *dir, *child, *prev;
+   struct delta_list *delta;
+   int count;
+
+   root = new_tree(100);
+
+   /*
+    * Insert files of several directories out of order.
+    */
+   for (int i = 99; i >= 0; i--) {
+      bsnprintf(name, sizeof(name), "f%d.txt", i);
+      insert(root, "/home/user/b/", name, TN_FILE);
+      insert(root, "/home/user/a/", name, TN_FILE);
    }
-
-   Pmsg3(-1, "%s/%s%s\n", path, tree->fname, termchr);
-
-   switch (tree->type) {
-   case TN_FILE:
-   case TN_NEWDIR:
-   case TN_DIR:
-   case TN_DIR_NLS:
-      bsnprintf(buf, sizeof(buf), "%s/%s", path, tree->fname);
-      print_tree(buf, first_child(tree));
-      break;
-   case TN_ROOT:
-      print_tree(path, first_child(tree));
-      break;
-   default:
-      Pmsg1(000, "Unknown node type %d\n", tree->type);
+   insert(root, "/home/user/", "a", TN_DIR);
+   dir = insert(root, "/home/user/", "b", TN_DIR);
+   assert_false(dir->inserted);
+   node = insert(root, "/home/user/a/", "f5.txt", TN_FILE);
+   assert_false(node->inserted);
+   node = insert(root, "/home/user/a/", "f100.txt", TN_FILE);
+   assert_true(node->inserted);
+   assert_path(node, "/home/user/a/f100.txt");
+
+   /*
+    * Children are sorted by name and every node is found once.
+    */
+   dir = cd(root, (TREE_NODE *)root, "/home/user/a");
+   assert_path(dir, "/home/user/a/");
+   count = 0;
+   prev = NULL;
+   foreach_child(child, dir) {
+      if (prev) {
+         assert_true(strcmp(prev->fname, child->fname) < 0);
+      }
+      assert_ptr_equal(child->parent, dir);
+      prev = child;
+      count++;
    }
+   assert_int_equal(count, 101);
+   assert_string_equal(first_child(dir)->fname, "f0.txt");
 
-   print_tree(path, tree->sibling_);
-
-   return;
+   count = 0;
+   for (node = first_tree_node(root); node; node = next_tree_node(node)) {
+      count++;
+   }
+   assert_int_equal(count, 205);
+
+   /*
+    * Exact, relative and wildcard cd.
+    */
+   assert_path(cd(root, dir, "../b"), "/home/user/b/");
+   assert_path(cd(root, (TREE_NODE *)root, "/home/us*/b"), "/home/user/b/");
+   assert_null(cd(root, (TREE_NODE *)root, "/home/user/c"));
+   assert_null(cd(root, dir, "f1.txt"));
+   assert_null(cd(root, dir, "f1*"));
+
+   /*
+    * Inserting after the children were walked and removing nodes.
+    */
+   insert(root, "/home/user/a/", "e.txt", TN_FILE);
+   assert_string_equal(first_child(dir)->fname, "e.txt");
+   node = insert(root, "/home/user/", "c", TN_DIR);
+   assert_path(cd(root, (TREE_NODE *)root, "/home/user/c"), "/home/user/c/");
+   tree_remove_node(root, node);
+   assert_null(cd(root, (TREE_NODE *)root, "/home/user/c"));
+   node = insert(root, "/home/user/", "c", TN_DIR);
+   assert_true(node->inserted);
+   assert_path(cd(root, (TREE_NODE *)root, "/home/user/c"), "/home/user/c/");
+
+   /*
+    * Removing a directory removes everything below it.
+    */
+   insert(root, "/home/user/d/", "x.txt", TN_FILE);
+   insert(root, "/home/user/d/e/", "y.txt", TN_FILE);
+   node = cd(root, (TREE_NODE *)root, "/home/user/d");
+   assert_path(node, "/home/user/d/");
+   assert_int_equal(node->nr_children, 2);
+   count = root->nr_nodes;
+   tree_remove_node(root, node);
+   assert_int_equal(root->nr_nodes, count - 4);
+   tree_build_children(root);
+   assert_null(cd(root, (TREE_NODE *)root, "/home/user/d"));
+   assert_null(cd(root, (TREE_NODE *)root, "/home/user/d/e"));
+   dir = cd(root, (TREE_NODE *)root, "/home/user");
+   count = 0;
+   foreach_child(child, dir) {
+      assert_false(child->removed);
+      count++;
+   }
+   assert_int_equal(count, 3);
+   node = insert(root, "/home/user/d/e/", "y.txt", TN_FILE);
+   assert_true(node->inserted);
+   assert_path(node, "/home/user/d/e/y.txt");
+   assert_path(cd(root, (TREE_NODE *)root, "/home/user/d/e"), "/home/user/d/e/");
+
+   /*
+    * Delta parts and file history live in side tables.
+    */
+   node = insert(root, "/home/user/a/", "f7.txt", TN_FILE);
+   assert_null(tree_node_delta_list(root, node));
+   tree_add_delta_part(root, node, 1, 10);
+   tree_add_delta_part(root, node, 2, 20);
+   delta = tree_node_delta_list(root, node);
+   assert_non_null(delta);
+   assert_int_equal(delta->JobId, 2);
+   assert_int_equal(delta->FileIndex, 20);
+   assert_non_null(delta->next);
+   assert_int_equal(delta->next->JobId, 1);
+   assert_null(delta->next->next);
+
+   assert_int_equal(tree_node_fhinfo(root, node), 0);
+   tree_set_file_history(root, node, 1234, 5678);
+   assert_int_equal(tree_node_fhinfo(root, node), 1234);
+   assert_int_equal(tree_node_fhnode(root, node), 5678);
+
+   assert_true(tree_memory_usage(root) > 0);
+
+   free_tree(root);
 }
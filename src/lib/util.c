@@ -83,23 +83,24 @@ bool is_buf_zero(char *buf, int len)
 {
    uint64_t *ip;
    char *p;
-   int i, len64, done, rem;
+   int i, len512, done, rem;
 
-   if (buf[0] != 0) {
+   if (len > 0 && buf[0] != 0) {
       return false;
    }
    ip = (uint64_t *)buf;
 
    /*
-    * Optimize by checking uint64_t for zero
+    * Optimize by or-ing 8 uint64_t at a time, without a branch per word
+    * the compiler turns this into vector instructions.
     */
-   len64 = len / sizeof(uint64_t);
-   for (i=0; i < len64; i++) {
-      if (ip[i] != 0) {
+   len512 = len / (8 * sizeof(uint64_t));
+   for (i = 0; i < len512; i++, ip += 8) {
+      if ((ip[0] | ip[1] | ip[2] | ip[3] | ip[4] | ip[5] | ip[6] | ip[7]) != 0) {
          return false;
       }
    }
-   done = len64 * sizeof(uint64_t);  /* bytes already checked */
+   done = len512 * 8 * sizeof(uint64_t);  /* bytes already checked */
    p = buf + done;
    rem = len - done;
    for (i = 0; i < rem; i++) {
@@ -37,6 +37,10 @@
 #include <fastlzlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
 #define PLUGIN_LICENSE      "Bareos AGPLv3"
 #define PLUGIN_AUTHOR       "Marco van Wieringen"
 #define PLUGIN_DATE         "June 2013"
@@ -56,6 +60,7 @@
 #define COMPRESSOR_NAME_FZLZ (char *)"FASTLZ"
 #define COMPRESSOR_NAME_FZ4L (char *)"LZ4"
 #define COMPRESSOR_NAME_FZ4H (char *)"LZ4HC"
+#define COMPRESSOR_NAME_ZSTD (char *)"ZSTD"
 #define COMPRESSOR_NAME_UNSET (char *)"unknown"
 
 /**
@@ -570,6 +575,22 @@ static bool setup_auto_deflation(bpContext *ctx, DCR *dcr)
       }
       break;
    }
+#endif
+#if defined(HAVE_ZSTD)
+   case COMPRESS_ZSTD: {
+      compressorname = COMPRESSOR_NAME_ZSTD;
+      size_t zstat;
+      ZSTD_CCtx *pZstdCtx;
+
+      pZstdCtx = (ZSTD_CCtx *)jcr->compress.workset.pZSTD;
+      zstat = ZSTD_CCtx_setParameter(pZstdCtx, ZSTD_c_compressionLevel, dcr->device->autodeflate_level);
+      if (ZSTD_isError(zstat)) {
+         Jmsg(ctx, M_FATAL, _("autoxflate-sd: Compression ZSTD_CCtx_setParameter error: %s\n"), ZSTD_getErrorName(zstat));
+         jcr->setJobStatus(JS_ErrorTerminated);
+         goto bail_out;
+      }
+      break;
+   }
 #endif
    default:
       break;
@@ -499,6 +499,27 @@ bool release_device(DCR *dcr)
    update_job_statistics(jcr, now);
 
    dev->Lock();
+
+   /*
+    * Blocks still queued to the writer thread must be on the volume
+    * before the JobMedia record and the volume info are updated.
+    */
+   if (dev->writer && !wait_async_writes(dcr, true)) {
+      Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+            dev->print_name(), dev->bstrerror());
+      jcr->forceJobStatus(JS_FatalError);
+   }
+
+   /*
+    * Devices buffering the data written, e.g. in chunks uploaded in the
+    * background, must have stored it before the job is reported done.
+    */
+   if (dev->num_writers > 0 && !dev->flush(dcr)) {
+      Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+            dev->print_name(), dev->errmsg);
+      jcr->forceJobStatus(JS_FatalError);
+   }
+
    if (!dev->is_blocked()) {
       block_device(dev, BST_RELEASING);
    } else {
@@ -857,6 +878,8 @@ void free_dcr(DCR *dcr)
       free_record(dcr->rec);
    }
 
+   free_dedup_chunks(dcr);
+
    if (jcr && jcr->dcr == dcr) {
       jcr->dcr = NULL;
    }
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2000-2012 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -29,6 +29,36 @@
 
 #include "bareos.h"
 #include "stored.h"
+#include "lib/cbuf.h"
+
+#ifndef SHUT_RDWR
+#define SHUT_RDWR 2
+#endif
+
+#define STREAM_READ_AHEAD 32          /**< Messages read ahead on a data connection */
+
+/**
+ * A message read ahead on a data connection.
+ */
+struct stream_msg {
+   int32_t n;                         /**< Return value of bget_msg() */
+   int32_t msglen;                    /**< Length of the message or the signal */
+   POOLMEM *msg;                      /**< Data of the message, NULL if none */
+};
+
+/**
+ * A data connection of the File daemon. The primary connection is read
+ * directly, the additional connections of a multi stream backup each have
+ * a thread reading their messages ahead. So the File daemon can keep
+ * sending on all connections while we write the files of one of them.
+ */
+struct data_stream {
+   BSOCK *bs;                         /**< Data connection */
+   circbuf *queue;                    /**< Messages read ahead, NULL when read directly */
+   pthread_t reader_id;               /**< Thread reading ahead */
+   bool reader_done;                  /**< Reader thread queued its last message */
+   stream_msg *cur;                   /**< Message being processed */
+};
 
 /* Responses sent to the daemon */
 static char OK_data[] =
@@ -44,16 +74,239 @@ void possible_incomplete_job(JCR *jcr, int32_t last_file_index)
 {
 }
 
+static inline void free_stream_msg(stream_msg *sm)
+{
+   if (sm->msg) {
+      free_pool_memory(sm->msg);
+   }
+   free(sm);
+}
+
+/**
+ * Read ahead thread of a data connection, stops after a hard end of file
+ * or an error. A NULL message tells the job there are no more messages.
+ */
+static void *stream_reader(void *arg)
+{
+   data_stream *ds = (data_stream *)arg;
+   stream_msg *sm;
+   int32_t n;
+
+   do {
+      n = bget_msg(ds->bs);
+      sm = (stream_msg *)malloc(sizeof(stream_msg));
+      sm->n = n;
+      sm->msglen = ds->bs->msglen;
+      sm->msg = NULL;
+      if (n > 0) {
+         sm->msg = ds->bs->msg;
+         ds->bs->msg = get_pool_memory(PM_BSOCK);
+      }
+      ds->queue->enqueue(sm);
+   } while (n >= 0 || n == BNET_SIGNAL);
+   ds->queue->enqueue(NULL);
+
+   return NULL;
+}
+
+/**
+ * Start reading ahead on the additional data connections. Without a
+ * thread a connection is read directly.
+ */
+static void start_stream_readers(JCR *jcr, data_stream *streams, int nr_streams)
+{
+   int status;
+
+   for (int i = 1; i < nr_streams; i++) {
+      data_stream *ds = &streams[i];
+
+      ds->queue = New(circbuf(STREAM_READ_AHEAD));
+      if ((status = pthread_create(&ds->reader_id, NULL, stream_reader, (void *)ds)) != 0) {
+         berrno be;
+
+         Jmsg2(jcr, M_WARNING, 0, _("Cannot create reader thread for data connection %d: ERR=%s\n"),
+               i, be.bstrerror(status));
+         delete ds->queue;
+         ds->queue = NULL;
+      }
+   }
+}
+
+/**
+ * Stop the read ahead threads. All data was received at this point, the
+ * threads only wait for the File daemon to close the connections.
+ */
+static void stop_stream_readers(data_stream *streams, int nr_streams)
+{
+   stream_msg *sm;
+
+   for (int i = 1; i < nr_streams; i++) {
+      data_stream *ds = &streams[i];
+
+      if (!ds->queue) {
+         continue;
+      }
+
+      ds->bs->m_suppress_error_msgs = true;
+      ds->bs->set_terminated();
+      shutdown(ds->bs->m_fd, SHUT_RDWR);
+
+      if (ds->cur) {
+         free_stream_msg(ds->cur);
+         ds->cur = NULL;
+      }
+      while (!ds->reader_done) {
+         if ((sm = (stream_msg *)ds->queue->dequeue())) {
+            free_stream_msg(sm);
+         } else {
+            ds->reader_done = true;
+         }
+      }
+      pthread_join(ds->reader_id, NULL);
+      delete ds->queue;
+      ds->queue = NULL;
+   }
+}
+
+/**
+ * Get the next message read ahead on a data connection.
+ */
+static inline int32_t next_stream_msg(data_stream *ds)
+{
+   if (ds->cur) {
+      free_stream_msg(ds->cur);
+      ds->cur = NULL;
+   }
+
+   if (ds->reader_done) {
+      return BNET_HARDEOF;
+   }
+
+   if (!(ds->cur = (stream_msg *)ds->queue->dequeue())) {
+      ds->reader_done = true;
+      return BNET_HARDEOF;
+   }
+
+   return ds->cur->n;
+}
+
+/**
+ * Data and length (or signal) of the last message received on a data connection.
+ */
+static inline char *stream_msg_data(data_stream *ds)
+{
+   return ds->queue ? ds->cur->msg : ds->bs->msg;
+}
+
+static inline int32_t stream_msglen(data_stream *ds)
+{
+   if (ds->queue) {
+      return ds->cur ? ds->cur->msglen : 0;
+   }
+
+   return ds->bs->msglen;
+}
+
+/**
+ * See if the last message received on a data connection was an error. The
+ * state of a connection read ahead is already past that message.
+ */
+static inline bool stream_error(data_stream *ds, int32_t n)
+{
+   if (ds->queue) {
+      return n == BNET_HARDEOF || n == BNET_ERROR;
+   }
+
+   return ds->bs->is_error();
+}
+
+/**
+ * Receive the next message. While waiting for it the despool thread of
+ * a segmented data spool may use the DCR.
+ */
+static inline int32_t receive_msg(DCR *dcr, data_stream *ds)
+{
+   int32_t n;
+
+   unlock_data_spool(dcr);
+   if (ds->queue) {
+      n = next_stream_msg(ds);
+   } else {
+      n = bget_msg(ds->bs);
+   }
+   lock_data_spool(dcr);
+
+   return n;
+}
+
+/**
+ * Records of these streams are also sent to the Director.
+ */
+static inline bool is_attribute_stream(int32_t maskedStream)
+{
+   return maskedStream == STREAM_UNIX_ATTRIBUTES    ||
+          maskedStream == STREAM_UNIX_ATTRIBUTES_EX ||
+          maskedStream == STREAM_RESTORE_OBJECT     ||
+          crypto_digest_stream_type(maskedStream) != CRYPTO_DIGEST_NONE;
+}
+
+/**
+ * Receive the data of the next record. With in_place set the data is read
+ * right behind the record header into the current block when it fits there,
+ * so it does not have to be copied into the block. Otherwise it is read
+ * into the message buffer. Data read ahead is used where it is.
+ */
+static inline int32_t receive_record(DCR *dcr, data_stream *ds, bool in_place)
+{
+   int32_t n;
+   int32_t navail = 0;
+   char *buf = NULL;
+
+   if (ds->queue) {
+      n = receive_msg(dcr, ds);
+      if (n > 0) {
+         dcr->rec->data = ds->cur->msg;
+         dcr->rec->data_len = n;
+      }
+      return n;
+   }
+
+   if (in_place) {
+      buf = record_data_in_block(dcr->block, &navail);
+   }
+
+   unlock_data_spool(dcr);
+   n = bget_msg(ds->bs, buf, navail);
+   lock_data_spool(dcr);
+
+   if (n > 0) {
+      if (buf && n <= navail) {
+         dcr->rec->data = buf;
+      } else {
+         dcr->rec->data = ds->bs->msg;
+      }
+      dcr->rec->data_len = n;
+   }
+
+   return n;
+}
+
 /**
  * Append Data sent from File daemon
  */
 bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
 {
    int32_t n, file_index, stream, last_file_index, job_elapsed;
+   int32_t cur_stream = 0;
+   int32_t nr_streams = 1;
+   bool multi_stream;
    bool ok = true;
+   bool in_place;
    char buf1[100];
    DCR *dcr = jcr->dcr;
    DEVICE *dev;
+   data_stream *streams;
+   data_stream *data;                 /* Connection the current file is received on */
    POOLMEM *rec_data;
    char ec[50];
 
@@ -74,6 +327,20 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
       goto bail_out;
    }
 
+   /*
+    * The files of a multi stream backup arrive round robin over the data
+    * connections of the File daemon, each followed by a BNET_NEXT_STREAM.
+    */
+   multi_stream = (bs == jcr->file_bsock && jcr->nr_fd_streams > 1);
+   if (multi_stream) {
+      for (int i = 1; i < jcr->nr_fd_streams; i++) {
+         if (!jcr->fd_streams[i]->set_buffer_size(dcr->device->max_network_buffer_size, BNET_SETBUF_WRITE)) {
+            Jmsg0(jcr, M_FATAL, 0, _("Unable to set network buffer size.\n"));
+            goto bail_out;
+         }
+      }
+   }
+
    if (!acquire_device_for_append(dcr)) {
       goto bail_out;
    }
@@ -89,7 +356,7 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
    }
    Dmsg1(50, "Begin append device=%s\n", dev->print_name());
 
-   if (!begin_data_spool(dcr) ) {
+   if (!begin_data_spool(dcr, true) ) {
       goto bail_out;
    }
 
@@ -97,6 +364,7 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
       discard_data_spool(dcr);
       goto bail_out;
    }
+   lock_data_spool(dcr);
 
    Dmsg0(100, "Just after acquire_device_for_append\n");
    if (dev->VolCatInfo.VolCatName[0] == 0) {
@@ -143,6 +411,17 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
     * file. 1. for the Attributes, 2. for the file data if any,
     * and 3. for the MD5 if any.
     */
+   if (multi_stream) {
+      nr_streams = jcr->nr_fd_streams;
+   }
+   streams = (data_stream *)malloc(nr_streams * sizeof(data_stream));
+   memset(streams, 0, nr_streams * sizeof(data_stream));
+   for (int i = 0; i < nr_streams; i++) {
+      streams[i].bs = (i == 0) ? bs : jcr->fd_streams[i];
+   }
+   start_stream_readers(jcr, streams, nr_streams);
+   data = &streams[0];
+
    dcr->VolFirstIndex = dcr->VolLastIndex = 0;
    jcr->run_time = time(NULL);              /* start counting time for rates */
    for (last_file_index = 0; ok && !jcr->is_job_canceled(); ) {
@@ -155,20 +434,25 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
        * - info       (Info for Storage daemon -- compressed, encrypted, ...)
        *               info is not currently used, so is read, but ignored!
        */
-      if ((n = bget_msg(bs)) <= 0) {
-         if (n == BNET_SIGNAL && bs->msglen == BNET_EOD) {
+      if ((n = receive_msg(dcr, data)) <= 0) {
+         if (n == BNET_SIGNAL && stream_msglen(data) == BNET_EOD) {
             break;                    /* end of data */
          }
+         if (n == BNET_SIGNAL && stream_msglen(data) == BNET_NEXT_STREAM && multi_stream) {
+            cur_stream = (cur_stream + 1) % nr_streams;
+            data = &streams[cur_stream];
+            continue;
+         }
          Jmsg2(jcr, M_FATAL, 0, _("Error reading data header from %s. ERR=%s\n"),
-               what, bs->bstrerror());
+               what, data->bs->bstrerror());
          possible_incomplete_job(jcr, last_file_index);
          ok = false;
          break;
       }
 
-      if (sscanf(bs->msg, "%ld %ld", &file_index, &stream) != 2) {
+      if (sscanf(stream_msg_data(data), "%ld %ld", &file_index, &stream) != 2) {
          Jmsg2(jcr, M_FATAL, 0, _("Malformed data header from %s: %s\n"),
-               what, bs->msg);
+               what, stream_msg_data(data));
          ok = false;
          possible_incomplete_job(jcr, last_file_index);
          break;
@@ -205,15 +489,21 @@ fi_checked:
        * We save the original data pointer from the record so we can restore
        * that after the loop ends.
        */
+      /*
+       * The data of attribute records is still used after write_record() and the
+       * records of deduplicated data shrink when the chunk goes into the chunk
+       * store, so only other data is received into the block. The despool
+       * thread of a segmented data spool swaps the block while we wait for data.
+       */
       rec_data = dcr->rec->data;
-      while ((n = bget_msg(bs)) > 0 && !jcr->is_job_canceled()) {
+      in_place = !dcr->segments && !is_attribute_stream(stream & STREAMMASK_TYPE) &&
+                 (stream & STREAMMASK_TYPE) != STREAM_DEDUP_DATA;
+      while ((n = receive_record(dcr, data, in_place)) > 0 && !jcr->is_job_canceled()) {
          dcr->rec->VolSessionId = jcr->VolSessionId;
          dcr->rec->VolSessionTime = jcr->VolSessionTime;
          dcr->rec->FileIndex = file_index;
          dcr->rec->Stream = stream;
          dcr->rec->maskedStream = stream & STREAMMASK_TYPE; /* strip high bits */
-         dcr->rec->data_len = bs->msglen;
-         dcr->rec->data = bs->msg; /* use message buffer */
 
          Dmsg4(850, "before writ_rec FI=%d SessId=%d Strm=%s len=%d\n",
                dcr->rec->FileIndex, dcr->rec->VolSessionId,
@@ -237,12 +527,12 @@ fi_checked:
        */
       dcr->rec->data = rec_data;
 
-      if (bs->is_error()) {
+      if (stream_error(data, n)) {
          if (!jcr->is_job_canceled()) {
             Dmsg2(350, "Network read error from %s. ERR=%s\n",
-                  what, bs->bstrerror());
+                  what, data->bs->bstrerror());
             Jmsg2(jcr, M_FATAL, 0, _("Network error reading from %s. ERR=%s\n"),
-                  what, bs->bstrerror());
+                  what, data->bs->bstrerror());
             possible_incomplete_job(jcr, last_file_index);
          }
          ok = false;
@@ -250,6 +540,13 @@ fi_checked:
       }
    }
 
+   stop_stream_readers(streams, nr_streams);
+   free(streams);
+
+   if (!finish_dedup_job(dcr)) {
+      ok = false;
+   }
+
    /*
     * Create Job status for end of session label
     */
@@ -306,6 +603,7 @@ fi_checked:
       }
    }
 
+   unlock_data_spool(dcr);
    if (!ok && !jcr->is_JobStatus(JS_Incomplete)) {
       discard_data_spool(dcr);
    } else {
@@ -354,10 +652,7 @@ bail_out:
  */
 bool send_attrs_to_dir(JCR *jcr, DEV_RECORD *rec)
 {
-   if (rec->maskedStream == STREAM_UNIX_ATTRIBUTES    ||
-       rec->maskedStream == STREAM_UNIX_ATTRIBUTES_EX ||
-       rec->maskedStream == STREAM_RESTORE_OBJECT     ||
-       crypto_digest_stream_type(rec->maskedStream) != CRYPTO_DIGEST_NONE) {
+   if (is_attribute_stream(rec->maskedStream)) {
       if (!jcr->no_attributes) {
          BSOCK *dir = jcr->dir_bsock;
          if (are_attributes_spooled(jcr)) {
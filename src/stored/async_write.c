@@ -0,0 +1,234 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Writer thread of a device.
+ *
+ * A device writing disk volumes gets a writer thread and a ring of
+ * blocks. DCR::write_block_to_device() does all checks and bookkeeping
+ * of a block write as before, but hands the full block to the writer
+ * thread and continues packing records into an empty one. Receiving
+ * from the network and packing records thus overlap with the device
+ * I/O.
+ *
+ * The blocks are written in the order they are queued. After a failed
+ * write the thread stops writing until the blocks left in the ring are
+ * taken back, see wait_async_writes() in block.c for how they are
+ * rewritten.
+ */
+
+#include "bareos.h"
+#include "stored.h"
+
+static const int dbglvl = 200;
+
+static void *async_writer_thread(void *arg)
+{
+   async_writer *aw = (async_writer *)arg;
+   async_write_slot *slot;
+   ssize_t status;
+   int saved_errno;
+
+   P(aw->lock);
+   while (1) {
+      while (!aw->quit && (aw->failed || aw->nr_written == aw->nr_queued)) {
+         pthread_cond_wait(&aw->work, &aw->lock);
+      }
+      if (aw->quit) {
+         break;
+      }
+      slot = &aw->slots[(aw->head + aw->nr_written) % aw->nr_slots];
+      V(aw->lock);
+
+      status = write_block_buffer(aw->dev, slot->block, slot->wlen);
+      saved_errno = errno;
+
+      P(aw->lock);
+      slot->status = status;
+      slot->saved_errno = saved_errno;
+      aw->nr_written++;
+      if (status != (ssize_t)slot->wlen) {
+         Dmsg3(dbglvl, "Async write of block %u failed status=%d errno=%d\n",
+               slot->block->BlockNumber, status, saved_errno);
+         aw->failed = true;
+      }
+      pthread_cond_broadcast(&aw->done);
+   }
+   V(aw->lock);
+
+   return NULL;
+}
+
+/**
+ * Create the writer thread of a device with a ring of nr_blocks blocks.
+ *
+ * Returns: NULL on failure
+ *          writer on success
+ */
+async_writer *new_async_writer(DEVICE *dev, int nr_blocks)
+{
+   int status;
+   async_writer *aw;
+
+   aw = (async_writer *)malloc(sizeof(async_writer));
+   memset(aw, 0, sizeof(async_writer));
+   aw->dev = dev;
+   aw->nr_slots = nr_blocks;
+   aw->slots = (async_write_slot *)malloc(nr_blocks * sizeof(async_write_slot));
+   memset(aw->slots, 0, nr_blocks * sizeof(async_write_slot));
+   for (int i = 0; i < nr_blocks; i++) {
+      aw->slots[i].block = new_block(dev);
+   }
+   pthread_mutex_init(&aw->lock, NULL);
+   pthread_cond_init(&aw->work, NULL);
+   pthread_cond_init(&aw->done, NULL);
+
+   if ((status = pthread_create(&aw->thread_id, NULL, async_writer_thread, (void *)aw)) != 0) {
+      berrno be;
+
+      Jmsg2(NULL, M_WARNING, 0, _("Cannot create writer thread for device %s, writing synchronously. ERR=%s\n"),
+            dev->print_name(), be.bstrerror(status));
+      aw->thread_id = 0;
+      free_async_writer(aw);
+      return NULL;
+   }
+
+   Dmsg2(dbglvl, "Created writer thread with %d blocks for device %s\n", nr_blocks, dev->print_name());
+   return aw;
+}
+
+/**
+ * Stop the writer thread and free the ring. Blocks still queued
+ * are written first.
+ */
+void free_async_writer(async_writer *aw)
+{
+   drain_async_writer(aw);
+
+   if (aw->thread_id) {
+      P(aw->lock);
+      aw->quit = true;
+      pthread_cond_signal(&aw->work);
+      V(aw->lock);
+      pthread_join(aw->thread_id, NULL);
+   }
+
+   for (int i = 0; i < aw->nr_slots; i++) {
+      free_block(aw->slots[i].block);
+   }
+   pthread_cond_destroy(&aw->done);
+   pthread_cond_destroy(&aw->work);
+   pthread_mutex_destroy(&aw->lock);
+   free(aw->slots);
+   free(aw);
+}
+
+/**
+ * Return the slot to put the next block to write in.
+ * The caller must have made sure there is one free, see wait_async_writer().
+ */
+async_write_slot *get_async_write_slot(async_writer *aw)
+{
+   ASSERT(aw->nr_queued < aw->nr_slots);
+
+   return &aw->slots[(aw->head + aw->nr_queued) % aw->nr_slots];
+}
+
+/**
+ * Hand the block in the slot returned by get_async_write_slot() to the writer thread.
+ */
+void queue_async_write(async_writer *aw, DCR *dcr)
+{
+   P(aw->lock);
+   aw->owner = dcr;
+   aw->nr_queued++;
+   pthread_cond_signal(&aw->work);
+   V(aw->lock);
+}
+
+/**
+ * Wait until there is room for another block in the ring or, when all
+ * is set, until all queued blocks are written. Written blocks are
+ * removed from the ring.
+ *
+ * Returns: true  on success
+ *          false when a write failed, the writer thread then has stopped
+ *                and the failed block is the first one in the ring
+ */
+bool wait_async_writer(async_writer *aw, bool all)
+{
+   bool retval;
+
+   P(aw->lock);
+   while (!aw->failed && aw->nr_written < aw->nr_queued &&
+          (all || aw->nr_queued == aw->nr_slots)) {
+      pthread_cond_wait(&aw->done, &aw->lock);
+   }
+
+   /*
+    * Remove the blocks that were written successfully.
+    */
+   while (aw->nr_written > 0) {
+      if (aw->slots[aw->head].status != (ssize_t)aw->slots[aw->head].wlen) {
+         break;
+      }
+      aw->head = (aw->head + 1) % aw->nr_slots;
+      aw->nr_queued--;
+      aw->nr_written--;
+   }
+   retval = !aw->failed;
+   V(aw->lock);
+
+   return retval;
+}
+
+/**
+ * Wait until the writer thread is idle. Unlike wait_async_writer() the
+ * ring is left untouched, this only makes sure the device can be used.
+ * Returns false when a queued block failed and was not dealt with yet.
+ */
+bool drain_async_writer(async_writer *aw)
+{
+   bool retval;
+
+   P(aw->lock);
+   while (!aw->failed && aw->nr_written < aw->nr_queued) {
+      pthread_cond_wait(&aw->done, &aw->lock);
+   }
+   retval = !aw->failed;
+   V(aw->lock);
+
+   return retval;
+}
+
+/**
+ * Empty the ring after the blocks left in it after a failed write have
+ * been dealt with and let the writer thread continue.
+ */
+void clear_async_writer(async_writer *aw)
+{
+   P(aw->lock);
+   aw->head = (aw->head + aw->nr_queued) % aw->nr_slots;
+   aw->nr_queued = 0;
+   aw->nr_written = 0;
+   aw->failed = false;
+   V(aw->lock);
+}
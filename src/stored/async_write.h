@@ -0,0 +1,78 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Asynchronous block writing definitions
+ */
+
+#ifndef BAREOS_STORED_ASYNC_WRITE_H_
+#define BAREOS_STORED_ASYNC_WRITE_H_ 1
+
+/**
+ * A block handed to the writer thread of a device.
+ *
+ * The positions are the ones from before the block was written, the
+ * bookkeeping of the write is done when the block is queued. If the
+ * write fails they are used to roll back to the state a synchronous
+ * write would have failed in.
+ */
+struct async_write_slot {
+   DEV_BLOCK *block;                  /**< Block to write */
+   uint32_t wlen;                     /**< Number of bytes to write */
+   ssize_t status;                    /**< Return value of the write */
+   int saved_errno;                   /**< errno of a failed write */
+
+   uint64_t VolCatBytes;              /**< Device positions */
+   uint32_t VolCatBlocks;
+   uint32_t block_num;
+   uint32_t file;
+   uint64_t file_addr;
+   uint64_t file_size;
+   uint32_t EndBlock;
+   uint32_t EndFile;
+   uint32_t LastBlock;
+
+   uint32_t dcr_EndBlock;             /**< DCR positions */
+   uint32_t dcr_EndFile;
+   int64_t VolMediaId;
+   uint32_t VolFirstIndex;
+   uint32_t VolLastIndex;
+   bool WroteVol;
+};
+
+struct async_writer {
+   DEVICE *dev;                       /**< Device we write to */
+   DCR *owner;                        /**< DCR that queued the blocks */
+   pthread_t thread_id;               /**< Writer thread */
+   pthread_mutex_t lock;
+   pthread_cond_t work;               /**< Signalled when a block is queued */
+   pthread_cond_t done;               /**< Signalled when a block is written */
+   int nr_slots;                      /**< Size of the ring */
+   int head;                          /**< Oldest queued block */
+   int nr_queued;                     /**< Number of blocks queued */
+   int nr_written;                    /**< Number of queued blocks processed by the thread */
+   bool failed;                       /**< A write failed, the thread stopped writing */
+   bool replaying;                    /**< Queued blocks are being rewritten after a failure */
+   bool quit;                         /**< Thread must exit */
+   async_write_slot *slots;
+};
+
+#endif /* BAREOS_STORED_ASYNC_WRITE_H_ */
@@ -121,6 +121,7 @@ bool authenticate_storagedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   sd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    if (!sd->authenticate_inbound_connection(jcr, "Storage daemon",
                                             "", password, me->tls)) {
@@ -145,6 +146,7 @@ bool authenticate_with_storagedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   sd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    if (!sd->authenticate_outbound_connection(jcr, "Storage daemon",
                                              "", password, me->tls)) {
@@ -169,6 +171,7 @@ bool authenticate_filedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   fd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    if (!fd->authenticate_inbound_connection(jcr, "File daemon",
                                                      "", password, me->tls)) {
@@ -181,6 +184,22 @@ bool authenticate_filedaemon(JCR *jcr)
    return true;
 }
 
+/**
+ * Authenticate an additional data connection of a remote File daemon.
+ *
+ * This is used for multi stream FD backups, the job is not touched.
+ */
+bool authenticate_filedaemon_stream(BSOCK *fd, char *auth_key)
+{
+   s_password password;
+
+   password.encoding = p_encoding_md5;
+   password.value = auth_key;
+   fd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
+
+   return fd->authenticate_inbound_connection(NULL, "File daemon", "", password, me->tls);
+}
+
 /**
  * Authenticate with a remote file daemon.
  *
@@ -193,6 +212,7 @@ bool authenticate_with_filedaemon(JCR *jcr)
 
    password.encoding = p_encoding_md5;
    password.value = jcr->sd_auth_key;
+   fd->set_compression_offer(me->network_compression ? BNET_COMPRESS_SUPPORTED : 0);
 
    if (!fd->authenticate_outbound_connection(jcr, "File daemon",
                                              "", password, me->tls)) {
@@ -0,0 +1,719 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Chunked volume device abstraction.
+ *
+ * A volume is a series of chunks of m_chunk_size bytes, the last one
+ * may be shorter. Writes fill the chunk in memory, a full chunk is
+ * queued to the I/O threads and stored by the backend while the job
+ * fills the next one. The number of chunks in memory is bounded by the
+ * number of slots, a writer waits for a slot when all of them hold
+ * chunks not stored yet. Reads load the chunk with the reading position
+ * and queue the chunks after it to the I/O threads. Closing or flushing
+ * the device waits until all chunks are stored.
+ */
+
+#include "bareos.h"
+
+#ifdef HAVE_OBJECTSTORE
+#include "stored.h"
+#include "chunked_device.h"
+
+static const int dbglvl = 200;
+
+static void *chunk_io_thread_main(void *arg)
+{
+   ((chunked_device *)arg)->chunk_io_thread();
+
+   return NULL;
+}
+
+/**
+ * Store or load the chunks of the slots queued.
+ */
+void chunked_device::chunk_io_thread()
+{
+   chunk_slot *slot;
+   char VolumeName[MAX_NAME_LENGTH];
+   uint32_t chunk, length;
+   bool ok;
+
+   P(m_lock);
+   while (!m_quit) {
+      if (m_queue_count == 0) {
+         pthread_cond_wait(&m_work, &m_lock);
+         continue;
+      }
+
+      slot = &m_slots[m_queue[m_queue_head]];
+      m_queue_head = (m_queue_head + 1) % m_nr_slots;
+      m_queue_count--;
+      slot->queued = false;
+
+      bstrncpy(VolumeName, slot->VolumeName, sizeof(VolumeName));
+      chunk = slot->chunk;
+      ok = false;
+
+      switch (slot->state) {
+      case CHUNK_LOADING:
+         V(m_lock);
+         for (uint32_t tries = 0; !ok && tries < m_retries; tries++) {
+            if (tries) {
+               bmicrosleep(CHUNK_RETRY_DELAY, 0);
+            }
+            length = m_chunk_size;
+            ok = read_remote_chunk(VolumeName, chunk, slot->buffer, &length);
+         }
+         P(m_lock);
+
+         if (ok) {
+            slot->length = length;
+         } else {
+            Emsg2(M_ERROR, 0, _("Failed to read chunk %d of volume %s\n"), chunk, VolumeName);
+            slot->length = 0;
+         }
+         slot->error = !ok;
+         slot->state = CHUNK_VALID;
+         Dmsg4(dbglvl, "Loaded chunk %d of volume %s, %u bytes ok=%d\n", chunk, VolumeName, slot->length, ok);
+         break;
+      case CHUNK_VALID:
+         if (!slot->dirty) {
+            break;
+         }
+
+         /*
+          * The slot is not changed while uploading, writers wait for it.
+          */
+         slot->state = CHUNK_UPLOADING;
+         slot->dirty = false;
+         length = slot->length;
+         V(m_lock);
+         for (uint32_t tries = 0; !ok && tries < m_retries; tries++) {
+            if (tries) {
+               bmicrosleep(CHUNK_RETRY_DELAY, 0);
+            }
+            ok = flush_remote_chunk(VolumeName, chunk, slot->buffer, length);
+         }
+         P(m_lock);
+
+         if (!ok) {
+            Emsg2(M_ERROR, 0, _("Failed to store chunk %d of volume %s\n"), chunk, VolumeName);
+            slot->dirty = true;
+            m_io_error = true;
+         }
+         slot->error = !ok;
+         slot->state = CHUNK_VALID;
+         Dmsg4(dbglvl, "Stored chunk %d of volume %s, %u bytes ok=%d\n", chunk, VolumeName, length, ok);
+         break;
+      default:
+         break;
+      }
+
+      pthread_cond_broadcast(&m_done);
+   }
+   V(m_lock);
+}
+
+/**
+ * Start the I/O threads and allocate the slots on first use.
+ */
+bool chunked_device::start_io_threads()
+{
+   int status;
+
+   if (m_threads) {
+      return true;
+   }
+
+   /*
+    * The length of a chunk is kept in 32 bits.
+    */
+   if (m_chunk_size == 0 || m_chunk_size > UINT32_MAX) {
+      Mmsg2(errmsg, _("Invalid chunk size %llu for device %s\n"), m_chunk_size, print_name());
+      return false;
+   }
+
+   /*
+    * The chunk being filled and the chunks read ahead need room next to
+    * the chunks being stored.
+    */
+   m_nr_slots = MAX(m_io_slots, MAX(m_read_ahead + 1, 2));
+   m_slots = (chunk_slot *)malloc(m_nr_slots * sizeof(chunk_slot));
+   memset(m_slots, 0, m_nr_slots * sizeof(chunk_slot));
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      m_slots[i].buffer = (char *)malloc(m_chunk_size);
+   }
+   m_queue = (uint32_t *)malloc(m_nr_slots * sizeof(uint32_t));
+   m_queue_head = m_queue_count = 0;
+
+   m_quit = false;
+   m_threads = (pthread_t *)malloc(MAX(m_io_threads, 1) * sizeof(pthread_t));
+   for (m_nr_threads = 0; m_nr_threads < MAX(m_io_threads, 1); m_nr_threads++) {
+      if ((status = pthread_create(&m_threads[m_nr_threads], NULL, chunk_io_thread_main, (void *)this)) != 0) {
+         berrno be;
+
+         Mmsg2(errmsg, _("Cannot create I/O thread for device %s. ERR=%s\n"),
+               print_name(), be.bstrerror(status));
+         stop_io_threads();
+         return false;
+      }
+   }
+
+   Dmsg4(dbglvl, "Started %d I/O threads with %d slots of %llu bytes for device %s\n",
+         m_nr_threads, m_nr_slots, m_chunk_size, print_name());
+   return true;
+}
+
+void chunked_device::stop_io_threads()
+{
+   if (!m_threads) {
+      return;
+   }
+
+   P(m_lock);
+   m_quit = true;
+   pthread_cond_broadcast(&m_work);
+   V(m_lock);
+   for (uint32_t i = 0; i < m_nr_threads; i++) {
+      pthread_join(m_threads[i], NULL);
+   }
+   free(m_threads);
+   m_threads = NULL;
+   m_nr_threads = 0;
+
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      free(m_slots[i].buffer);
+   }
+   free(m_slots);
+   m_slots = NULL;
+   free(m_queue);
+   m_queue = NULL;
+   m_nr_slots = 0;
+}
+
+/**
+ * Hand a slot to the I/O threads. The lock must be held.
+ */
+void chunked_device::queue_chunk_io(chunk_slot *slot)
+{
+   if (slot->queued) {
+      return;
+   }
+
+   m_queue[(m_queue_head + m_queue_count) % m_nr_slots] = slot - m_slots;
+   m_queue_count++;
+   slot->queued = true;
+   pthread_cond_signal(&m_work);
+}
+
+/**
+ * Find the slot holding a chunk of the open volume. The lock must be held.
+ */
+chunk_slot *chunked_device::find_chunk(uint32_t chunk)
+{
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      if (m_slots[i].state != CHUNK_FREE && m_slots[i].chunk == chunk &&
+          bstrcmp(m_slots[i].VolumeName, m_VolumeName)) {
+         return &m_slots[i];
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Get a slot for another chunk, a slot holding a chunk already stored
+ * is reused. Without a slot to reuse the chunks changed are stored
+ * first, when wait is not set NULL is returned instead. The lock must
+ * be held.
+ */
+chunk_slot *chunked_device::get_free_slot(bool wait)
+{
+   chunk_slot *slot, *lru, *lru_dirty;
+   bool busy;
+
+   while (1) {
+      lru = lru_dirty = NULL;
+      busy = false;
+      for (uint32_t i = 0; i < m_nr_slots; i++) {
+         slot = &m_slots[i];
+         switch (slot->state) {
+         case CHUNK_FREE:
+            return slot;
+         case CHUNK_VALID:
+            if (slot->queued) {
+               busy = true;
+            } else if (!slot->dirty) {
+               if (!lru || slot->last_use < lru->last_use) {
+                  lru = slot;
+               }
+            } else if (!slot->error) {
+               if (!lru_dirty || slot->last_use < lru_dirty->last_use) {
+                  lru_dirty = slot;
+               }
+            }
+            break;
+         default:
+            busy = true;
+            break;
+         }
+      }
+
+      if (lru) {
+         lru->state = CHUNK_FREE;
+         return lru;
+      }
+
+      if (!wait) {
+         return NULL;
+      }
+
+      if (!busy) {
+         if (!lru_dirty) {
+            errno = EIO;
+            return NULL;
+         }
+         queue_chunk_io(lru_dirty);
+      }
+      pthread_cond_wait(&m_done, &m_lock);
+   }
+}
+
+/**
+ * Get the slot of a chunk of the open volume. With load set a chunk
+ * not in memory is read, otherwise the slot starts empty. The lock must
+ * be held.
+ *
+ * Returns: NULL on failure with errno set
+ *          slot on success
+ */
+chunk_slot *chunked_device::get_chunk(uint32_t chunk, bool load)
+{
+   chunk_slot *slot;
+
+   while ((slot = find_chunk(chunk))) {
+      if (slot->state == CHUNK_LOADING || slot->state == CHUNK_UPLOADING) {
+         pthread_cond_wait(&m_done, &m_lock);
+         continue;
+      }
+
+      /*
+       * A chunk read ahead that could not be read is read again.
+       */
+      if (slot->error && !slot->dirty) {
+         slot->state = CHUNK_FREE;
+         break;
+      }
+
+      slot->last_use = ++m_use_counter;
+      return slot;
+   }
+
+   if (!(slot = get_free_slot(true))) {
+      return NULL;
+   }
+
+   bstrncpy(slot->VolumeName, m_VolumeName, sizeof(slot->VolumeName));
+   slot->chunk = chunk;
+   slot->length = 0;
+   slot->dirty = false;
+   slot->error = false;
+   slot->last_use = ++m_use_counter;
+
+   if (load && (uint64_t)chunk * m_chunk_size < m_volume_size) {
+      slot->state = CHUNK_LOADING;
+      queue_chunk_io(slot);
+      while (slot->state == CHUNK_LOADING) {
+         pthread_cond_wait(&m_done, &m_lock);
+      }
+      if (slot->error) {
+         slot->state = CHUNK_FREE;
+         errno = EIO;
+         return NULL;
+      }
+   } else {
+      slot->state = CHUNK_VALID;
+   }
+
+   return slot;
+}
+
+/**
+ * Start reading the chunks after the one read when there are slots
+ * left to read them into. The lock must be held.
+ */
+void chunked_device::read_ahead_chunks(uint32_t chunk)
+{
+   chunk_slot *slot;
+
+   for (uint32_t next = chunk + 1; next <= chunk + m_read_ahead; next++) {
+      if ((uint64_t)next * m_chunk_size >= m_volume_size) {
+         break;
+      }
+      if (find_chunk(next)) {
+         continue;
+      }
+      if (!(slot = get_free_slot(false))) {
+         break;
+      }
+
+      bstrncpy(slot->VolumeName, m_VolumeName, sizeof(slot->VolumeName));
+      slot->chunk = next;
+      slot->length = 0;
+      slot->dirty = false;
+      slot->error = false;
+      slot->last_use = m_use_counter;
+      slot->state = CHUNK_LOADING;
+      queue_chunk_io(slot);
+      Dmsg2(dbglvl, "Read ahead chunk %d of volume %s\n", next, m_VolumeName);
+   }
+}
+
+/**
+ * Store all changed chunks of the open volume and wait for the I/O
+ * threads to finish with them. The lock must be held.
+ *
+ * Returns: false if a chunk could not be stored
+ *          true on success
+ */
+bool chunked_device::flush_chunks()
+{
+   chunk_slot *slot;
+   bool busy;
+
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      slot = &m_slots[i];
+      if (slot->state == CHUNK_VALID && slot->dirty && bstrcmp(slot->VolumeName, m_VolumeName)) {
+         slot->error = false;
+         queue_chunk_io(slot);
+      }
+   }
+
+   do {
+      busy = false;
+      for (uint32_t i = 0; i < m_nr_slots; i++) {
+         slot = &m_slots[i];
+         if (slot->queued || slot->state == CHUNK_LOADING || slot->state == CHUNK_UPLOADING ||
+             (slot->dirty && !slot->error)) {
+            busy = true;
+            break;
+         }
+      }
+      if (busy) {
+         pthread_cond_wait(&m_done, &m_lock);
+      }
+   } while (busy);
+
+   if (m_io_error) {
+      Mmsg1(errmsg, _("Failed to store all chunks of volume %s\n"), m_VolumeName);
+      errno = EIO;
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ * Forget all chunks in memory. The lock must be held and no I/O may be
+ * in progress.
+ */
+void chunked_device::release_chunks()
+{
+   for (uint32_t i = 0; i < m_nr_slots; i++) {
+      m_slots[i].state = CHUNK_FREE;
+      m_slots[i].dirty = false;
+      m_slots[i].error = false;
+   }
+   m_io_error = false;
+}
+
+/**
+ * Open a volume, called by the backend when it is ready to access the
+ * chunks of the volume.
+ */
+int chunked_device::open_chunked_volume(const char *VolumeName, int flags)
+{
+   uint64_t size = 0;
+
+   if (!start_io_threads()) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   if (!get_remote_volume_size(VolumeName, &size)) {
+      if (errno != ENOENT) {
+         Emsg0(M_ERROR, 0, errmsg);
+         errno = EIO;
+         return -1;
+      }
+      if (!(flags & O_CREAT)) {
+         Mmsg1(errmsg, _("Volume %s not found\n"), VolumeName);
+         errno = ENOENT;
+         return -1;
+      }
+      size = 0;
+   }
+
+   /*
+    * The chunks of the previous volume must be stored before they are
+    * released, release_chunks() also forgets about any I/O error.
+    */
+   P(m_lock);
+   if (m_VolumeName[0]) {
+      if (!flush_chunks()) {
+         V(m_lock);
+         return -1;
+      }
+      release_chunks();
+   }
+   bstrncpy(m_VolumeName, VolumeName, sizeof(m_VolumeName));
+   m_offset = 0;
+   m_volume_size = size;
+   m_io_error = false;
+   V(m_lock);
+
+   Dmsg2(dbglvl, "Opened volume %s of %llu bytes\n", VolumeName, size);
+   return 0;
+}
+
+/**
+ * Read data from the chunks of a volume.
+ */
+ssize_t chunked_device::d_read(int fd, void *buffer, size_t count)
+{
+   chunk_slot *slot;
+   uint32_t chunk, pos, len;
+   size_t done = 0;
+
+   if (!m_VolumeName[0]) {
+      errno = EBADF;
+      return -1;
+   }
+
+   P(m_lock);
+   while (done < count && (uint64_t)m_offset < m_volume_size) {
+      chunk = m_offset / m_chunk_size;
+      pos = m_offset % m_chunk_size;
+      if (!(slot = get_chunk(chunk, true))) {
+         V(m_lock);
+         Mmsg2(errmsg, _("Failed to read chunk %d of volume %s\n"), chunk, m_VolumeName);
+         return -1;
+      }
+      if (pos >= slot->length) {
+         break;
+      }
+
+      len = MIN(count - done, slot->length - pos);
+      memcpy((char *)buffer + done, slot->buffer + pos, len);
+      done += len;
+      m_offset += len;
+
+      read_ahead_chunks(chunk);
+   }
+   V(m_lock);
+
+   return done;
+}
+
+/**
+ * Write data into the chunks of a volume.
+ */
+ssize_t chunked_device::d_write(int fd, const void *buffer, size_t count)
+{
+   chunk_slot *slot;
+   uint32_t chunk, pos, len;
+   size_t done = 0;
+
+   if (!m_VolumeName[0]) {
+      errno = EBADF;
+      return -1;
+   }
+
+   P(m_lock);
+   if (m_io_error) {
+      V(m_lock);
+      Mmsg1(errmsg, _("Failed to store a chunk of volume %s\n"), m_VolumeName);
+      errno = EIO;
+      return -1;
+   }
+
+   while (done < count) {
+      chunk = m_offset / m_chunk_size;
+      pos = m_offset % m_chunk_size;
+      if (chunk >= MAX_CHUNKS) {
+         V(m_lock);
+         Mmsg2(errmsg, _("Volume %s exceeds %d chunks\n"), m_VolumeName, MAX_CHUNKS);
+         errno = ENOSPC;
+         return -1;
+      }
+
+      /*
+       * Only a chunk written from its start on needs not be read first.
+       */
+      if (!(slot = get_chunk(chunk, pos > 0 || (uint64_t)m_offset < m_volume_size))) {
+         V(m_lock);
+         Mmsg2(errmsg, _("Failed to read chunk %d of volume %s\n"), chunk, m_VolumeName);
+         return -1;
+      }
+
+      len = MIN(count - done, m_chunk_size - pos);
+      if (pos > slot->length) {
+         memset(slot->buffer + slot->length, 0, pos - slot->length);
+      }
+      memcpy(slot->buffer + pos, (const char *)buffer + done, len);
+      slot->length = MAX(slot->length, pos + len);
+      slot->dirty = true;
+      done += len;
+      m_offset += len;
+      m_volume_size = MAX(m_volume_size, (uint64_t)m_offset);
+
+      /*
+       * Store a full chunk while the next one is filled.
+       */
+      if (slot->length == m_chunk_size) {
+         queue_chunk_io(slot);
+      }
+   }
+   V(m_lock);
+
+   return count;
+}
+
+int chunked_device::d_close(int fd)
+{
+   bool ok;
+
+   if (!m_VolumeName[0]) {
+      errno = EBADF;
+      return -1;
+   }
+
+   P(m_lock);
+   ok = flush_chunks();
+   release_chunks();
+   m_VolumeName[0] = '\0';
+   V(m_lock);
+
+   if (!ok) {
+      errno = EIO;
+      return -1;
+   }
+
+   return 0;
+}
+
+boffset_t chunked_device::d_lseek(DCR *dcr, boffset_t offset, int whence)
+{
+   switch (whence) {
+   case SEEK_SET:
+      m_offset = offset;
+      break;
+   case SEEK_CUR:
+      m_offset += offset;
+      break;
+   case SEEK_END:
+      m_offset = m_volume_size + offset;
+      break;
+   default:
+      errno = EINVAL;
+      return -1;
+   }
+
+   return m_offset;
+}
+
+/**
+ * Drop all chunks of the volume.
+ */
+bool chunked_device::d_truncate(DCR *dcr)
+{
+   if (!m_VolumeName[0]) {
+      return true;
+   }
+
+   P(m_lock);
+   flush_chunks();
+   release_chunks();
+   V(m_lock);
+
+   if (!truncate_remote_volume(m_VolumeName)) {
+      return false;
+   }
+
+   m_offset = 0;
+   m_volume_size = 0;
+
+   return true;
+}
+
+/**
+ * Wait until all data written is stored.
+ */
+bool chunked_device::d_flush(DCR *dcr)
+{
+   bool ok;
+
+   if (!m_VolumeName[0]) {
+      return true;
+   }
+
+   P(m_lock);
+   ok = flush_chunks();
+   V(m_lock);
+
+   return ok;
+}
+
+chunked_device::~chunked_device()
+{
+   stop_io_threads();
+   pthread_cond_destroy(&m_done);
+   pthread_cond_destroy(&m_work);
+   pthread_mutex_destroy(&m_lock);
+}
+
+chunked_device::chunked_device()
+{
+   m_VolumeName[0] = '\0';
+   m_offset = 0;
+   m_volume_size = 0;
+   m_io_error = false;
+   m_quit = false;
+   m_nr_threads = 0;
+   m_threads = NULL;
+   m_nr_slots = 0;
+   m_slots = NULL;
+   m_queue_head = m_queue_count = 0;
+   m_queue = NULL;
+   m_use_counter = 0;
+
+   m_chunk_size = DEFAULT_CHUNK_SIZE;
+   m_io_threads = DEFAULT_IO_THREADS;
+   m_io_slots = DEFAULT_IO_SLOTS;
+   m_read_ahead = DEFAULT_READ_AHEAD;
+   m_retries = DEFAULT_RETRIES;
+
+   pthread_mutex_init(&m_lock, NULL);
+   pthread_cond_init(&m_work, NULL);
+   pthread_cond_init(&m_done, NULL);
+}
+#endif /* HAVE_OBJECTSTORE */
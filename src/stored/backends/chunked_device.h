@@ -0,0 +1,144 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunked volume device abstraction.
+ */
+
+#ifndef CHUNKED_DEVICE_H
+#define CHUNKED_DEVICE_H
+
+#define DEFAULT_CHUNK_SIZE (10 * 1024 * 1024) /**< Bytes per chunk of a volume */
+#define MAX_CHUNKS 10000                      /**< Chunks are numbered 0000 to 9999 */
+#define DEFAULT_IO_THREADS 4                  /**< Threads storing and reading chunks */
+#define DEFAULT_IO_SLOTS 8                    /**< Chunks held in memory */
+#define DEFAULT_READ_AHEAD 2                  /**< Chunks read ahead of the reading position */
+#define DEFAULT_RETRIES 3                     /**< Tries of a failing chunk store or read */
+#define CHUNK_RETRY_DELAY 1                   /**< Seconds between tries */
+
+enum chunk_state {
+   CHUNK_FREE = 0,                    /**< Slot not in use */
+   CHUNK_LOADING,                     /**< Chunk being read into the slot */
+   CHUNK_VALID,                       /**< Slot holds the chunk */
+   CHUNK_UPLOADING                    /**< Chunk being stored from the slot */
+};
+
+/**
+ * A chunk of a volume in memory.
+ */
+struct chunk_slot {
+   chunk_state state;
+   char VolumeName[MAX_NAME_LENGTH];  /**< Volume of the chunk */
+   uint32_t chunk;                    /**< Number of the chunk in the volume */
+   char *buffer;                      /**< Chunk size bytes */
+   uint32_t length;                   /**< Bytes of the chunk in buffer */
+   bool dirty;                        /**< Changed since it was read or stored */
+   bool queued;                       /**< Waiting for an I/O thread */
+   bool error;                        /**< Last read or store failed */
+   uint64_t last_use;                 /**< For replacing the least recently used chunk */
+};
+
+/**
+ * A device storing each volume as a series of fixed size chunks, e.g.
+ * one object per chunk in an object store.
+ *
+ * The chunks being written and read are held in a bounded number of
+ * slots in memory. Full chunks are stored by a pool of I/O threads
+ * while the next chunk is filled, reading the chunks after the one read
+ * is started ahead of time. The backend only implements storing,
+ * reading and removing the chunks of a volume.
+ */
+class chunked_device: public DEVICE {
+private:
+   /*
+    * Private Members
+    */
+   char m_VolumeName[MAX_NAME_LENGTH]; /**< Volume open, empty when closed */
+   boffset_t m_offset;
+   uint64_t m_volume_size;
+   bool m_io_error;                   /**< A chunk of the volume could not be stored */
+   bool m_quit;                       /**< I/O threads must exit */
+   pthread_mutex_t m_lock;
+   pthread_cond_t m_work;             /**< Signalled when a slot is queued */
+   pthread_cond_t m_done;             /**< Signalled when a slot changes state */
+   uint32_t m_nr_threads;
+   pthread_t *m_threads;
+   uint32_t m_nr_slots;
+   chunk_slot *m_slots;
+   uint32_t m_queue_head;
+   uint32_t m_queue_count;
+   uint32_t *m_queue;                 /**< Ring of slots waiting for an I/O thread */
+   uint64_t m_use_counter;
+
+   /*
+    * Private Methods
+    */
+   bool start_io_threads();
+   void queue_chunk_io(chunk_slot *slot);
+   chunk_slot *find_chunk(uint32_t chunk);
+   chunk_slot *get_free_slot(bool wait);
+   chunk_slot *get_chunk(uint32_t chunk, bool load);
+   void read_ahead_chunks(uint32_t chunk);
+   bool flush_chunks();
+   void release_chunks();
+
+protected:
+   /*
+    * Settings, a backend sets them from its device options.
+    */
+   uint64_t m_chunk_size;
+   uint32_t m_io_threads;
+   uint32_t m_io_slots;
+   uint32_t m_read_ahead;
+   uint32_t m_retries;
+
+   /*
+    * Protected Methods
+    */
+   int open_chunked_volume(const char *VolumeName, int flags);
+   void stop_io_threads();
+
+   /*
+    * Interface to the backend, called by the I/O threads.
+    */
+   virtual bool flush_remote_chunk(const char *VolumeName, uint32_t chunk,
+                                   const char *buffer, uint32_t length) = 0;
+   virtual bool read_remote_chunk(const char *VolumeName, uint32_t chunk,
+                                  char *buffer, uint32_t *length) = 0;
+   virtual bool get_remote_volume_size(const char *VolumeName, uint64_t *size) = 0;
+   virtual bool truncate_remote_volume(const char *VolumeName) = 0;
+
+public:
+   chunked_device();
+   virtual ~chunked_device();
+
+   void chunk_io_thread();
+
+   /*
+    * Interface from DEVICE
+    */
+   int d_close(int fd);
+   ssize_t d_read(int fd, void *buffer, size_t count);
+   ssize_t d_write(int fd, const void *buffer, size_t count);
+   boffset_t d_lseek(DCR *dcr, boffset_t offset, int whence);
+   bool d_truncate(DCR *dcr);
+   bool d_flush(DCR *dcr);
+};
+#endif /* CHUNKED_DEVICE_H */
@@ -25,6 +25,11 @@
 /**
  * @file
  * Object Storage API device abstraction.
+ *
+ * Each volume is stored as a directory holding one object per chunk of
+ * the volume, the objects are named after the chunk number (0000 to
+ * 9999). Uploading and reading the chunks is done by the I/O threads
+ * of the chunked device.
  */
 
 #include "bareos.h"
@@ -39,7 +44,12 @@
 enum device_option_type {
    argument_none = 0,
    argument_profile,
-   argument_bucket
+   argument_bucket,
+   argument_chunksize,
+   argument_iothreads,
+   argument_ioslots,
+   argument_readahead,
+   argument_retries
 };
 
 struct device_option {
@@ -51,6 +61,11 @@ struct device_option {
 static device_option device_options[] = {
    { "profile=", argument_profile, 8 },
    { "bucket=", argument_bucket, 7 },
+   { "chunksize=", argument_chunksize, 10 },
+   { "iothreads=", argument_iothreads, 10 },
+   { "ioslots=", argument_ioslots, 8 },
+   { "readahead=", argument_readahead, 10 },
+   { "retries=", argument_retries, 8 },
    { NULL, argument_none }
 };
 
@@ -79,31 +94,16 @@ static void object_store_logfunc(dpl_ctx_t *ctx, dpl_log_level_t level, const ch
 }
 
 /**
- * Map the droplet errno's to system ones.
+ * Drop a reference to the droplet library, the last one frees it.
  */
-static inline int droplet_errno_to_system_errno(dpl_status_t status)
+static void release_droplet()
 {
-   switch (status) {
-   case DPL_ENOENT:
-      errno = ENOENT;
-      break;
-   case DPL_EIO:
-      errno = EIO;
-      break;
-   case DPL_ENAMETOOLONG:
-      errno = ENAMETOOLONG;
-      break;
-   case DPL_EEXIST:
-      errno = EEXIST;
-      break;
-   case DPL_EPERM:
-      errno = EPERM;
-      break;
-   default:
-      break;
+   P(mutex);
+   droplet_reference_count--;
+   if (droplet_reference_count == 0) {
+      dpl_free();
    }
-
-   return -1;
+   V(mutex);
 }
 
 /**
@@ -112,29 +112,24 @@ static inline int droplet_errno_to_system_errno(dpl_status_t status)
 int object_store_device::d_open(const char *pathname, int flags, int mode)
 {
    dpl_status_t status;
-   dpl_vfile_flag_t dpl_flags;
-   dpl_option_t dpl_options;
-
-#if 1
-   Mmsg1(errmsg, _("Object Storage devices are not yet supported, please disable %s\n"), dev_name);
-   return -1;
-#endif
 
    /*
     * Initialize the droplet library when its not done previously.
     */
-   P(mutex);
-   if (droplet_reference_count == 0) {
-      status = dpl_init();
-      if (status != DPL_SUCCESS) {
-         V(mutex);
-         return -1;
-      }
+   if (!m_ctx) {
+      P(mutex);
+      if (droplet_reference_count == 0) {
+         status = dpl_init();
+         if (status != DPL_SUCCESS) {
+            V(mutex);
+            return -1;
+         }
 
-      dpl_set_log_func(object_store_logfunc);
+         dpl_set_log_func(object_store_logfunc);
+      }
       droplet_reference_count++;
+      V(mutex);
    }
-   V(mutex);
 
    if (!m_object_configstring) {
       int len;
@@ -144,7 +139,7 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
       if (!dev_options) {
          Mmsg0(errmsg, _("No device options configured\n"));
          Emsg0(M_FATAL, 0, errmsg);
-         return -1;
+         goto bail_out;
       }
 
       m_object_configstring = bstrdup(dev_options);
@@ -171,6 +166,26 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
                   m_object_bucketname = bp + device_options[i].compare_size;
                   done = true;
                   break;
+               case argument_chunksize:
+                  size_to_uint64(bp + device_options[i].compare_size, &m_chunk_size);
+                  done = true;
+                  break;
+               case argument_iothreads:
+                  m_io_threads = str_to_int32(bp + device_options[i].compare_size);
+                  done = true;
+                  break;
+               case argument_ioslots:
+                  m_io_slots = str_to_int32(bp + device_options[i].compare_size);
+                  done = true;
+                  break;
+               case argument_readahead:
+                  m_read_ahead = str_to_int32(bp + device_options[i].compare_size);
+                  done = true;
+                  break;
+               case argument_retries:
+                  m_retries = MAX(str_to_int32(bp + device_options[i].compare_size), 1);
+                  done = true;
+                  break;
                default:
                   break;
                }
@@ -206,18 +221,20 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
     */
    if (!m_ctx) {
       char *bp;
+      POOL_MEM profile(PM_FNAME);
 
       /*
-       * See if this is a path.
+       * See if this is a path, split a copy so a later open can try again.
        */
-      bp = strrchr(m_object_configstring, '/');
+      pm_strcpy(profile, m_profile);
+      bp = strrchr(profile.c_str(), '/');
       if (!bp) {
          /*
           * Only a profile name.
           */
-         m_ctx = dpl_ctx_new(NULL, m_object_configstring);
+         m_ctx = dpl_ctx_new(NULL, profile.c_str());
       } else {
-         if (bp == m_object_configstring) {
+         if (bp == profile.c_str()) {
             /*
              * Profile in root of filesystem
              */
@@ -227,7 +244,7 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
              * Profile somewhere else.
              */
             *bp++ = '\0';
-            m_ctx = dpl_ctx_new(m_object_configstring, bp);
+            m_ctx = dpl_ctx_new(profile.c_str(), bp);
          }
       }
 
@@ -236,7 +253,7 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
        */
       if (!m_ctx) {
          Mmsg1(errmsg, _("Failed to create a new context using config %s\n"), dev_options);
-         return -1;
+         goto bail_out;
       }
 
       /*
@@ -254,7 +271,9 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
       default:
          Mmsg2(errmsg, _("Failed to login for voume %s using dpl_login(): ERR=%s.\n"),
                getVolCatName(), dpl_status_str(status));
-         return -1;
+         dpl_ctx_free(m_ctx);
+         m_ctx = NULL;
+         goto bail_out;
       }
 
       /*
@@ -265,286 +284,278 @@ int object_store_device::d_open(const char *pathname, int flags, int mode)
       }
    }
 
-   /*
-    * See if we don't have a file open already.
-    */
-   if (m_vfd) {
-      dpl_close(m_vfd);
-      m_vfd = NULL;
-   }
+   return open_chunked_volume(getVolCatName(), flags);
 
+bail_out:
    /*
-    * Create some options for libdroplet.
-    *
-    * DPL_OPTION_NOALLOC - we provide the buffer to copy the data into
-    *                      no need to let the library allocate memory we
-    *                      need to free after copying the data.
+    * Without a context this device holds no reference to the library.
     */
-   memset(&dpl_options, 0, sizeof(dpl_options));
-   dpl_options.mask |= DPL_OPTION_NOALLOC;
-
-   if (flags & O_CREAT) {
-      dpl_flags = DPL_VFILE_FLAG_CREAT | DPL_VFILE_FLAG_RDWR;
-      status = dpl_open(m_ctx, /* context */
-                        getVolCatName(), /* locator */
-                        dpl_flags, /* flags */
-                        &dpl_options, /* options */
-                        NULL, /* condition */
-                        NULL, /* metadata */
-                        NULL, /* sysmd */
-                        NULL, /* query_params */
-                        NULL, /* stream_status */
-                        &m_vfd);
-   } else {
-      dpl_flags = DPL_VFILE_FLAG_RDWR;
-      status = dpl_open(m_ctx, /* context */
-                        getVolCatName(), /* locator */
-                        dpl_flags, /* flags */
-                        &dpl_options, /* options */
-                        NULL, /* condition */
-                        NULL, /* metadata */
-                        NULL, /* sysmd */
-                        NULL, /* query_params */
-                        NULL, /* stream_status */
-                        &m_vfd);
-   }
-
-   switch (status) {
-   case DPL_SUCCESS:
-      m_offset = 0;
-      return 0;
-   default:
-      Mmsg2(errmsg, _("Failed to open %s using dpl_open(): ERR=%s.\n"),
-            getVolCatName(), dpl_status_str(status));
-      m_vfd = NULL;
-      return droplet_errno_to_system_errno(status);
+   if (!m_ctx) {
+      release_droplet();
    }
+   return -1;
+}
 
-bail_out:
+int object_store_device::d_ioctl(int fd, ioctl_req_t request, char *op)
+{
    return -1;
 }
 
 /**
- * Read data from a volume using libdroplet.
+ * Store a chunk of a volume as an object using libdroplet.
  */
-ssize_t object_store_device::d_read(int fd, void *buffer, size_t count)
+bool object_store_device::flush_remote_chunk(const char *VolumeName, uint32_t chunk,
+                                             const char *buffer, uint32_t length)
 {
-   if (m_vfd) {
-      unsigned int buflen;
-      dpl_status_t status;
-
-      buflen = count;
-      status = dpl_pread(m_vfd, count, m_offset, (char **)&buffer, &buflen);
+   dpl_status_t status;
+   POOL_MEM chunk_name(PM_FNAME);
+
+   Mmsg(chunk_name, "%s/%04d", VolumeName, chunk);
+   status = dpl_fput(m_ctx, /* context */
+                     chunk_name.c_str(), /* locator */
+                     NULL, /* options */
+                     NULL, /* condition */
+                     NULL, /* range */
+                     NULL, /* metadata */
+                     NULL, /* sysmd */
+                     (char *)buffer, /* data */
+                     length); /* length */
 
-      switch (status) {
-      case DPL_SUCCESS:
-         m_offset += buflen;
-         return buflen;
-      default:
-         Mmsg2(errmsg, _("Failed to read %s using dpl_read(): ERR=%s.\n"),
-               getVolCatName(), dpl_status_str(status));
-         return droplet_errno_to_system_errno(status);
+   /*
+    * The first chunk of a volume may need the directory of the volume.
+    */
+   if (status == DPL_ENOENT) {
+      status = dpl_mkdir(m_ctx, VolumeName, NULL, NULL);
+      if (status == DPL_SUCCESS || status == DPL_EEXIST) {
+         status = dpl_fput(m_ctx, chunk_name.c_str(), NULL, NULL, NULL,
+                           NULL, NULL, (char *)buffer, length);
       }
-   } else {
-      errno = EBADF;
-      return -1;
+   }
+
+   switch (status) {
+   case DPL_SUCCESS:
+      return true;
+   default:
+      Dmsg2(100, "Failed to store %s using dpl_fput(): ERR=%s.\n",
+            chunk_name.c_str(), dpl_status_str(status));
+      return false;
    }
 }
 
 /**
- * Write data to a volume using libdroplet.
+ * Read a chunk of a volume from its object using libdroplet.
  */
-ssize_t object_store_device::d_write(int fd, const void *buffer, size_t count)
+bool object_store_device::read_remote_chunk(const char *VolumeName, uint32_t chunk,
+                                            char *buffer, uint32_t *length)
 {
-   if (m_vfd) {
-      dpl_status_t status;
+   dpl_status_t status;
+   dpl_option_t dpl_options;
+   unsigned int buflen = *length;
+   POOL_MEM chunk_name(PM_FNAME);
 
-      status = dpl_pwrite(m_vfd, (char *)buffer, count, m_offset);
-      switch (status) {
-      case DPL_SUCCESS:
-         m_offset += count;
-         return count;
-      default:
-         Mmsg2(errmsg, _("Failed to write %s using dpl_write(): ERR=%s.\n"),
-               getVolCatName(), dpl_status_str(status));
-         return droplet_errno_to_system_errno(status);
-      }
-   } else {
-      errno = EBADF;
-      return -1;
-   }
-}
+   Mmsg(chunk_name, "%s/%04d", VolumeName, chunk);
 
-int object_store_device::d_close(int fd)
-{
-   if (m_vfd) {
-      dpl_status_t status;
+   /*
+    * DPL_OPTION_NOALLOC - we provide the buffer to copy the data into
+    *                      no need to let the library allocate memory we
+    *                      need to free after copying the data.
+    */
+   memset(&dpl_options, 0, sizeof(dpl_options));
+   dpl_options.mask |= DPL_OPTION_NOALLOC;
 
-      status = dpl_close(m_vfd);
-      switch (status) {
-      case DPL_SUCCESS:
-         m_vfd = NULL;
-         return 0;
-      default:
-         m_vfd = NULL;
-         return droplet_errno_to_system_errno(status);
-      }
-   } else {
-      errno = EBADF;
-      return -1;
-   }
-}
+   status = dpl_fget(m_ctx, /* context */
+                     chunk_name.c_str(), /* locator */
+                     &dpl_options, /* options */
+                     NULL, /* condition */
+                     NULL, /* range */
+                     &buffer, /* data */
+                     &buflen, /* length */
+                     NULL, /* metadata */
+                     NULL); /* sysmd */
 
-int object_store_device::d_ioctl(int fd, ioctl_req_t request, char *op)
-{
-   return -1;
+   switch (status) {
+   case DPL_SUCCESS:
+      *length = buflen;
+      return true;
+   default:
+      Dmsg2(100, "Failed to read %s using dpl_fget(): ERR=%s.\n",
+            chunk_name.c_str(), dpl_status_str(status));
+      return false;
+   }
 }
 
 /**
- * Open a directory on the object store and find out size information for a file.
+ * Find out the size of a volume from the objects of its chunks. Returns
+ * false with errno set to ENOENT when the volume doesn't exist and to EIO
+ * when its chunks don't make up a volume written with our chunk size.
  */
-static inline size_t object_store_get_file_size(dpl_ctx_t *ctx, const char *filename)
+bool object_store_device::get_remote_volume_size(const char *VolumeName, uint64_t *size)
 {
    void *dir_hdl;
    dpl_status_t status;
    dpl_dirent_t dirent;
-   size_t filesize = -1;
+   const char *name;
+   int64_t chunk, last_chunk = -1;
+   uint64_t nr_chunks = 0, last_size = 0;
 
-   status = dpl_opendir(ctx, ".", &dir_hdl);
+   status = dpl_opendir(m_ctx, VolumeName, &dir_hdl);
    switch (status) {
    case DPL_SUCCESS:
       break;
+   case DPL_ENOENT:
+      errno = ENOENT;
+      return false;
    default:
-      return -1;
+      Mmsg2(errmsg, _("Failed to list volume %s using dpl_opendir(): ERR=%s.\n"),
+            VolumeName, dpl_status_str(status));
+      errno = EIO;
+      return false;
    }
 
    while (!dpl_eof(dir_hdl)) {
-      if (bstrcasecmp(dirent.name, filename)) {
-         filesize = dirent.size;
+      if (dpl_readdir(dir_hdl, &dirent) != DPL_SUCCESS) {
          break;
       }
+
+      /*
+       * Only the objects named after a chunk number count.
+       */
+      name = strrchr(dirent.name, '/');
+      name = (name) ? name + 1 : dirent.name;
+      if (!is_an_integer(name)) {
+         continue;
+      }
+
+      /*
+       * Only the last chunk of a volume may be shorter than the chunk size,
+       * so a chunk that doesn't fit means the volume was written with an
+       * other chunk size.
+       */
+      if ((uint64_t)dirent.size > m_chunk_size) {
+         goto bail_out;
+      }
+
+      chunk = str_to_int64(name);
+      if (chunk > last_chunk) {
+         if (last_chunk >= 0 && last_size != m_chunk_size) {
+            goto bail_out;
+         }
+         last_chunk = chunk;
+         last_size = dirent.size;
+      } else if ((uint64_t)dirent.size != m_chunk_size) {
+         goto bail_out;
+      }
+      nr_chunks++;
    }
 
    dpl_closedir(dir_hdl);
 
-   return filesize;
+   if (last_chunk < 0) {
+      errno = ENOENT;
+      return false;
+   }
+
+   if (nr_chunks != (uint64_t)last_chunk + 1) {
+      Mmsg1(errmsg, _("Volume %s is missing chunks\n"), VolumeName);
+      errno = EIO;
+      return false;
+   }
+
+   *size = (uint64_t)last_chunk * m_chunk_size + last_size;
+   return true;
+
+bail_out:
+   dpl_closedir(dir_hdl);
+   Mmsg2(errmsg, _("Chunks of volume %s don't match the chunk size of %llu bytes\n"),
+         VolumeName, m_chunk_size);
+   errno = EIO;
+   return false;
 }
 
-boffset_t object_store_device::d_lseek(DCR *dcr, boffset_t offset, int whence)
+/**
+ * Remove the objects of all chunks of a volume, libdroplet doesn't
+ * have a truncate function. The objects are listed first, a chunk
+ * missing in the middle must not leave the chunks after it behind.
+ */
+bool object_store_device::truncate_remote_volume(const char *VolumeName)
 {
-   switch (whence) {
-   case SEEK_SET:
-      m_offset = offset;
-      break;
-   case SEEK_CUR:
-      m_offset += offset;
-      break;
-   case SEEK_END: {
-      size_t filesize;
+   void *dir_hdl;
+   char *object;
+   dpl_status_t status;
+   dpl_dirent_t dirent;
+   const char *name;
+   bool retval = true;
+   POOL_MEM chunk_name(PM_FNAME);
+   alist chunk_names(10, owned_by_alist);
 
-      filesize = object_store_get_file_size(m_ctx, getVolCatName());
-      if (filesize >= 0) {
-         m_offset = filesize + offset;
-      } else {
-         return -1;
-      }
+   status = dpl_opendir(m_ctx, VolumeName, &dir_hdl);
+   switch (status) {
+   case DPL_SUCCESS:
       break;
-   }
+   case DPL_ENOENT:
+      return true;
    default:
-      return -1;
+      Mmsg2(errmsg, _("Failed to list volume %s using dpl_opendir(): ERR=%s.\n"),
+            VolumeName, dpl_status_str(status));
+      return false;
    }
 
-   return m_offset;
-}
-
-bool object_store_device::d_truncate(DCR *dcr)
-{
-   /*
-    * libdroplet doesn't have a truncate function so unlink the volume and create a new empty one.
-    */
-   if (m_vfd) {
-      dpl_status_t status;
-      dpl_vfile_flag_t dpl_flags;
-      dpl_option_t dpl_options;
-
-      status = dpl_close(m_vfd);
-      switch (status) {
-      case DPL_SUCCESS:
-         m_vfd = NULL;
+   while (!dpl_eof(dir_hdl)) {
+      if (dpl_readdir(dir_hdl, &dirent) != DPL_SUCCESS) {
          break;
-      default:
-         Mmsg2(errmsg, _("Failed to close %s using dpl_close(): ERR=%s.\n"),
-               getVolCatName(), dpl_status_str(status));
-         return false;
       }
 
-      status = dpl_unlink(m_ctx, getVolCatName());
-      switch (status) {
-      case DPL_SUCCESS:
-         break;
-      default:
-         Mmsg2(errmsg, _("Failed to unlink %s using dpl_unlink(): ERR=%s.\n"),
-               getVolCatName(), dpl_status_str(status));
-         return false;
+      name = strrchr(dirent.name, '/');
+      name = (name) ? name + 1 : dirent.name;
+      if (!is_an_integer(name)) {
+         continue;
       }
 
-      /*
-       * Create some options for libdroplet.
-       *
-       * DPL_OPTION_NOALLOC - we provide the buffer to copy the data into
-       *                      no need to let the library allocate memory we
-       *                      need to free after copying the data.
-       */
-      memset(&dpl_options, 0, sizeof(dpl_options));
-      dpl_options.mask |= DPL_OPTION_NOALLOC;
-
-      dpl_flags = DPL_VFILE_FLAG_CREAT | DPL_VFILE_FLAG_RDWR;
-      status = dpl_open(m_ctx, /* context */
-                        getVolCatName(), /* locator */
-                        dpl_flags, /* flags */
-                        &dpl_options, /* options */
-                        NULL, /* condition */
-                        NULL, /* metadata */
-                        NULL, /* sysmd */
-                        NULL, /* query_params */
-                        NULL, /* stream_status */
-                        &m_vfd);
+      Mmsg(chunk_name, "%s/%s", VolumeName, name);
+      chunk_names.append(bstrdup(chunk_name.c_str()));
+   }
+
+   dpl_closedir(dir_hdl);
 
+   foreach_alist(object, &chunk_names) {
+      status = dpl_unlink(m_ctx, object);
       switch (status) {
       case DPL_SUCCESS:
+      case DPL_ENOENT:
          break;
       default:
-         Mmsg2(errmsg, _("Failed to open %s using dpl_open(): ERR=%s.\n"),
-               getVolCatName(), dpl_status_str(status));
-         return false;
+         Mmsg2(errmsg, _("Failed to unlink %s using dpl_unlink(): ERR=%s.\n"),
+               object, dpl_status_str(status));
+         retval = false;
+         break;
       }
    }
 
-   return true;
+   return retval;
 }
 
 object_store_device::~object_store_device()
 {
+   /*
+    * The I/O threads use the context.
+    */
+   stop_io_threads();
+
    if (m_ctx) {
       dpl_ctx_free(m_ctx);
       m_ctx = NULL;
+      release_droplet();
    }
 
    if (m_object_configstring) {
       free(m_object_configstring);
    }
-
-   P(mutex);
-   droplet_reference_count--;
-   if (droplet_reference_count == 0) {
-      dpl_free();
-   }
-   V(mutex);
 }
 
 object_store_device::object_store_device()
 {
    m_object_configstring = NULL;
+   m_profile = NULL;
    m_object_bucketname = NULL;
    m_ctx = NULL;
 }
@@ -31,14 +31,27 @@
 #include <droplet.h>
 #include <droplet/vfs.h>
 
-class object_store_device: public DEVICE {
+#include "chunked_device.h"
+
+/**
+ * Each volume is stored as a directory with one object per chunk.
+ */
+class object_store_device: public chunked_device {
 private:
    char *m_object_configstring;
    char *m_profile;
    char *m_object_bucketname;
    dpl_ctx_t *m_ctx;
-   dpl_vfile_t *m_vfd;
-   boffset_t m_offset;
+
+   /*
+    * Interface to the chunked device
+    */
+   bool flush_remote_chunk(const char *VolumeName, uint32_t chunk,
+                           const char *buffer, uint32_t length);
+   bool read_remote_chunk(const char *VolumeName, uint32_t chunk,
+                          char *buffer, uint32_t *length);
+   bool get_remote_volume_size(const char *VolumeName, uint64_t *size);
+   bool truncate_remote_volume(const char *VolumeName);
 
 public:
    object_store_device();
@@ -47,12 +60,7 @@ public:
    /*
     * Interface from DEVICE
     */
-   int d_close(int);
    int d_open(const char *pathname, int flags, int mode);
    int d_ioctl(int fd, ioctl_req_t request, char *mt = NULL);
-   boffset_t d_lseek(DCR *dcr, boffset_t offset, int whence);
-   ssize_t d_read(int fd, void *buffer, size_t count);
-   ssize_t d_write(int fd, const void *buffer, size_t count);
-   bool d_truncate(DCR *dcr);
 };
 #endif /* OBJECTSTORE_DEVICE_H */
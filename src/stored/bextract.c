@@ -551,13 +551,23 @@ static bool record_cb(DCR *dcr, DEV_RECORD *rec)
    case STREAM_FILE_DATA:
    case STREAM_SPARSE_DATA:
    case STREAM_WIN32_DATA:
+   case STREAM_DEDUP_DATA:
 
       if (extract) {
-         if (rec->maskedStream == STREAM_SPARSE_DATA) {
+         if (rec->maskedStream == STREAM_SPARSE_DATA ||
+             rec->maskedStream == STREAM_DEDUP_DATA) {
             ser_declare;
             uint64_t faddr;
             wbuf = rec->data + OFFSET_FADDR_SIZE;
             wsize = rec->data_len - OFFSET_FADDR_SIZE;
+            if (rec->maskedStream == STREAM_DEDUP_DATA) {
+               /*
+                * Chunk references are expanded when the record is read,
+                * so the record holds the chunk data after its header.
+                */
+               wbuf = rec->data + DEDUP_CHUNK_HDR_SIZE;
+               wsize = rec->data_len - DEDUP_CHUNK_HDR_SIZE;
+            }
             ser_begin(rec->data, OFFSET_FADDR_SIZE);
             unser_uint64(faddr);
             if (fileAddr != faddr) {
@@ -23,6 +23,7 @@
 /*
  * Kern Sibbald, March MMI
  * added BB02 format October MMII
+ * added BB03 format (CRC32C checksums) October MMXVII
  */
 /**
  @file
@@ -46,10 +47,24 @@ static const bool no_tape_write_test = false;
 
 static bool terminate_writing_volume(DCR *dcr);
 static bool do_new_file_bookkeeping(DCR *dcr);
+static bool handle_block_write_error(DCR *dcr, ssize_t status, uint32_t wlen);
 static void reread_last_block(DCR *dcr);
 
 bool forge_on = false;                /* proceed inspite of I/O errors */
 
+/**
+ * Checksum a whole block except for the checksum itself using
+ * the checksum algorithm of the given block version.
+ */
+static inline uint32_t block_checksum(int BlockVer, char *buf, uint32_t block_len)
+{
+   if (BlockVer >= 3) {
+      return bcrc32c((uint8_t *)buf + BLKHDR_CS_LENGTH, block_len - BLKHDR_CS_LENGTH);
+   } else {
+      return bcrc32((uint8_t *)buf + BLKHDR_CS_LENGTH, block_len - BLKHDR_CS_LENGTH);
+   }
+}
+
 /**
  * Dump the block header, then walk through
  * the block printing out the record headers.
@@ -75,7 +90,7 @@ void dump_block(DEV_BLOCK *b, const char *msg)
    unser_bytes(Id, BLKHDR_ID_LENGTH);
    ASSERT(unser_length(b->buf) == BLKHDR1_LENGTH);
    Id[BLKHDR_ID_LENGTH] = 0;
-   if (Id[3] == '2') {
+   if (Id[3] == '2' || Id[3] == '3') {
       unser_uint32(VolSessionId);
       unser_uint32(VolSessionTime);
       bhl = BLKHDR2_LENGTH;
@@ -91,8 +106,7 @@ void dump_block(DEV_BLOCK *b, const char *msg)
       return;
    }
 
-   BlockCheckSum = bcrc32((uint8_t *)b->buf+BLKHDR_CS_LENGTH,
-                         block_len-BLKHDR_CS_LENGTH);
+   BlockCheckSum = block_checksum((Id[3] == '3') ? 3 : 2, b->buf, block_len);
    Pmsg6(000, _("Dump block %s %x: size=%d BlkNum=%d\n"
                 "               Hdrcksum=%x cksum=%x\n"),
       msg, b, block_len, BlockNumber, CheckSum, BlockCheckSum);
@@ -195,31 +209,30 @@ void empty_block(DEV_BLOCK *block)
 /**
  * Create block header just before write. The space
  * in the buffer should have already been reserved by
- * init_block.
+ * init_block. The block version written is the one
+ * configured for the device.
  */
-static uint32_t ser_block_header(DEV_BLOCK *block, bool do_checksum)
+static uint32_t ser_block_header(DEV_BLOCK *block, DEVICE *dev)
 {
    ser_declare;
    uint32_t CheckSum = 0;
    uint32_t block_len = block->binbuf;
 
    Dmsg1(1390, "ser_block_header: block_len=%d\n", block_len);
+   block->BlockVer = dev->block_version;
    ser_begin(block->buf, BLKHDR2_LENGTH);
    ser_uint32(CheckSum);
    ser_uint32(block_len);
    ser_uint32(block->BlockNumber);
-   ser_bytes(WRITE_BLKHDR_ID, BLKHDR_ID_LENGTH);
-   if (BLOCK_VER >= 2) {
-      ser_uint32(block->VolSessionId);
-      ser_uint32(block->VolSessionTime);
-   }
+   ser_bytes((block->BlockVer >= 3) ? BLKHDR3_ID : BLKHDR2_ID, BLKHDR_ID_LENGTH);
+   ser_uint32(block->VolSessionId);
+   ser_uint32(block->VolSessionTime);
 
    /*
     * Checksum whole block except for the checksum
     */
-   if (do_checksum) {
-      CheckSum = bcrc32((uint8_t *)block->buf+BLKHDR_CS_LENGTH,
-                    block_len-BLKHDR_CS_LENGTH);
+   if (dev->do_checksum()) {
+      CheckSum = block_checksum(block->BlockVer, block->buf, block_len);
    }
    Dmsg1(1390, "ser_bloc_header: checksum=%x\n", CheckSum);
    ser_begin(block->buf, BLKHDR2_LENGTH);
@@ -282,6 +295,22 @@ static inline bool unser_block_header(JCR *jcr, DEVICE *dev, DEV_BLOCK *block)
          block->read_errors++;
          return false;
       }
+   } else if (Id[3] == '3') {
+      unser_uint32(block->VolSessionId);
+      unser_uint32(block->VolSessionTime);
+      bhl = BLKHDR3_LENGTH;
+      block->BlockVer = 3;
+      block->bufp = block->buf + bhl;
+      if (!bstrncmp(Id, BLKHDR3_ID, BLKHDR_ID_LENGTH)) {
+         dev->dev_errno = EIO;
+         Mmsg4(dev->errmsg, _("Volume data error at %u:%u! Wanted ID: \"%s\", got \"%s\". Buffer discarded.\n"),
+            dev->file, dev->block_num, BLKHDR3_ID, Id);
+         if (block->read_errors == 0 || verbose >= 2) {
+            Jmsg(jcr, M_ERROR, 0, "%s", dev->errmsg);
+         }
+         block->read_errors++;
+         return false;
+      }
    } else {
       dev->dev_errno = EIO;
       Mmsg4(dev->errmsg, _("Volume data error at %u:%u! Wanted ID: \"%s\", got \"%s\". Buffer discarded.\n"),
@@ -325,8 +354,7 @@ static inline bool unser_block_header(JCR *jcr, DEVICE *dev, DEV_BLOCK *block)
    Dmsg3(390, "Read binbuf = %d %d block_len=%d\n", block->binbuf,
       bhl, block_len);
    if (block_len <= block->read_len && dev->do_checksum()) {
-      BlockCheckSum = bcrc32((uint8_t *)block->buf+BLKHDR_CS_LENGTH,
-                         block_len-BLKHDR_CS_LENGTH);
+      BlockCheckSum = block_checksum(block->BlockVer, block->buf, block_len);
       if (BlockCheckSum != CheckSum) {
          dev->dev_errno = EIO;
          Mmsg6(dev->errmsg, _("Volume data error at %u:%u!\n"
@@ -347,27 +375,53 @@ static inline bool unser_block_header(JCR *jcr, DEVICE *dev, DEV_BLOCK *block)
 }
 
 /**
- * Write a block to the device, with locking and unlocking
+ * Check if a block can be handed to the writer thread of the device.
+ * This is done for disk volumes while a single job writes to the
+ * device. The writer thread is created on first use.
+ */
+static bool use_async_write(DCR *dcr)
+{
+   DEVICE *dev = dcr->dev;
+
+   if (no_tape_write_test || debug_block_checksum ||
+       dev->async_write_blocks == 0 || !dev->is_file() || dev->num_writers != 1) {
+      return false;
+   }
+
+   if (!dev->writer) {
+      dev->writer = new_async_writer(dev, dev->async_write_blocks);
+      if (!dev->writer) {
+         dev->async_write_blocks = 0; /* don't try again */
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/**
+ * Write a block to the device, the device must be locked.
+ * When async is set the block may be handed to the writer thread.
  *
  * Returns: true  on success
  *        : false on failure
- *
  */
-bool DCR::write_block_to_device()
+static bool do_write_block(DCR *dcr, bool async)
 {
-   bool status = true;
-   DCR *dcr = this;
+   DEVICE *dev = dcr->dev;
+   JCR *jcr = dcr->jcr;
 
-   if (dcr->spooling) {
-      status = write_block_to_spool_file(dcr);
-      return status;
+   if (async) {
+      async = use_async_write(dcr);
    }
 
-   if (!dcr->is_dev_locked()) {        /* device already locked? */
-      /*
-       * Note, do not change this to dcr->r_dlock
-       */
-      dev->rLock();                  /* no, lock it */
+   /*
+    * Wait for room in the ring of the writer thread. Before a JobMedia
+    * record is created or the block is written directly, all blocks
+    * queued must be written.
+    */
+   if (dev->writer && !wait_async_writes(dcr, !async || dcr->NewVol || dcr->NewFile)) {
+      return false;
    }
 
    /*
@@ -379,9 +433,8 @@ bool DCR::write_block_to_device()
     */
    if (dcr->NewVol || dcr->NewFile) {
       if (job_canceled(jcr)) {
-         status = false;
          Dmsg0(100, "Canceled\n");
-         goto bail_out;
+         return false;
       }
       /* Create a jobmedia record for this job */
       if (!dcr->dir_create_jobmedia_record(false)) {
@@ -389,9 +442,8 @@ bool DCR::write_block_to_device()
          Jmsg2(jcr, M_FATAL, 0, _("Could not create JobMedia record for Volume=\"%s\" Job=%s\n"),
             dcr->getVolCatName(), jcr->Job);
          set_new_volume_parameters(dcr);
-         status = false;
          Dmsg0(100, "cannot create media record\n");
-         goto bail_out;
+         return false;
       }
       if (dcr->NewVol) {
          /*
@@ -403,15 +455,43 @@ bool DCR::write_block_to_device()
       }
    }
 
-   if (!dcr->write_block_to_dev()) {
+   if (!dcr->write_block_to_dev(async)) {
        if (job_canceled(jcr) || jcr->is_JobType(JT_SYSTEM)) {
-          status = false;
+          return false;
        } else {
-          status = fixup_device_block_write_error(dcr);
+          return fixup_device_block_write_error(dcr);
        }
    }
 
-bail_out:
+   return true;
+}
+
+/**
+ * Write a block to the device, with locking and unlocking
+ *
+ * Returns: true  on success
+ *        : false on failure
+ *
+ */
+bool DCR::write_block_to_device()
+{
+   bool status = true;
+   DCR *dcr = this;
+
+   if (dcr->spooling) {
+      status = write_block_to_spool_file(dcr);
+      return status;
+   }
+
+   if (!dcr->is_dev_locked()) {        /* device already locked? */
+      /*
+       * Note, do not change this to dcr->r_dlock
+       */
+      dev->rLock();                  /* no, lock it */
+   }
+
+   status = do_write_block(dcr, true);
+
    if (!dcr->is_dev_locked()) {        /* did we lock dev above? */
       /*
        * Note, do not change this to dcr->dunlock
@@ -422,17 +502,329 @@ bail_out:
 }
 
 /**
- * Write a block to the device
+ * Save the positions before a block is handed to the writer thread.
+ */
+static void save_write_positions(DCR *dcr, async_write_slot *slot)
+{
+   DEVICE *dev = dcr->dev;
+
+   slot->VolCatBytes = dev->VolCatInfo.VolCatBytes;
+   slot->VolCatBlocks = dev->VolCatInfo.VolCatBlocks;
+   slot->block_num = dev->block_num;
+   slot->file = dev->file;
+   slot->file_addr = dev->file_addr;
+   slot->file_size = dev->file_size;
+   slot->EndBlock = dev->EndBlock;
+   slot->EndFile = dev->EndFile;
+   slot->LastBlock = dev->LastBlock;
+
+   slot->dcr_EndBlock = dcr->EndBlock;
+   slot->dcr_EndFile = dcr->EndFile;
+   slot->VolMediaId = dcr->VolMediaId;
+   slot->VolFirstIndex = dcr->VolFirstIndex;
+   slot->VolLastIndex = dcr->VolLastIndex;
+   slot->WroteVol = dcr->WroteVol;
+}
+
+/**
+ * Roll back to the positions before a block the writer thread failed to write.
+ */
+static void restore_write_positions(DCR *dcr, async_write_slot *slot)
+{
+   DEVICE *dev = dcr->dev;
+
+   dev->VolCatInfo.VolCatBytes = slot->VolCatBytes;
+   dev->VolCatInfo.VolCatBlocks = slot->VolCatBlocks;
+   dev->block_num = slot->block_num;
+   dev->file = slot->file;
+   dev->file_addr = slot->file_addr;
+   dev->file_size = slot->file_size;
+   dev->EndBlock = slot->EndBlock;
+   dev->EndFile = slot->EndFile;
+   dev->LastBlock = slot->LastBlock;
+
+   dcr->EndBlock = slot->dcr_EndBlock;
+   dcr->EndFile = slot->dcr_EndFile;
+   dcr->VolMediaId = slot->VolMediaId;
+   dcr->VolFirstIndex = slot->VolFirstIndex;
+   dcr->VolLastIndex = slot->VolLastIndex;
+   dcr->WroteVol = slot->WroteVol;
+}
+
+/**
+ * Wait for the writer thread of the device until there is room for
+ * another block or, when all is set, until all queued blocks are
+ * written. The device must be locked.
+ *
+ * When a write failed, the positions are rolled back to the ones
+ * before the failed block and the error is handled as it is for a
+ * synchronous write: the volume is terminated, and the failed block
+ * and the ones queued after it are written to the next volume.
+ *
+ * Returns: true  on success
+ *          false on hard error
+ */
+bool wait_async_writes(DCR *dcr, bool all)
+{
+   DEVICE *dev = dcr->dev;
+   JCR *jcr = dcr->jcr;
+   async_writer *aw = dev->writer;
+   async_write_slot *slot;
+   DEV_BLOCK *block;
+   bool ok = true;
+
+   if (!aw || aw->replaying) {
+      return true;
+   }
+
+   if (wait_async_writer(aw, all)) {
+      return true;
+   }
+
+   /*
+    * Only the job that queued the blocks can mount the next volume,
+    * any other job waits until it has done so.
+    */
+   if (aw->owner != dcr) {
+      while (!wait_async_writer(aw, all)) {
+         if (job_canceled(jcr)) {
+            return false;
+         }
+         dev->Unlock();
+         bmicrosleep(1, 0);
+         dev->Lock();
+      }
+      return true;
+   }
+
+   /*
+    * The writer thread has stopped, so the ring is ours until it is cleared.
+    */
+   Dmsg2(100, "Rewriting %d queued blocks after write error on device %s\n",
+         aw->nr_queued, dev->print_name());
+   aw->replaying = true;
+   block = dcr->block;
+   for (int i = 0; ok && i < aw->nr_queued; i++) {
+      slot = &aw->slots[(aw->head + i) % aw->nr_slots];
+      dcr->block = slot->block;
+      if (i == 0) {
+         restore_write_positions(dcr, slot);
+         errno = slot->saved_errno;
+         handle_block_write_error(dcr, slot->status, slot->wlen);
+         if (job_canceled(jcr) || jcr->is_JobType(JT_SYSTEM)) {
+            ok = false;
+         } else {
+            ok = fixup_device_block_write_error(dcr);
+         }
+      } else {
+         ok = do_write_block(dcr, false);
+      }
+      block->BlockNumber = dcr->block->BlockNumber;
+   }
+   dcr->block = block;
+   clear_async_writer(aw);
+   aw->replaying = false;
+
+   return ok;
+}
+
+/**
+ * Write the first wlen bytes of the block buffer, make a somewhat feeble
+ * attempt to recover from I/O errors, or from the OS telling us it is busy.
+ * This is also called by the writer thread of the device.
+ */
+ssize_t write_block_buffer(DEVICE *dev, DEV_BLOCK *block, uint32_t wlen)
+{
+   int retry = 0;
+   ssize_t status = 0;
+
+   errno = 0;
+   do {
+      if (retry > 0 && status == -1 && errno == EBUSY) {
+         berrno be;
+         Dmsg4(100, "===== write retry=%d status=%d errno=%d: ERR=%s\n",
+               retry, status, errno, be.bstrerror());
+         bmicrosleep(5, 0);    /* pause a bit if busy or lots of errors */
+         dev->clrerror(-1);
+      }
+      status = dev->write(block->buf, (size_t)wlen);
+
+   } while (status == -1 && (errno == EBUSY || errno == EIO) && retry++ < 3);
+
+   return status;
+}
+
+/**
+ * Hand the block to the writer thread. The block gets the empty buffer
+ * of the ring slot to continue with.
+ */
+static void queue_block_write(DCR *dcr, uint32_t wlen)
+{
+   DEVICE *dev = dcr->dev;
+   DEV_BLOCK *block = dcr->block;
+   async_write_slot *slot = get_async_write_slot(dev->writer);
+   POOLMEM *buf;
+
+   save_write_positions(dcr, slot);
+
+   buf = check_pool_memory_size(slot->block->buf, block->buf_len);
+   memcpy(slot->block, block, sizeof(DEV_BLOCK));
+   block->buf = buf;
+   block->bufp = buf + (block->bufp - slot->block->buf);
+   slot->wlen = wlen;
+
+   queue_async_write(dev->writer, dcr);
+}
+
+/**
+ * Handle a failed write of a block, which in most cases is the end of
+ * the volume.
+ *
+ * Returns: false, after terminating the volume
+ */
+static bool handle_block_write_error(DCR *dcr, ssize_t status, uint32_t wlen)
+{
+   DEVICE *dev = dcr->dev;
+   JCR *jcr = dcr->jcr;
+   DEV_BLOCK *block = dcr->block;
+   bool ok;
+
+   /*
+    * Some devices simply report EIO when the volume is full.
+    * With a little more thought we may be able to check
+    * capacity and distinguish real errors and EOT
+    * conditions.  In any case, we probably want to
+    * simulate an End of Medium.
+    */
+   if (status == -1) {
+      berrno be;
+      dev->clrerror(-1);
+      if (dev->dev_errno == 0) {
+         dev->dev_errno = ENOSPC;        /* out of space */
+      }
+      if (dev->dev_errno != ENOSPC) {
+         dev->VolCatInfo.VolCatErrors++;
+         Jmsg4(jcr, M_ERROR, 0, _("Write error at %u:%u on device %s. ERR=%s.\n"),
+               dev->file, dev->block_num, dev->print_name(), be.bstrerror());
+      }
+   } else {
+     dev->dev_errno = ENOSPC;            /* out of space */
+   }
+
+   if (dev->dev_errno == ENOSPC) {
+      Jmsg(jcr, M_INFO, 0, _("End of Volume \"%s\" at %u:%u on device %s. Write of %u bytes got %d.\n"),
+           dev->getVolCatName(), dev->file, dev->block_num, dev->print_name(), wlen, status);
+   } else {
+      berrno be;
+
+      be.set_errno(dev->dev_errno);
+      Mmsg5(dev->errmsg, _("Write error on fd=%d at file:blk %u:%u on device %s. ERR=%s.\n"),
+            dev->fd(), dev->file, dev->block_num, dev->print_name(), be.bstrerror());
+   }
+
+   generate_plugin_event(jcr, bsdEventWriteError, dcr);
+
+   if (dev->dev_errno != ENOSPC) {
+      Jmsg(jcr, M_ERROR, 0, "%s", dev->errmsg);
+   }
+
+   if (debug_level >= 100) {
+      berrno be;
+
+      be.set_errno(dev->dev_errno);
+      Dmsg7(100, "=== Write error. fd=%d size=%u rtn=%d dev_blk=%d blk_blk=%d errno=%d: ERR=%s\n",
+            dev->fd(), wlen, status, dev->block_num, block->BlockNumber, dev->dev_errno,
+            be.bstrerror(dev->dev_errno));
+   }
+
+   ok = terminate_writing_volume(dcr);
+   if (!ok && !forge_on) {
+      return false;
+   }
+   if (ok) {
+      reread_last_block(dcr);
+   }
+   return false;
+}
+
+/**
+ * We successfully wrote the block (or handed it to the writer thread),
+ * now do housekeeping
+ */
+static void finish_block_write(DCR *dcr, uint32_t wlen)
+{
+   DEVICE *dev = dcr->dev;
+   DEV_BLOCK *block = dcr->block;
+
+   Dmsg2(1300, "VolCatBytes=%d newVolCatBytes=%d\n",
+         (int)dev->VolCatInfo.VolCatBytes, (int)(dev->VolCatInfo.VolCatBytes+wlen));
+   dev->VolCatInfo.VolCatBytes += wlen;
+   dev->VolCatInfo.VolCatBlocks++;
+   dev->EndBlock = dev->block_num;
+   dev->EndFile  = dev->file;
+   dev->LastBlock = block->BlockNumber;
+   block->BlockNumber++;
+
+   /*
+    * Update dcr values
+    */
+   if (dev->is_tape()) {
+      dcr->EndBlock = dev->EndBlock;
+      dcr->EndFile  = dev->EndFile;
+      dev->block_num++;
+   } else {
+      /*
+       * Save address of block just written
+       */
+      uint64_t addr = dev->file_addr + wlen - 1;
+      dcr->EndBlock = (uint32_t)addr;
+      dcr->EndFile = (uint32_t)(addr >> 32);
+      dev->block_num = dcr->EndBlock;
+      dev->file = dcr->EndFile;
+   }
+   dcr->VolMediaId = dev->VolCatInfo.VolMediaId;
+   if (dcr->VolFirstIndex == 0 && block->FirstIndex > 0) {
+      dcr->VolFirstIndex = block->FirstIndex;
+   }
+   if (block->LastIndex > 0) {
+      dcr->VolLastIndex = block->LastIndex;
+   }
+   dcr->WroteVol = true;
+   update_block_index(dcr, wlen);
+   dev->file_addr += wlen;            /* update file address */
+   dev->file_size += wlen;
+
+   Dmsg2(1300, "write_block: wrote block %d bytes=%d\n", dev->block_num, wlen);
+   empty_block(block);
+}
+
+/**
+ * Check if writing the block reaches the maximum size of the volume or of
+ * a file on the volume.
+ */
+static inline bool write_limit_reached(DEVICE *dev, DEV_BLOCK *block)
+{
+   return (dev->max_volume_size > 0 &&
+           (dev->VolCatInfo.VolCatBytes + block->binbuf) >= dev->max_volume_size) ||
+          (dev->VolCatInfo.VolCatMaxBytes > 0 &&
+           (dev->VolCatInfo.VolCatBytes + block->binbuf) >= dev->VolCatInfo.VolCatMaxBytes) ||
+          (dev->max_file_size > 0 &&
+           (dev->file_size + block->binbuf) >= dev->max_file_size);
+}
+
+/**
+ * Write a block to the device. When async is set the block is handed
+ * to the writer thread of the device and the bookkeeping is done as if
+ * it was written.
  *
  * Returns: true  on success or EOT
  *          false on hard error
  */
-bool DCR::write_block_to_dev()
+bool DCR::write_block_to_dev(bool async)
 {
    ssize_t status = 0;
    uint32_t wlen;                     /* length to write */
    int hit_max1, hit_max2;
-   bool ok = true;
    DCR *dcr = this;
    uint32_t checksum;
 
@@ -444,6 +836,14 @@ bool DCR::write_block_to_dev()
       return false;
    }
 
+   /*
+    * A block written directly must not overtake the ones queued
+    * to the writer thread.
+    */
+   if (!async && dev->writer && !wait_async_writes(dcr, true)) {
+      return false;
+   }
+
    ASSERT(block->binbuf == ((uint32_t) (block->bufp - block->buf)));
 
    wlen = block->binbuf;
@@ -513,7 +913,15 @@ bool DCR::write_block_to_dev()
    Dmsg4(400, "writing block of size %d to dev=%s with max_block_size %d and min_block_size %d\n",
          wlen, dev->print_name(), dev->max_block_size, dev->min_block_size);
 
-   checksum = ser_block_header(block, dev->do_checksum());
+   /*
+    * When the volume or the file on it gets full, all blocks queued
+    * to the writer thread must be on the volume first.
+    */
+   if (async && write_limit_reached(dev, block) && !wait_async_writes(dcr, true)) {
+      return false;
+   }
+
+   checksum = ser_block_header(block, dev);
 
    /*
     * Limit maximum Volume size to value specified by user
@@ -578,27 +986,19 @@ bool DCR::write_block_to_dev()
    }
 #endif
 
-   /*
-    * Do write here, make a somewhat feeble attempt to recover from
-    *  I/O errors, or from the OS telling us it is busy.
-    */
-   int retry = 0;
-   errno = 0;
-   status = 0;
-   do {
-      if (retry > 0 && status == -1 && errno == EBUSY) {
-         berrno be;
-         Dmsg4(100, "===== write retry=%d status=%d errno=%d: ERR=%s\n",
-               retry, status, errno, be.bstrerror());
-         bmicrosleep(5, 0);    /* pause a bit if busy or lots of errors */
-         dev->clrerror(-1);
-      }
-      status = dev->write(block->buf, (size_t)wlen);
+   if (async) {
+      /*
+       * A failed write is handled by wait_async_writes().
+       */
+      queue_block_write(dcr, wlen);
+      finish_block_write(dcr, wlen);
+      return true;
+   }
 
-   } while (status == -1 && (errno == EBUSY || errno == EIO) && retry++ < 3);
+   status = write_block_buffer(dev, block, wlen);
 
    if (debug_block_checksum) {
-      uint32_t achecksum = ser_block_header(block, dev->do_checksum());
+      uint32_t achecksum = ser_block_header(block, dev);
       if (checksum != achecksum) {
          Jmsg2(jcr, M_ERROR, 0, _("Block checksum changed during write: before=%ud after=%ud\n"),
             checksum, achecksum);
@@ -613,106 +1013,10 @@ bool DCR::write_block_to_dev()
 #endif
 
    if (status != (ssize_t)wlen) {
-      /*
-       * Some devices simply report EIO when the volume is full.
-       * With a little more thought we may be able to check
-       * capacity and distinguish real errors and EOT
-       * conditions.  In any case, we probably want to
-       * simulate an End of Medium.
-       */
-      if (status == -1) {
-         berrno be;
-         dev->clrerror(-1);
-         if (dev->dev_errno == 0) {
-            dev->dev_errno = ENOSPC;        /* out of space */
-         }
-         if (dev->dev_errno != ENOSPC) {
-            dev->VolCatInfo.VolCatErrors++;
-            Jmsg4(jcr, M_ERROR, 0, _("Write error at %u:%u on device %s. ERR=%s.\n"),
-                  dev->file, dev->block_num, dev->print_name(), be.bstrerror());
-         }
-      } else {
-        dev->dev_errno = ENOSPC;            /* out of space */
-      }
-
-      if (dev->dev_errno == ENOSPC) {
-         Jmsg(jcr, M_INFO, 0, _("End of Volume \"%s\" at %u:%u on device %s. Write of %u bytes got %d.\n"),
-              dev->getVolCatName(), dev->file, dev->block_num, dev->print_name(), wlen, status);
-      } else {
-         berrno be;
-
-         be.set_errno(dev->dev_errno);
-         Mmsg5(dev->errmsg, _("Write error on fd=%d at file:blk %u:%u on device %s. ERR=%s.\n"),
-               dev->fd(), dev->file, dev->block_num, dev->print_name(), be.bstrerror());
-      }
-
-      generate_plugin_event(jcr, bsdEventWriteError, dcr);
-
-      if (dev->dev_errno != ENOSPC) {
-         Jmsg(jcr, M_ERROR, 0, "%s", dev->errmsg);
-      }
-
-      if (debug_level >= 100) {
-         berrno be;
-
-         be.set_errno(dev->dev_errno);
-         Dmsg7(100, "=== Write error. fd=%d size=%u rtn=%d dev_blk=%d blk_blk=%d errno=%d: ERR=%s\n",
-               dev->fd(), wlen, status, dev->block_num, block->BlockNumber, dev->dev_errno,
-               be.bstrerror(dev->dev_errno));
-      }
-
-      ok = terminate_writing_volume(dcr);
-      if (!ok && !forge_on) {
-         return false;
-      }
-      if (ok) {
-         reread_last_block(dcr);
-      }
-      return false;
-   }
-
-   /*
-    * We successfully wrote the block, now do housekeeping
-    */
-   Dmsg2(1300, "VolCatBytes=%d newVolCatBytes=%d\n",
-         (int)dev->VolCatInfo.VolCatBytes, (int)(dev->VolCatInfo.VolCatBytes+wlen));
-   dev->VolCatInfo.VolCatBytes += wlen;
-   dev->VolCatInfo.VolCatBlocks++;
-   dev->EndBlock = dev->block_num;
-   dev->EndFile  = dev->file;
-   dev->LastBlock = block->BlockNumber;
-   block->BlockNumber++;
-
-   /*
-    * Update dcr values
-    */
-   if (dev->is_tape()) {
-      dcr->EndBlock = dev->EndBlock;
-      dcr->EndFile  = dev->EndFile;
-      dev->block_num++;
-   } else {
-      /*
-       * Save address of block just written
-       */
-      uint64_t addr = dev->file_addr + wlen - 1;
-      dcr->EndBlock = (uint32_t)addr;
-      dcr->EndFile = (uint32_t)(addr >> 32);
-      dev->block_num = dcr->EndBlock;
-      dev->file = dcr->EndFile;
-   }
-   dcr->VolMediaId = dev->VolCatInfo.VolMediaId;
-   if (dcr->VolFirstIndex == 0 && block->FirstIndex > 0) {
-      dcr->VolFirstIndex = block->FirstIndex;
-   }
-   if (block->LastIndex > 0) {
-      dcr->VolLastIndex = block->LastIndex;
+      return handle_block_write_error(dcr, status, wlen);
    }
-   dcr->WroteVol = true;
-   dev->file_addr += wlen;            /* update file address */
-   dev->file_size += wlen;
 
-   Dmsg2(1300, "write_block: wrote block %d bytes=%d\n", dev->block_num, wlen);
-   empty_block(block);
+   finish_block_write(dcr, wlen);
    return true;
 }
 
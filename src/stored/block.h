@@ -37,14 +37,16 @@
 /* Block Header definitions. */
 #define BLKHDR1_ID                       "BB01"
 #define BLKHDR2_ID                       "BB02"
+#define BLKHDR3_ID                       "BB03"
 #define BLKHDR_ID_LENGTH                  4
 #define BLKHDR_CS_LENGTH                  4     /**< checksum length */
 #define BLKHDR1_LENGTH                   16     /**< Total length */
 #define BLKHDR2_LENGTH                   24     /**< Total length */
+#define BLKHDR3_LENGTH                   24     /**< Total length */
 
-#define WRITE_BLKHDR_ID     BLKHDR2_ID
-#define WRITE_BLKHDR_LENGTH BLKHDR2_LENGTH
-#define BLOCK_VER                        2
+#define WRITE_BLKHDR_LENGTH BLKHDR2_LENGTH      /**< BB02 and BB03 headers have the same length */
+#define BLOCK_VER                        2      /**< Default write version */
+#define MAX_BLOCK_VER                    3      /**< Highest version that can be written */
 
 /* Record header definitions */
 #define RECHDR1_LENGTH                   20
@@ -69,10 +71,13 @@
    uint32_t BlockNumber;
    char     Id[BLKHDR_ID_LENGTH];
 
- * for BB02 block, we also have
+ * for BB02 and BB03 blocks, we also have
 
    uint32_t VolSessionId;
    uint32_t VolSessionTime;
+
+ * BB01 and BB02 blocks use the PNG CRC32 (bcrc32) as CheckSum,
+ * BB03 blocks use CRC32C (bcrc32c) which most CPUs compute in hardware.
  */
 
 class DEVICE;                         /* for forward reference */
@@ -101,7 +106,7 @@ struct DEV_BLOCK {
    uint32_t VolSessionId;             /* */
    uint32_t VolSessionTime;           /* */
    uint32_t read_errors;              /* block errors (checksum, header, ...) */
-   int      BlockVer;                 /* block version 1 or 2 */
+   int      BlockVer;                 /* block version 1, 2 or 3 */
    bool     write_failed;             /* set if write failed */
    bool     block_read;               /* set when block read */
    int32_t  FirstIndex;               /* first index this block */
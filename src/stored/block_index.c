@@ -0,0 +1,423 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Block index of disk volumes.
+ *
+ * A device with "Block Index = yes" writes an index file next to each
+ * volume it writes, named like the volume with BLOCK_INDEX_EXT appended.
+ * It has one fixed size entry per block with the address and length of
+ * the block, its session and the range of FileIndexes of its records.
+ *
+ * When records are read with a bootstrap, the index is used to seek
+ * directly to the next block that can contain a wanted record instead
+ * of reading and checking all blocks in between. Any device uses the
+ * index of a volume when it finds one.
+ */
+
+#include "bareos.h"
+#include "stored.h"
+
+static const int dbglvl = 200;
+
+block_index *new_block_index()
+{
+   block_index *idx;
+
+   idx = (block_index *)malloc(sizeof(block_index));
+   memset(idx, 0, sizeof(block_index));
+   idx->fd = -1;
+
+   return idx;
+}
+
+void close_block_index(block_index *idx)
+{
+   if (idx->fd >= 0) {
+      ::close(idx->fd);
+   }
+   idx->fd = -1;
+   idx->writing = false;
+   idx->usable = false;
+   idx->VolumeName[0] = 0;
+   idx->nr_entries = 0;
+   idx->next_addr = 0;
+   idx->buf_count = 0;
+}
+
+void free_block_index(block_index *idx)
+{
+   close_block_index(idx);
+   if (idx->buf) {
+      free(idx->buf);
+   }
+   free(idx);
+}
+
+/**
+ * The index file is named like the volume file with BLOCK_INDEX_EXT appended.
+ */
+static void get_block_index_name(DEVICE *dev, POOL_MEM &fname)
+{
+   get_volume_file_name(dev, dev->getVolCatName(), fname.addr());
+   pm_strcat(fname, BLOCK_INDEX_EXT);
+}
+
+static inline uint64_t entry_offset(uint64_t nr)
+{
+   return BLOCK_INDEX_HDR_SIZE + nr * BLOCK_INDEX_ENTRY_SIZE;
+}
+
+static void unser_block_index_entry(uint8_t *buf, block_index_entry *entry)
+{
+   unser_declare;
+
+   unser_begin(buf, BLOCK_INDEX_ENTRY_SIZE);
+   unser_uint64(entry->addr);
+   unser_uint32(entry->length);
+   unser_uint32(entry->VolSessionId);
+   unser_uint32(entry->VolSessionTime);
+   unser_int32(entry->FirstIndex);
+   unser_int32(entry->LastIndex);
+}
+
+/**
+ * Read entry nr of the index, entries are read ahead in chunks of
+ * BLOCK_INDEX_BUF_ENTRIES as the index is mostly read sequentially.
+ */
+static block_index_entry *get_block_index_entry(block_index *idx, uint64_t nr)
+{
+   uint32_t count;
+   ssize_t len;
+   uint8_t *raw;
+
+   if (nr >= idx->nr_entries) {
+      return NULL;
+   }
+
+   if (idx->buf_count && nr >= idx->buf_first && nr < idx->buf_first + idx->buf_count) {
+      return &idx->buf[nr - idx->buf_first];
+   }
+
+   if (!idx->buf) {
+      idx->buf = (block_index_entry *)malloc(BLOCK_INDEX_BUF_ENTRIES * sizeof(block_index_entry));
+   }
+
+   count = (uint32_t)MIN((uint64_t)BLOCK_INDEX_BUF_ENTRIES, idx->nr_entries - nr);
+   raw = (uint8_t *)malloc(count * BLOCK_INDEX_ENTRY_SIZE);
+   len = pread(idx->fd, raw, count * BLOCK_INDEX_ENTRY_SIZE, entry_offset(nr));
+   if (len < BLOCK_INDEX_ENTRY_SIZE) {
+      free(raw);
+      idx->buf_count = 0;
+      return NULL;
+   }
+
+   idx->buf_first = nr;
+   idx->buf_count = len / BLOCK_INDEX_ENTRY_SIZE;
+   for (uint32_t i = 0; i < idx->buf_count; i++) {
+      unser_block_index_entry(raw + i * BLOCK_INDEX_ENTRY_SIZE, &idx->buf[i]);
+   }
+   free(raw);
+
+   return &idx->buf[0];
+}
+
+/**
+ * Return the number of the first entry of a block at or after addr.
+ */
+static uint64_t find_block_index_entry(block_index *idx, uint64_t addr)
+{
+   uint64_t lo, hi, mid;
+   block_index_entry *entry;
+
+   lo = 0;
+   hi = idx->nr_entries;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (!(entry = get_block_index_entry(idx, mid))) {
+         return idx->nr_entries;
+      }
+      if (entry->addr < addr) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+/**
+ * Set the number of entries and the address after the last one.
+ */
+static void set_block_index_end(block_index *idx, uint64_t nr_entries)
+{
+   block_index_entry *entry;
+
+   idx->nr_entries = nr_entries;
+   idx->buf_count = 0;
+   if (nr_entries && (entry = get_block_index_entry(idx, nr_entries - 1))) {
+      idx->next_addr = entry->addr + entry->length;
+   } else {
+      idx->nr_entries = 0;
+      idx->next_addr = 0;
+   }
+}
+
+static bool write_block_index_header(DEVICE *dev, block_index *idx)
+{
+   uint8_t buf[BLOCK_INDEX_HDR_SIZE];
+   ser_declare;
+
+   memset(buf, 0, sizeof(buf));
+   ser_begin(buf, BLOCK_INDEX_HDR_SIZE);
+   ser_bytes(BLOCK_INDEX_ID, sizeof(BLOCK_INDEX_ID));
+   ser_uint32(BLOCK_INDEX_VERSION);
+   ser_btime(dev->VolHdr.label_btime);
+   ser_bytes(dev->VolHdr.VolumeName, sizeof(dev->VolHdr.VolumeName));
+
+   if (ftruncate(idx->fd, 0) < 0 ||
+       pwrite(idx->fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) {
+      return false;
+   }
+
+   idx->label_btime = dev->VolHdr.label_btime;
+   idx->nr_entries = 0;
+   idx->next_addr = 0;
+   idx->buf_count = 0;
+
+   return true;
+}
+
+/**
+ * Check that the index was written for the label of the volume on the
+ * device, an earlier label of the same volume has another label time.
+ */
+static bool check_block_index_header(DEVICE *dev, block_index *idx)
+{
+   uint8_t buf[BLOCK_INDEX_HDR_SIZE];
+   char Id[sizeof(BLOCK_INDEX_ID)];
+   char VolumeName[MAX_NAME_LENGTH];
+   uint32_t version;
+   btime_t label_btime;
+   struct stat st;
+   unser_declare;
+
+   if (fstat(idx->fd, &st) < 0 || st.st_size < BLOCK_INDEX_HDR_SIZE) {
+      return false;
+   }
+   if (pread(idx->fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) {
+      return false;
+   }
+
+   unser_begin(buf, BLOCK_INDEX_HDR_SIZE);
+   unser_bytes(Id, sizeof(Id));
+   unser_uint32(version);
+   unser_btime(label_btime);
+   unser_bytes(VolumeName, sizeof(VolumeName));
+   VolumeName[sizeof(VolumeName) - 1] = 0;
+
+   if (memcmp(Id, BLOCK_INDEX_ID, sizeof(Id)) != 0 ||
+       version != BLOCK_INDEX_VERSION ||
+       label_btime != dev->VolHdr.label_btime ||
+       !bstrcmp(VolumeName, dev->VolHdr.VolumeName)) {
+      Dmsg1(dbglvl, "Block index of Volume \"%s\" is for another label\n", dev->VolHdr.VolumeName);
+      return false;
+   }
+
+   idx->label_btime = label_btime;
+   set_block_index_end(idx, (st.st_size - BLOCK_INDEX_HDR_SIZE) / BLOCK_INDEX_ENTRY_SIZE);
+
+   return true;
+}
+
+/**
+ * Open the index of the volume on the device unless it is open already.
+ * When writing, a missing index is only created for a block written at
+ * the start of the volume.
+ *
+ * Returns: true  if the index can be used
+ *          false otherwise
+ */
+static bool open_block_index(DCR *dcr, block_index *idx, bool writing, bool create)
+{
+   DEVICE *dev = dcr->dev;
+   POOL_MEM fname(PM_FNAME);
+
+   if (bstrcmp(idx->VolumeName, dev->getVolCatName()) &&
+       idx->label_btime == dev->VolHdr.label_btime &&
+       (idx->writing || !writing) &&
+       (idx->fd >= 0 || !create)) {
+      return idx->usable;
+   }
+
+   close_block_index(idx);
+   bstrncpy(idx->VolumeName, dev->getVolCatName(), sizeof(idx->VolumeName));
+   idx->label_btime = dev->VolHdr.label_btime;
+   idx->writing = writing;
+
+   get_block_index_name(dev, fname);
+   if (writing) {
+      idx->fd = ::open(fname.c_str(), O_RDWR | O_BINARY | (create ? O_CREAT : 0), 0640);
+   } else {
+      idx->fd = ::open(fname.c_str(), O_RDONLY | O_BINARY);
+   }
+   if (idx->fd < 0) {
+      if (errno != ENOENT) {
+         berrno be;
+
+         Jmsg2(dcr->jcr, M_WARNING, 0, _("Could not open block index %s. ERR=%s\n"),
+               fname.c_str(), be.bstrerror());
+      }
+      return false;
+   }
+
+   if (create) {
+      idx->usable = true;
+   } else {
+      idx->usable = check_block_index_header(dev, idx);
+   }
+   Dmsg3(dbglvl, "Opened block index %s usable=%d entries=%lld\n",
+         fname.c_str(), idx->usable, idx->nr_entries);
+
+   return idx->usable;
+}
+
+/**
+ * Add the block just written to the index of the volume, called before
+ * the address of the device is advanced past the block. Writing the
+ * index never fails the job, on an error the index is no longer extended
+ * and the blocks behind its last entry are read sequentially.
+ */
+void update_block_index(DCR *dcr, uint32_t wlen)
+{
+   DEVICE *dev = dcr->dev;
+   DEV_BLOCK *block = dcr->block;
+   block_index *idx = dev->blkidx;
+   uint64_t addr = dev->file_addr;
+   uint8_t buf[BLOCK_INDEX_ENTRY_SIZE];
+   ser_declare;
+
+   if (!idx || !dev->device->block_index) {
+      return;
+   }
+
+   /*
+    * Writing the label block starts a new index.
+    */
+   if (addr == 0) {
+      close_block_index(idx);
+      if (!open_block_index(dcr, idx, true, true)) {
+         return;
+      }
+      if (!write_block_index_header(dev, idx)) {
+         goto bail_out;
+      }
+   } else if (!open_block_index(dcr, idx, true, false)) {
+      return;
+   }
+
+   /*
+    * Blocks rewritten after a failed write replace the entries from
+    * their address on, no entries are added after a gap.
+    */
+   if (addr < idx->next_addr) {
+      set_block_index_end(idx, find_block_index_entry(idx, addr));
+      if (ftruncate(idx->fd, entry_offset(idx->nr_entries)) < 0) {
+         goto bail_out;
+      }
+   }
+   if (addr != idx->next_addr) {
+      Dmsg2(dbglvl, "Block at %llu not after last block index entry %llu\n", addr, idx->next_addr);
+      return;
+   }
+
+   ser_begin(buf, BLOCK_INDEX_ENTRY_SIZE);
+   ser_uint64(addr);
+   ser_uint32(wlen);
+   ser_uint32(block->VolSessionId);
+   ser_uint32(block->VolSessionTime);
+   ser_int32(block->FirstIndex);
+   ser_int32(block->LastIndex);
+   ser_uint32(0);
+
+   if (pwrite(idx->fd, buf, sizeof(buf), entry_offset(idx->nr_entries)) != (ssize_t)sizeof(buf)) {
+      goto bail_out;
+   }
+   idx->nr_entries++;
+   idx->next_addr = addr + wlen;
+   idx->buf_count = 0;
+   return;
+
+bail_out:
+   berrno be;
+   Jmsg2(dcr->jcr, M_WARNING, 0, _("Could not write block index of Volume \"%s\". ERR=%s\n"),
+         idx->VolumeName, be.bstrerror());
+   idx->usable = false;
+}
+
+/**
+ * Before the next block of a disk volume is read with a bootstrap,
+ * position the device to the next block in the index that can contain
+ * a wanted record. When no block in the index can, the device is
+ * positioned after the last block in the index.
+ */
+void seek_block_index(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+   DEVICE *dev = dcr->dev;
+   block_index *idx = dev->blkidx;
+   block_index_entry *entry;
+   uint64_t addr = dev->file_addr;
+   uint64_t nr, target;
+
+   if (!idx || !jcr->bsr || !dev->is_labeled() || !dev->has_cap(CAP_POSITIONBLOCKS)) {
+      return;
+   }
+
+   /*
+    * The volume label is always read first.
+    */
+   if (addr == 0 || !open_block_index(dcr, idx, false, false)) {
+      return;
+   }
+
+   if (addr >= idx->next_addr) {
+      return;
+   }
+
+   nr = find_block_index_entry(idx, addr);
+   if (!(entry = get_block_index_entry(idx, nr)) || entry->addr != addr) {
+      return;
+   }
+
+   target = idx->next_addr;
+   for (; (entry = get_block_index_entry(idx, nr)); nr++) {
+      if (match_bsr_block_index(jcr->bsr, &dev->VolHdr, entry)) {
+         target = entry->addr;
+         break;
+      }
+   }
+
+   if (target > addr) {
+      Dmsg2(dbglvl, "Block index skips from %llu to %llu\n", addr, target);
+      dev->reposition(dcr, (uint32_t)(target >> 32), (uint32_t)target);
+   }
+}
@@ -0,0 +1,71 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Block index of disk volumes definitions
+ */
+
+#ifndef BAREOS_STORED_BLOCK_INDEX_H_
+#define BAREOS_STORED_BLOCK_INDEX_H_ 1
+
+#define BLOCK_INDEX_EXT ".idx"
+#define BLOCK_INDEX_ID "BB01IDX"
+#define BLOCK_INDEX_VERSION 1
+#define BLOCK_INDEX_HDR_SIZE 160      /**< Id, version, label time and Volume name */
+#define BLOCK_INDEX_ENTRY_SIZE 32     /**< Serialized size of an entry */
+#define BLOCK_INDEX_BUF_ENTRIES 1024  /**< Entries read from the index at once */
+
+/**
+ * One entry per block written to the volume, in the order of the blocks.
+ */
+struct block_index_entry {
+   uint64_t addr;                     /**< Volume address of the block */
+   uint32_t length;                   /**< Number of bytes of the block */
+   uint32_t VolSessionId;             /**< Session of the records in the block */
+   uint32_t VolSessionTime;
+   int32_t FirstIndex;                /**< First FileIndex in the block, 0 for labels only */
+   int32_t LastIndex;                 /**< Last FileIndex in the block */
+};
+
+/**
+ * The index file of the volume mounted on a device.
+ *
+ * The index belongs to the volume with the given label time, an index
+ * left behind by an earlier label of the volume is not used. Only the
+ * entries of the blocks from the start of the volume on without a gap
+ * are used, blocks appended while the index was not written are read
+ * sequentially.
+ */
+struct block_index {
+   int fd;                            /**< Index file, -1 when not open */
+   bool writing;                      /**< Opened to add entries */
+   bool usable;                       /**< Header matches the volume label */
+   char VolumeName[MAX_NAME_LENGTH];  /**< Volume the index is open for */
+   btime_t label_btime;               /**< Label time of that volume */
+   uint64_t nr_entries;               /**< Number of entries in the index file */
+   uint64_t next_addr;                /**< Address of the block after the last entry */
+
+   uint64_t buf_first;                /**< Number of the first entry in buf */
+   uint32_t buf_count;                /**< Number of entries in buf */
+   block_index_entry *buf;            /**< Entries read from the index */
+};
+
+#endif /* BAREOS_STORED_BLOCK_INDEX_H_ */
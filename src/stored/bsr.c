@@ -35,7 +35,8 @@
  *   delinked from the bsr chain.  This will avoid the above
  *   problem and make traversal of the bsr chain more efficient.
  *
- *   To be done ...
+ *   For now match_bsr() only skips the bsrs at the start of the
+ *   chain that are done.
  */
 
 #include "bareos.h"
@@ -57,8 +58,8 @@ static int match_volfile(BSR *bsr, BSR_VOLFILE *volfile, DEV_RECORD *rec, bool d
 static int match_voladdr(BSR *bsr, BSR_VOLADDR *voladdr, DEV_RECORD *rec, bool done);
 static int match_stream(BSR *bsr, BSR_STREAM *stream, DEV_RECORD *rec, bool done);
 static int match_all(BSR *bsr, DEV_RECORD *rec, VOLUME_LABEL *volrec, SESSION_LABEL *sessrec, bool done, JCR *jcr);
-static int match_block_sesstime(BSR *bsr, BSR_SESSTIME *sesstime, DEV_BLOCK *block);
-static int match_block_sessid(BSR *bsr, BSR_SESSID *sessid, DEV_BLOCK *block);
+static int match_block_sesstime(BSR *bsr, BSR_SESSTIME *sesstime, uint32_t VolSessionTime);
+static int match_block_sessid(BSR *bsr, BSR_SESSID *sessid, uint32_t VolSessionId);
 static BSR *find_smallest_volfile(BSR *fbsr, BSR *bsr);
 
 /**
@@ -90,10 +91,10 @@ int match_bsr_block(BSR *bsr, DEV_BLOCK *block)
    }
 
    for ( ; bsr; bsr=bsr->next) {
-      if (!match_block_sesstime(bsr, bsr->sesstime, block)) {
+      if (!match_block_sesstime(bsr, bsr->sesstime, block->VolSessionTime)) {
          continue;
       }
-      if (!match_block_sessid(bsr, bsr->sessid, block)) {
+      if (!match_block_sessid(bsr, bsr->sessid, block->VolSessionId)) {
          continue;
       }
       return 1;
@@ -101,30 +102,116 @@ int match_bsr_block(BSR *bsr, DEV_BLOCK *block)
    return 0;
 }
 
-static int match_block_sesstime(BSR *bsr, BSR_SESSTIME *sesstime, DEV_BLOCK *block)
+/**
+ *
+ *  Check with the block index entry of a block that is not read yet
+ *    if the block can contain records that match the bsr. All records
+ *    of a block have the session and the volume address of the block,
+ *    their FileIndexes are in the range of the entry.
+ *
+ *   returns:  1 if block may contain valid records
+ *             0 if block may be skipped
+ *
+ */
+int match_bsr_block_index(BSR *bsr, VOLUME_LABEL *volrec, block_index_entry *entry)
+{
+   uint32_t lo, hi, mid;
+   uint64_t addr;
+
+   if (!bsr) {
+      return 1;
+   }
+
+   /*
+    * Records get the address of the last byte of their block.
+    */
+   addr = entry->addr + entry->length - 1;
+
+   for (bsr = bsr->first_active ? bsr->first_active : bsr; bsr; bsr = bsr->next) {
+      if (bsr->done) {
+         continue;
+      }
+
+      /*
+       * Selections on the session label need the label records read.
+       */
+      if (bsr->JobId || bsr->job || bsr->client || bsr->JobType || bsr->JobLevel) {
+         return 1;
+      }
+
+      if (!match_volume(bsr, bsr->volume, volrec, 1)) {
+         continue;
+      }
+      if (!match_block_sesstime(bsr, bsr->sesstime, entry->VolSessionTime)) {
+         continue;
+      }
+      if (!match_block_sessid(bsr, bsr->sessid, entry->VolSessionId)) {
+         continue;
+      }
+
+      if (bsr->voladdr) {
+         lo = 0;
+         hi = bsr->nr_voladdr_ranges;
+         while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (bsr->voladdr_ranges[mid].saddr <= addr) {
+               lo = mid + 1;
+            } else {
+               hi = mid;
+            }
+         }
+         if (lo == 0 || bsr->voladdr_ranges[lo - 1].eaddr < addr) {
+            continue;
+         }
+      }
+
+      /*
+       * A block with labels only has no FileIndex range, read it.
+       */
+      if (bsr->FileIndex && entry->FirstIndex > 0) {
+         lo = 0;
+         hi = bsr->nr_findex_ranges;
+         while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (bsr->findex_ranges[mid].findex2 < entry->FirstIndex) {
+               lo = mid + 1;
+            } else {
+               hi = mid;
+            }
+         }
+         if (lo == bsr->nr_findex_ranges || bsr->findex_ranges[lo].findex > entry->LastIndex) {
+            continue;
+         }
+      }
+      return 1;
+   }
+   return 0;
+}
+
+static int match_block_sesstime(BSR *bsr, BSR_SESSTIME *sesstime, uint32_t VolSessionTime)
 {
    if (!sesstime) {
       return 1;                       /* no specification matches all */
    }
-   if (sesstime->sesstime == block->VolSessionTime) {
+   if (sesstime->sesstime == VolSessionTime) {
       return 1;
    }
    if (sesstime->next) {
-      return match_block_sesstime(bsr, sesstime->next, block);
+      return match_block_sesstime(bsr, sesstime->next, VolSessionTime);
    }
    return 0;
 }
 
-static int match_block_sessid(BSR *bsr, BSR_SESSID *sessid, DEV_BLOCK *block)
+static int match_block_sessid(BSR *bsr, BSR_SESSID *sessid, uint32_t VolSessionId)
 {
    if (!sessid) {
       return 1;                       /* no specification matches all */
    }
-   if (sessid->sessid <= block->VolSessionId && sessid->sessid2 >= block->VolSessionId) {
+   if (sessid->sessid <= VolSessionId && sessid->sessid2 >= VolSessionId) {
       return 1;
    }
    if (sessid->next) {
-      return match_block_sessid(bsr, sessid->next, block);
+      return match_block_sessid(bsr, sessid->next, VolSessionId);
    }
    return 0;
 }
@@ -177,8 +264,26 @@ int match_bsr(BSR *bsr, DEV_RECORD *rec, VOLUME_LABEL *volrec, SESSION_LABEL *se
     *   tape to the next available bsr position.
     */
    if (bsr) {
+      BSR *active;
+
       bsr->reposition = false;
-      status = match_all(bsr, rec, volrec, sessrec, true, jcr);
+
+      /*
+       * Skip the bsrs at the start of the chain that are done, they can
+       * never match again. No more matches are possible once all are done.
+       */
+      if (!bsr->first_active) {
+         bsr->first_active = bsr;
+      }
+      for (active = bsr->first_active; active && active->done; active = active->next) {
+      }
+      bsr->first_active = active;
+
+      if (active) {
+         status = match_all(active, rec, volrec, sessrec, true, jcr);
+      } else {
+         status = -1;
+      }
       /*
        * Note, bsr->reposition is set by match_all when
        *  a bsr is done. We turn it off if a match was
@@ -382,6 +487,14 @@ static int match_all(BSR *bsr, DEV_RECORD *rec, VOLUME_LABEL *volrec,
 //    Dmsg0(dbglevel, "bsr->done set\n");
       goto no_match;
    }
+
+   /*
+    * A record before all VolAddr ranges of this bsr cannot match, this is
+    * the cheapest test so do it first.
+    */
+   if (bsr->min_saddr && get_record_address(rec) < bsr->min_saddr) {
+      goto no_match;
+   }
    if (!match_volume(bsr, bsr->volume, volrec, 1)) {
       Dmsg2(dbglevel, "bsr fail bsr_vol=%s != rec read_vol=%s\n", bsr->volume->VolumeName,
             volrec->VolumeName);
@@ -627,44 +740,47 @@ static int match_volfile(BSR *bsr, BSR_VOLFILE *volfile, DEV_RECORD *rec, bool d
 
 static int match_voladdr(BSR *bsr, BSR_VOLADDR *voladdr, DEV_RECORD *rec, bool done)
 {
+   uint32_t lo, hi, mid;
+   BSR_VOLADDR *va;
+
    if (!voladdr) {
       return 1;                       /* no specification matches all */
    }
 
-#ifdef xxx
-
-   /* For the moment, these tests work only with disk. */
-   if (rec->state & REC_ISTAPE) {
-      uint32_t sFile = (voladdr->saddr)>>32;
-      uint32_t eFile = (voladdr->eaddr)>>32;
-      if (sFile <= rec->File && eFile >= rec->File) {
-         return 1;
-      }
-   }
-
-#endif
-
    uint64_t addr = get_record_address(rec);
    Dmsg6(dbglevel, "match_voladdr: saddr=%llu eaddr=%llu recaddr=%llu sfile=%u efile=%u recfile=%u\n",
          voladdr->saddr, voladdr->eaddr, addr, voladdr->saddr>>32, voladdr->eaddr>>32, addr>>32);
 
-   if (voladdr->saddr <= addr && voladdr->eaddr >= addr) {
-      return 1;
+   /*
+    * Once we get past the end of a VolAddr range it is done.
+    */
+   while ((va = bsr->voladdr_by_end[bsr->voladdr_cursor]) && va->eaddr < addr) {
+      va->done = true;                   /* set local done */
+      bsr->voladdr_cursor++;
    }
-   /* Once we get past last eblock, we are done */
-   if (addr > voladdr->eaddr) {
-      voladdr->done = true;              /* set local done */
+
+   /*
+    * Find the last range starting at or before addr.
+    */
+   lo = 0;
+   hi = bsr->nr_voladdr_ranges;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (bsr->voladdr_ranges[mid].saddr <= addr) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
    }
-   if (voladdr->next) {
-      return match_voladdr(bsr, voladdr->next, rec, voladdr->done && done);
+   if (lo > 0 && bsr->voladdr_ranges[lo - 1].eaddr >= addr) {
+      return 1;
    }
 
    /* If we are done and all prior matches are done, this bsr is finished */
-   if (voladdr->done && done) {
+   if (!bsr->voladdr_by_end[bsr->voladdr_cursor] && done) {
       bsr->done = true;
       bsr->root->reposition = true;
-      Dmsg2(dbglevel, "bsr done from voladdr rec=%llu voleaddr=%llu\n",
-            addr, voladdr->eaddr);
+      Dmsg1(dbglevel, "bsr done from voladdr rec=%llu\n", addr);
    }
    return 0;
 }
@@ -729,28 +845,41 @@ static int match_sessid(BSR *bsr, BSR_SESSID *sessid, DEV_RECORD *rec)
  * When reading the Volume, the Volume Findex (rec->FileIndex) always
  *   are found in sequential order. Thus we can make optimizations.
  *
- *  ***FIXME*** optimizations
- * We could optimize by removing the recursion.
+ * The ranges are sorted and merged, so all ranges ending before the
+ *   current FileIndex are done and the findex_cursor points to the first
+ *   range that is not. It is advanced with a binary search.
  */
 static int match_findex(BSR *bsr, BSR_FINDEX *findex, DEV_RECORD *rec, bool done)
 {
+   uint32_t lo, hi, mid;
+   BSR_FINDEX_RANGE *range;
+
    if (!findex) {
       return 1;                       /* no specification matches all */
    }
-   if (!findex->done) {
-      if (findex->findex <= rec->FileIndex && findex->findex2 >= rec->FileIndex) {
+
+   lo = bsr->findex_cursor;
+   hi = bsr->nr_findex_ranges;
+   if (lo < hi && bsr->findex_ranges[lo].findex2 < rec->FileIndex) {
+      while (lo < hi) {
+         mid = lo + (hi - lo) / 2;
+         if (bsr->findex_ranges[mid].findex2 < rec->FileIndex) {
+            lo = mid + 1;
+         } else {
+            hi = mid;
+         }
+      }
+      bsr->findex_cursor = lo;
+   }
+
+   if (bsr->findex_cursor < bsr->nr_findex_ranges) {
+      range = &bsr->findex_ranges[bsr->findex_cursor];
+      if (range->findex <= rec->FileIndex) {
          Dmsg3(dbglevel, "Match on findex=%d. bsrFIs=%d,%d\n",
-               rec->FileIndex, findex->findex, findex->findex2);
+               rec->FileIndex, range->findex, range->findex2);
          return 1;
       }
-      if (rec->FileIndex > findex->findex2) {
-         findex->done = true;
-      }
-   }
-   if (findex->next) {
-      return match_findex(bsr, findex->next, rec, findex->done && done);
-   }
-   if (findex->done && done) {
+   } else if (done) {
       bsr->done = true;
       bsr->root->reposition = true;
       Dmsg1(dbglevel, "bsr done from findex %d\n", rec->FileIndex);
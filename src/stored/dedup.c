@@ -0,0 +1,667 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunk store of deduplicated data.
+ *
+ * The File daemon sends the data of files backed up with deduplication
+ * as content defined chunks, each in a record of the deduplicated data
+ * stream. The record holds the file address, the SHA1 digest and the
+ * length of the chunk followed by the chunk data.
+ *
+ * When a device has a chunk store, each chunk is kept once in the store
+ * and only the header of the record, a reference to the chunk, is written
+ * to the volume. When the records are read the data of the references is
+ * filled in again, so the File daemon and the other readers always get
+ * complete records.
+ *
+ * The chunks are appended to a data file, an LMDB index maps the digest
+ * and length of a chunk to its offset in the data file. LMDB allows an
+ * environment to be opened only once per process, so all devices using
+ * the same directory share one store.
+ *
+ * The store is shared by all clients, so the File daemon is not trusted.
+ * The digest of each chunk received is checked before it is stored, and
+ * a reference is only accepted for a chunk whose data the File daemon
+ * sent earlier in the same job.
+ */
+
+#include "bareos.h"
+#include "stored.h"
+
+#ifdef HAVE_LMDB
+#include "lmdb.h"
+
+#define DEDUP_KEY_SIZE (CRYPTO_DIGEST_SHA1_SIZE + sizeof(uint32_t)) /* Digest and length of a chunk */
+#define DEDUP_INDEX_NAME "chunks.index"
+#define DEDUP_DATA_NAME "chunks.data"
+
+struct dedup_chunk {
+   hlink link;                        /* Hash table link */
+   uint8_t key[DEDUP_KEY_SIZE];       /* Digest and length of the chunk */
+};
+
+struct dedup_store {
+   dedup_store *next;                 /* Next open store */
+   char *directory;                   /* Directory of the store */
+   int use_count;                     /* Number of devices using the store */
+   pthread_mutex_t lock;              /* Serializes adding chunks */
+   int data_fd;                       /* Data file */
+   uint64_t data_size;                /* Size of the data file */
+   MDB_env *env;                      /* Index environment */
+   MDB_dbi dbi;                       /* Index database */
+};
+
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dedup_store *stores = NULL;
+
+static void free_dedup_store(dedup_store *store)
+{
+   if (store->env) {
+      mdb_env_close(store->env);
+   }
+   if (store->data_fd >= 0) {
+      close(store->data_fd);
+   }
+   pthread_mutex_destroy(&store->lock);
+   free(store->directory);
+   free(store);
+}
+
+/**
+ * Open the chunk store in the given directory or use it when another
+ * device already opened it.
+ */
+dedup_store *open_dedup_store(JCR *jcr, const char *directory)
+{
+   int status;
+   struct stat st;
+   MDB_txn *txn;
+   dedup_store *store;
+   POOL_MEM fname(PM_FNAME);
+   char ed1[50];
+
+   P(store_mutex);
+   for (store = stores; store; store = store->next) {
+      if (bstrcmp(store->directory, directory)) {
+         store->use_count++;
+         goto bail_out;
+      }
+   }
+
+   store = (dedup_store *)malloc(sizeof(dedup_store));
+   memset(store, 0, sizeof(dedup_store));
+   store->directory = bstrdup(directory);
+   store->data_fd = -1;
+   pthread_mutex_init(&store->lock, NULL);
+
+   Mmsg(fname, "%s/%s", directory, DEDUP_DATA_NAME);
+   store->data_fd = open(fname.c_str(), O_RDWR | O_CREAT | O_BINARY, 0640);
+   if (store->data_fd < 0 || fstat(store->data_fd, &st) < 0) {
+      berrno be;
+      Jmsg2(jcr, M_ERROR, 0, _("Could not open chunk store data file %s: ERR=%s\n"),
+            fname.c_str(), be.bstrerror());
+      goto bail_out_free;
+   }
+   store->data_size = st.st_size;
+
+   status = mdb_env_create(&store->env);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to create MDB environment: %s\n"), mdb_strerror(status));
+      goto bail_out_free;
+   }
+
+   /*
+    * The map is only address space, the index file grows as needed.
+    */
+   status = mdb_env_set_mapsize(store->env, sizeof(size_t) > 4 ? (size_t)1 << 36 : (size_t)1 << 30);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to set MDB mapsize: %s\n"), mdb_strerror(status));
+      goto bail_out_free;
+   }
+
+   /*
+    * The index is synced explicitly with the data file at the end of a job.
+    */
+   Mmsg(fname, "%s/%s", directory, DEDUP_INDEX_NAME);
+   status = mdb_env_open(store->env, fname.c_str(), MDB_NOSUBDIR | MDB_NOTLS | MDB_NOSYNC, 0640);
+   if (status) {
+      Jmsg2(jcr, M_ERROR, 0, _("Unable to open chunk store index %s: %s\n"), fname.c_str(), mdb_strerror(status));
+      goto bail_out_free;
+   }
+
+   status = mdb_txn_begin(store->env, NULL, 0, &txn);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to start a write transaction: %s\n"), mdb_strerror(status));
+      goto bail_out_free;
+   }
+
+   status = mdb_dbi_open(txn, NULL, MDB_CREATE, &store->dbi);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to open LMDB internal database: %s\n"), mdb_strerror(status));
+      mdb_txn_abort(txn);
+      goto bail_out_free;
+   }
+
+   status = mdb_txn_commit(txn);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to commit transaction: %s\n"), mdb_strerror(status));
+      goto bail_out_free;
+   }
+
+   Dmsg2(100, "Opened chunk store %s with %s bytes of data\n", directory, edit_uint64(store->data_size, ed1));
+   store->use_count = 1;
+   store->next = stores;
+   stores = store;
+   goto bail_out;
+
+bail_out_free:
+   free_dedup_store(store);
+   store = NULL;
+
+bail_out:
+   V(store_mutex);
+   return store;
+}
+
+/**
+ * Close the chunk store when the last device using it is done.
+ */
+void close_dedup_store(dedup_store *store)
+{
+   dedup_store **pp;
+
+   P(store_mutex);
+   if (--store->use_count > 0) {
+      V(store_mutex);
+      return;
+   }
+
+   for (pp = &stores; *pp; pp = &(*pp)->next) {
+      if (*pp == store) {
+         *pp = store->next;
+         break;
+      }
+   }
+   V(store_mutex);
+
+   sync_dedup_store(NULL, store);
+   free_dedup_store(store);
+}
+
+/**
+ * Flush the chunks added to the store to stable storage. The data file is
+ * synced before the index, so the index never references lost data.
+ */
+bool sync_dedup_store(JCR *jcr, dedup_store *store)
+{
+   int status;
+
+   if (fdatasync(store->data_fd) < 0) {
+      berrno be;
+      Jmsg2(jcr, M_ERROR, 0, _("Could not sync chunk store data file in %s: ERR=%s\n"),
+            store->directory, be.bstrerror());
+      return false;
+   }
+
+   status = mdb_env_sync(store->env, 1);
+   if (status) {
+      Jmsg2(jcr, M_ERROR, 0, _("Could not sync chunk store index in %s: %s\n"),
+            store->directory, mdb_strerror(status));
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ * Lookup a chunk in the index. Returns false when it is not there.
+ */
+static bool lookup_chunk(JCR *jcr, dedup_store *store, uint8_t *key, uint64_t *offset)
+{
+   int status;
+   MDB_txn *txn;
+   MDB_val mkey, mdata;
+   ser_declare;
+
+   status = mdb_txn_begin(store->env, NULL, MDB_RDONLY, &txn);
+   if (status) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to create read transaction: %s\n"), mdb_strerror(status));
+      return false;
+   }
+
+   mkey.mv_data = key;
+   mkey.mv_size = DEDUP_KEY_SIZE;
+   status = mdb_get(txn, store->dbi, &mkey, &mdata);
+   if (status == 0 && mdata.mv_size == sizeof(uint64_t)) {
+      unser_begin(mdata.mv_data, sizeof(uint64_t));
+      unser_uint64(*offset);
+   }
+   mdb_txn_abort(txn);
+
+   return status == 0;
+}
+
+/**
+ * Check the data of a chunk against the digest in its key.
+ */
+static bool chunk_digest_matches(JCR *jcr, uint8_t *key, const char *data, uint32_t length)
+{
+   DIGEST *digest;
+   uint8_t sha1[CRYPTO_DIGEST_SHA1_SIZE];
+   uint32_t sha1_len = sizeof(sha1);
+
+   digest = crypto_digest_new(jcr, CRYPTO_DIGEST_SHA1);
+   if (!digest) {
+      return false;
+   }
+   crypto_digest_update(digest, (uint8_t *)data, length);
+   crypto_digest_finalize(digest, sha1, &sha1_len);
+   crypto_digest_free(digest);
+
+   return memcmp(sha1, key, CRYPTO_DIGEST_SHA1_SIZE) == 0;
+}
+
+/**
+ * Add a chunk to the store unless it is already there. The data must
+ * match the digest, other clients get this data for the same key.
+ *
+ * Returns: false on errors
+ *          true with *added telling whether the chunk was new
+ */
+static bool add_chunk(JCR *jcr, dedup_store *store, uint8_t *key, const char *data,
+                      uint32_t length, bool *added)
+{
+   int status;
+   bool retval = false;
+   MDB_txn *txn;
+   MDB_val mkey, mdata;
+   uint8_t value[sizeof(uint64_t)];
+   ser_declare;
+
+   *added = false;
+
+   if (!chunk_digest_matches(jcr, key, data, length)) {
+      Jmsg0(jcr, M_FATAL, 0, _("Data of a deduplicated chunk doesn't match its digest\n"));
+      return false;
+   }
+
+   P(store->lock);
+   status = mdb_txn_begin(store->env, NULL, 0, &txn);
+   if (status) {
+      Jmsg1(jcr, M_FATAL, 0, _("Unable to create write transaction: %s\n"), mdb_strerror(status));
+      goto bail_out;
+   }
+
+   mkey.mv_data = key;
+   mkey.mv_size = DEDUP_KEY_SIZE;
+   status = mdb_get(txn, store->dbi, &mkey, &mdata);
+   if (status == 0) {
+      mdb_txn_abort(txn);
+      retval = true;
+      goto bail_out;
+   }
+
+   /*
+    * Append the data, a crash before the commit only leaves unreferenced bytes.
+    */
+   if (pwrite(store->data_fd, data, length, store->data_size) != (ssize_t)length) {
+      berrno be;
+      Jmsg2(jcr, M_FATAL, 0, _("Write error on chunk store data file in %s: ERR=%s\n"),
+            store->directory, be.bstrerror());
+      mdb_txn_abort(txn);
+      goto bail_out;
+   }
+
+   ser_begin(value, sizeof(uint64_t));
+   ser_uint64(store->data_size);
+   mdata.mv_data = value;
+   mdata.mv_size = sizeof(uint64_t);
+
+   status = mdb_put(txn, store->dbi, &mkey, &mdata, MDB_NOOVERWRITE);
+   if (status) {
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to add chunk to the chunk store index in %s: %s\n"),
+            store->directory, mdb_strerror(status));
+      mdb_txn_abort(txn);
+      goto bail_out;
+   }
+
+   status = mdb_txn_commit(txn);
+   if (status) {
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to commit chunk store index in %s: %s\n"),
+            store->directory, mdb_strerror(status));
+      goto bail_out;
+   }
+
+   store->data_size += length;
+   *added = true;
+   retval = true;
+
+bail_out:
+   V(store->lock);
+   return retval;
+}
+
+/**
+ * Read a chunk from the data file and check it against its digest.
+ */
+static bool read_chunk(JCR *jcr, dedup_store *store, uint8_t *key, uint64_t offset,
+                       char *data, uint32_t length)
+{
+   char ec1[50];
+
+   if (pread(store->data_fd, data, length, offset) != (ssize_t)length) {
+      berrno be;
+      Jmsg3(jcr, M_FATAL, 0, _("Read error on chunk store data file in %s at %s: ERR=%s\n"),
+            store->directory, edit_uint64(offset, ec1), be.bstrerror());
+      return false;
+   }
+
+   if (!chunk_digest_matches(jcr, key, data, length)) {
+      Jmsg2(jcr, M_FATAL, 0, _("Chunk at %s in chunk store %s is corrupt\n"),
+            edit_uint64(offset, ec1), store->directory);
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ * Check the chunk header of a deduplicated data record. Returns the
+ * length of the chunk or -1 when the record is invalid.
+ */
+static inline int64_t chunk_length(JCR *jcr, DEV_RECORD *rec)
+{
+   uint32_t length;
+   ser_declare;
+
+   if (rec->data_len < DEDUP_CHUNK_HDR_SIZE) {
+      Jmsg1(jcr, M_FATAL, 0, _("Invalid deduplicated data record of %u bytes\n"), rec->data_len);
+      return -1;
+   }
+
+   unser_begin(rec->data + OFFSET_FADDR_SIZE + CRYPTO_DIGEST_SHA1_SIZE, sizeof(uint32_t));
+   unser_uint32(length);
+
+   if (rec->data_len != DEDUP_CHUNK_HDR_SIZE && rec->data_len != DEDUP_CHUNK_HDR_SIZE + length) {
+      Jmsg2(jcr, M_FATAL, 0, _("Invalid deduplicated data record of %u bytes for a chunk of %u bytes\n"),
+            rec->data_len, length);
+      return -1;
+   }
+
+   return length;
+}
+
+/**
+ * Remember that the data of a chunk was received in this job.
+ */
+static void remember_chunk(DCR *dcr, uint8_t *key)
+{
+   dedup_chunk *chunk = NULL;
+
+   if (!dcr->dedup_chunks) {
+      dcr->dedup_chunks = (htable *)malloc(sizeof(htable));
+      dcr->dedup_chunks->init(chunk, &chunk->link, 1024);
+   }
+
+   if (dcr->dedup_chunks->lookup(key, DEDUP_KEY_SIZE)) {
+      return;
+   }
+
+   chunk = (dedup_chunk *)dcr->dedup_chunks->hash_malloc(sizeof(dedup_chunk));
+   memcpy(chunk->key, key, DEDUP_KEY_SIZE);
+   dcr->dedup_chunks->insert(chunk->key, DEDUP_KEY_SIZE, chunk);
+}
+
+/**
+ * A reference is only taken from the File daemon for a chunk it sent the
+ * data of in this job. A copy or migration job reading from a device using
+ * the same store passes on references of chunks that are already stored.
+ */
+static inline bool reference_allowed(DCR *dcr, uint8_t *key)
+{
+   JCR *jcr = dcr->jcr;
+
+   if (jcr->read_dcr && jcr->read_dcr != dcr && jcr->read_dcr->dev &&
+       jcr->read_dcr->dev->dedup == dcr->dev->dedup) {
+      return true;
+   }
+
+   return dcr->dedup_chunks && dcr->dedup_chunks->lookup(key, DEDUP_KEY_SIZE);
+}
+
+void free_dedup_chunks(DCR *dcr)
+{
+   if (dcr->dedup_chunks) {
+      dcr->dedup_chunks->destroy();
+      free(dcr->dedup_chunks);
+      dcr->dedup_chunks = NULL;
+   }
+}
+
+/**
+ * Translate a deduplicated data record that is written to the volume. The
+ * data of the chunk is put into the chunk store and only the reference is
+ * written. References must point to chunks in the store.
+ */
+bool dedup_write_translation(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+   DEV_RECORD *rec, *nrec;
+   dedup_store *store = dcr->dev->dedup;
+   uint8_t *key;
+   int64_t length;
+   uint64_t offset;
+   bool added;
+   char ed1[50];
+
+   rec = dcr->after_rec ? dcr->after_rec : dcr->before_rec;
+   if (rec->maskedStream != STREAM_DEDUP_DATA) {
+      return true;
+   }
+
+   if ((length = chunk_length(jcr, rec)) < 0) {
+      return false;
+   }
+   key = (uint8_t *)rec->data + OFFSET_FADDR_SIZE;
+
+   if (rec->data_len == DEDUP_CHUNK_HDR_SIZE) {
+      if (!store || !lookup_chunk(jcr, store, key, &offset)) {
+         Jmsg2(jcr, M_FATAL, 0, _("Referenced chunk of %s bytes is not in the chunk store of device %s\n"),
+               edit_uint64(length, ed1), dcr->dev->print_name());
+         return false;
+      }
+      if (!reference_allowed(dcr, key)) {
+         Jmsg1(jcr, M_FATAL, 0, _("Referenced chunk of %s bytes was not sent in this job\n"),
+               edit_uint64(length, ed1));
+         return false;
+      }
+      dcr->dedup_old_chunks++;
+      dcr->dedup_old_bytes += length;
+      return true;
+   }
+
+   if (!store) {
+      return true;
+   }
+
+   if (!add_chunk(jcr, store, key, rec->data + DEDUP_CHUNK_HDR_SIZE, length, &added)) {
+      return false;
+   }
+   remember_chunk(dcr, key);
+
+   if (added) {
+      dcr->dedup_new_chunks++;
+      dcr->dedup_new_bytes += length;
+   } else {
+      dcr->dedup_old_chunks++;
+      dcr->dedup_old_bytes += length;
+   }
+
+   /*
+    * Write just the chunk header. A record translated before is ours to
+    * shorten, otherwise the new record shares the data of the original.
+    */
+   if (dcr->after_rec) {
+      dcr->after_rec->data_len = DEDUP_CHUNK_HDR_SIZE;
+      return true;
+   }
+
+   nrec = new_record(false);
+   copy_record_state(nrec, rec);
+   nrec->Stream = rec->Stream;
+   nrec->maskedStream = rec->maskedStream;
+   nrec->data = rec->data;
+   nrec->data_len = DEDUP_CHUNK_HDR_SIZE;
+   dcr->after_rec = nrec;
+
+   return true;
+}
+
+/**
+ * Translate a deduplicated data record read from the volume. The data of
+ * a reference is filled in from the chunk store.
+ *
+ * A copy or migration job writing to a device that uses the same store
+ * keeps the references as they are.
+ */
+bool dedup_read_translation(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+   DEV_RECORD *rec, *nrec;
+   dedup_store *store = dcr->dev->dedup;
+   uint8_t *key;
+   int64_t length;
+   uint64_t offset;
+   char ed1[50];
+
+   rec = dcr->after_rec ? dcr->after_rec : dcr->before_rec;
+   if (rec->maskedStream != STREAM_DEDUP_DATA || rec->data_len != DEDUP_CHUNK_HDR_SIZE) {
+      return true;
+   }
+
+   if ((length = chunk_length(jcr, rec)) < 0) {
+      return false;
+   }
+   key = (uint8_t *)rec->data + OFFSET_FADDR_SIZE;
+
+   if (store && jcr->dcr && jcr->dcr != dcr && jcr->dcr->dev && jcr->dcr->dev->dedup == store) {
+      return true;
+   }
+
+   if (!store || !lookup_chunk(jcr, store, key, &offset)) {
+      Jmsg2(jcr, M_FATAL, 0, _("Referenced chunk of %s bytes is not in the chunk store of device %s\n"),
+            edit_uint64(length, ed1), dcr->dev->print_name());
+      return false;
+   }
+
+   nrec = new_record(true);
+   copy_record_state(nrec, rec);
+   nrec->Stream = rec->Stream;
+   nrec->maskedStream = rec->maskedStream;
+   nrec->data = check_pool_memory_size(nrec->data, DEDUP_CHUNK_HDR_SIZE + length);
+   memcpy(nrec->data, rec->data, DEDUP_CHUNK_HDR_SIZE);
+   nrec->data_len = DEDUP_CHUNK_HDR_SIZE + length;
+
+   if (!read_chunk(jcr, store, key, offset, nrec->data + DEDUP_CHUNK_HDR_SIZE, length)) {
+      free_record(nrec);
+      return false;
+   }
+
+   if (dcr->after_rec) {
+      free_record(dcr->after_rec);
+   }
+   dcr->after_rec = nrec;
+
+   return true;
+}
+
+/**
+ * Report what the job added to the chunk store of the device and make
+ * the chunks durable before the job is reported as done.
+ */
+bool finish_dedup_job(DCR *dcr)
+{
+   JCR *jcr = dcr->jcr;
+   char ec1[50], ec2[50], ec3[50], ec4[50];
+
+   if (dcr->dedup_new_chunks || dcr->dedup_old_chunks) {
+      Jmsg(jcr, M_INFO, 0, _("Chunk store: %s chunks (%s bytes) added, %s chunks (%s bytes) already stored\n"),
+           edit_uint64_with_commas(dcr->dedup_new_chunks, ec1),
+           edit_uint64_with_commas(dcr->dedup_new_bytes, ec2),
+           edit_uint64_with_commas(dcr->dedup_old_chunks, ec3),
+           edit_uint64_with_commas(dcr->dedup_old_bytes, ec4));
+   }
+
+   if (!dcr->dev->dedup || !dcr->dedup_new_chunks) {
+      return true;
+   }
+
+   return sync_dedup_store(jcr, dcr->dev->dedup);
+}
+
+#else
+
+dedup_store *open_dedup_store(JCR *jcr, const char *directory)
+{
+   Jmsg1(jcr, M_ERROR, 0, _("Chunk store %s not available, compiled without LMDB support\n"), directory);
+   return NULL;
+}
+
+void close_dedup_store(dedup_store *store)
+{
+}
+
+bool sync_dedup_store(JCR *jcr, dedup_store *store)
+{
+   return true;
+}
+
+/**
+ * Without a chunk store complete records are written as they are,
+ * references can't be resolved.
+ */
+bool dedup_write_translation(DCR *dcr)
+{
+   DEV_RECORD *rec = dcr->after_rec ? dcr->after_rec : dcr->before_rec;
+
+   if (rec->maskedStream == STREAM_DEDUP_DATA && rec->data_len <= DEDUP_CHUNK_HDR_SIZE) {
+      Jmsg1(dcr->jcr, M_FATAL, 0, _("Referenced chunk is not in the chunk store of device %s\n"),
+            dcr->dev->print_name());
+      return false;
+   }
+
+   return true;
+}
+
+bool dedup_read_translation(DCR *dcr)
+{
+   return dedup_write_translation(dcr);
+}
+
+bool finish_dedup_job(DCR *dcr)
+{
+   return true;
+}
+
+void free_dedup_chunks(DCR *dcr)
+{
+}
+#endif /* HAVE_LMDB */
@@ -279,6 +279,8 @@ static inline DEVICE *m_init_dev(JCR *jcr, DEVRES *device, bool new_init)
    dev->autoselect = device->autoselect;
    dev->norewindonclose = device->norewindonclose;
    dev->dev_type = device->dev_type;
+   dev->block_version = device->block_version;
+   dev->async_write_blocks = device->async_write_blocks;
    dev->device = device;
 
    /*
@@ -287,8 +289,22 @@ static inline DEVICE *m_init_dev(JCR *jcr, DEVRES *device, bool new_init)
    if (dev->vol_poll_interval && dev->vol_poll_interval < 60) {
       dev->vol_poll_interval = 60;
    }
+
+   if (dev->block_version < 2 || dev->block_version > MAX_BLOCK_VER) {
+      Jmsg2(jcr, M_WARNING, 0, _("Unsupported block version %d for device %s, using the default.\n"),
+            dev->block_version, dev->print_name());
+      dev->block_version = BLOCK_VER;
+   }
    device->dev = dev;
 
+   if (device->dedup_directory) {
+      dev->dedup = open_dedup_store(jcr, device->dedup_directory);
+   }
+
+   if (dev->is_file()) {
+      dev->blkidx = new_block_index();
+   }
+
    if (dev->is_fifo()) {
       dev->set_cap(CAP_STREAM);       /* set stream device */
    }
@@ -613,6 +629,21 @@ void DEVICE::set_mode(int mode)
    }
 }
 
+/**
+ * Get the name of the file of a volume on a disk device, like
+ * DEVICE::open_device() opens it.
+ */
+void get_volume_file_name(DEVICE *dev, const char *VolumeName, POOLMEM *&fname)
+{
+   pm_strcpy(fname, dev->dev_name);
+   if (!dev->device->changer_res || dev->device->changer_command[0] == 0) {
+      if (!IsPathSeparator(fname[strlen(fname) - 1])) {
+         pm_strcat(fname, "/");
+      }
+      pm_strcat(fname, VolumeName);
+   }
+}
+
 /**
  * Open a device.
  */
@@ -952,6 +983,22 @@ bool DEVICE::close(DCR *dcr)
       goto bail_out;                  /* already closed */
    }
 
+   /*
+    * The blocks queued to the writer thread must be on the volume before
+    * it is closed. The DCR that queued them deals with a failed write like
+    * with a synchronous one, for anyone else it is an error.
+    */
+   if (writer) {
+      if (dcr && writer->owner == dcr) {
+         if (!wait_async_writes(dcr, true)) {
+            retval = false;
+         }
+      } else if (!drain_async_writer(writer)) {
+         Mmsg1(errmsg, _("Write of a queued block to device %s failed.\n"), print_name());
+         retval = false;
+      }
+   }
+
    if (!norewindonclose) {
       offline_or_rewind();
    }
@@ -978,6 +1025,10 @@ bool DEVICE::close(DCR *dcr)
 
    unmount(dcr, 1);                   /* do unmount if required */
 
+   if (blkidx) {
+      close_block_index(blkidx);
+   }
+
    /*
     * Clean up device packet so it can be reused.
     */
@@ -1225,6 +1276,21 @@ void DEVICE::term()
     */
    close(NULL);
 
+   if (writer) {
+      free_async_writer(writer);
+      writer = NULL;
+   }
+
+   if (dedup) {
+      close_dedup_store(dedup);
+      dedup = NULL;
+   }
+
+   if (blkidx) {
+      free_block_index(blkidx);
+      blkidx = NULL;
+   }
+
    if (dev_name) {
       free_memory(dev_name);
       dev_name = NULL;
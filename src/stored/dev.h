@@ -255,6 +255,10 @@ struct BLOCKSIZES {
 class DEVRES; /* Device resource defined in stored_conf.h */
 class DCR; /* Forward reference */
 class VOLRES; /* Forward reference */
+struct async_writer; /* Forward reference */
+struct dedup_store; /* Forward reference */
+struct block_index; /* Forward reference */
+struct spool_segments; /* Forward reference */
 
 /**
  * Device structure definition.
@@ -323,6 +327,11 @@ public:
    uint32_t max_rewind_wait;          /**< Max secs to allow for rewind */
    uint32_t max_open_wait;            /**< Max secs to allow for open */
    uint32_t max_open_vols;            /**< Max simultaneous open volumes */
+   uint32_t block_version;            /**< Block header version to write */
+   uint32_t async_write_blocks;       /**< Number of blocks queued to the writer thread */
+   async_writer *writer;              /**< Writer thread, NULL when writing synchronously */
+   dedup_store *dedup;                /**< Chunk store of deduplicated data */
+   block_index *blkidx;               /**< Block index of the volume, only for disk devices */
 
    utime_t vol_poll_interval;         /**< Interval between polling Vol mount */
    DEVRES *device;                    /**< Pointer to Device Resource */
@@ -508,6 +517,7 @@ public:
    virtual bool unmount_backend(DCR *dcr, int timeout) { return true; };
    boffset_t lseek(DCR *dcr, boffset_t offset, int whence) { return d_lseek(dcr, offset, whence); };
    bool truncate(DCR *dcr) { return d_truncate(dcr); };
+   bool flush(DCR *dcr) { return d_flush(dcr); };
 
    /*
     * Low level operations
@@ -519,6 +529,7 @@ public:
    virtual ssize_t d_write(int fd, const void *buffer, size_t count) = 0;
    virtual boffset_t d_lseek(DCR *dcr, boffset_t offset, int whence) = 0;
    virtual bool d_truncate(DCR *dcr) = 0;
+   virtual bool d_flush(DCR *dcr) { return true; };
 
    /*
     * Locking and blocking calls
@@ -613,6 +624,7 @@ public:
    bool spooling;                     /**< Set when actually spooling */
    bool despooling;                   /**< Set when despooling */
    bool despool_wait;                 /**< Waiting for despooling */
+   spool_segments *segments;          /**< Segments of the data spool, NULL when spooling into one file */
    bool NewVol;                       /**< Set if new Volume mounted */
    bool WroteVol;                     /**< Set if Volume written */
    bool NewFile;                      /**< Set when EOF written */
@@ -622,6 +634,15 @@ public:
    bool keep_dcr;                     /**< Do not free dcr in release_dcr */
    uint32_t autodeflate;              /**< Try to autodeflate streams */
    uint32_t autoinflate;              /**< Try to autoinflate streams */
+   uint64_t dedup_new_chunks;         /**< Chunks added to the chunk store */
+   uint64_t dedup_new_bytes;          /**< Bytes of the chunks added to the chunk store */
+   uint64_t dedup_old_chunks;         /**< Chunks already in the chunk store */
+   uint64_t dedup_old_bytes;          /**< Bytes of the chunks already in the chunk store */
+   htable *dedup_chunks;              /**< Chunks the File daemon sent the data of */
+   bool copy_blocks;                  /**< Copy the blocks of the session read as a whole */
+   bool block_copied;                 /**< The block read was copied as a whole */
+   bool copy_in_record;               /**< The last block copied ends inside a record */
+   int32_t copy_last_index;           /**< Last FileIndex of the session to copy */
    uint32_t VolFirstIndex;            /**< First file index this Volume */
    uint32_t VolLastIndex;             /**< Last file index this Volume */
    uint32_t FileIndex;                /**< Current File Index */
@@ -739,7 +760,7 @@ public:
     * Methods in block.c
     */
    bool write_block_to_device();
-   bool write_block_to_dev();
+   bool write_block_to_dev(bool async = false);
    bool read_block_from_device(bool check_block_numbers);
    bool read_block_from_dev(bool check_block_numbers);
 
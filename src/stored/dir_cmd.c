@@ -497,6 +497,10 @@ static bool cancel_cmd(JCR *cjcr)
    if (jcr->file_bsock) {
       jcr->file_bsock->set_terminated();
       jcr->file_bsock->set_timed_out();
+      for (int i = 1; i < jcr->nr_fd_streams; i++) {
+         jcr->fd_streams[i]->set_terminated();
+         jcr->fd_streams[i]->set_timed_out();
+      }
       Dmsg2(800, "Term bsock jid=%d %p\n", jcr->JobId, jcr);
    } else {
       if (oldStatus != JS_WaitSD) {
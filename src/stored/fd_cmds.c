@@ -42,6 +42,8 @@
 /* Static variables */
 static char ferrmsg[] =
    "3900 Invalid command\n";
+static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_wait = PTHREAD_COND_INITIALIZER;
 
 /* Imported functions */
 
@@ -78,6 +80,8 @@ static struct s_cmds fd_cmds[] = {
 /* Commands from the File daemon that require additional scanning */
 static char read_open[] =
    "read open session = %127s %ld %ld %ld %ld %ld %ld\n";
+static char append_data_streams[] =
+   "append data %d streams=%d\n";
 
 /* Responses sent to the File daemon */
 static char NO_open[] =
@@ -90,6 +94,10 @@ static char OK_close[] =
    "3000 OK close Status = %d\n";
 static char OK_open[] =
    "3000 OK open ticket = %d\n";
+static char OK_open_streams[] =
+   "3000 OK open ticket = %d streams=%d\n";
+static char OK_open_dedup[] =
+   "3000 OK open ticket = %d streams=%d dedup=%d\n";
 static char ERROR_append[] =
    "3903 Error append data\n";
 
@@ -160,6 +168,111 @@ void *handle_filed_connection(BSOCK *fd, char *job_name)
    return NULL;
 }
 
+/**
+ * After receiving an additional data connection of a multi stream
+ * backup from the File daemon, this routine is called.
+ */
+void *handle_filed_stream_connection(BSOCK *fd, char *job_name, int stream)
+{
+   JCR *jcr;
+   char *auth_key = NULL;
+
+   if (!(jcr = get_jcr_by_full_name(job_name))) {
+      Jmsg1(NULL, M_FATAL, 0, _("FD connect failed: Job name not found: %s\n"), job_name);
+      Dmsg1(3, "**** Job \"%s\" not found.\n", job_name);
+      fd->close();
+      delete fd;
+      return NULL;
+   }
+
+   /*
+    * The key is destroyed once the job has all its connections, so use a copy.
+    */
+   P(stream_mutex);
+   if (jcr->fd_streams_auth_key) {
+      auth_key = bstrdup(jcr->fd_streams_auth_key);
+   }
+   V(stream_mutex);
+
+   if (!auth_key || !authenticate_filedaemon_stream(fd, auth_key)) {
+      Jmsg1(jcr, M_ERROR, 0, _("Unable to authenticate data connection %d of File daemon\n"), stream);
+      goto bail_out;
+   }
+   memset(auth_key, 0, strlen(auth_key));
+   free(auth_key);
+   auth_key = NULL;
+
+   P(stream_mutex);
+   if (!jcr->fd_streams || stream < 1 || stream >= jcr->max_fd_streams || jcr->fd_streams[stream]) {
+      V(stream_mutex);
+      Jmsg1(jcr, M_ERROR, 0, _("Unexpected data connection %d of File daemon\n"), stream);
+      goto bail_out;
+   }
+   fd->set_jcr(jcr);
+   jcr->fd_streams[stream] = fd;
+   pthread_cond_broadcast(&stream_wait);
+   V(stream_mutex);
+
+   Dmsg2(50, "Data connection %d of Job %s\n", stream, jcr->Job);
+   free_jcr(jcr);
+
+   return NULL;
+
+bail_out:
+   if (auth_key) {
+      memset(auth_key, 0, strlen(auth_key));
+      free(auth_key);
+   }
+   fd->close();
+   delete fd;
+   free_jcr(jcr);
+
+   return NULL;
+}
+
+/**
+ * Wait until the File daemon opened the additional data connections.
+ */
+static bool wait_for_fd_streams(JCR *jcr, int nr_streams)
+{
+   int i;
+   struct timeval tv;
+   struct timezone tz;
+   struct timespec timeout;
+   bool complete = false;
+
+   if (nr_streams < 1 || nr_streams > jcr->max_fd_streams) {
+      return false;
+   }
+
+   gettimeofday(&tv, &tz);
+   timeout.tv_nsec = tv.tv_usec * 1000;
+   timeout.tv_sec = tv.tv_sec + 60;
+
+   P(stream_mutex);
+   while (!job_canceled(jcr)) {
+      for (i = 1; i < nr_streams && jcr->fd_streams[i]; i++);
+      if (i == nr_streams) {
+         complete = true;
+         break;
+      }
+      if (pthread_cond_timedwait(&stream_wait, &stream_mutex, &timeout) == ETIMEDOUT) {
+         break;
+      }
+   }
+   if (complete) {
+      jcr->nr_fd_streams = nr_streams;
+   }
+   if (jcr->fd_streams_auth_key) {
+      memset(jcr->fd_streams_auth_key, 0, strlen(jcr->fd_streams_auth_key));
+      free(jcr->fd_streams_auth_key);
+      jcr->fd_streams_auth_key = NULL;
+   }
+   V(stream_mutex);
+
+   return complete;
+}
+
 /**
  * Run a File daemon Job -- File daemon already authorized
  * Director sends us this command.
@@ -263,10 +376,17 @@ void do_fd_commands(JCR *jcr)
 static bool append_data_cmd(JCR *jcr)
 {
    BSOCK *fd = jcr->file_bsock;
+   int ticket, nr_streams;
 
    Dmsg1(120, "Append data: %s", fd->msg);
    if (jcr->session_opened) {
       Dmsg1(110, "<filed: %s", fd->msg);
+      if (sscanf(fd->msg, append_data_streams, &ticket, &nr_streams) == 2 &&
+          !wait_for_fd_streams(jcr, nr_streams)) {
+         pm_strcpy(jcr->errmsg, _("Data connections of File daemon missing.\n"));
+         fd->fsend(ERROR_append);
+         return false;
+      }
       jcr->setJobType(JT_BACKUP);
       if (do_append_data(jcr, fd, "FD")) {
          return true;
@@ -301,6 +421,7 @@ static bool append_end_session(JCR *jcr)
 static bool append_open_session(JCR *jcr)
 {
    BSOCK *fd = jcr->file_bsock;
+   int nr_streams = 1;
 
    Dmsg1(120, "Append open session: %s", fd->msg);
    if (jcr->session_opened) {
@@ -311,8 +432,27 @@ static bool append_open_session(JCR *jcr)
 
    jcr->session_opened = true;
 
-   /* Send "Ticket" to File Daemon */
-   fd->fsend(OK_open, jcr->VolSessionId);
+   /*
+    * Send "Ticket" to File Daemon, offer multiple data connections when allowed
+    * and tell it when the device keeps a chunk store for deduplicated data.
+    */
+   if (me->max_network_data_streams > 1 && !jcr->fd_streams) {
+      nr_streams = me->max_network_data_streams;
+      P(stream_mutex);
+      jcr->max_fd_streams = me->max_network_data_streams;
+      jcr->fd_streams = (BSOCK **)malloc(jcr->max_fd_streams * sizeof(BSOCK *));
+      memset(jcr->fd_streams, 0, jcr->max_fd_streams * sizeof(BSOCK *));
+      jcr->fd_streams[0] = fd;
+      V(stream_mutex);
+   }
+
+   if (jcr->dcr && jcr->dcr->dev && jcr->dcr->dev->dedup) {
+      fd->fsend(OK_open_dedup, jcr->VolSessionId, nr_streams, 1);
+   } else if (nr_streams > 1) {
+      fd->fsend(OK_open_streams, jcr->VolSessionId, nr_streams);
+   } else {
+      fd->fsend(OK_open, jcr->VolSessionId);
+   }
    Dmsg1(110, ">filed: %s", fd->msg);
 
    return true;
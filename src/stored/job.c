@@ -204,6 +204,13 @@ bool do_job_run(JCR *jcr)
    V(mutex);
    Dmsg2(800, "Auth fail or cancel for jid=%d %p\n", jcr->JobId, jcr);
 
+   /*
+    * The additional data connections of a multi stream backup authenticate
+    * with the same key after the File daemon is started, so keep a copy.
+    */
+   if (jcr->authenticated && me->max_network_data_streams > 1) {
+      jcr->fd_streams_auth_key = bstrdup(jcr->sd_auth_key);
+   }
    memset(jcr->sd_auth_key, 0, strlen(jcr->sd_auth_key));
    switch (jcr->getJobProtocol()) {
    case PT_NDMP_BAREOS:
@@ -470,6 +477,23 @@ void stored_free_jcr(JCR *jcr)
       jcr->store_bsock = NULL;
    }
 
+   if (jcr->fd_streams) {
+      for (int i = 1; i < jcr->max_fd_streams; i++) {
+         if (jcr->fd_streams[i]) {
+            jcr->fd_streams[i]->close();
+            delete jcr->fd_streams[i];
+         }
+      }
+      free(jcr->fd_streams);
+      jcr->fd_streams = NULL;
+   }
+
+   if (jcr->fd_streams_auth_key) {
+      memset(jcr->fd_streams_auth_key, 0, strlen(jcr->fd_streams_auth_key));
+      free(jcr->fd_streams_auth_key);
+      jcr->fd_streams_auth_key = NULL;
+   }
+
    if (jcr->file_bsock) {
       jcr->file_bsock->close();
       delete jcr->file_bsock;
@@ -137,6 +137,31 @@ static bool clone_record_internally(DCR *dcr, DEV_RECORD *rec)
       goto bail_out;
    }
 
+   /*
+    * The records of a block copied as a whole are on the volume already,
+    * only account for them.
+    */
+   if (dcr->block_copied) {
+      if (rec->FileIndex < 0) {
+         retval = true;
+         goto bail_out;
+      }
+
+      if (rec->VolSessionId != rec->last_VolSessionId ||
+          rec->VolSessionTime != rec->last_VolSessionTime ||
+          rec->FileIndex != rec->last_FileIndex) {
+         jcr->JobFiles++;
+         rec->last_VolSessionId = rec->VolSessionId;
+         rec->last_VolSessionTime = rec->VolSessionTime;
+         rec->last_FileIndex = rec->FileIndex;
+      }
+      jcr->JobBytes += rec->data_len;
+      send_attrs_to_dir(jcr, rec);
+
+      retval = true;
+      goto bail_out;
+   }
+
 //   if (jcr->is_JobType(JT_BACKUP)) {
       /*
        * For normal migration jobs, FileIndex values are sequential because
@@ -158,7 +183,13 @@ static bool clone_record_internally(DCR *dcr, DEV_RECORD *rec)
             rec->last_VolSessionTime = rec->VolSessionTime;
             rec->last_FileIndex = rec->FileIndex;
          }
-         rec->FileIndex = jcr->JobFiles;     /* set sequential output FileIndex */
+         /*
+          * When copying blocks as a whole the FileIndex of the session is kept
+          * for all records, those of the copied blocks cannot be changed.
+          */
+         if (!dcr->copy_blocks) {
+            rec->FileIndex = jcr->JobFiles;  /* set sequential output FileIndex */
+         }
       }
 //   }
 
@@ -181,6 +212,10 @@ static bool clone_record_internally(DCR *dcr, DEV_RECORD *rec)
       goto bail_out;
    }
 
+   if (!dedup_write_translation(jcr->dcr)) {
+      goto bail_out;
+   }
+
    /*
     * The record got translated when we got an after_rec pointer after calling the
     * bsdEventWriteRecordTranslation plugin event. If no translation has taken place
@@ -234,6 +269,226 @@ bail_out:
    return retval;
 }
 
+/**
+ * Scan the records of a block read for a copy of whole blocks.
+ *
+ * Returns: -1 if the block is not of the session or only holds volume labels
+ *           0 if the records of the block must be cloned one by one
+ *           1 if the block can be copied as a whole
+ */
+static int scan_block_to_copy(DCR *dcr, int32_t *FirstIndex, int32_t *LastIndex, bool *in_record)
+{
+   ser_declare;
+   int32_t FileIndex, Stream;
+   uint32_t data_bytes;
+   uint32_t pos, end;
+   bool labels = false, records = false;
+   DEV_BLOCK *block = dcr->block;
+   BSR *bsr = dcr->jcr->bsr;
+
+   if (block->BlockVer < 2 ||
+       block->VolSessionId != bsr->sessid->sessid ||
+       block->VolSessionTime != bsr->sesstime->sesstime) {
+      return -1;
+   }
+
+   /*
+    * The block must have been read completely and fit in the block we write.
+    */
+   if (block->block_len > block->read_len ||
+       block->block_len < BLKHDR2_LENGTH ||
+       block->block_len - BLKHDR2_LENGTH > dcr->jcr->dcr->block->buf_len - WRITE_BLKHDR_LENGTH) {
+      return 0;
+   }
+
+   *FirstIndex = *LastIndex = 0;
+   *in_record = false;
+   end = block->block_len;
+   for (pos = BLKHDR2_LENGTH; pos + RECHDR2_LENGTH <= end; pos += RECHDR2_LENGTH + data_bytes) {
+      unser_begin(block->buf + pos, RECHDR2_LENGTH);
+      unser_int32(FileIndex);
+      unser_int32(Stream);
+      unser_uint32(data_bytes);
+
+      switch (FileIndex) {
+      case PRE_LABEL:
+      case VOL_LABEL:
+      case EOT_LABEL:
+      case EOM_LABEL:
+         labels = true;
+         continue;
+      default:
+         records = true;
+         break;
+      }
+
+      /*
+       * A block starting with the rest of a record continues a block
+       * copied as a whole or it is cloned record by record like the block
+       * before.
+       */
+      if (Stream < 0 && pos == BLKHDR2_LENGTH && !dcr->copy_in_record) {
+         return 0;
+      }
+
+      /*
+       * Deduplicated data is only valid as it is in the same chunk store.
+       */
+      if (((Stream < 0 ? -Stream : Stream) & STREAMMASK_TYPE) == STREAM_DEDUP_DATA &&
+          dcr->dev->dedup != dcr->jcr->dcr->dev->dedup) {
+         return 0;
+      }
+
+      if (FileIndex > 0) {
+         if (FileIndex > dcr->copy_last_index) {
+            return 0;
+         }
+         if (*FirstIndex == 0) {
+            *FirstIndex = FileIndex;
+         }
+         *LastIndex = FileIndex;
+      }
+
+      if (data_bytes > end - pos - RECHDR2_LENGTH) {
+         *in_record = true;
+         break;
+      }
+   }
+
+   if (!records) {
+      return -1;
+   }
+
+   return labels ? 0 : 1;
+}
+
+/**
+ * Called here for each block from read_records() when the session is
+ * copied as a whole. A block holding only records of the session is
+ * written as it is, only its header gets the block number and session
+ * of this job. Other blocks are left to clone_record_internally().
+ *
+ * Returns: true if OK
+ *          false if error
+ */
+static bool copy_block_internally(DCR *dcr)
+{
+   int status;
+   int32_t FirstIndex, LastIndex;
+   bool in_record;
+   uint32_t len;
+   JCR *jcr = dcr->jcr;
+   DEV_BLOCK *block = dcr->block;
+   DEV_BLOCK *wblock = jcr->dcr->block;
+   DEVICE *dev = jcr->dcr->dev;
+
+   dcr->block_copied = false;
+
+   status = scan_block_to_copy(dcr, &FirstIndex, &LastIndex, &in_record);
+   if (status < 0) {
+      return true;
+   }
+
+   if (status == 0) {
+      if (dcr->copy_in_record) {
+         Jmsg2(jcr, M_FATAL, 0, _("Cannot continue the record copied from block %u of volume %s.\n"),
+               block->BlockNumber, dcr->VolumeName);
+         return false;
+      }
+      Dmsg1(200, "Clone records of block %u\n", block->BlockNumber);
+      return true;
+   }
+
+   /*
+    * Flush the records cloned before, the block starts a new one.
+    */
+   if (wblock->binbuf > WRITE_BLKHDR_LENGTH && !jcr->dcr->write_block_to_device()) {
+      goto bail_out;
+   }
+
+   len = block->block_len - BLKHDR2_LENGTH;
+   memcpy(wblock->buf + WRITE_BLKHDR_LENGTH, block->buf + BLKHDR2_LENGTH, len);
+   wblock->binbuf = WRITE_BLKHDR_LENGTH + len;
+   wblock->bufp = wblock->buf + wblock->binbuf;
+   wblock->FirstIndex = FirstIndex;
+   wblock->LastIndex = LastIndex;
+   wblock->VolSessionId = jcr->VolSessionId;
+   wblock->VolSessionTime = jcr->VolSessionTime;
+
+   Dmsg4(200, "Copy block %u len=%u FI=%d-%d\n", block->BlockNumber, len, FirstIndex, LastIndex);
+   if (!jcr->dcr->write_block_to_device()) {
+      goto bail_out;
+   }
+
+   dcr->block_copied = true;
+   dcr->copy_in_record = in_record;
+
+   return true;
+
+bail_out:
+   Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+         dev->print_name(), dev->bstrerror());
+   return false;
+}
+
+/**
+ * See if the blocks read can be copied as a whole. This is the case for
+ * a local copy or migration of one session with all its files when the
+ * records are not translated on the way.
+ */
+static bool can_copy_blocks(JCR *jcr)
+{
+   int32_t last_index = 0;
+   DCR *dcr = jcr->read_dcr;
+
+   if (!jcr->is_JobType(JT_COPY) && !jcr->is_JobType(JT_MIGRATE)) {
+      return false;
+   }
+
+   if (dcr->autodeflate != IO_DIRECTION_NONE || dcr->autoinflate != IO_DIRECTION_NONE ||
+       jcr->dcr->autodeflate != IO_DIRECTION_NONE || jcr->dcr->autoinflate != IO_DIRECTION_NONE) {
+      return false;
+   }
+
+   if (jcr->plugin_ctx_list && jcr->plugin_ctx_list->size() > 0) {
+      return false;
+   }
+
+   /*
+    * All bsrs must select the same session and the FileIndexes of all
+    * of them must make up one range from the first file on.
+    */
+   if (!jcr->bsr || !jcr->bsr->sessid || !jcr->bsr->sesstime) {
+      return false;
+   }
+
+   for (BSR *bsr = jcr->bsr; bsr; bsr = bsr->next) {
+      if (!bsr->sessid || bsr->sessid->next ||
+          bsr->sessid->sessid != bsr->sessid->sessid2 ||
+          bsr->sessid->sessid != jcr->bsr->sessid->sessid ||
+          !bsr->sesstime || bsr->sesstime->next ||
+          bsr->sesstime->sesstime != jcr->bsr->sesstime->sesstime) {
+         return false;
+      }
+
+      if (bsr->fileregex || bsr->stream || bsr->JobId || bsr->job ||
+          bsr->client || bsr->JobType || bsr->JobLevel) {
+         return false;
+      }
+
+      if (bsr->nr_findex_ranges != 1 ||
+          bsr->findex_ranges[0].findex > last_index + 1 ||
+          (last_index == 0 && bsr->findex_ranges[0].findex > 1)) {
+         return false;
+      }
+      last_index = MAX(last_index, bsr->findex_ranges[0].findex2);
+   }
+
+   dcr->copy_last_index = last_index;
+
+   return true;
+}
+
 /**
  * Called here for each record from read_records()
  * This function is used when we do a external clone of a Job e.g.
@@ -444,7 +699,7 @@ bool do_mac_run(JCR *jcr)
 {
    DEVICE *dev;
    utime_t now;
-   char ec1[50];
+   char ec1[50], ec2[50];
    const char *Type;
    bool ok = true;
    BSOCK *dir = jcr->dir_bsock;
@@ -574,6 +829,12 @@ bool do_mac_run(JCR *jcr)
          goto bail_out;
       }
 
+      if (sd->is_compressing()) {
+         Jmsg(jcr, M_INFO, 0, _("Network compression: %s bytes of data sent as %s bytes\n"),
+              edit_uint64_with_commas(sd->get_raw_bytes_sent(), ec1),
+              edit_uint64_with_commas(sd->get_wire_bytes_sent(), ec2));
+      }
+
       /*
        * Expect to get response that the replicate data succeeded.
        */
@@ -645,7 +906,17 @@ bool do_mac_run(JCR *jcr)
       /*
        * Read all data and make a local clone of it.
        */
-      ok = read_records(jcr->read_dcr, clone_record_internally, mount_next_read_volume);
+      if (can_copy_blocks(jcr)) {
+         Dmsg1(100, "Copy blocks of session up to FileIndex %d\n", jcr->read_dcr->copy_last_index);
+         jcr->read_dcr->copy_blocks = true;
+         ok = read_records(jcr->read_dcr, clone_record_internally, mount_next_read_volume,
+                           copy_block_internally);
+      } else {
+         ok = read_records(jcr->read_dcr, clone_record_internally, mount_next_read_volume);
+      }
+      if (!finish_dedup_job(jcr->dcr)) {
+         ok = false;
+      }
    }
 
 bail_out:
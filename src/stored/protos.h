@@ -48,8 +48,18 @@ bool authenticate_director(JCR *jcr);
 bool authenticate_storagedaemon(JCR *jcr);
 bool authenticate_with_storagedaemon(JCR *jcr);
 bool authenticate_filedaemon(JCR *jcr);
+bool authenticate_filedaemon_stream(BSOCK *fd, char *auth_key);
 bool authenticate_with_filedaemon(JCR *jcr);
 
+/* async_write.c */
+async_writer *new_async_writer(DEVICE *dev, int nr_blocks);
+void free_async_writer(async_writer *aw);
+async_write_slot *get_async_write_slot(async_writer *aw);
+void queue_async_write(async_writer *aw, DCR *dcr);
+bool wait_async_writer(async_writer *aw, bool all);
+bool drain_async_writer(async_writer *aw);
+void clear_async_writer(async_writer *aw);
+
 /* autochanger.c */
 bool init_autochangers();
 int autoload_device(DCR *dcr, int writing, BSOCK *dir);
@@ -69,6 +79,15 @@ void empty_block(DEV_BLOCK *block);
 void free_block(DEV_BLOCK *block);
 void print_block_read_errors(JCR *jcr, DEV_BLOCK *block);
 void ser_block_header(DEV_BLOCK *block);
+ssize_t write_block_buffer(DEVICE *dev, DEV_BLOCK *block, uint32_t wlen);
+bool wait_async_writes(DCR *dcr, bool all);
+
+/* block_index.c */
+block_index *new_block_index();
+void free_block_index(block_index *idx);
+void close_block_index(block_index *idx);
+void update_block_index(DCR *dcr, uint32_t wlen);
+void seek_block_index(DCR *dcr);
 
 /* butil.c -- utilities for SD tool programs */
 void print_ls_output(const char *fname, const char *link, int type, struct stat *statp);
@@ -80,6 +99,15 @@ void display_tape_error_status(JCR *jcr, DEVICE *dev);
 /* crc32.c */
 uint32_t bcrc32(uint8_t *buf, int len);
 
+/* dedup.c */
+dedup_store *open_dedup_store(JCR *jcr, const char *directory);
+void close_dedup_store(dedup_store *store);
+bool sync_dedup_store(JCR *jcr, dedup_store *store);
+bool dedup_write_translation(DCR *dcr);
+bool dedup_read_translation(DCR *dcr);
+bool finish_dedup_job(DCR *dcr);
+void free_dedup_chunks(DCR *dcr);
+
 /* dev.c */
 DEVICE *init_dev(JCR *jcr, DEVRES *device);
 bool can_open_mounted_dev(DEVICE *dev);
@@ -91,6 +119,7 @@ JCR *next_attached_jcr(DEVICE *dev, JCR *jcr);
 void init_device_wait_timers(DCR *dcr);
 void init_jcr_device_wait_timers(JCR *jcr);
 bool double_dev_wait_time(DEVICE *dev);
+void get_volume_file_name(DEVICE *dev, const char *VolumeName, POOLMEM *&fname);
 
 /* device.c */
 bool open_device(DCR *dcr);
@@ -107,6 +136,7 @@ void *handle_director_connection(BSOCK *dir);
 
 /* fd_cmds.c */
 void *handle_filed_connection(BSOCK *fd, char *job_name);
+void *handle_filed_stream_connection(BSOCK *fd, char *job_name, int stream);
 void run_job(JCR *jcr);
 void do_fd_commands(JCR *jcr);
 
@@ -143,6 +173,7 @@ void _give_back_device_lock(const char *file, int line, DEVICE *dev, bsteal_lock
 int match_bsr(BSR *bsr, DEV_RECORD *rec, VOLUME_LABEL *volrec,
               SESSION_LABEL *sesrec, JCR *jcr);
 int match_bsr_block(BSR *bsr, DEV_BLOCK *block);
+int match_bsr_block_index(BSR *bsr, VOLUME_LABEL *volrec, block_index_entry *entry);
 void position_bsr_block(BSR *bsr, DEV_BLOCK *block);
 BSR *find_next_bsr(BSR *root_bsr, DEVICE *dev);
 bool is_this_bsr_done(BSR *bsr, DEV_RECORD *rec);
@@ -176,6 +207,11 @@ char *bareos_status(char *buf, int buf_len);
 /* read.c */
 bool do_read_data(JCR *jcr);
 
+/* read_ahead.c */
+read_ahead *new_read_ahead(DCR *dcr);
+void update_read_ahead(read_ahead *ra, DCR *dcr);
+void free_read_ahead(read_ahead *ra);
+
 /* read_record.c */
 READ_CTX *new_read_context(void);
 void free_read_context(READ_CTX *rctx);
@@ -190,7 +226,8 @@ bool read_next_record_from_block(DCR *dcr,
                                  bool *done);
 bool read_records(DCR *dcr,
                   bool record_cb(DCR *dcr, DEV_RECORD *rec),
-                  bool mount_cb(DCR *dcr));
+                  bool mount_cb(DCR *dcr),
+                  bool block_cb(DCR *dcr) = NULL);
 
 /* record.c */
 const char *FI_to_ascii(char *buf, int fi);
@@ -199,6 +236,7 @@ const char *record_to_str(POOL_MEM &resultbuffer, JCR *jcr, const DEV_RECORD *re
 void dump_record(const char *tag, const DEV_RECORD *rec);
 bool write_record_to_block(DCR *dcr, DEV_RECORD *rec);
 bool can_write_record_to_block(DEV_BLOCK *block, const DEV_RECORD *rec);
+char *record_data_in_block(DEV_BLOCK *block, int32_t *navail);
 bool read_record_from_block(DCR *dcr, DEV_RECORD *rec);
 DEV_RECORD *new_record(bool with_data = true);
 void empty_record(DEV_RECORD *rec);
@@ -295,7 +333,7 @@ void start_socket_server(dlist *addrs);
 void stop_socket_server();
 
 /* spool.c */
-bool begin_data_spool (DCR *dcr);
+bool begin_data_spool (DCR *dcr, bool concurrent_despool = false);
 bool discard_data_spool (DCR *dcr);
 bool commit_data_spool (DCR *dcr);
 bool are_attributes_spooled (JCR *jcr);
@@ -303,6 +341,8 @@ bool begin_attribute_spool (JCR *jcr);
 bool discard_attribute_spool (JCR *jcr);
 bool commit_attribute_spool (JCR *jcr);
 bool write_block_to_spool_file (DCR *dcr);
+void lock_data_spool (DCR *dcr);
+void unlock_data_spool (DCR *dcr);
 void list_spool_stats (void sendit(const char *msg, int len, void *sarg), void *arg);
 
 /* vol_mgr.c */
@@ -0,0 +1,321 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Read ahead thread of jobs reading disk volumes with a bootstrap.
+ *
+ * The bootstrap names the volumes and the parts of them a restore,
+ * copy or migration reads, in the order they are read. A device with
+ * a "Read Ahead Size" starts a thread for such a job that opens the
+ * volume files itself and reads these parts into the page cache ahead
+ * of the job, also the parts of the volumes after the one mounted.
+ * The job then finds the blocks it reads in memory instead of waiting
+ * for the disks, also right after a volume switch.
+ *
+ * The thread stays at most the read ahead size ahead of the job, when
+ * the job skips a part it continues from where the job reads.
+ */
+
+#include "bareos.h"
+#include "stored.h"
+
+static const int dbglvl = 200;
+
+/**
+ * Add the volume of a bsr to the volumes to read ahead, returns its index.
+ */
+static uint32_t add_read_ahead_volume(read_ahead *ra, const char *VolumeName)
+{
+   read_ahead_volume *vol;
+   struct stat st;
+
+   for (uint32_t i = ra->nr_volumes; i > 0; i--) {
+      if (bstrcmp(ra->volumes[i - 1].VolumeName, VolumeName)) {
+         return i - 1;
+      }
+   }
+
+   ra->volumes = (read_ahead_volume *)realloc(ra->volumes, (ra->nr_volumes + 1) * sizeof(read_ahead_volume));
+   vol = &ra->volumes[ra->nr_volumes];
+   bstrncpy(vol->VolumeName, VolumeName, sizeof(vol->VolumeName));
+   vol->fname = get_pool_memory(PM_FNAME);
+   get_volume_file_name(ra->dev, VolumeName, vol->fname);
+   vol->size = (stat(vol->fname, &st) == 0 && S_ISREG(st.st_mode)) ? st.st_size : 0;
+
+   return ra->nr_volumes++;
+}
+
+static void add_read_ahead_range(read_ahead *ra, uint32_t vol, uint64_t start, uint64_t end)
+{
+   read_ahead_range *range;
+
+   end = MIN(end, ra->volumes[vol].size);
+   if (start >= end) {
+      return;
+   }
+
+   /*
+    * Merge with the range before when they overlap.
+    */
+   if (ra->nr_ranges) {
+      range = &ra->ranges[ra->nr_ranges - 1];
+      if (range->vol == vol && start >= range->start && start <= range->end) {
+         range->end = MAX(range->end, end);
+         return;
+      }
+   }
+
+   if (ra->nr_ranges % 64 == 0) {
+      ra->ranges = (read_ahead_range *)realloc(ra->ranges, (ra->nr_ranges + 64) * sizeof(read_ahead_range));
+   }
+   range = &ra->ranges[ra->nr_ranges++];
+   range->vol = vol;
+   range->start = start;
+   range->end = end;
+}
+
+/**
+ * Collect the parts of the volumes to read from the bootstrap. A bsr
+ * without VolAddr reads its whole volume.
+ */
+static void build_read_ahead_ranges(read_ahead *ra)
+{
+   uint32_t vol;
+   uint64_t pos = 0;
+
+   for (BSR *bsr = ra->bsr; bsr; bsr = bsr->next) {
+      if (!bsr->volume) {
+         continue;
+      }
+
+      vol = add_read_ahead_volume(ra, bsr->volume->VolumeName);
+      if (bsr->nr_voladdr_ranges) {
+         for (uint32_t i = 0; i < bsr->nr_voladdr_ranges; i++) {
+            add_read_ahead_range(ra, vol, bsr->voladdr_ranges[i].saddr, bsr->voladdr_ranges[i].eaddr + 1);
+         }
+      } else {
+         add_read_ahead_range(ra, vol, 0, UINT64_MAX);
+      }
+   }
+
+   for (uint32_t i = 0; i < ra->nr_ranges; i++) {
+      ra->ranges[i].pos = pos;
+      pos += ra->ranges[i].end - ra->ranges[i].start;
+   }
+
+   Dmsg3(dbglvl, "Read ahead of %d ranges in %d volumes, %lld bytes\n",
+         ra->nr_ranges, ra->nr_volumes, pos);
+}
+
+/**
+ * Find the position of the job in the ranges, starting at range cur.
+ * The ranges of a volume follow each other, a job reading after the
+ * last range of its volume is at the start of the next range.
+ * The lock must be held.
+ *
+ * Returns: false if the volume of the job has no range left
+ *          true otherwise with the range and the position
+ */
+static bool get_read_position(read_ahead *ra, uint32_t *cur, uint64_t *pos)
+{
+   uint32_t i = *cur;
+   read_ahead_range *range;
+
+   while (i < ra->nr_ranges && !bstrcmp(ra->volumes[ra->ranges[i].vol].VolumeName, ra->VolumeName)) {
+      i++;
+   }
+   if (i == ra->nr_ranges) {
+      return false;
+   }
+
+   while (i + 1 < ra->nr_ranges &&
+          ra->ranges[i].vol == ra->ranges[i + 1].vol &&
+          ra->ranges[i].end <= ra->addr) {
+      i++;
+   }
+
+   range = &ra->ranges[i];
+   if (ra->addr >= range->end) {
+      if (i + 1 == ra->nr_ranges) {
+         return false;
+      }
+      range = &ra->ranges[++i];
+      *pos = range->pos;
+   } else if (ra->addr > range->start) {
+      *pos = range->pos + ra->addr - range->start;
+   } else {
+      *pos = range->pos;
+   }
+   *cur = i;
+
+   return true;
+}
+
+static void *read_ahead_thread(void *arg)
+{
+   read_ahead *ra = (read_ahead *)arg;
+   read_ahead_range *range;
+   uint32_t cur = 0, next = 0, fd_vol = 0;
+   uint64_t addr, pos = 0, next_pos;
+   ssize_t len;
+   int fd = -1;
+   char *buf;
+
+   build_read_ahead_ranges(ra);
+   if (ra->nr_ranges == 0) {
+      return NULL;
+   }
+   buf = (char *)malloc(READ_AHEAD_CHUNK);
+   addr = ra->ranges[0].start;
+
+   P(ra->lock);
+   while (!ra->quit && next < ra->nr_ranges) {
+      /*
+       * Continue from the job when it is ahead of us, wait while we are
+       * far enough ahead of it.
+       */
+      range = &ra->ranges[next];
+      next_pos = range->pos + addr - range->start;
+      if (get_read_position(ra, &cur, &pos) && next_pos < pos) {
+         next = cur;
+         range = &ra->ranges[next];
+         addr = range->start + pos - range->pos;
+         continue;
+      }
+      if (next_pos >= pos + ra->size) {
+         pthread_cond_wait(&ra->moved, &ra->lock);
+         continue;
+      }
+      V(ra->lock);
+
+      range = &ra->ranges[next];
+      if (fd < 0 || fd_vol != range->vol) {
+         if (fd >= 0) {
+            ::close(fd);
+         }
+         fd_vol = range->vol;
+         fd = ::open(ra->volumes[fd_vol].fname, O_RDONLY | O_BINARY);
+         Dmsg2(dbglvl, "Read ahead opened %s fd=%d\n", ra->volumes[fd_vol].fname, fd);
+      }
+
+      len = -1;
+      if (fd >= 0) {
+         len = pread(fd, buf, MIN((uint64_t)READ_AHEAD_CHUNK, range->end - addr), addr);
+      }
+      if (len > 0) {
+         addr += len;
+      }
+      if (len <= 0 || addr >= range->end) {
+         if (++next < ra->nr_ranges) {
+            addr = ra->ranges[next].start;
+         }
+      }
+
+      P(ra->lock);
+   }
+   V(ra->lock);
+
+   if (fd >= 0) {
+      ::close(fd);
+   }
+   free(buf);
+
+   return NULL;
+}
+
+/**
+ * Start reading ahead for a job reading with a bootstrap on a disk device.
+ *
+ * Returns: NULL if there is no read ahead
+ *          read ahead on success
+ */
+read_ahead *new_read_ahead(DCR *dcr)
+{
+   int status;
+   read_ahead *ra;
+   DEVICE *dev = dcr->dev;
+
+   if (!dcr->jcr->bsr || !dev->is_file() || !dev->device->read_ahead_size) {
+      return NULL;
+   }
+
+   ra = (read_ahead *)malloc(sizeof(read_ahead));
+   memset(ra, 0, sizeof(read_ahead));
+   ra->dev = dev;
+   ra->bsr = dcr->jcr->bsr;
+   ra->size = dev->device->read_ahead_size;
+   pthread_mutex_init(&ra->lock, NULL);
+   pthread_cond_init(&ra->moved, NULL);
+
+   if ((status = pthread_create(&ra->thread_id, NULL, read_ahead_thread, (void *)ra)) != 0) {
+      berrno be;
+
+      Jmsg2(dcr->jcr, M_WARNING, 0, _("Cannot create read ahead thread for device %s. ERR=%s\n"),
+            dev->print_name(), be.bstrerror(status));
+      ra->thread_id = 0;
+      free_read_ahead(ra);
+      return NULL;
+   }
+
+   Dmsg2(dbglvl, "Created read ahead thread of %lld bytes for device %s\n", ra->size, dev->print_name());
+   return ra;
+}
+
+/**
+ * Tell the read ahead thread where the job reads next.
+ */
+void update_read_ahead(read_ahead *ra, DCR *dcr)
+{
+   P(ra->lock);
+   if (!bstrcmp(ra->VolumeName, dcr->VolumeName)) {
+      bstrncpy(ra->VolumeName, dcr->VolumeName, sizeof(ra->VolumeName));
+   }
+   ra->addr = dcr->dev->file_addr;
+   pthread_cond_signal(&ra->moved);
+   V(ra->lock);
+}
+
+/**
+ * Stop the read ahead thread.
+ */
+void free_read_ahead(read_ahead *ra)
+{
+   if (ra->thread_id) {
+      P(ra->lock);
+      ra->quit = true;
+      pthread_cond_signal(&ra->moved);
+      V(ra->lock);
+      pthread_join(ra->thread_id, NULL);
+   }
+
+   for (uint32_t i = 0; i < ra->nr_volumes; i++) {
+      free_pool_memory(ra->volumes[i].fname);
+   }
+   if (ra->volumes) {
+      free(ra->volumes);
+   }
+   if (ra->ranges) {
+      free(ra->ranges);
+   }
+   pthread_cond_destroy(&ra->moved);
+   pthread_mutex_destroy(&ra->lock);
+   free(ra);
+}
@@ -0,0 +1,70 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Read ahead of disk volumes definitions
+ */
+
+#ifndef BAREOS_STORED_READ_AHEAD_H_
+#define BAREOS_STORED_READ_AHEAD_H_ 1
+
+#define READ_AHEAD_CHUNK (1024 * 1024) /**< Bytes read ahead at once */
+
+struct read_ahead_volume {
+   char VolumeName[MAX_NAME_LENGTH];  /**< Volume named in the bootstrap */
+   POOLMEM *fname;                    /**< Volume file in the archive directory */
+   uint64_t size;                     /**< Size of the volume file, 0 if not found */
+};
+
+/**
+ * A part of a volume the bootstrap selects, in the order it is read.
+ */
+struct read_ahead_range {
+   uint32_t vol;                      /**< Index in volumes */
+   uint64_t start;                    /**< First address */
+   uint64_t end;                      /**< Address after the range */
+   uint64_t pos;                      /**< Bytes in all ranges before this one */
+};
+
+/**
+ * The read ahead thread of a read job. It keeps reading the ranges
+ * of the volumes ahead of the position the job reads, at most size
+ * bytes ahead.
+ */
+struct read_ahead {
+   DEVICE *dev;                       /**< Device reading the volumes */
+   BSR *bsr;                          /**< Bootstrap of the job */
+   uint64_t size;                     /**< Maximum bytes read ahead */
+   pthread_t thread_id;               /**< Read ahead thread */
+   pthread_mutex_t lock;
+   pthread_cond_t moved;              /**< Signalled when the reading position moves */
+   bool quit;                         /**< Thread must exit */
+
+   char VolumeName[MAX_NAME_LENGTH];  /**< Volume the job reads */
+   uint64_t addr;                     /**< Address the job reads next */
+
+   uint32_t nr_volumes;
+   read_ahead_volume *volumes;
+   uint32_t nr_ranges;
+   read_ahead_range *ranges;
+};
+
+#endif /* BAREOS_STORED_READ_AHEAD_H_ */
@@ -372,22 +372,26 @@ bool read_next_record_from_block(DCR *dcr, READ_CTX *rctx, bool *done)
 
 /**
  * This subroutine reads all the records and passes them back to your
- * callback routine (also mount routine at EOM).
+ * callback routine (also mount routine at EOM). The optional block
+ * callback sees each block read before its records are passed on.
  *
  * You must not change any values in the DEV_RECORD packet
  */
 bool read_records(DCR *dcr,
                   bool record_cb(DCR *dcr, DEV_RECORD *rec),
-                  bool mount_cb(DCR *dcr))
+                  bool mount_cb(DCR *dcr),
+                  bool block_cb(DCR *dcr))
 {
    JCR *jcr = dcr->jcr;
    READ_CTX *rctx;
+   read_ahead *ra;
    bool ok = true;
    bool done = false;
 
    rctx = new_read_context();
    position_device_to_first_file(jcr, dcr);
    jcr->mount_next_volume = false;
+   ra = new_read_ahead(dcr);
 
    while (ok && !done) {
       if (job_canceled(jcr)) {
@@ -395,6 +399,12 @@ bool read_records(DCR *dcr,
          break;
       }
 
+      /*
+       * Skip the blocks the block index of the volume shows not to
+       * contain any wanted record.
+       */
+      seek_block_index(dcr);
+
       /*
        * Read the next block into our buffers.
        */
@@ -402,6 +412,15 @@ bool read_records(DCR *dcr,
          break;
       }
 
+      if (ra) {
+         update_read_ahead(ra, dcr);
+      }
+
+      if (block_cb && !block_cb(dcr)) {
+         ok = false;
+         break;
+      }
+
 #ifdef if_and_when_FAST_BLOCK_REJECTION_is_working
       /*
        * This does not stop when file/block are too big
@@ -459,6 +478,14 @@ bool read_records(DCR *dcr,
             dcr->before_rec = rctx->rec;
             dcr->after_rec = NULL;
 
+            /*
+             * Fill in the data of deduplicated chunks before the plugins see the record.
+             */
+            if (!dedup_read_translation(dcr)) {
+               ok = false;
+               continue;
+            }
+
             /*
              * We want the plugins to be called in reverse order so we give the generate_plugin_event()
              * the reverse argument so it knows that we want the plugins to be called in that order.
@@ -510,6 +537,9 @@ bool read_records(DCR *dcr,
    }
 // Dmsg2(dbglvl, "Position=(file:block) %u:%u\n", dcr->dev->file, dcr->dev->block_num);
 
+   if (ra) {
+      free_read_ahead(ra);
+   }
    free_read_context(rctx);
    print_block_read_errors(jcr, dcr->block);
 
@@ -147,6 +147,9 @@ static const char *record_compression_to_str(POOL_MEM &resultbuffer, const DEV_R
       case COMPRESS_FZ4H:
          compression_to_str(resultbuffer, "FZ4H", comp_len, comp_level, comp_version);
          break;
+      case COMPRESS_ZSTD:
+         compression_to_str(resultbuffer, "ZSTD", comp_len, comp_level, comp_version);
+         break;
       default:
          tmp.bsprintf(_("Compression algorithm 0x%x found, but not supported!\n"), comp_magic);
          resultbuffer.strcat(tmp);
@@ -247,6 +250,8 @@ const char *stream_to_ascii(char *buf, int stream, int fi)
          return "contSPARSE-GZIP";
       case STREAM_SPARSE_COMPRESSED_DATA:
          return "contSPARSE-COMPRESSED";
+      case STREAM_DEDUP_DATA:
+         return "contDEDUP-DATA";
       case STREAM_PROGRAM_NAMES:
          return "contPROG-NAMES";
       case STREAM_PROGRAM_DATA:
@@ -314,6 +319,8 @@ const char *stream_to_ascii(char *buf, int stream, int fi)
       return "SPARSE-GZIP";
    case STREAM_SPARSE_COMPRESSED_DATA:
       return "SPARSE-COMPRESSED";
+   case STREAM_DEDUP_DATA:
+      return "DEDUP-DATA";
    case STREAM_PROGRAM_NAMES:
       return "PROG-NAMES";
    case STREAM_PROGRAM_DATA:
@@ -599,11 +606,17 @@ static inline ssize_t write_header_to_block(DEV_BLOCK *block, const DEV_RECORD *
 static inline ssize_t write_data_to_block(DEV_BLOCK *block, const DEV_RECORD *rec)
 {
    uint32_t len;
+   char *data;
 
    len = MIN(rec->remainder, block_write_navail(block));
-   memcpy(block->bufp,
-          ((unsigned char *)rec->data) + (rec->data_len - rec->remainder),
-          len);
+   data = rec->data + (rec->data_len - rec->remainder);
+
+   /*
+    * Data received directly into the block (see record_data_in_block()) is already in place.
+    */
+   if (data != block->bufp) {
+      memcpy(block->bufp, data, len);
+   }
    block->bufp += len;
    block->binbuf += len;
 
@@ -651,6 +664,10 @@ bool DCR::write_record()
       goto bail_out;
    }
 
+   if (!dedup_write_translation(this)) {
+      goto bail_out;
+   }
+
    /*
     * The record got translated when we got an after_rec pointer after calling the
     * bsdEventWriteRecordTranslation plugin event. If no translation has taken place
@@ -848,6 +865,25 @@ bail_out:
    return retval;
 }
 
+/**
+ * Return the place in the block where the data of a record must be
+ * received to end up right behind its record header, so that
+ * write_record_to_block() does not have to copy it.
+ *
+ * Returns: NULL if there is no room left in the block
+ *          the buffer and in navail its size otherwise.
+ */
+char *record_data_in_block(DEV_BLOCK *block, int32_t *navail)
+{
+   if (block_write_navail(block) <= WRITE_RECHDR_LENGTH) {
+      *navail = 0;
+      return NULL;
+   }
+
+   *navail = block_write_navail(block) - WRITE_RECHDR_LENGTH;
+   return block->bufp + WRITE_RECHDR_LENGTH;
+}
+
 /**
  * Test if we can write whole record to the block
  *
@@ -50,6 +50,7 @@ static pthread_t tcp_server_tid;
  *
  * Basic tasks done here:
  *  - If it was a connection from the FD, call handle_filed_connection()
+ *  - If it was a data connection from the FD, call handle_filed_stream_connection()
  *  - If it was a connection from another SD, call handle_stored_connection()
  *  - Otherwise it was a connection from the DIR, call handle_director_connection()
  */
@@ -58,6 +59,7 @@ static void *handle_connection_request(void *arg)
    BSOCK *bs = (BSOCK *)arg;
    char name[MAX_NAME_LENGTH];
    char tbuf[MAX_TIME_LENGTH];
+   int stream;
 
    if (bs->recv() <= 0) {
       Emsg1(M_ERROR, 0, _("Connection request from %s failed.\n"), bs->who());
@@ -79,6 +81,14 @@ static void *handle_connection_request(void *arg)
 
    Dmsg1(110, "Conn: %s", bs->msg);
 
+   /*
+    * See if this is an additional data connection of a File daemon.
+    */
+   if (sscanf(bs->msg, "Hello Start Job %127s Stream %d", name, &stream) == 2) {
+      Dmsg1(110, "Got a FD data connection at %s\n", bstrftimes(tbuf, sizeof(tbuf), (utime_t)time(NULL)));
+      return handle_filed_stream_connection(bs, name, stream);
+   }
+
    /*
     * See if this is a File daemon connection. If so call FD handler.
     */
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2004-2012 Free Software Foundation Europe e.V.
-   Copyright (C) 2015-2016 Bareos GmbH & Co. KG
+   Copyright (C) 2015-2017 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -25,16 +25,25 @@
 /**
  * @file
  * Spooling code
+ *
+ * The data spool of a job is one file that is despooled to the volume
+ * when it gets too big and when the job ends. With Spool Segments set
+ * in the Device, the spool of a backup job is split into segment files
+ * instead. A full segment is handed to a despool thread, which writes
+ * it to the volume while the job keeps spooling into the next segment.
  */
 
 #include "bareos.h"
 #include "stored.h"
 
 /* Forward referenced subroutines */
-static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name);
+static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name, uint32_t index);
 static bool open_data_spool_file(DCR *dcr);
 static bool close_data_spool_file(DCR *dcr, bool end_of_spool);
 static bool despool_data(DCR *dcr, bool commit);
+static bool make_room_in_data_spool(DCR *dcr);
+static void free_spool_segments(DCR *dcr);
+static bool stop_despool_thread(spool_segments *ss, bool abort);
 static int  read_block_from_spool_file(DCR *dcr);
 static bool open_attr_spool_file(JCR *jcr, BSOCK *bs);
 static bool close_attr_spool_file(JCR *jcr, BSOCK *bs);
@@ -50,6 +59,9 @@ struct spool_stats_t {
    int64_t max_attr_size;
    int64_t data_size;                 /* current data size (all jobs running) */
    int64_t attr_size;
+   uint32_t total_segments;           /* total spool segments despooled while spooling */
+   uint32_t segment_waits;            /* times spooling waited for a free segment */
+   int64_t segment_size;              /* total bytes despooled from segments */
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -69,6 +81,95 @@ enum {
    RB_OK
 };
 
+/**
+ * A full segment of a segmented data spool.
+ */
+struct spool_segment {
+   dlink link;                        /* Link in the queue of full segments */
+   int fd;                            /* Spool file */
+   uint32_t index;                    /* Segment number, part of the file name */
+   int64_t size;                      /* Bytes spooled */
+   int64_t despooled;                 /* Bytes written to the volume */
+};
+
+/**
+ * Who uses the DCR of a segmented data spool.
+ */
+enum {
+   SPOOL_TURN_NONE = 0,
+   SPOOL_TURN_RECEIVER,               /* Job thread spooling received data */
+   SPOOL_TURN_DESPOOLER               /* Despool thread */
+};
+
+/**
+ * Data spool of a job split into segments.
+ *
+ * Both the job thread and the despool thread use the DCR, its block and
+ * the connection to the Director, so they take turns. The job thread
+ * holds its turn except while it waits for data from the network, the
+ * despool thread takes it for each block it writes. When both want the
+ * turn they get it alternately.
+ */
+struct spool_segments {
+   dlink link;                        /* Link in the list of segmented spools */
+   DCR *dcr;                          /* DCR of the job */
+   pthread_t thid;                    /* Despool thread */
+   bool thread_started;               /* Set when the despool thread runs */
+   pthread_mutex_t lock;
+   pthread_cond_t wakeup;             /* Broadcast on every change */
+   dlist *full;                       /* Full segments, oldest first */
+   uint32_t nr_segments;              /* Maximum number of segments */
+   uint32_t current_index;            /* Segment being spooled into */
+   uint32_t next_index;               /* Index of the next segment */
+   int64_t current_size;              /* Bytes spooled into the current segment */
+   int turn;                          /* Who uses the DCR */
+   int last_turn;                     /* Who used it last */
+   bool receiver_waiting;             /* Job thread waits for its turn */
+   bool despooler_waiting;            /* Despool thread waits for its turn */
+   bool quit;                         /* Despool the queued segments, then exit */
+   bool abort;                        /* Exit without despooling */
+   bool failed;                       /* Despooling a segment failed */
+   uint32_t nr_despooled;             /* Segments despooled */
+   uint32_t nr_waits;                 /* Times spooling waited for a free segment */
+};
+
+static dlist *segmented_spools = NULL;
+
+/**
+ * Add the statistics of the segmented data spools of the running jobs.
+ */
+static void list_spool_segments(POOL_MEM &msg)
+{
+   char ed1[30], ed2[30];
+   spool_segments *ss;
+   spool_segment *seg;
+   POOL_MEM line(PM_MESSAGE);
+
+   Mmsg(msg, _("Spool segments: %u despooled, %s bytes; spooling waited %u times for a free segment.\n"),
+        spool_stats.total_segments, edit_uint64_with_commas(spool_stats.segment_size, ed1),
+        spool_stats.segment_waits);
+
+   if (!segmented_spools) {
+      return;
+   }
+
+   foreach_dlist(ss, segmented_spools) {
+      P(ss->lock);
+      Mmsg(line, _("   JobId=%u: segment %u spooling %s bytes; %u despooled, %u waits\n"),
+           ss->dcr->jcr->JobId, ss->current_index, edit_uint64_with_commas(ss->current_size, ed1),
+           ss->nr_despooled, ss->nr_waits);
+      pm_strcat(msg, line.c_str());
+      foreach_dlist(seg, ss->full) {
+         Mmsg(line, _("      segment %u %s: %s bytes, %s despooled\n"), seg->index,
+              seg == ss->full->first() ? _("despooling") : _("queued"),
+              edit_uint64_with_commas(seg->size, ed1),
+              edit_uint64_with_commas(seg->despooled, ed2));
+         pm_strcat(msg, line.c_str());
+      }
+      V(ss->lock);
+   }
+}
+
 void list_spool_stats(void sendit(const char *msg, int len, void *sarg), void *arg)
 {
    char ed1[30], ed2[30];
@@ -93,15 +194,51 @@ void list_spool_stats(void sendit(const char *msg, int len, void *sarg), void *a
 
       sendit(msg.c_str(), len, arg);
    }
+
+   P(mutex);
+   if (spool_stats.total_segments || segmented_spools) {
+      list_spool_segments(msg);
+      V(mutex);
+      sendit(msg.c_str(), strlen(msg.c_str()), arg);
+   } else {
+      V(mutex);
+   }
 }
 
-bool begin_data_spool(DCR *dcr)
+/**
+ * Start spooling data when the job wants to.
+ *
+ * When concurrent_despool is set the caller holds the turn of the job
+ * thread with lock_data_spool() and only gives it up while waiting for
+ * data, the data spool may then be split into segments.
+ */
+bool begin_data_spool(DCR *dcr, bool concurrent_despool)
 {
    bool status = true;
 
    if (dcr->jcr->spool_data) {
       Dmsg0(100, "Turning on data spooling\n");
       dcr->spool_data = true;
+      if (concurrent_despool && dcr->device->spool_segments > 1) {
+         spool_segments *ss;
+         spool_segment *seg = NULL;
+
+         ss = (spool_segments *)malloc(sizeof(spool_segments));
+         memset(ss, 0, sizeof(spool_segments));
+         ss->dcr = dcr;
+         ss->nr_segments = dcr->device->spool_segments;
+         ss->full = New(dlist(seg, &seg->link));
+         pthread_mutex_init(&ss->lock, NULL);
+         pthread_cond_init(&ss->wakeup, NULL);
+
+         P(mutex);
+         if (!segmented_spools) {
+            segmented_spools = New(dlist(ss, &ss->link));
+         }
+         segmented_spools->append(ss);
+         dcr->segments = ss;
+         V(mutex);
+      }
       status = open_data_spool_file(dcr);
       if (status) {
          dcr->spooling = true;
@@ -109,6 +246,8 @@ bool begin_data_spool(DCR *dcr)
          P(mutex);
          spool_stats.data_jobs++;
          V(mutex);
+      } else if (dcr->segments) {
+         free_spool_segments(dcr);
       }
    }
 
@@ -117,6 +256,13 @@ bool begin_data_spool(DCR *dcr)
 
 bool discard_data_spool(DCR *dcr)
 {
+   /*
+    * The despool thread clears spooling while it writes a block.
+    */
+   if (dcr->segments) {
+      stop_despool_thread(dcr->segments, true);
+   }
+
    if (dcr->spooling) {
       Dmsg0(100, "Data spooling discarded\n");
       return close_data_spool_file(dcr, true);
@@ -129,6 +275,16 @@ bool commit_data_spool(DCR *dcr)
 {
    bool status;
 
+   /*
+    * The full segments go to the volume first, then the current one.
+    * The despool thread clears spooling while it writes a block.
+    */
+   if (dcr->segments && !stop_despool_thread(dcr->segments, false)) {
+      Dmsg0(100, "Despooling of the full spool segments failed\n");
+      close_data_spool_file(dcr, true);
+      return false;
+   }
+
    if (dcr->spooling) {
       Dmsg0(100, "Committing spooled data\n");
       status = despool_data(dcr, true /*commit*/);
@@ -143,7 +299,10 @@ bool commit_data_spool(DCR *dcr)
    return true;
 }
 
-static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name)
+/**
+ * Segment 0 is the only spool file when the spool is not segmented.
+ */
+static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name, uint32_t index)
 {
    const char *dir;
 
@@ -153,19 +312,41 @@ static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name)
       dir = working_directory;
    }
 
-   Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name,
-        dcr->jcr->JobId, dcr->jcr->Job, dcr->device->name());
+   if (index == 0) {
+      Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name,
+           dcr->jcr->JobId, dcr->jcr->Job, dcr->device->name());
+   } else {
+      Mmsg(name, "%s/%s.data.%u.%s.%s.%u.spool", dir, my_name,
+           dcr->jcr->JobId, dcr->jcr->Job, dcr->device->name(), index);
+   }
 }
 
+/**
+ * Open the spool file, with a segmented spool the next segment.
+ */
 static bool open_data_spool_file(DCR *dcr)
 {
    int spool_fd;
+   uint32_t index = 0;
    POOLMEM *name = get_pool_memory(PM_MESSAGE);
 
-   make_unique_data_spool_filename(dcr, name);
+   if (dcr->segments) {
+      index = dcr->segments->next_index;
+   }
+
+   make_unique_data_spool_filename(dcr, name, index);
    if ((spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640)) >= 0) {
       dcr->spool_fd = spool_fd;
       dcr->jcr->spool_attributes = true;
+      if (dcr->segments) {
+         spool_segments *ss = dcr->segments;
+
+         P(ss->lock);
+         ss->current_index = index;
+         ss->current_size = 0;
+         ss->next_index++;
+         V(ss->lock);
+      }
    } else {
       berrno be;
 
@@ -181,17 +362,29 @@ static bool open_data_spool_file(DCR *dcr)
 
 static bool close_data_spool_file(DCR *dcr, bool end_of_spool)
 {
+   uint32_t index = 0;
    POOLMEM *name = get_pool_memory(PM_MESSAGE);
 
    close(dcr->spool_fd);
    dcr->spool_fd = -1;
    dcr->spooling = false;
 
-   make_unique_data_spool_filename(dcr, name);
+   if (dcr->segments) {
+      index = dcr->segments->current_index;
+   }
+   make_unique_data_spool_filename(dcr, name, index);
    secure_erase(dcr->jcr, name);
    Dmsg1(100, "Deleted spool file: %s\n", name);
    free_pool_memory(name);
 
+   /*
+    * The sizes of segments that were not despooled are still part of
+    * the job spool size.
+    */
+   if (dcr->segments) {
+      free_spool_segments(dcr);
+   }
+
    P(mutex);
    spool_stats.data_jobs--;
    if (end_of_spool) {
@@ -214,13 +407,54 @@ static bool close_data_spool_file(DCR *dcr, bool end_of_spool)
 
 static const char *spool_name = "*spool*";
 
+/**
+ * This is really quite kludgy and should be fixed some time.
+ * We create a dev structure to read from the spool file
+ * in rdev and rdcr.
+ */
+static DCR *new_spool_read_dcr(DCR *dcr, int spool_fd)
+{
+   DEVICE *rdev;
+   DCR *rdcr;
+
+   rdev = (DEVICE *)malloc(sizeof(DEVICE));
+   memset(rdev, 0, sizeof(DEVICE));
+   rdev->dev_name = get_memory(strlen(spool_name)+1);
+   bstrncpy(rdev->dev_name, spool_name, sizeof_pool_memory(rdev->dev_name));
+   rdev->errmsg = get_pool_memory(PM_EMSG);
+   *rdev->errmsg = 0;
+   rdev->max_block_size = dcr->dev->max_block_size;
+   rdev->min_block_size = dcr->dev->min_block_size;
+   rdev->device = dcr->dev->device;
+   rdcr = dcr->get_new_spooling_dcr();
+   setup_new_dcr_device(dcr->jcr, rdcr, rdev, NULL);
+   rdcr->spool_fd = spool_fd;
+
+   return rdcr;
+}
+
+static void free_spool_read_dcr(DCR *rdcr)
+{
+   DEVICE *rdev = rdcr->dev;
+
+   free_memory(rdev->dev_name);
+   free_pool_memory(rdev->errmsg);
+
+   /*
+    * Be careful to NULL the jcr and free rdev after free_dcr()
+    */
+   rdcr->jcr = NULL;
+   rdcr->set_dev(NULL);
+   free_dcr(rdcr);
+   free(rdev);
+}
+
 /**
  * NB! This routine locks the device, but if committing will
  *     not unlock it. If not committing, it will be unlocked.
  */
 static bool despool_data(DCR *dcr, bool commit)
 {
-   DEVICE *rdev;
    DCR *rdcr;
    bool ok = true;
    DEV_BLOCK *block;
@@ -260,23 +494,7 @@ static bool despool_data(DCR *dcr, bool commit)
    dcr->despool_wait = false;
    dcr->despooling = true;
 
-   /*
-    * This is really quite kludgy and should be fixed some time.
-    * We create a dev structure to read from the spool file
-    * in rdev and rdcr.
-    */
-   rdev = (DEVICE *)malloc(sizeof(DEVICE));
-   memset(rdev, 0, sizeof(DEVICE));
-   rdev->dev_name = get_memory(strlen(spool_name)+1);
-   bstrncpy(rdev->dev_name, spool_name, sizeof_pool_memory(rdev->dev_name));
-   rdev->errmsg = get_pool_memory(PM_EMSG);
-   *rdev->errmsg = 0;
-   rdev->max_block_size = dcr->dev->max_block_size;
-   rdev->min_block_size = dcr->dev->min_block_size;
-   rdev->device = dcr->dev->device;
-   rdcr = dcr->get_new_spooling_dcr();
-   setup_new_dcr_device(jcr, rdcr, rdev, NULL);
-   rdcr->spool_fd = dcr->spool_fd;
+   rdcr = new_spool_read_dcr(dcr, dcr->spool_fd);
    block = dcr->block;                /* save block */
    dcr->block = rdcr->block;          /* make read and write block the same */
 
@@ -316,6 +534,21 @@ static bool despool_data(DCR *dcr, bool commit)
       Dmsg3(800, "Write block ok=%d FI=%d LI=%d\n", ok, block->FirstIndex, block->LastIndex);
    }
 
+   /*
+    * Blocks still queued to the writer thread must be on the volume
+    * before the JobMedia record is created.
+    */
+   if (dcr->dev->writer) {
+      dcr->dev->Lock();
+      if (!wait_async_writes(dcr, true) && ok) {
+         ok = false;
+         Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+               dcr->dev->print_name(), dcr->dev->bstrerror());
+         jcr->forceJobStatus(JS_FatalError);
+      }
+      dcr->dev->Unlock();
+   }
+
    /*
     * If this Job is incomplete, we need to backup the FileIndex
     *  to the last correctly saved file so that the JobMedia
@@ -381,16 +614,7 @@ static bool despool_data(DCR *dcr, bool commit)
       V(dcr->dev->spool_mutex);
    }
 
-   free_memory(rdev->dev_name);
-   free_pool_memory(rdev->errmsg);
-
-   /*
-    * Be careful to NULL the jcr and free rdev after free_dcr()
-    */
-   rdcr->jcr = NULL;
-   rdcr->set_dev(NULL);
-   free_dcr(rdcr);
-   free(rdev);
+   free_spool_read_dcr(rdcr);
    dcr->spooling = true;           /* turn on spooling again */
    dcr->despooling = false;
 
@@ -405,6 +629,538 @@ static bool despool_data(DCR *dcr, bool commit)
    return ok;
 }
 
+/**
+ * Wait for the turn to use the DCR of a segmented data spool.
+ * Call with ss->lock locked.
+ */
+static void wait_spool_turn(spool_segments *ss, int who)
+{
+   bool *waiting, *other_waiting;
+
+   if (who == SPOOL_TURN_RECEIVER) {
+      waiting = &ss->receiver_waiting;
+      other_waiting = &ss->despooler_waiting;
+   } else {
+      waiting = &ss->despooler_waiting;
+      other_waiting = &ss->receiver_waiting;
+   }
+
+   *waiting = true;
+   while (ss->turn != SPOOL_TURN_NONE || (*other_waiting && ss->last_turn == who)) {
+      pthread_cond_wait(&ss->wakeup, &ss->lock);
+   }
+   *waiting = false;
+   ss->turn = who;
+}
+
+/**
+ * Give up the turn to use the DCR. Call with ss->lock locked.
+ */
+static void end_spool_turn(spool_segments *ss)
+{
+   ss->last_turn = ss->turn;
+   ss->turn = SPOOL_TURN_NONE;
+   pthread_cond_broadcast(&ss->wakeup);
+}
+
+/**
+ * Take the turn of the job thread to use the DCR, see struct spool_segments.
+ * This does nothing when the data spool is not segmented.
+ */
+void lock_data_spool(DCR *dcr)
+{
+   spool_segments *ss = dcr->segments;
+
+   if (ss) {
+      P(ss->lock);
+      wait_spool_turn(ss, SPOOL_TURN_RECEIVER);
+      V(ss->lock);
+   }
+}
+
+void unlock_data_spool(DCR *dcr)
+{
+   spool_segments *ss = dcr->segments;
+
+   if (ss) {
+      P(ss->lock);
+      end_spool_turn(ss);
+      V(ss->lock);
+   }
+}
+
+/**
+ * Take the turn of the despool thread.
+ *
+ * Returns: true  when the turn was taken
+ *          false when the spool is discarded, the turn is not taken then
+ */
+static bool take_despool_turn(spool_segments *ss)
+{
+   bool retval;
+
+   P(ss->lock);
+   wait_spool_turn(ss, SPOOL_TURN_DESPOOLER);
+   retval = !ss->abort;
+   if (!retval) {
+      end_spool_turn(ss);
+   }
+   V(ss->lock);
+
+   return retval;
+}
+
+static void end_despool_turn(spool_segments *ss)
+{
+   P(ss->lock);
+   end_spool_turn(ss);
+   V(ss->lock);
+}
+
+/**
+ * Write a full segment to the volume, called by the despool thread.
+ *
+ * Like despool_data() the device is blocked while writing, but the DCR
+ * is only used in the turns of the despool thread. When the next segment
+ * is already full, the device stays blocked and the segments go to the
+ * volume as one part with one JobMedia record.
+ */
+static bool despool_segment(DCR *dcr, spool_segment *seg)
+{
+   spool_segments *ss = dcr->segments;
+   DCR *rdcr;
+   bool ok = true;
+   bool more;
+   DEV_BLOCK *block;
+   JCR *jcr = dcr->jcr;
+   int status;
+   uint32_t block_len;
+   char ec1[50];
+
+   if (!take_despool_turn(ss)) {
+      if (dcr->despooling) {
+         dcr->despooling = false;
+         dcr->dev->dunblock();
+      }
+      return false;
+   }
+   Jmsg(jcr, M_INFO, 0, _("Writing spool segment %u to Volume. Despooling %s bytes ...\n"),
+        seg->index, edit_uint64_with_commas(seg->size, ec1));
+   end_despool_turn(ss);
+
+   /*
+    * Blocking the device may wait for another job, the job thread
+    * continues spooling meanwhile.
+    */
+   if (!dcr->despooling) {
+      dcr->despool_wait = true;
+      dcr->dblock(BST_DESPOOLING);
+      dcr->despool_wait = false;
+      dcr->despooling = true;
+      if (!take_despool_turn(ss)) {
+         ok = false;
+      } else {
+         set_new_file_parameters(dcr);
+         end_despool_turn(ss);
+      }
+   }
+
+   rdcr = new_spool_read_dcr(dcr, seg->fd);
+   lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+   posix_fadvise(rdcr->spool_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+   /* Add run time, to get current wait time */
+   int32_t despool_start = time(NULL) - jcr->run_time;
+
+   while (ok) {
+      if (!take_despool_turn(ss)) {
+         ok = false;
+         break;
+      }
+      if (job_canceled(jcr)) {
+         end_despool_turn(ss);
+         ok = false;
+         break;
+      }
+      status = read_block_from_spool_file(rdcr);
+      if (status != RB_OK) {
+         end_despool_turn(ss);
+         ok = (status == RB_EOT);
+         break;
+      }
+
+      /*
+       * The DCR writes the block read from the segment, the block the
+       * job thread packs records into is put back before its turn.
+       * Writing empties the block, so remember its spooled length.
+       */
+      block_len = rdcr->block->binbuf;
+      block = dcr->block;
+      dcr->block = rdcr->block;
+      dcr->spooling = false;
+      ok = dcr->write_block_to_device();
+      if (!ok) {
+         Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+               dcr->dev->print_name(), dcr->dev->bstrerror());
+         Dmsg2(000, "Fatal append error on device %s: ERR=%s\n",
+               dcr->dev->print_name(), dcr->dev->bstrerror());
+         /* Force in case Incomplete set */
+         jcr->forceJobStatus(JS_FatalError);
+      }
+      Dmsg3(800, "Write block ok=%d FI=%d LI=%d\n", ok, dcr->block->FirstIndex, dcr->block->LastIndex);
+      dcr->spooling = true;
+      dcr->block = block;
+
+      P(ss->lock);
+      seg->despooled += block_len + sizeof(spool_hdr);
+      end_spool_turn(ss);
+      V(ss->lock);
+   }
+   free_spool_read_dcr(rdcr);
+
+   P(ss->lock);
+   more = ok && ss->full->size() > 1;
+   V(ss->lock);
+
+   if (take_despool_turn(ss)) {
+      if (ok) {
+         int32_t despool_elapsed = time(NULL) - despool_start - jcr->run_time;
+
+         if (despool_elapsed <= 0) {
+            despool_elapsed = 1;
+         }
+
+         Jmsg(jcr, M_INFO, 0, _("Despooling elapsed time = %02d:%02d:%02d, Transfer rate = %s Bytes/second\n"),
+              despool_elapsed / 3600, despool_elapsed % 3600 / 60, despool_elapsed % 60,
+              edit_uint64_with_suffix(seg->size / despool_elapsed, ec1));
+      }
+
+      /*
+       * Blocks still queued to the writer thread must be on the volume
+       * before the JobMedia record is created.
+       */
+      if (!more && dcr->despooling) {
+         if (dcr->dev->writer) {
+            dcr->dev->Lock();
+            if (!wait_async_writes(dcr, true) && ok) {
+               ok = false;
+               Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+                     dcr->dev->print_name(), dcr->dev->bstrerror());
+               jcr->forceJobStatus(JS_FatalError);
+            }
+            dcr->dev->Unlock();
+         }
+
+         if (!dcr->dir_create_jobmedia_record(false)) {
+            Jmsg2(jcr, M_FATAL, 0, _("Could not create JobMedia record for Volume=\"%s\" Job=%s\n"),
+                  dcr->getVolCatName(), jcr->Job);
+            jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
+            ok = false;
+         }
+         set_new_file_parameters(dcr);
+      }
+      end_despool_turn(ss);
+   } else {
+      ok = false;
+   }
+
+   if (!more && dcr->despooling) {
+      dcr->despooling = false;
+      dcr->dev->dunblock();
+   }
+
+   if (ok) {
+      P(mutex);
+      spool_stats.total_segments++;
+      spool_stats.segment_size += seg->size;
+      V(mutex);
+   }
+
+   return ok;
+}
+
+/**
+ * Remove a segment file and its size from the spool sizes.
+ */
+static void remove_spool_segment(DCR *dcr, spool_segment *seg)
+{
+   POOLMEM *name = get_pool_memory(PM_MESSAGE);
+
+   close(seg->fd);
+   make_unique_data_spool_filename(dcr, name, seg->index);
+   secure_erase(dcr->jcr, name);
+   Dmsg1(100, "Deleted spool file: %s\n", name);
+   free_pool_memory(name);
+
+   P(mutex);
+   if (spool_stats.data_size < seg->size) {
+      spool_stats.data_size = 0;
+   } else {
+      spool_stats.data_size -= seg->size;
+   }
+   V(mutex);
+
+   P(dcr->dev->spool_mutex);
+   dcr->dev->spool_size -= seg->size;
+   dcr->job_spool_size -= seg->size;
+   V(dcr->dev->spool_mutex);
+}
+
+/**
+ * The despool thread writes the full segments in the order they were
+ * spooled.
+ */
+static void *despool_thread(void *arg)
+{
+   DCR *dcr = (DCR *)arg;
+   spool_segments *ss = dcr->segments;
+   spool_segment *seg;
+   bool ok;
+
+   set_jcr_in_tsd(dcr->jcr);
+
+   P(ss->lock);
+   while (1) {
+      while (!ss->quit && !ss->abort && ss->full->empty()) {
+         pthread_cond_wait(&ss->wakeup, &ss->lock);
+      }
+      if (ss->abort || ss->full->empty()) {
+         break;
+      }
+      seg = (spool_segment *)ss->full->first();
+      V(ss->lock);
+
+      ok = despool_segment(dcr, seg);
+
+      /*
+       * Removing the file may run the secure erase command, which
+       * reports to the Director.
+       */
+      P(ss->lock);
+      wait_spool_turn(ss, SPOOL_TURN_DESPOOLER);
+      V(ss->lock);
+      remove_spool_segment(dcr, seg);
+
+      P(ss->lock);
+      end_spool_turn(ss);
+      ss->full->remove(seg);
+      free(seg);
+      if (!ok) {
+         ss->failed = true;
+         pthread_cond_broadcast(&ss->wakeup);
+         break;
+      }
+      ss->nr_despooled++;
+      pthread_cond_broadcast(&ss->wakeup);
+   }
+   V(ss->lock);
+
+   return NULL;
+}
+
+/**
+ * Stop the despool thread. Unless abort is set the full segments are
+ * despooled first.
+ *
+ * Returns: true  when all segments were despooled
+ *          false on error
+ */
+static bool stop_despool_thread(spool_segments *ss, bool abort)
+{
+   bool retval;
+
+   P(ss->lock);
+   if (abort) {
+      ss->abort = true;
+   } else {
+      ss->quit = true;
+   }
+   pthread_cond_broadcast(&ss->wakeup);
+   V(ss->lock);
+
+   if (ss->thread_started) {
+      pthread_join(ss->thid, NULL);
+      ss->thread_started = false;
+   }
+
+   P(ss->lock);
+   retval = !ss->failed && ss->full->empty();
+   V(ss->lock);
+
+   return retval;
+}
+
+/**
+ * Stop despooling and remove the segments that were not despooled.
+ */
+static void free_spool_segments(DCR *dcr)
+{
+   spool_segments *ss = dcr->segments;
+   spool_segment *seg;
+
+   stop_despool_thread(ss, true);
+
+   while ((seg = (spool_segment *)ss->full->first())) {
+      ss->full->remove(seg);
+      remove_spool_segment(dcr, seg);
+      free(seg);
+   }
+
+   P(mutex);
+   segmented_spools->remove(ss);
+   if (segmented_spools->empty()) {
+      delete segmented_spools;
+      segmented_spools = NULL;
+   }
+   dcr->segments = NULL;
+   V(mutex);
+
+   delete ss->full;
+   pthread_cond_destroy(&ss->wakeup);
+   pthread_mutex_destroy(&ss->lock);
+   free(ss);
+}
+
+/**
+ * Queue the current segment to the despool thread and continue spooling
+ * into a new one. When there are too many full segments, wait until the
+ * despool thread has written enough of them, with drain set until it
+ * has written all of them.
+ *
+ * The caller has the turn of the job thread.
+ *
+ * Returns: true  on success
+ *          false on error
+ */
+static bool rotate_spool_segment(DCR *dcr, bool drain)
+{
+   spool_segments *ss = dcr->segments;
+   JCR *jcr = dcr->jcr;
+   spool_segment *seg;
+   uint32_t max_full;
+   bool waited = false;
+   bool retval;
+   int status;
+
+   if (!ss->thread_started) {
+      if ((status = pthread_create(&ss->thid, NULL, despool_thread, (void *)dcr)) != 0) {
+         berrno be;
+
+         Jmsg(jcr, M_FATAL, 0, _("Cannot create despool thread: ERR=%s\n"), be.bstrerror(status));
+         jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
+         return false;
+      }
+      ss->thread_started = true;
+   }
+
+   seg = (spool_segment *)malloc(sizeof(spool_segment));
+   memset(seg, 0, sizeof(spool_segment));
+   seg->fd = dcr->spool_fd;
+   seg->index = ss->current_index;
+   seg->size = ss->current_size;
+
+   if (!open_data_spool_file(dcr)) {
+      dcr->spool_fd = seg->fd;
+      free(seg);
+      return false;
+   }
+   Dmsg3(100, "Spool segment %u full with %lld bytes, spooling into segment %u\n",
+         seg->index, seg->size, ss->current_index);
+
+   max_full = drain ? 0 : ss->nr_segments - 1;
+
+   P(ss->lock);
+   ss->full->append(seg);
+   end_spool_turn(ss);
+   while (!ss->failed && (uint32_t)ss->full->size() > max_full) {
+      waited = true;
+      pthread_cond_wait(&ss->wakeup, &ss->lock);
+   }
+   wait_spool_turn(ss, SPOOL_TURN_RECEIVER);
+   if (waited) {
+      ss->nr_waits++;
+   }
+   retval = !ss->failed;
+   V(ss->lock);
+
+   if (waited) {
+      P(mutex);
+      spool_stats.segment_waits++;
+      V(mutex);
+   }
+
+   return retval;
+}
+
+/**
+ * Rotate the spool segments when a block of len bytes does not fit into
+ * the current one. A job may spool its Maximum Job Spool Size or else the
+ * Maximum Spool Size of the device, each segment gets its share of that.
+ * When the spool of the device is full, all segments are despooled.
+ *
+ * Returns: true  on success
+ *          false when despooling failed
+ */
+static bool check_spool_segment(DCR *dcr, uint32_t len)
+{
+   spool_segments *ss = dcr->segments;
+   int64_t max_size;
+   bool failed, device_full;
+
+   P(ss->lock);
+   failed = ss->failed;
+   V(ss->lock);
+   if (failed) {
+      return false;
+   }
+
+   if (ss->current_size == 0) {
+      return true;
+   }
+
+   P(dcr->dev->spool_mutex);
+   device_full = dcr->dev->max_spool_size > 0 &&
+                 dcr->dev->spool_size + len > dcr->dev->max_spool_size;
+   V(dcr->dev->spool_mutex);
+
+   if (device_full) {
+      char ec1[30], ec2[30];
+
+      Jmsg(dcr->jcr, M_INFO, 0, _("User specified Device spool size reached: "
+           "DevSpoolSize=%s MaxDevSpoolSize=%s\n"),
+           edit_uint64_with_commas(dcr->dev->spool_size, ec1),
+           edit_uint64_with_commas(dcr->dev->max_spool_size, ec2));
+      return rotate_spool_segment(dcr, true);
+   }
+
+   if (dcr->max_job_spool_size > 0) {
+      max_size = dcr->max_job_spool_size;
+   } else {
+      max_size = dcr->dev->max_spool_size;
+   }
+   if (max_size > 0 && ss->current_size + len > max_size / ss->nr_segments) {
+      return rotate_spool_segment(dcr, false);
+   }
+
+   return true;
+}
+
+/**
+ * Make room when writing to the spool failed, e.g. because the disk is
+ * full. A segmented spool is drained, else the spool is despooled.
+ */
+static bool make_room_in_data_spool(DCR *dcr)
+{
+   if (dcr->segments) {
+      return rotate_spool_segment(dcr, true);
+   }
+
+   return despool_data(dcr, false);
+}
+
 /**
  * Read a block from the spool file
  *
@@ -484,11 +1240,25 @@ bool write_block_to_spool_file(DCR *dcr)
 
    hlen = sizeof(spool_hdr);
    wlen = block->binbuf;
+
+   /*
+    * A segmented spool continues in a new segment instead of despooling.
+    */
+   if (dcr->segments) {
+      if (!check_spool_segment(dcr, hlen + wlen)) {
+         return false;
+      }
+      P(dcr->segments->lock);
+      dcr->segments->current_size += hlen + wlen;
+      V(dcr->segments->lock);
+   }
+
    P(dcr->dev->spool_mutex);
    dcr->job_spool_size += hlen + wlen;
    dcr->dev->spool_size += hlen + wlen;
-   if ((dcr->max_job_spool_size > 0 && dcr->job_spool_size >= dcr->max_job_spool_size) ||
-       (dcr->dev->max_spool_size > 0 && dcr->dev->spool_size >= dcr->dev->max_spool_size)) {
+   if (!dcr->segments &&
+       ((dcr->max_job_spool_size > 0 && dcr->job_spool_size >= dcr->max_job_spool_size) ||
+        (dcr->dev->max_spool_size > 0 && dcr->dev->spool_size >= dcr->dev->max_spool_size))) {
       despool = true;
    }
    V(dcr->dev->spool_mutex);
@@ -575,7 +1345,7 @@ static bool write_spool_header(DCR *dcr)
               /* Note, try continuing despite ftruncate problem */
             }
          }
-         if (!despool_data(dcr, false)) {
+         if (!make_room_in_data_spool(dcr)) {
             Jmsg(jcr, M_FATAL, 0, _("Fatal despooling error."));
             jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
             return false;
@@ -624,7 +1394,7 @@ static bool write_spool_data(DCR *dcr)
             }
          }
 
-         if (!despool_data(dcr, false)) {
+         if (!make_room_in_data_spool(dcr)) {
             Jmsg(jcr, M_FATAL, 0, _("Fatal despooling error."));
             jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
             return false;
@@ -59,6 +59,9 @@ const int sd_dbglvl = 300;
 #include "block.h"
 #include "record.h"
 #include "dev.h"
+#include "async_write.h"
+#include "block_index.h"
+#include "read_ahead.h"
 #include "stored_conf.h"
 #include "jcr.h"
 #include "vol_mgr.h"
@@ -99,6 +99,10 @@ static RES_ITEM store_items[] = {
    { "StatisticsCollectInterval", CFG_TYPE_PINT32, ITEM(res_store.stats_collect_interval), 0, CFG_ITEM_DEFAULT, "30", NULL, NULL },
    { "DeviceReserveByMediaType", CFG_TYPE_BOOL, ITEM(res_store.device_reserve_by_mediatype), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "FileDeviceConcurrentRead", CFG_TYPE_BOOL, ITEM(res_store.filedevice_concurrent_read), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
+   { "NetworkCompression", CFG_TYPE_BOOL, ITEM(res_store.network_compression), 0, CFG_ITEM_DEFAULT, "false", "17.2.4-",
+     "Offer to compress the data sent between this Storage Daemon and File Daemons or other Storage Daemons. The data is only compressed on the network when the other side enables it too, the volumes are written unchanged." },
+   { "MaximumNetworkDataStreams", CFG_TYPE_PINT32, ITEM(res_store.max_network_data_streams), 0, CFG_ITEM_DEFAULT, "4", "17.2.4-",
+     "Maximum number of network connections a File Daemon may use to send the data of a backup (Network Data Streams). 1 disables multiple data connections." },
    { "SecureEraseCommand", CFG_TYPE_STR, ITEM(res_store.secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
      "Specify command that will be called when bareos unlinks files." },
    { "LogTimestampFormat", CFG_TYPE_STR, ITEM(res_store.log_timestamp_format), 0, 0, NULL, "15.2.3-", NULL },
@@ -205,6 +209,26 @@ static RES_ITEM dev_items[] = {
    { "AutoDeflateLevel", CFG_TYPE_PINT16, ITEM(res_dev.autodeflate_level), 0, CFG_ITEM_DEFAULT, "6", "13.4.0-", NULL },
    { "AutoInflate", CFG_TYPE_IODIRECTION, ITEM(res_dev.autoinflate), 0, 0, NULL, "13.4.0-", NULL },
    { "CollectStatistics", CFG_TYPE_BOOL, ITEM(res_dev.collectstats), 0, CFG_ITEM_DEFAULT, "true", NULL, NULL },
+   { "BlockVersion", CFG_TYPE_PINT16, ITEM(res_dev.block_version), 0, CFG_ITEM_DEFAULT, "2", "17.2.4-",
+     "Version of the block header written to the volumes. Version 3 uses CRC32C block checksums which are computed in hardware "
+     "on most CPUs, but volumes written with it cannot be read by Storage Daemons older than 17.2.4." },
+   { "AsyncWriteBlocks", CFG_TYPE_PINT32, ITEM(res_dev.async_write_blocks), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Number of blocks a disk device queues to its writer thread, so receiving data overlaps with writing "
+     "the volume. This is used while a single job writes to the device. 0 (default) writes synchronously." },
+   { "SpoolSegments", CFG_TYPE_PINT32, ITEM(res_dev.spool_segments), 0, CFG_ITEM_DEFAULT, "1", "17.2.4-",
+     "Number of files the data spool of a backup job is split into. When a segment is full, it is written "
+     "to the volume by a despool thread while the job spools into the next segment, so the client does not wait "
+     "for despooling. Each segment may hold its share of the Maximum Job Spool Size or else the Maximum Spool Size." },
+   { "DedupDirectory", CFG_TYPE_DIR, ITEM(res_dev.dedup_directory), 0, 0, NULL, "17.2.4-",
+     "Directory of the chunk store for deduplicated data. Each chunk of a file backed up with deduplication is kept "
+     "once in the store and the volumes only reference it. Devices using the same directory share the store." },
+   { "BlockIndex", CFG_TYPE_BOOL, ITEM(res_dev.block_index), 0, CFG_ITEM_DEFAULT, "false", "17.2.4-",
+     "Write an index of the blocks next to each volume of a disk device. Restores and other jobs reading with a "
+     "bootstrap use the index to seek to the blocks holding the selected files instead of reading the whole volume." },
+   { "ReadAheadSize", CFG_TYPE_SIZE64, ITEM(res_dev.read_ahead_size), 0, CFG_ITEM_DEFAULT, "0", "17.2.4-",
+     "Number of bytes a disk device reads ahead of a job reading with a bootstrap, like a restore, copy or migration. "
+     "A thread reads the parts of the volumes the bootstrap selects, also of the volumes after the mounted one, "
+     "so they are in memory when the job gets to them. 0 disables reading ahead." },
    { NULL, 0, { 0 }, 0, 0, NULL, NULL, NULL }
 };
 
@@ -287,6 +311,7 @@ static s_kw compression_algorithms[] = {
    { "lzfast", COMPRESS_FZFZ },
    { "lz4", COMPRESS_FZ4L },
    { "lz4hc", COMPRESS_FZ4H },
+   { "zstd", COMPRESS_ZSTD },
    { NULL, 0 }
 };
 
@@ -595,6 +620,9 @@ void free_resource(RES *sres, int type)
       if (res->res_dev.spool_directory) {
          free(res->res_dev.spool_directory);
       }
+      if (res->res_dev.dedup_directory) {
+         free(res->res_dev.dedup_directory);
+      }
       if (res->res_dev.mount_point) {
          free(res->res_dev.mount_point);
       }
@@ -104,6 +104,8 @@ public:
    bool collect_job_stats;            /**< Collect Job Statistics */
    bool device_reserve_by_mediatype;  /**< Allow device reservation based on a matching mediatype */
    bool filedevice_concurrent_read;   /**< Allow filedevices to be read concurrently */
+   bool network_compression;          /**< Offer network compression to FDs and SDs */
+   uint32_t max_network_data_streams; /**< Maximum number of data connections of a backup */
    char *verid;                       /**< Custom Id to print in version command */
    char *secure_erase_cmdline;        /**< Cmdline to execute to perform secure erase of file */
    char *log_timestamp_format;        /**< Timestamp format to use in generic logging messages */
@@ -130,6 +132,7 @@ public:
    char *changer_command;             /**< Changer command  -- external program */
    char *alert_command;               /**< Alert command -- external program */
    char *spool_directory;             /**< Spool file directory */
+   char *dedup_directory;             /**< Chunk store of deduplicated data */
    uint32_t dev_type;                 /**< device type */
    uint32_t label_type;               /**< label type */
    bool autoselect;                   /**< Automatically select from AutoChanger */
@@ -138,6 +141,7 @@ public:
    bool drive_crypto_enabled;         /**< Enable hardware crypto */
    bool query_crypto_status;          /**< Query device for crypto status */
    bool collectstats;                 /**< Set if statistics should be collected */
+   bool block_index;                  /**< Write a block index next to each volume */
    drive_number_t drive;              /**< Autochanger logical drive number */
    drive_number_t drive_index;        /**< Autochanger physical drive index */
    char cap_bits[CAP_BYTES];          /**< Capabilities of this device */
@@ -155,6 +159,10 @@ public:
    uint16_t autodeflate_level;        /**< Compression level to use for compression algorithm which uses levels */
    uint16_t autodeflate;              /**< Perform auto deflation in this IO direction */
    uint16_t autoinflate;              /**< Perform auto inflation in this IO direction */
+   uint16_t block_version;            /**< Block header version to write */
+   uint32_t async_write_blocks;       /**< Number of blocks queued to the writer thread */
+   uint32_t spool_segments;           /**< Number of files the data spool of a job is split into */
+   uint64_t read_ahead_size;          /**< Bytes read ahead of jobs reading with a bootstrap */
    utime_t vol_poll_interval;         /**< Interval between polling volume during mount */
    int64_t max_volume_files;          /**< Max files to put on one volume */
    int64_t max_volume_size;           /**< Max bytes to put on one volume */
@@ -0,0 +1,397 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program comparing the accurate payload storage classes
+ * of the File Daemon.
+ *
+ * The accurate list is either generated or read from a file with one
+ * filename per line (e.g. the output of find). Every storage class is
+ * loaded with the list in a child process and all filenames are looked
+ * up in random order. Reported are the load and lookup times and the
+ * increase of the resident set size.
+ */
+
+#include "bareos.h"
+#include "filed/filed.h"
+#include "filed/accurate.h"
+
+/*
+ * The storage classes send the base and deleted lists via the backup code,
+ * which is not part of this benchmark.
+ */
+CLIENTRES *me = NULL;
+
+bool encode_and_send_attributes(JCR *jcr, FF_PKT *ff_pkt, int &data_stream)
+{
+   return true;
+}
+
+bool plugin_check_file(JCR *jcr, char *fname)
+{
+   return false;
+}
+
+struct bench_entry {
+   char *fname;
+   int fname_length;
+   char lstat[128];
+   int lstat_length;
+   accurate_stat stat;
+};
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: baccurate_bench [-b backend] [-c] [-d debug_level] [-f file] [-n nr]\n"
+"       -b <name>   only run the named backend (htable, arena or lmdb)\n"
+"       -c          add a checksum to every entry\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -f <file>   read the filenames from file, one per line\n"
+"       -n <nr>     number of filenames to generate (default 1000000)\n"
+"       -w <dir>    working directory for the LMDB backend (default /tmp)\n"
+"       -?          print this message.\n"
+"\n"));
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static inline long get_rss_kb()
+{
+   long pages = 0;
+   FILE *fp;
+
+   fp = fopen("/proc/self/statm", "r");
+   if (fp) {
+      if (fscanf(fp, "%*s %ld", &pages) != 1) {
+         pages = 0;
+      }
+      fclose(fp);
+   }
+
+   return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Fill in a plausible lstat field for an entry.
+ */
+static void make_lstat(bench_entry *entry, int32_t nr)
+{
+   struct stat statp;
+
+   memset(&statp, 0, sizeof(statp));
+   statp.st_dev = 2049;
+   statp.st_ino = 1000000 + nr;
+   statp.st_mode = (entry->fname[entry->fname_length - 1] == '/') ? 040755 : 0100644;
+   statp.st_nlink = 1;
+   statp.st_uid = 1000;
+   statp.st_gid = 1000;
+   statp.st_size = (nr * 7919) % 1048576;
+   statp.st_blksize = 4096;
+   statp.st_blocks = (statp.st_size + 511) / 512;
+   statp.st_atime = 1500000000 + nr;
+   statp.st_mtime = 1500000000 + nr / 2;
+   statp.st_ctime = 1500000000 + nr / 2;
+
+   encode_stat(entry->lstat, &statp, sizeof(statp), 0, STREAM_UNIX_ATTRIBUTES);
+   entry->lstat_length = strlen(entry->lstat);
+   accurate_stat_from_stat(&entry->stat, &statp);
+}
+
+/**
+ * Generate a directory tree like list of filenames.
+ */
+static bench_entry *generate_entries(int nr)
+{
+   bench_entry *entries;
+   char name[256];
+
+   entries = (bench_entry *)malloc(nr * sizeof(bench_entry));
+   for (int i = 0; i < nr; i++) {
+      bsnprintf(name, sizeof(name), "/export/home/user%03d/projects/project%02d/src/module%03d/file%05d.c",
+                (i / 100000) % 1000, (i / 10000) % 10, (i / 100) % 100, i);
+      entries[i].fname = bstrdup(name);
+      entries[i].fname_length = strlen(name);
+      make_lstat(&entries[i], i);
+   }
+
+   return entries;
+}
+
+static bench_entry *read_entries(const char *filename, int *nr)
+{
+   FILE *fp;
+   int size = 1024;
+   bench_entry *entries;
+   char buf[4096];
+
+   if ((fp = fopen(filename, "r")) == NULL) {
+      berrno be;
+      Pmsg2(0, _("Could not open %s. ERR=%s\n"), filename, be.bstrerror());
+      exit(1);
+   }
+
+   *nr = 0;
+   entries = (bench_entry *)malloc(size * sizeof(bench_entry));
+   while (fgets(buf, sizeof(buf), fp)) {
+      strip_trailing_newline(buf);
+      if (!buf[0]) {
+         continue;
+      }
+
+      if (*nr == size) {
+         size *= 2;
+         entries = (bench_entry *)realloc(entries, size * sizeof(bench_entry));
+      }
+      entries[*nr].fname = bstrdup(buf);
+      entries[*nr].fname_length = strlen(buf);
+      make_lstat(&entries[*nr], *nr);
+      (*nr)++;
+   }
+   fclose(fp);
+
+   return entries;
+}
+
+/**
+ * Load one storage class and look up every entry.
+ */
+static bool run_bench(const char *name, B_ACCURATE *file_list, bench_entry *entries,
+                      int nr, int *order, bool use_chksum)
+{
+   JCR *jcr;
+   long rss_before, rss_after;
+   double start, load_time, lookup_time;
+   accurate_payload *payload;
+   const char *chksum = "tKm6L2QcBD+xV0RBVf1dPg";
+   int found = 0;
+   bool retval = true;
+
+   jcr = new_jcr(sizeof(JCR), NULL);
+   jcr->JobId = getpid();
+   jcr->accurate = true;
+
+   rss_before = get_rss_kb();
+   start = now();
+   file_list->init(jcr, nr);
+   for (int i = 0; i < nr; i++) {
+      if (!file_list->add_file(jcr, entries[i].fname, entries[i].fname_length,
+                               entries[i].lstat, entries[i].lstat_length,
+                               use_chksum ? (char *)chksum : NULL,
+                               use_chksum ? strlen(chksum) : 0, 0)) {
+         Pmsg1(0, _("%s: failed to load the accurate list\n"), name);
+         retval = false;
+         goto bail_out;
+      }
+   }
+   file_list->end_load(jcr);
+   load_time = now() - start;
+   rss_after = get_rss_kb();
+
+   start = now();
+   for (int i = 0; i < nr; i++) {
+      bench_entry *entry = &entries[order[i]];
+
+      payload = file_list->lookup_payload(jcr, entry->fname);
+      if (payload) {
+         if (!bstrcmp(payload->lstat, entry->lstat) ||
+             memcmp(&payload->stat, &entry->stat, sizeof(accurate_stat)) != 0) {
+            Pmsg2(0, _("%s: wrong payload for %s\n"), name, entry->fname);
+            retval = false;
+            break;
+         }
+         file_list->mark_file_as_seen(jcr, payload);
+         found++;
+      }
+   }
+   lookup_time = now() - start;
+
+   if (found != nr) {
+      Pmsg3(0, _("%s: found %d out of %d entries\n"), name, found, nr);
+      retval = false;
+   }
+
+   printf("%-8s %10.2f s %10.2f s %10.0f ns %10ld KB %8.1f B\n", name, load_time, lookup_time,
+          lookup_time * 1000000000.0 / nr, rss_after - rss_before,
+          (rss_after - rss_before) * 1024.0 / nr);
+   fflush(stdout);
+
+bail_out:
+   file_list->destroy(jcr);
+   delete file_list;
+   free_jcr(jcr);
+
+   return retval;
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, nr = 1000000;
+   int status = 0;
+   int *order;
+   bool use_chksum = false;
+   const char *backend = NULL;
+   const char *filename = NULL;
+   const char *working_directory = "/tmp";
+   const char *backends[] = {
+      "htable",
+      "arena",
+#ifdef HAVE_LMDB
+      "lmdb",
+#endif
+      NULL
+   };
+   bench_entry *entries;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+   init_msg(NULL, NULL);
+
+   while ((ch = getopt(argc, argv, "b:cd:f:n:w:?")) != -1) {
+      switch (ch) {
+      case 'b':
+         backend = optarg;
+         break;
+
+      case 'c':
+         use_chksum = true;
+         break;
+
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'f':
+         filename = optarg;
+         break;
+
+      case 'n':
+         nr = atoi(optarg);
+         if (nr <= 0) {
+            usage();
+         }
+         break;
+
+      case 'w':
+         working_directory = optarg;
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   me = (CLIENTRES *)malloc(sizeof(CLIENTRES));
+   memset(me, 0, sizeof(CLIENTRES));
+   me->working_directory = bstrdup(working_directory);
+
+   if (filename) {
+      entries = read_entries(filename, &nr);
+   } else {
+      entries = generate_entries(nr);
+   }
+
+   /*
+    * Look up the entries in random order.
+    */
+   order = (int *)malloc(nr * sizeof(int));
+   for (int i = 0; i < nr; i++) {
+      order[i] = i;
+   }
+   srandom(nr);
+   for (int i = nr - 1; i > 0; i--) {
+      int j = random() % (i + 1);
+      int tmp = order[i];
+
+      order[i] = order[j];
+      order[j] = tmp;
+   }
+
+   printf(_("%d entries, %s checksums\n\n"), nr, use_chksum ? _("with") : _("without"));
+   printf("%-8s %12s %12s %13s %13s %10s\n", _("Backend"), _("Load"), _("Lookup"),
+          _("Per lookup"), _("RSS"), _("Per entry"));
+   fflush(stdout);
+
+   for (int i = 0; backends[i]; i++) {
+      pid_t pid;
+      int child_status;
+
+      if (backend && !bstrcasecmp(backend, backends[i])) {
+         continue;
+      }
+
+      /*
+       * Run every backend in its own process so the RSS numbers are not
+       * influenced by the memory the previous backend freed.
+       */
+      pid = fork();
+      if (pid == 0) {
+         B_ACCURATE *file_list;
+
+         if (bstrcmp(backends[i], "arena")) {
+            file_list = New(B_ACCURATE_ARENA);
+#ifdef HAVE_LMDB
+         } else if (bstrcmp(backends[i], "lmdb")) {
+            file_list = New(B_ACCURATE_LMDB);
+#endif
+         } else {
+            file_list = New(B_ACCURATE_HTABLE);
+         }
+
+         _exit(run_bench(backends[i], file_list, entries, nr, order, use_chksum) ? 0 : 1);
+      }
+
+      if (pid < 0 || waitpid(pid, &child_status, 0) != pid ||
+          !WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+         status = 1;
+      }
+   }
+
+   for (int i = 0; i < nr; i++) {
+      free(entries[i].fname);
+   }
+   free(entries);
+   free(order);
+   free(me->working_directory);
+   free(me);
+
+   term_msg();
+   term_last_jobs_list();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit(status);
+}
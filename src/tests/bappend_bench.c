@@ -0,0 +1,326 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program for the receive path of the Storage Daemon.
+ *
+ * A child process plays the File Daemon and sends the attributes and
+ * the data of files over a socket pair. The parent receives the records
+ * like do_append_data() and packs them into blocks with
+ * write_record_to_block(), once copying the data from the message
+ * buffer and once receiving it directly into the block. Full blocks
+ * are discarded. Reported are the throughput, the share of the records
+ * received into the block and optionally (-v) whether both runs
+ * produced the same blocks.
+ */
+
+#include "bareos.h"
+#include "stored/stored.h"
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: bappend_bench [-d debug_level] [-b size] [-f size] [-n nr] [-s size] [-v]\n"
+"       -b <size>   block size (default 1048576)\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -f <size>   size of each file (default 1048576)\n"
+"       -n <nr>     number of files to send (default 5000)\n"
+"       -s <size>   size of the data records (default 65536)\n"
+"       -v          verify that both runs produce the same blocks\n"
+"       -?          print this message.\n"
+"\n"));
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Play the File Daemon: send a stream header, the data records and an
+ * end of data signal for the attributes and the data of every file.
+ */
+static void feed(int fd, int nr, int file_size, int record_size)
+{
+   BSOCK *fd_sock;
+
+   fd_sock = New(BSOCK_TCP);
+   fd_sock->m_fd = fd;
+   fd_sock->set_who(bstrdup("feeder"));
+   fd_sock->set_host(bstrdup("localhost"));
+
+   for (int i = 1; i <= nr; i++) {
+      fd_sock->fsend("%ld %d 0", (long)i, STREAM_UNIX_ATTRIBUTES);
+      fd_sock->fsend("%ld %d %s%c%s%c%c%s%c%d%c", (long)i, FT_REG, "/export/home/user/data/", 0,
+                     "file.dat", 0, 0, "gB DLgH IGk B Po Po A Ab BAA I BZjNs0 BZjNs0 BZjNs0 A A C", 0, 0, 0);
+      fd_sock->signal(BNET_EOD);
+
+      fd_sock->fsend("%ld %d 0", (long)i, STREAM_FILE_DATA);
+      fd_sock->msg = check_pool_memory_size(fd_sock->msg, record_size + 1);
+      for (int len = file_size; len > 0; len -= record_size) {
+         memset(fd_sock->msg, 'a' + (i + len) % 26, MIN(len, record_size));
+         fd_sock->msglen = MIN(len, record_size);
+         if (!fd_sock->send()) {
+            break;
+         }
+      }
+      if (!fd_sock->signal(BNET_EOD)) {
+         break;
+      }
+   }
+   fd_sock->signal(BNET_EOD);
+
+   fd_sock->close();
+   delete fd_sock;
+}
+
+struct run_result {
+   double time;
+   uint64_t bytes;
+   uint32_t records;
+   uint32_t in_place;
+   uint32_t blocks;
+   uint64_t hash;
+};
+
+/**
+ * Hash the records of a full block and start a new one.
+ */
+static void flush_block(DEV_BLOCK *block, run_result *res, bool verify)
+{
+   if (verify) {
+      for (char *p = block->buf + WRITE_BLKHDR_LENGTH; p < block->bufp; p++) {
+         res->hash = (res->hash ^ (uint8_t)*p) * 1099511628211ULL;
+      }
+   }
+   res->blocks++;
+   empty_block(block);
+}
+
+/**
+ * Receive the records like do_append_data() does.
+ */
+static bool receive(BSOCK *bs, DCR *dcr, bool in_place, bool verify, run_result *res)
+{
+   int32_t n, navail, file_index, stream;
+   char *buf;
+   DEV_RECORD *rec = dcr->rec;
+
+   while ((n = bget_msg(bs)) > 0) {
+      if (sscanf(bs->msg, "%d %d", &file_index, &stream) != 2) {
+         Pmsg1(0, _("Malformed data header: %s\n"), bs->msg);
+         return false;
+      }
+
+      for (;;) {
+         navail = 0;
+         buf = NULL;
+         if (in_place && stream != STREAM_UNIX_ATTRIBUTES) {
+            buf = record_data_in_block(dcr->block, &navail);
+         }
+         if ((n = bget_msg(bs, buf, navail)) <= 0) {
+            break;
+         }
+
+         rec->FileIndex = file_index;
+         rec->Stream = stream;
+         rec->maskedStream = stream & STREAMMASK_TYPE;
+         rec->data_len = n;
+         if (buf && n <= navail) {
+            rec->data = buf;
+            res->in_place++;
+         } else {
+            rec->data = bs->msg;
+         }
+
+         while (!write_record_to_block(dcr, rec)) {
+            flush_block(dcr->block, res, verify);
+         }
+         res->records++;
+         res->bytes += n;
+      }
+      if (n < 0 && bs->msglen != BNET_EOD) {
+         Pmsg0(0, _("Error receiving data\n"));
+         return false;
+      }
+   }
+   flush_block(dcr->block, res, verify);
+
+   return n == BNET_SIGNAL && bs->msglen == BNET_EOD;
+}
+
+static bool run(int nr, int file_size, int record_size, int block_size, bool in_place,
+                bool verify, run_result *res)
+{
+   int sv[2];
+   pid_t pid;
+   bool ok;
+   BSOCK *bs;
+   DCR *dcr;
+   DEV_BLOCK *block;
+   POOLMEM *rec_data;
+
+   memset(res, 0, sizeof(run_result));
+   res->hash = 14695981039346656037ULL;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      berrno be;
+      Pmsg1(0, _("Could not create socket pair. ERR=%s\n"), be.bstrerror());
+      return false;
+   }
+
+   fflush(stdout);
+   if ((pid = fork()) == 0) {
+      close(sv[1]);
+      feed(sv[0], nr, file_size, record_size);
+      _exit(0);
+   }
+   close(sv[0]);
+
+   bs = New(BSOCK_TCP);
+   bs->m_fd = sv[1];
+   bs->set_who(bstrdup("bench"));
+   bs->set_host(bstrdup("localhost"));
+
+   block = (DEV_BLOCK *)get_memory(sizeof(DEV_BLOCK));
+   memset(block, 0, sizeof(DEV_BLOCK));
+   block->buf_len = block_size;
+   block->block_len = block_size;
+   block->buf = get_memory(block_size);
+   block->BlockVer = BLOCK_VER;
+   empty_block(block);
+
+   dcr = New(SD_DCR);
+   dcr->block = block;
+   dcr->rec = new_record();
+   rec_data = dcr->rec->data;
+
+   res->time = now();
+   ok = receive(bs, dcr, in_place, verify, res);
+   res->time = now() - res->time;
+
+   dcr->rec->data = rec_data;
+   free_record(dcr->rec);
+   free_memory(block->buf);
+   free_memory((POOLMEM *)block);
+   delete dcr;
+
+   bs->close();
+   delete bs;
+   waitpid(pid, NULL, 0);
+
+   return ok;
+}
+
+static void print_result(const char *what, run_result *res)
+{
+   printf(_("%-16s %10.2f s %10.1f MB/s %8u blocks %6.1f%% in place\n"), what, res->time,
+          res->bytes / res->time / 1000000, res->blocks,
+          res->records ? 100.0 * res->in_place / res->records : 0.0);
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, nr = 5000;
+   int file_size = 1048576, record_size = 65536, block_size = 1048576;
+   bool verify = false;
+   run_result copy, direct;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+   init_msg(NULL, NULL);
+
+   while ((ch = getopt(argc, argv, "b:d:f:n:s:v?")) != -1) {
+      switch (ch) {
+      case 'b':
+         block_size = atoi(optarg);
+         if (block_size <= WRITE_BLKHDR_LENGTH + WRITE_RECHDR_LENGTH) {
+            usage();
+         }
+         break;
+
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'f':
+         file_size = atoi(optarg);
+         if (file_size <= 0) {
+            usage();
+         }
+         break;
+
+      case 'n':
+         nr = atoi(optarg);
+         if (nr <= 0) {
+            usage();
+         }
+         break;
+
+      case 's':
+         record_size = atoi(optarg);
+         if (record_size <= 0) {
+            usage();
+         }
+         break;
+
+      case 'v':
+         verify = true;
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   if (!run(nr, file_size, record_size, block_size, false, verify, &copy) ||
+       !run(nr, file_size, record_size, block_size, true, verify, &direct)) {
+      Pmsg0(0, _("Receiving the records failed\n"));
+      exit(1);
+   }
+
+   printf(_("%d files of %d bytes in records of %d bytes, blocks of %d bytes\n\n"),
+          nr, file_size, record_size, block_size);
+   print_result(_("Copy"), &copy);
+   print_result(_("Into block"), &direct);
+   if (verify) {
+      printf(_("\nBlocks identical: %s\n"),
+             (copy.blocks == direct.blocks && copy.hash == direct.hash) ? _("yes") : _("no"));
+   }
+
+   term_msg();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit(0);
+}
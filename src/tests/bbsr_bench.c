@@ -0,0 +1,265 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program for matching the records of a volume against a
+ * bootstrap file in the Storage Daemon.
+ *
+ * A bootstrap file is written like the Director does for a restore of
+ * scattered files from a single Full backup: one bsr per JobMedia record
+ * with its VolAddr range and the selected FileIndex ranges. It is parsed
+ * with parse_bsr() and a synthetic record stream of the whole job is
+ * replayed through match_bsr() the way read_records() does. Reported are
+ * the parse and the match times and the number of matched records.
+ */
+
+#include "bareos.h"
+#include "stored/stored.h"
+
+#define RECORD_SIZE 65536
+#define VOLUME_NAME "Full-0001"
+#define VOL_SESSION_ID 1
+#define VOL_SESSION_TIME 1500000000
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: bbsr_bench [-d debug_level] [-j nr] [-n nr] [-r nr] [-s nr] [-w dir]\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -j <nr>     number of files per JobMedia record (default 10000)\n"
+"       -n <nr>     number of files in the backup (default 2000000)\n"
+"       -r <nr>     number of records per file (default 3)\n"
+"       -s <nr>     select every <nr>th file for the restore (default 2)\n"
+"       -w <dir>    directory for the bootstrap file (default /tmp)\n"
+"       -?          print this message.\n"
+"\n"));
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static inline uint64_t record_address(int32_t findex, int record, int nr_records)
+{
+   return ((uint64_t)(findex - 1) * nr_records + record) * RECORD_SIZE;
+}
+
+/**
+ * Write the bootstrap file, returns the number of files selected.
+ */
+static uint32_t write_bsr(const char *fname, int nr_files, int files_per_jobmedia,
+                          int nr_records, int step)
+{
+   FILE *fp;
+   uint32_t selected = 0;
+   char ed1[50], ed2[50];
+
+   if ((fp = fopen(fname, "w")) == NULL) {
+      berrno be;
+      Pmsg2(0, _("Could not create %s. ERR=%s\n"), fname, be.bstrerror());
+      exit(1);
+   }
+
+   for (int first = 1; first <= nr_files; first += files_per_jobmedia) {
+      int last = MIN(first + files_per_jobmedia - 1, nr_files);
+      uint32_t count = 0;
+
+      fprintf(fp, "Volume=\"%s\"\n", VOLUME_NAME);
+      fprintf(fp, "MediaType=\"File\"\n");
+      fprintf(fp, "VolSessionId=%u\n", VOL_SESSION_ID);
+      fprintf(fp, "VolSessionTime=%u\n", VOL_SESSION_TIME);
+      fprintf(fp, "VolAddr=%s-%s\n",
+              edit_uint64(record_address(first, 0, nr_records), ed1),
+              edit_uint64(record_address(last + 1, 0, nr_records) - 1, ed2));
+      for (int findex = first; findex <= last; findex++) {
+         if (findex % step == 0) {
+            fprintf(fp, "FileIndex=%d\n", findex);
+            count++;
+         }
+      }
+      if (count) {
+         fprintf(fp, "Count=%u\n", count);
+      }
+      selected += count;
+   }
+   fclose(fp);
+
+   return selected;
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch;
+   int nr_files = 2000000, files_per_jobmedia = 10000, nr_records = 3, step = 2;
+   int32_t last_findex = -1;
+   uint32_t selected, matched_files = 0, matched_records = 0;
+   uint64_t nr_matches = 0;
+   const char *working_directory = "/tmp";
+   char fname[1024];
+   double start, parse_time, match_time;
+   JCR *jcr;
+   BSR *bsr;
+   DEV_RECORD *rec;
+   VOLUME_LABEL volrec;
+   SESSION_LABEL sessrec;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+   init_msg(NULL, NULL);
+
+   while ((ch = getopt(argc, argv, "d:j:n:r:s:w:?")) != -1) {
+      switch (ch) {
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'j':
+         files_per_jobmedia = atoi(optarg);
+         if (files_per_jobmedia <= 0) {
+            usage();
+         }
+         break;
+
+      case 'n':
+         nr_files = atoi(optarg);
+         if (nr_files <= 0) {
+            usage();
+         }
+         break;
+
+      case 'r':
+         nr_records = atoi(optarg);
+         if (nr_records <= 0) {
+            usage();
+         }
+         break;
+
+      case 's':
+         step = atoi(optarg);
+         if (step <= 0) {
+            usage();
+         }
+         break;
+
+      case 'w':
+         working_directory = optarg;
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   bsnprintf(fname, sizeof(fname), "%s/bbsr_bench.%d.bsr", working_directory, (int)getpid());
+   selected = write_bsr(fname, nr_files, files_per_jobmedia, nr_records, step);
+
+   jcr = new_jcr(sizeof(JCR), NULL);
+   jcr->JobId = getpid();
+
+   start = now();
+   bsr = parse_bsr(jcr, fname);
+   parse_time = now() - start;
+   unlink(fname);
+   if (!bsr) {
+      Pmsg1(0, _("Could not parse the bootstrap file %s\n"), fname);
+      exit(1);
+   }
+
+   memset(&volrec, 0, sizeof(volrec));
+   bstrncpy(volrec.VolumeName, VOLUME_NAME, sizeof(volrec.VolumeName));
+   memset(&sessrec, 0, sizeof(sessrec));
+   sessrec.JobId = 1;
+
+   /*
+    * Replay the records of all files like read_records() does.
+    */
+   rec = new_record();
+   rec->VolSessionId = VOL_SESSION_ID;
+   rec->VolSessionTime = VOL_SESSION_TIME;
+   start = now();
+   for (int32_t findex = 1; findex <= nr_files; findex++) {
+      for (int i = 0; i < nr_records; i++) {
+         uint64_t addr = record_address(findex, i, nr_records);
+         int status;
+
+         rec->File = (uint32_t)(addr >> 32);
+         rec->Block = (uint32_t)addr;
+         rec->FileIndex = findex;
+         rec->Stream = (i == 0) ? STREAM_UNIX_ATTRIBUTES : STREAM_FILE_DATA;
+         rec->maskedStream = rec->Stream;
+
+         status = match_bsr(bsr, rec, &volrec, &sessrec, jcr);
+         nr_matches++;
+         if (status == -1) {
+            goto done;
+         } else if (status == 0) {
+            continue;
+         }
+
+         if (last_findex != -1 && last_findex != findex) {
+            is_this_bsr_done(bsr, rec);
+         }
+         if (last_findex != findex) {
+            matched_files++;
+         }
+         last_findex = findex;
+         matched_records++;
+      }
+   }
+
+done:
+   match_time = now() - start;
+
+   printf(_("%d files of %d records, %u files selected in %d bsrs\n\n"),
+          nr_files, nr_records, selected, (nr_files + files_per_jobmedia - 1) / files_per_jobmedia);
+   printf(_("Parse:   %10.2f s\n"), parse_time);
+   printf(_("Match:   %10.2f s %10.0f ns per record\n"), match_time,
+          nr_matches ? match_time * 1000000000.0 / nr_matches : 0.0);
+   printf(_("Matched: %10u files %10u records\n"), matched_files, matched_records);
+
+   free_record(rec);
+   free_bsr(bsr);
+   free_jcr(jcr);
+
+   if (matched_files != selected) {
+      Pmsg2(0, _("Matched %u files, expected %u\n"), matched_files, selected);
+      exit(1);
+   }
+
+   term_msg();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   return 0;
+}
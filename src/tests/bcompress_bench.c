@@ -0,0 +1,370 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program comparing the compression algorithms Bareos
+ * supports for file data on a sample corpus.
+ *
+ * The corpus is cut into blocks of the network buffer size and every
+ * block is compressed and decompressed on its own using the same
+ * library functions the File Daemon and the autoxflate plugin use.
+ */
+
+#include "bareos.h"
+#include "jcr.h"
+#include "ch.h"
+#include "streams.h"
+
+#if defined(HAVE_LIBZ)
+#include <zlib.h>
+#endif
+
+#if defined(HAVE_FASTLZ)
+#include <fastlzlib.h>
+#endif
+
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+struct bench_algo {
+   const char *name;
+   uint32_t algo;
+   uint32_t level;
+};
+
+static struct bench_algo bench_algos[] = {
+#if defined(HAVE_LIBZ)
+   { "gzip1", COMPRESS_GZIP, 1 },
+   { "gzip6", COMPRESS_GZIP, 6 },
+   { "gzip9", COMPRESS_GZIP, 9 },
+#endif
+#if defined(HAVE_LZO)
+   { "lzo", COMPRESS_LZO1X, 1 },
+#endif
+#if defined(HAVE_FASTLZ)
+   { "lzfast", COMPRESS_FZFZ, 1 },
+   { "lz4", COMPRESS_FZ4L, 1 },
+   { "lz4hc", COMPRESS_FZ4H, 1 },
+#endif
+#if defined(HAVE_ZSTD)
+   { "zstd1", COMPRESS_ZSTD, 1 },
+   { "zstd3", COMPRESS_ZSTD, 3 },
+   { "zstd6", COMPRESS_ZSTD, 6 },
+   { "zstd9", COMPRESS_ZSTD, 9 },
+   { "zstd19", COMPRESS_ZSTD, 19 },
+   { "zstdlong", COMPRESS_ZSTD, 3 | COMPRESS_ZSTD_LONG },
+#endif
+   { NULL, 0, 0 }
+};
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: bcompress_bench [-b blocksize] [-d debug_level] [-r rounds] file ...\n"
+"       -a <name>   only run the named algorithm (can be given multiple times)\n"
+"       -b <size>   blocksize to cut the corpus in (default %d)\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -r <nn>     number of rounds to run each algorithm (default 1)\n"
+"       -?          print this message.\n"
+"\n"
+"The files given are used as the sample corpus.\n"
+"\n"), DEFAULT_NETWORK_BUFFER_SIZE);
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Read all files of the corpus into one big buffer.
+ */
+static char *load_corpus(int argc, char *const *argv, uint64_t *corpus_size)
+{
+   int fd;
+   ssize_t len;
+   struct stat st;
+   char *corpus = NULL;
+   uint64_t size = 0;
+
+   for (int i = 0; i < argc; i++) {
+      if (stat(argv[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+         Pmsg1(0, _("Skipping %s not a regular file\n"), argv[i]);
+         continue;
+      }
+
+      if ((fd = open(argv[i], O_RDONLY)) < 0) {
+         berrno be;
+         Pmsg2(0, _("Could not open %s. ERR=%s\n"), argv[i], be.bstrerror());
+         continue;
+      }
+
+      corpus = (char *)realloc(corpus, size + st.st_size + 1);
+      while ((len = read(fd, corpus + size, st.st_size)) > 0) {
+         size += len;
+         st.st_size -= len;
+      }
+      close(fd);
+   }
+
+   *corpus_size = size;
+   return corpus;
+}
+
+/**
+ * Set the compression level just like the File Daemon does per file.
+ */
+static bool setup_level(JCR *jcr, struct bench_algo *ba)
+{
+   switch (ba->algo) {
+#if defined(HAVE_LIBZ)
+   case COMPRESS_GZIP:
+      if (deflateParams((z_stream *)jcr->compress.workset.pZLIB, ba->level, Z_DEFAULT_STRATEGY) != Z_OK) {
+         return false;
+      }
+      break;
+#endif
+#if defined(HAVE_FASTLZ)
+   case COMPRESS_FZFZ:
+   case COMPRESS_FZ4L:
+   case COMPRESS_FZ4H:
+      if (fastlzlibSetCompressor((zfast_stream *)jcr->compress.workset.pZFAST,
+                                 ba->algo == COMPRESS_FZFZ ? COMPRESSOR_FASTLZ : COMPRESSOR_LZ4) != Z_OK) {
+         return false;
+      }
+      break;
+#endif
+#if defined(HAVE_ZSTD)
+   case COMPRESS_ZSTD: {
+      ZSTD_CCtx *pZstdCtx = (ZSTD_CCtx *)jcr->compress.workset.pZSTD;
+
+      if (ZSTD_isError(ZSTD_CCtx_setParameter(pZstdCtx, ZSTD_c_compressionLevel,
+                                              COMPRESS_ZSTD_LEVEL(ba->level))) ||
+          ZSTD_isError(ZSTD_CCtx_setParameter(pZstdCtx, ZSTD_c_enableLongDistanceMatching,
+                                              (ba->level & COMPRESS_ZSTD_LONG) ? 1 : 0))) {
+         return false;
+      }
+      break;
+   }
+#endif
+   default:
+      break;
+   }
+
+   return true;
+}
+
+/**
+ * Compress and decompress the whole corpus block by block with one algorithm.
+ */
+static bool run_bench(JCR *jcr, struct bench_algo *ba, char *corpus,
+                      uint64_t corpus_size, uint32_t blocksize, int rounds)
+{
+   ser_declare;
+   uint32_t compress_buf_size = 0;
+   uint32_t decompress_buf_size = 0;
+   uint32_t compress_len, length;
+   uint64_t total_in = 0, total_out = 0;
+   double ctime = 0.0, dtime = 0.0, start;
+   char *block, *data;
+   char ed1[50];
+   bool retval = false;
+
+   jcr->buf_size = blocksize;
+   if (!setup_compression_buffers(jcr, false, ba->algo, &compress_buf_size)) {
+      return false;
+   }
+   setup_decompression_buffers(jcr, &decompress_buf_size);
+
+   jcr->compress.deflate_buffer = get_memory(compress_buf_size);
+   jcr->compress.deflate_buffer_size = compress_buf_size;
+   jcr->compress.inflate_buffer = get_memory(decompress_buf_size);
+   jcr->compress.inflate_buffer_size = decompress_buf_size;
+
+   if (!setup_level(jcr, ba)) {
+      Pmsg1(0, _("Failed to set compression level for %s\n"), ba->name);
+      goto bail_out;
+   }
+
+   for (int round = 0; round < rounds; round++) {
+      for (uint64_t offset = 0; offset < corpus_size; offset += blocksize) {
+         block = corpus + offset;
+         length = MIN(blocksize, corpus_size - offset);
+
+         start = now();
+         if (!compress_data(jcr, ba->algo, block, length,
+                            (unsigned char *)jcr->compress.deflate_buffer + sizeof(comp_stream_header),
+                            compress_buf_size - sizeof(comp_stream_header), &compress_len)) {
+            goto bail_out;
+         }
+         ctime += now() - start;
+
+         /*
+          * Generate the compression header as the File Daemon does.
+          */
+         ser_begin(jcr->compress.deflate_buffer, sizeof(comp_stream_header));
+         ser_uint32(ba->algo);
+         ser_uint32(compress_len);
+         ser_uint16(ba->level);
+         ser_uint16(COMP_HEAD_VERSION);
+         ser_end(jcr->compress.deflate_buffer, sizeof(comp_stream_header));
+
+         total_in += length;
+         total_out += compress_len + sizeof(comp_stream_header);
+
+         data = jcr->compress.deflate_buffer;
+         length = compress_len + sizeof(comp_stream_header);
+         start = now();
+         if (!decompress_data(jcr, ba->name, STREAM_COMPRESSED_DATA, &data, &length, false)) {
+            goto bail_out;
+         }
+         dtime += now() - start;
+
+         if (length != MIN(blocksize, corpus_size - offset) ||
+             memcmp(data, block, length) != 0) {
+            Pmsg2(0, _("%s: data mismatch after decompression at offset %s\n"),
+                  ba->name, edit_uint64(offset, ed1));
+            goto bail_out;
+         }
+      }
+   }
+
+   printf("%-10s %8.2f%% %10.1f MB/s %10.1f MB/s\n", ba->name,
+          total_in ? (100.0 * total_out) / total_in : 0.0,
+          ctime > 0.0 ? total_in / ctime / (1024 * 1024) : 0.0,
+          dtime > 0.0 ? total_in / dtime / (1024 * 1024) : 0.0);
+   retval = true;
+
+bail_out:
+   cleanup_compression(jcr);
+   return retval;
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, rounds = 1;
+   uint32_t blocksize = DEFAULT_NETWORK_BUFFER_SIZE;
+   uint64_t corpus_size;
+   alist *wanted = NULL;
+   char *corpus;
+   char ed1[50];
+   JCR *jcr;
+   int status = 0;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+
+   while ((ch = getopt(argc, argv, "a:b:d:r:?")) != -1) {
+      switch (ch) {
+      case 'a':
+         if (!wanted) {
+            wanted = New(alist(10, not_owned_by_alist));
+         }
+         wanted->append(optarg);
+         break;
+
+      case 'b':
+         blocksize = str_to_int64(optarg);
+         if (blocksize == 0) {
+            usage();
+         }
+         break;
+
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'r':
+         rounds = atoi(optarg);
+         if (rounds <= 0) {
+            rounds = 1;
+         }
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc == 0) {
+      usage();
+   }
+
+   corpus = load_corpus(argc, argv, &corpus_size);
+   if (!corpus_size) {
+      Pmsg0(0, _("Empty corpus, nothing to benchmark\n"));
+      exit(1);
+   }
+
+   printf(_("Corpus %s bytes, blocksize %u, %d round(s)\n\n"),
+          edit_uint64_with_commas(corpus_size, ed1), blocksize, rounds);
+   printf("%-10s %9s %15s %15s\n", _("Algorithm"), _("Ratio"), _("Compress"), _("Decompress"));
+
+   jcr = new_jcr(sizeof(JCR), NULL);
+   for (struct bench_algo *ba = bench_algos; ba->name; ba++) {
+      if (wanted) {
+         char *name;
+         bool found = false;
+
+         foreach_alist(name, wanted) {
+            if (bstrcasecmp(name, ba->name)) {
+               found = true;
+               break;
+            }
+         }
+
+         if (!found) {
+            continue;
+         }
+      }
+
+      if (!run_bench(jcr, ba, corpus, corpus_size, blocksize, rounds)) {
+         status = 1;
+      }
+   }
+
+   free_jcr(jcr);
+   free(corpus);
+   if (wanted) {
+      delete wanted;
+   }
+
+   term_last_jobs_list();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit(status);
+}
@@ -0,0 +1,275 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test and benchmark program for the block checksums of the Storage Daemon.
+ *
+ * Checks the CRC32 and CRC32C implementations against known values and
+ * the hardware CRC32C against the table driven one, then measures the
+ * throughput of all of them. Given volume files (of a disk device) are
+ * walked block by block and every block checksum is verified using the
+ * algorithm of the block version found.
+ */
+
+#include "bareos.h"
+#include "stored/block.h"
+
+/* stored/crc32.c */
+uint32_t bcrc32(uint8_t *buf, int len);
+
+struct crc_vector {
+   const char *data;
+   int len;
+   uint32_t crc32;
+   uint32_t crc32c;
+};
+
+static struct crc_vector crc_vectors[] = {
+   { "", 0, 0x00000000, 0x00000000 },
+   { "a", 1, 0xe8b7be43, 0xc1d04330 },
+   { "123456789", 9, 0xcbf43926, 0xe3069283 },
+   { "The quick brown fox jumps over the lazy dog", 43, 0x414fa339, 0x22620404 },
+   { NULL, 0, 0, 0 }
+};
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: bcrc_bench [-d debug_level] [-r rounds] [-s size] [volume-file ...]\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -r <nn>     number of rounds to run each checksum (default 1000)\n"
+"       -s <size>   buffer size to checksum (default %d)\n"
+"       -?          print this message.\n"
+"\n"
+"The volume files given are verified block by block.\n"
+"\n"), DEFAULT_BLOCK_SIZE);
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Check the implementations against known values and against each other.
+ */
+static bool check_crcs()
+{
+   uint8_t buf[1100];
+   uint32_t crc, crc_sw;
+   bool retval = true;
+
+   for (struct crc_vector *cv = crc_vectors; cv->data; cv++) {
+      memcpy(buf, cv->data, cv->len);
+      if ((crc = bcrc32(buf, cv->len)) != cv->crc32) {
+         Pmsg3(0, _("CRC32 of \"%s\" is %08x, expected %08x\n"), cv->data, crc, cv->crc32);
+         retval = false;
+      }
+      if ((crc = bcrc32c(buf, cv->len)) != cv->crc32c) {
+         Pmsg3(0, _("CRC32C of \"%s\" is %08x, expected %08x\n"), cv->data, crc, cv->crc32c);
+         retval = false;
+      }
+      if ((crc = bcrc32c_sw(buf, cv->len)) != cv->crc32c) {
+         Pmsg3(0, _("Table driven CRC32C of \"%s\" is %08x, expected %08x\n"), cv->data, crc, cv->crc32c);
+         retval = false;
+      }
+   }
+
+   /*
+    * All lengths and alignments must give the same result.
+    */
+   for (int i = 0; i < (int)sizeof(buf); i++) {
+      buf[i] = (uint8_t)(i * 7 + 3);
+   }
+   for (int offset = 0; offset < 8; offset++) {
+      for (int len = 0; len <= 1024; len++) {
+         crc = bcrc32c(buf + offset, len);
+         crc_sw = bcrc32c_sw(buf + offset, len);
+         if (crc != crc_sw) {
+            Pmsg4(0, _("CRC32C mismatch at offset %d length %d: %08x != %08x\n"),
+                  offset, len, crc, crc_sw);
+            retval = false;
+         }
+      }
+   }
+
+   return retval;
+}
+
+static void bench_crc(const char *name, uint32_t (*crc_func)(uint8_t *, int),
+                      uint8_t *buf, int size, int rounds)
+{
+   double start, elapsed;
+   uint32_t crc = 0;
+
+   start = now();
+   for (int i = 0; i < rounds; i++) {
+      crc = crc_func(buf, size);
+   }
+   elapsed = now() - start;
+
+   printf("%-20s %10.1f MB/s  (%08x)\n", name,
+          elapsed > 0.0 ? ((double)size * rounds) / elapsed / (1024 * 1024) : 0.0, crc);
+}
+
+/**
+ * Walk a volume file block by block and verify the block checksums.
+ */
+static bool verify_volume(const char *filename)
+{
+   ser_declare;
+   int fd;
+   char Id[BLKHDR_ID_LENGTH + 1];
+   uint32_t CheckSum, BlockCheckSum, block_len, BlockNumber;
+   uint64_t nr_blocks[4] = { 0, 0, 0, 0 };
+   uint64_t nr_errors = 0;
+   POOLMEM *buf = get_memory(DEFAULT_BLOCK_SIZE);
+   bool retval = false;
+
+   if ((fd = open(filename, O_RDONLY)) < 0) {
+      berrno be;
+      Pmsg2(0, _("Could not open %s. ERR=%s\n"), filename, be.bstrerror());
+      goto bail_out;
+   }
+
+   while (read(fd, buf, BLKHDR2_LENGTH) == BLKHDR2_LENGTH) {
+      unser_begin(buf, BLKHDR2_LENGTH);
+      unser_uint32(CheckSum);
+      unser_uint32(block_len);
+      unser_uint32(BlockNumber);
+      unser_bytes(Id, BLKHDR_ID_LENGTH);
+      Id[BLKHDR_ID_LENGTH] = 0;
+
+      if (!bstrncmp(Id, "BB0", 3) || Id[3] < '2' || Id[3] > '3' ||
+          block_len < BLKHDR2_LENGTH || block_len > MAX_BLOCK_LENGTH) {
+         Pmsg2(0, _("%s: no valid block header found after %llu blocks\n"), filename,
+               (unsigned long long)(nr_blocks[2] + nr_blocks[3]));
+         goto bail_out;
+      }
+
+      buf = check_pool_memory_size(buf, block_len);
+      if (read(fd, buf + BLKHDR2_LENGTH, block_len - BLKHDR2_LENGTH) != (ssize_t)(block_len - BLKHDR2_LENGTH)) {
+         Pmsg2(0, _("%s: short read of block %u\n"), filename, BlockNumber);
+         goto bail_out;
+      }
+
+      if (Id[3] == '3') {
+         BlockCheckSum = bcrc32c((uint8_t *)buf + BLKHDR_CS_LENGTH, block_len - BLKHDR_CS_LENGTH);
+      } else {
+         BlockCheckSum = bcrc32((uint8_t *)buf + BLKHDR_CS_LENGTH, block_len - BLKHDR_CS_LENGTH);
+      }
+      if (CheckSum && BlockCheckSum != CheckSum) {
+         Pmsg5(0, _("%s: block %u (%s) checksum mismatch calc=%x blk=%x\n"),
+               filename, BlockNumber, Id, BlockCheckSum, CheckSum);
+         nr_errors++;
+      }
+      nr_blocks[Id[3] - '0']++;
+   }
+
+   printf(_("%s: %llu BB02 blocks, %llu BB03 blocks, %llu checksum errors\n"), filename,
+          (unsigned long long)nr_blocks[2], (unsigned long long)nr_blocks[3],
+          (unsigned long long)nr_errors);
+   retval = (nr_errors == 0);
+
+bail_out:
+   if (fd >= 0) {
+      close(fd);
+   }
+   free_pool_memory(buf);
+   return retval;
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, rounds = 1000, size = DEFAULT_BLOCK_SIZE;
+   int status = 0;
+   uint8_t *buf;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+
+   while ((ch = getopt(argc, argv, "d:r:s:?")) != -1) {
+      switch (ch) {
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'r':
+         rounds = atoi(optarg);
+         if (rounds <= 0) {
+            rounds = 1;
+         }
+         break;
+
+      case 's':
+         size = str_to_int64(optarg);
+         if (size <= 0) {
+            usage();
+         }
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (!check_crcs()) {
+      status = 1;
+   }
+
+   buf = (uint8_t *)malloc(size);
+   for (int i = 0; i < size; i++) {
+      buf[i] = (uint8_t)random();
+   }
+
+   printf(_("Buffer size %d, %d round(s), CRC32C implementation %s\n\n"),
+          size, rounds, bcrc32c_implementation());
+   bench_crc("crc32", bcrc32, buf, size, rounds);
+   bench_crc("crc32c slicing-by-8", bcrc32c_sw, buf, size, rounds);
+   bench_crc("crc32c", bcrc32c, buf, size, rounds);
+   free(buf);
+
+   for (int i = 0; i < argc; i++) {
+      if (!verify_volume(argv[i])) {
+         status = 1;
+      }
+   }
+
+   term_last_jobs_list();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit(status);
+}
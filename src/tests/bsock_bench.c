@@ -0,0 +1,274 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program for the write coalescing of the network sockets.
+ *
+ * Sends the messages the File Daemon sends to the Storage Daemon for a
+ * backup of small files (attributes, file data and digest, each stream
+ * with its header and end of data signal) over a socket pair, once
+ * without and once with write coalescing. A child process reads and
+ * checksums the byte stream. Reported are the write system calls per
+ * file (from /proc/self/io), the time and whether both byte streams are
+ * identical.
+ */
+
+#include "bareos.h"
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: bsock_bench [-d debug_level] [-n nr] [-s size] [-c size]\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -n <nr>     number of files to send (default 100000)\n"
+"       -s <size>   size of the file data (default 1024)\n"
+"       -c <size>   size of the write coalescing buffer (default 65536)\n"
+"       -?          print this message.\n"
+"\n"));
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Number of write system calls of this process, -1 if unknown.
+ */
+static inline int64_t get_syscw()
+{
+   int64_t syscw = -1;
+   char line[128];
+   FILE *fp;
+
+   fp = fopen("/proc/self/io", "r");
+   if (fp) {
+      while (fgets(line, sizeof(line), fp)) {
+         if (sscanf(line, "syscw: %lld", (long long *)&syscw) == 1) {
+            break;
+         }
+      }
+      fclose(fp);
+   }
+
+   return syscw;
+}
+
+/**
+ * Read everything from the socket and return the size and a FNV-1a hash of it.
+ */
+static void receive_stream(int fd, uint64_t *bytes, uint64_t *hash)
+{
+   char buf[256 * 1024];
+   ssize_t len;
+
+   *bytes = 0;
+   *hash = 14695981039346656037ULL;
+   while ((len = read(fd, buf, sizeof(buf))) != 0) {
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         break;
+      }
+      for (ssize_t i = 0; i < len; i++) {
+         *hash = (*hash ^ (uint8_t)buf[i]) * 1099511628211ULL;
+      }
+      *bytes += len;
+   }
+}
+
+/**
+ * Send the backup messages of nr files of the given size.
+ */
+static bool send_files(BSOCK *sd, int nr, int size)
+{
+   for (int i = 1; i <= nr; i++) {
+      sd->fsend("%ld %d 0", (long)i, STREAM_UNIX_ATTRIBUTES);
+      sd->fsend("%ld %d %s%c%s%c%c%s%c%d%c", (long)i, FT_REG, "/export/home/user/data/", 0,
+                "file.txt", 0, 0, "gB DLgH IGk B Po Po A Ab BAA I BZjNs0 BZjNs0 BZjNs0 A A C", 0, 0, 0);
+      sd->signal(BNET_EOD);
+
+      sd->fsend("%ld %d 0", (long)i, STREAM_FILE_DATA);
+      sd->msg = check_pool_memory_size(sd->msg, size + 1);
+      memset(sd->msg, 'a' + i % 26, size);
+      sd->msglen = size;
+      sd->send();
+      sd->signal(BNET_EOD);
+
+      sd->fsend("%ld %d 0", (long)i, STREAM_MD5_DIGEST);
+      memset(sd->msg, i % 256, 16);
+      sd->msglen = 16;
+      sd->send();
+      if (!sd->signal(BNET_EOD)) {
+         return false;
+      }
+   }
+   sd->signal(BNET_EOD);
+
+   return sd->clear_write_coalescing();
+}
+
+struct run_result {
+   int64_t writes;
+   double time;
+   uint64_t bytes;
+   uint64_t hash;
+};
+
+static bool run(int nr, int size, int coalescing_size, run_result *res)
+{
+   int sv[2], pfd[2];
+   pid_t pid;
+   int64_t syscw;
+   bool ok;
+   BSOCK *sd;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 || pipe(pfd) < 0) {
+      berrno be;
+      Pmsg1(0, _("Could not create socket pair. ERR=%s\n"), be.bstrerror());
+      return false;
+   }
+
+   fflush(stdout);
+   if ((pid = fork()) == 0) {
+      uint64_t result[2];
+
+      close(sv[0]);
+      close(pfd[0]);
+      receive_stream(sv[1], &result[0], &result[1]);
+      if (write(pfd[1], result, sizeof(result)) != sizeof(result)) {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   close(sv[1]);
+   close(pfd[1]);
+
+   sd = New(BSOCK_TCP);
+   sd->m_fd = sv[0];
+   sd->set_who(bstrdup("bench"));
+   sd->set_host(bstrdup("localhost"));
+   sd->set_write_coalescing(coalescing_size);
+
+   syscw = get_syscw();
+   res->time = now();
+   ok = send_files(sd, nr, size);
+   res->time = now() - res->time;
+   res->writes = (syscw < 0) ? -1 : get_syscw() - syscw;
+
+   sd->close();
+   delete sd;
+
+   if (read(pfd[0], &res->bytes, sizeof(uint64_t)) != sizeof(uint64_t) ||
+       read(pfd[0], &res->hash, sizeof(uint64_t)) != sizeof(uint64_t)) {
+      ok = false;
+   }
+   close(pfd[0]);
+   waitpid(pid, NULL, 0);
+
+   return ok;
+}
+
+static void print_result(const char *what, int nr, run_result *res)
+{
+   if (res->writes < 0) {
+      printf(_("%-22s %12s %10s %10.2f s %12.0f files/s\n"), what, "n/a", "n/a", res->time, nr / res->time);
+   } else {
+      printf(_("%-22s %12lld %10.2f %10.2f s %12.0f files/s\n"), what, (long long)res->writes,
+             (double)res->writes / nr, res->time, nr / res->time);
+   }
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, nr = 100000, size = 1024, coalescing_size = 65536;
+   char what[64];
+   run_result plain, coalesced;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+   init_msg(NULL, NULL);
+
+   while ((ch = getopt(argc, argv, "c:d:n:s:?")) != -1) {
+      switch (ch) {
+      case 'c':
+         coalescing_size = atoi(optarg);
+         if (coalescing_size <= 0) {
+            usage();
+         }
+         break;
+
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'n':
+         nr = atoi(optarg);
+         if (nr <= 0) {
+            usage();
+         }
+         break;
+
+      case 's':
+         size = atoi(optarg);
+         if (size <= 0) {
+            usage();
+         }
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   if (!run(nr, size, 0, &plain) || !run(nr, size, coalescing_size, &coalesced)) {
+      Pmsg0(0, _("Sending the messages failed\n"));
+      exit(1);
+   }
+
+   printf(_("%d files of %d bytes\n\n"), nr, size);
+   printf(_("%-22s %12s %10s %12s %18s\n"), "", "writes", "per file", "time", "rate");
+   print_result(_("Plain"), nr, &plain);
+   bsnprintf(what, sizeof(what), _("Coalescing %d"), coalescing_size);
+   print_result(what, nr, &coalesced);
+   printf(_("\nBytes sent:            %12llu\n"), (unsigned long long)coalesced.bytes);
+   printf(_("Byte streams identical: %s\n"),
+          (plain.bytes == coalesced.bytes && plain.hash == coalesced.hash) ? _("yes") : _("no"));
+
+   term_msg();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit((plain.bytes == coalesced.bytes && plain.hash == coalesced.hash) ? 0 : 1);
+}
@@ -0,0 +1,295 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2017-2017 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark program for the restore tree of the Director.
+ *
+ * The file list is either generated or read from a file with one
+ * filename per line (e.g. the output of find). The tree is built the
+ * way the restore command builds it from the catalog, then all files
+ * are marked and every directory is entered and listed. Reported are
+ * the times of these steps, the memory allocated for the tree and the
+ * increase of the resident set size.
+ */
+
+#include "bareos.h"
+
+static void usage()
+{
+   fprintf(stderr, _(
+"\n"
+"Usage: btree_bench [-d debug_level] [-f file] [-n nr]\n"
+"       -d <nn>     set debug level to <nn>\n"
+"       -f <file>   read the filenames from file, one per line\n"
+"       -n <nr>     number of filenames to generate (default 1000000)\n"
+"       -?          print this message.\n"
+"\n"));
+
+   exit(1);
+}
+
+static inline double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static inline long get_rss_kb()
+{
+   long pages = 0;
+   FILE *fp;
+
+   fp = fopen("/proc/self/statm", "r");
+   if (fp) {
+      if (fscanf(fp, "%*s %ld", &pages) != 1) {
+         pages = 0;
+      }
+      fclose(fp);
+   }
+
+   return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Generate a directory tree like list of filenames, file names repeat
+ * in every directory like they do in copies of the same project.
+ */
+static char **generate_entries(int nr)
+{
+   char **entries;
+   char name[256];
+
+   entries = (char **)malloc(nr * sizeof(char *));
+   for (int i = 0; i < nr; i++) {
+      bsnprintf(name, sizeof(name), "/export/home/user%03d/projects/project%02d/src/module%03d/file%02d.c",
+                (i / 100000) % 1000, (i / 10000) % 10, (i / 100) % 100, i % 100);
+      entries[i] = bstrdup(name);
+   }
+
+   return entries;
+}
+
+static char **read_entries(const char *filename, int *nr)
+{
+   FILE *fp;
+   int size = 1024;
+   char **entries;
+   char buf[4096];
+
+   if ((fp = fopen(filename, "r")) == NULL) {
+      berrno be;
+      Pmsg2(0, _("Could not open %s. ERR=%s\n"), filename, be.bstrerror());
+      exit(1);
+   }
+
+   *nr = 0;
+   entries = (char **)malloc(size * sizeof(char *));
+   while (fgets(buf, sizeof(buf), fp)) {
+      strip_trailing_newline(buf);
+      if (!buf[0]) {
+         continue;
+      }
+
+      if (*nr == size) {
+         size *= 2;
+         entries = (char **)realloc(entries, size * sizeof(char *));
+      }
+      entries[*nr] = bstrdup(buf);
+      (*nr)++;
+   }
+   fclose(fp);
+
+   return entries;
+}
+
+/**
+ * Mark a node and everything below it for extraction like the mark command.
+ */
+static int mark_node(TREE_NODE *node)
+{
+   int count = 1;
+   TREE_NODE *child;
+
+   node->extract = true;
+   node->extract_dir = (node->type != TN_FILE);
+   foreach_child(child, node) {
+      count += mark_node(child);
+   }
+
+   return count;
+}
+
+/**
+ * Enter every directory and list it like the cd and ls commands.
+ */
+static int list_node(TREE_ROOT *root, TREE_NODE *node)
+{
+   int count = 0;
+   POOLMEM *path;
+   TREE_NODE *child, *cd;
+
+   path = tree_getpath(node);
+   cd = tree_cwd(path, root, (TREE_NODE *)root);
+   if (cd != node) {
+      Pmsg1(0, _("cd %s failed\n"), path);
+      free_pool_memory(path);
+      return -1;
+   }
+   free_pool_memory(path);
+
+   foreach_child(child, node) {
+      count++;
+   }
+   foreach_child(child, node) {
+      if (tree_node_has_child(child)) {
+         int result = list_node(root, child);
+         if (result < 0) {
+            return result;
+         }
+         count += result;
+      }
+   }
+
+   return count;
+}
+
+int main(int argc, char *const *argv)
+{
+   int ch, nr = 1000000;
+   int status = 0;
+   int marked, listed;
+   long rss_before, rss_after;
+   double start, build_time, children_time, mark_time, list_time;
+   const char *filename = NULL;
+   char **entries;
+   POOLMEM *path, *fname;
+   TREE_ROOT *root;
+
+   setlocale(LC_ALL, "");
+   bindtextdomain("bareos", LOCALEDIR);
+   textdomain("bareos");
+   lmgr_init_thread();
+   init_msg(NULL, NULL);
+
+   while ((ch = getopt(argc, argv, "d:f:n:?")) != -1) {
+      switch (ch) {
+      case 'd':                       /* set debug level */
+         debug_level = atoi(optarg);
+         if (debug_level <= 0) {
+            debug_level = 1;
+         }
+         break;
+
+      case 'f':
+         filename = optarg;
+         break;
+
+      case 'n':
+         nr = atoi(optarg);
+         if (nr <= 0) {
+            usage();
+         }
+         break;
+
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   if (filename) {
+      entries = read_entries(filename, &nr);
+   } else {
+      entries = generate_entries(nr);
+   }
+
+   path = get_pool_memory(PM_FNAME);
+   fname = get_pool_memory(PM_FNAME);
+
+   /*
+    * Split the entries into path and filename like the catalog does.
+    */
+   rss_before = get_rss_kb();
+   start = now();
+   root = new_tree(nr);
+   for (int i = 0; i < nr; i++) {
+      TREE_NODE *node;
+      char *p = (char *)last_path_separator(entries[i]);
+
+      if (p && p[1]) {
+         pm_strcpy(fname, p + 1);
+         pm_memcpy(path, entries[i], p - entries[i] + 2);
+         path[p - entries[i] + 1] = 0;
+      } else {
+         pm_strcpy(fname, "");
+         pm_strcpy(path, entries[i]);
+      }
+      node = insert_tree_node(path, fname, TN_FILE, root, NULL);
+      node->type = *fname ? TN_FILE : TN_DIR;
+      node->FileIndex = i + 1;
+      node->JobId = 1;
+   }
+   build_time = now() - start;
+
+   start = now();
+   tree_build_children(root);
+   children_time = now() - start;
+   rss_after = get_rss_kb();
+
+   start = now();
+   marked = mark_node((TREE_NODE *)root) - 1;
+   mark_time = now() - start;
+
+   start = now();
+   listed = list_node(root, (TREE_NODE *)root);
+   list_time = now() - start;
+
+   if (listed < 0 || marked != listed) {
+      Pmsg2(0, _("marked %d but listed %d nodes\n"), marked, listed);
+      status = 1;
+   }
+
+   printf(_("%d entries, %d nodes\n\n"), nr, marked);
+   printf(_("Build:          %10.2f s\n"), build_time);
+   printf(_("Sort children:  %10.2f s\n"), children_time);
+   printf(_("Mark all:       %10.2f s\n"), mark_time);
+   printf(_("cd/ls all dirs: %10.2f s\n"), list_time);
+   printf(_("Tree memory:    %10llu KB %8.1f B/node\n"), (unsigned long long)(tree_memory_usage(root) / 1024),
+          (double)tree_memory_usage(root) / marked);
+   printf(_("RSS:            %10ld KB %8.1f B/node\n"), rss_after - rss_before,
+          (rss_after - rss_before) * 1024.0 / marked);
+
+   free_tree(root);
+   free_pool_memory(path);
+   free_pool_memory(fname);
+   for (int i = 0; i < nr; i++) {
+      free(entries[i]);
+   }
+   free(entries);
+
+   term_msg();
+   close_memory_pool();
+   lmgr_cleanup_main();
+   sm_dump(false);
+
+   exit(status);
+}
@@ -55,6 +55,7 @@ static void usage()
 "       -dt         print timestamp in debug output\n"
 "       -e          specify file of exclude patterns\n"
 "       -i          specify file of include patterns\n"
+"       -p <nn>     prefetch directories using <nn> threads\n"
 "       -q          quiet, don't print filenames (debug)\n"
 "       -           read pattern(s) from stdin\n"
 "       -?          print this message.\n"
@@ -79,6 +80,7 @@ int main(int argc, char *const *argv)
    int i, ch;
    char *inc = NULL;
    char *exc = NULL;
+   int prefetch_workers = 0;
    FILE *fd;
 
    setlocale(LC_ALL, "");
@@ -86,7 +88,7 @@ int main(int argc, char *const *argv)
    textdomain("bareos");
    lmgr_init_thread();
 
-   while ((ch = getopt(argc, argv, "ad:e:i:q?")) != -1) {
+   while ((ch = getopt(argc, argv, "ad:e:i:p:q?")) != -1) {
       switch (ch) {
       case 'a':                       /* print extended attributes *debug* */
          attrs = 1;
@@ -111,6 +113,10 @@ int main(int argc, char *const *argv)
          inc = optarg;
          break;
 
+      case 'p':                       /* prefetch threads */
+         prefetch_workers = atoi(optarg);
+         break;
+
       case 'q':
          quiet = true;
          break;
@@ -127,6 +133,7 @@ int main(int argc, char *const *argv)
    jcr = new_jcr(sizeof(JCR), NULL);
 
    ff = init_find_files();
+   set_find_prefetch_workers(ff, prefetch_workers);
    if (argc == 0 && !inc) {
       add_fname_to_include_list(ff, 0, "/"); /* default to / */
    } else {